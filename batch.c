@@ -0,0 +1,232 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "symnmf.h"
+
+/**
+ * Copies width columns of src starting at column s0 into dst starting at column d0.
+ * @param src: Source matrix
+ * @param s0: First source column
+ * @param dst: Destination matrix with the same number of rows
+ * @param d0: First destination column
+ * @param width: Number of columns to copy
+ */
+static void copy_cols(const Matrix* src, int s0, Matrix* dst, int d0, int width)
+{
+    int i;
+    for (i = 0; i < src->rows; i++)
+    {
+        memmove(MAT_ROW(dst, i) + d0, MAT_ROW(src, i) + s0, (size_t)width * sizeof(double));
+    }
+}
+
+/**
+ * Computes the SymNMF objective ||W - H*H^T||_F^2 from its expansion
+ * ||W||^2 - 2 * tr(H^T*W*H) + ||H^T*H||^2, without forming an n*n matrix.
+ * The expansion loses absolute precision when the residual is small compared to ||W||,
+ * which is enough to rank factorizations of the same W.
+ * @param w_sq: Squared Frobenius norm of W (see graph_squared_norm)
+ * @param H: Matrix H (n*k)
+ * @param WH: W*H (n*k)
+ * @param gram: k*k scratch matrix, receives H^T*H
+ * @return: The objective
+ */
+double symnmf_objective(double w_sq, const Matrix* H, const Matrix* WH, Matrix* gram)
+{
+    int i;
+    int j;
+    double cross = 0.0;
+    double gram_sq = 0.0;
+    const double* H_row;
+    const double* WH_row;
+    for (i = 0; i < H->rows; i++)
+    {
+        H_row = MAT_ROW(H, i);
+        WH_row = MAT_ROW(WH, i);
+        for (j = 0; j < H->cols; j++)
+        {
+            cross += H_row[j] * WH_row[j];
+        }
+    }
+    gemm_tn(H, H, gram, 0);
+    gram_sq = forb(gram);
+    return w_sq - 2 * cross + gram_sq;
+}
+
+/**
+ * Runs several SymNMF factorizations of the same W, one per (k, seed) configuration.
+ * The factors of all running restarts sit side by side in one n*K matrix, so every
+ * iteration does a single wide product W*[H_1 ... H_r]; the k*k Gram matrices and the
+ * updates are then done in parallel across restarts. A restart leaves the wide matrix
+ * as soon as one of the stopping criteria of options holds for it. Every column of the
+ * wide product is summed exactly as in a separate product, so each H equals the one
+ * symnmf_solve computes from init_H(W, H, seed) with the same options bit for bit.
+ * @param W: Graph operand for W (n*n)
+ * @param ks: Number of clusters of each restart
+ * @param seeds: Seed of each restart (see init_H)
+ * @param r: Number of restarts
+ * @param options: Stopping criteria (tol, max_iter, rel_obj) of every restart, NULL for the defaults;
+ *                 only SOLVER_MU is batched and checkpoints are not written
+ * @param H: Output matrices, H[i] of size n*ks[i] (views are allowed)
+ * @param objectives: Optional output array of r objectives ||W - H*H^T||_F^2 (may be NULL)
+ * @return: 1 on success, 0 if the solver is not SOLVER_MU or an allocation failed
+ */
+int symnmf_batch(const Graph* W, const int* ks, const unsigned long* seeds, int r, const SolverOptions* options, Matrix** H, double* objectives)
+{
+    int n = W->n;
+    int total = 0;
+    int kmax = 1;
+    int width;
+    int active_count;
+    int kept;
+    int a;
+    int i;
+    int m;
+    double avg;
+    double w_sq = 0.0;
+    double objective;
+    int* state;
+    int* active;
+    int* col;
+    int* done;
+    Matrix* wide;
+    Matrix* old_all;
+    Matrix* mone_all;
+    Matrix* mechane_all;
+    Matrix* grams;
+    Matrix* previous;
+    Matrix H_view;
+    Matrix old_view;
+    Matrix mone_view;
+    Matrix mechane_view;
+    Matrix gram_view;
+    SolverOptions defaults;
+    options = (options == NULL) ? solver_options_default(&defaults) : options;
+    if (options->solver != SOLVER_MU || options->max_iter < 0)
+    {
+        return 0;
+    }
+    for (i = 0; i < r; i++)
+    {
+        total += ks[i];
+        kmax = (ks[i] > kmax) ? ks[i] : kmax;
+    }
+    state = (int*)malloc(3 * (size_t)(r + 1) * sizeof(int));
+    wide = matrix_create(n, total);
+    old_all = matrix_create(n, total);
+    mone_all = matrix_create(n, total);
+    mechane_all = matrix_create(n, total);
+    grams = matrix_create(r * kmax, kmax);
+    previous = matrix_create(1, r);
+    if (state == NULL || wide == NULL || old_all == NULL || mone_all == NULL || mechane_all == NULL || grams == NULL || previous == NULL)
+    {
+        if (state == NULL)
+        {
+            printf("An Error Has Occurred\n");
+        }
+        free(state);
+        matrix_free(wide);
+        matrix_free(old_all);
+        matrix_free(mone_all);
+        matrix_free(mechane_all);
+        matrix_free(grams);
+        matrix_free(previous);
+        return 0;
+    }
+    active = state;
+    col = state + (r + 1);
+    done = state + 2 * (r + 1);
+    avg = graph_entry_avg(W);
+    width = 0;
+    for (i = 0; i < r; i++)
+    {
+        active[i] = i;
+        col[i] = width;
+        init_H_from_avg(avg, matrix_view(&H_view, wide->data + width, n, ks[i], wide->stride), seeds[i]);
+        width += ks[i];
+    }
+    active_count = r;
+    if (options->rel_obj > 0)
+    {
+        w_sq = graph_squared_norm(W);
+    }
+    for (m = 0; m < options->max_iter && active_count > 0; m++)
+    {
+        copy_cols(wide, 0, old_all, 0, width);
+        graph_mult(W, matrix_view(&old_view, old_all->data, n, width, old_all->stride), matrix_view(&mone_view, mone_all->data, n, width, mone_all->stride));
+#ifdef _OPENMP
+#pragma omp parallel for private(i, objective, H_view, old_view, mone_view, mechane_view, gram_view) schedule(dynamic, 1) num_threads(get_num_threads()) if (active_count > 1)
+#endif
+        for (a = 0; a < active_count; a++)
+        {
+            i = active[a];
+            matrix_view(&H_view, wide->data + col[a], n, ks[i], wide->stride);
+            matrix_view(&old_view, old_all->data + col[a], n, ks[i], old_all->stride);
+            matrix_view(&mone_view, mone_all->data + col[a], n, ks[i], mone_all->stride);
+            matrix_view(&mechane_view, mechane_all->data + col[a], n, ks[i], mechane_all->stride);
+            matrix_view(&gram_view, MAT_ROW(grams, i * kmax), ks[i], ks[i], grams->stride);
+            if (options->rel_obj > 0)
+            {
+                objective = symnmf_objective(w_sq, &old_view, &mone_view, &gram_view);
+                if (m > 0 && fabs(MAT_AT(previous, 0, i) - objective) <= options->rel_obj * fabs(MAT_AT(previous, 0, i)))
+                {
+                    done[a] = 1;
+                    continue;
+                }
+                MAT_AT(previous, 0, i) = objective;
+            }
+            done[a] = mu_update(&H_view, &old_view, &mone_view, &gram_view, &mechane_view) < options->tol;
+        }
+        kept = 0;
+        width = 0;
+        for (a = 0; a < active_count; a++)
+        {
+            i = active[a];
+            if (done[a])
+            {
+                copy_cols(wide, col[a], H[i], 0, ks[i]);
+                continue;
+            }
+            if (col[a] != width)
+            {
+                copy_cols(wide, col[a], wide, width, ks[i]);
+            }
+            active[kept] = i;
+            col[kept] = width;
+            width += ks[i];
+            kept++;
+        }
+        active_count = kept;
+    }
+    for (a = 0; a < active_count; a++)
+    {
+        copy_cols(wide, col[a], H[active[a]], 0, ks[active[a]]);
+    }
+    if (objectives != NULL)
+    {
+        w_sq = graph_squared_norm(W);
+        width = 0;
+        for (i = 0; i < r; i++)
+        {
+            copy_cols(H[i], 0, wide, width, ks[i]);
+            width += ks[i];
+        }
+        graph_mult(W, wide, mone_all);
+        width = 0;
+        for (i = 0; i < r; i++)
+        {
+            objectives[i] = symnmf_objective(w_sq, H[i], matrix_view(&mone_view, mone_all->data + width, n, ks[i], mone_all->stride),
+                                             matrix_view(&gram_view, MAT_ROW(grams, i * kmax), ks[i], ks[i], grams->stride));
+            width += ks[i];
+        }
+    }
+    free(state);
+    matrix_free(wide);
+    matrix_free(old_all);
+    matrix_free(mone_all);
+    matrix_free(mechane_all);
+    matrix_free(grams);
+    matrix_free(previous);
+    return 1;
+}
@@ -0,0 +1,562 @@
+#define _XOPEN_SOURCE 600
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <sys/resource.h>
+#include "symnmf.h"
+
+/* Scratch file the loading benchmark writes its points to. */
+#define POINTS_FILE "bench_points.txt"
+
+/* Largest number of values in one grid list. */
+#define MAX_GRID 16
+
+/* Spread of the blob centres around the origin, in units of the blob standard deviation. */
+#define CENTER_RANGE 10.0
+
+/* Values of n, d and k to run, and how each measurement is taken. */
+typedef struct BenchConfig {
+    int n[MAX_GRID];
+    int n_count;
+    int d[MAX_GRID];
+    int d_count;
+    int k[MAX_GRID];
+    int k_count;
+    int repeats;                /* every kernel is run this many times, the fastest run is reported */
+    const char* out;            /* JSON output file, NULL for stdout */
+    const char* baseline;       /* earlier JSON output to compare against, or NULL */
+    double tolerance;           /* slowdown over the baseline reported as a regression */
+} BenchConfig;
+
+/* One measurement. k is 0 for the kernels that do not depend on it. */
+typedef struct BenchResult {
+    const char* kernel;
+    int n;
+    int d;
+    int k;
+    double seconds;
+    double flops;
+    double bytes;
+    int iterations;             /* opt_mat_with_H only, 0 otherwise */
+    long peak_rss_kb;           /* peak RSS of the process right after the measurement */
+} BenchResult;
+
+/**
+ * Returns a monotonic time stamp.
+ * @return: Seconds since an arbitrary point
+ */
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+/**
+ * Returns the peak resident set size of the process so far.
+ * @return: Peak RSS in KiB
+ */
+static long peak_rss_kb(void)
+{
+    struct rusage usage;
+    return (getrusage(RUSAGE_SELF, &usage) == 0) ? usage.ru_maxrss : 0;
+}
+
+/**
+ * Fills points with k Gaussian blobs: the centres are drawn uniformly from
+ * [-CENTER_RANGE, CENTER_RANGE)^d, point i belongs to blob i % k and is its centre plus
+ * standard normal noise (Box-Muller). The data only depends on the seed.
+ * @param points: Output matrix (n*d)
+ * @param k: Number of blobs
+ * @param seed: Seed of the generator
+ * @return: 1 on success, 0 if an allocation failed
+ */
+static int make_blobs(Matrix* points, int k, unsigned long seed)
+{
+    int i;
+    int j;
+    double u;
+    double v;
+    Mt19937 rng;
+    Matrix* centers = matrix_create(k, points->cols);
+    if (centers == NULL)
+    {
+        return 0;
+    }
+    mt_seed(&rng, seed);
+    for (i = 0; i < k; i++)
+    {
+        for (j = 0; j < points->cols; j++)
+        {
+            MAT_AT(centers, i, j) = CENTER_RANGE * (2 * mt_uniform(&rng) - 1);
+        }
+    }
+    for (i = 0; i < points->rows; i++)
+    {
+        for (j = 0; j < points->cols; j++)
+        {
+            u = 1.0 - mt_uniform(&rng);
+            v = mt_uniform(&rng);
+            MAT_AT(points, i, j) = MAT_AT(centers, i % k, j) + sqrt(-2 * log(u)) * cos(2 * 3.14159265358979323846 * v);
+        }
+    }
+    matrix_free(centers);
+    return 1;
+}
+
+/**
+ * Copies src into dst (same size, any strides).
+ * @param src: Source matrix
+ * @param dst: Destination matrix
+ */
+static void copy_matrix(const Matrix* src, Matrix* dst)
+{
+    int i;
+    for (i = 0; i < src->rows; i++)
+    {
+        memcpy(MAT_ROW(dst, i), MAT_ROW(src, i), (size_t)src->cols * sizeof(double));
+    }
+}
+
+/**
+ * Keeps the faster of two timings.
+ * @param best: Fastest time so far, negative if none
+ * @param start: Start time stamp of the run that just finished
+ * @return: The faster time
+ */
+static double keep_best(double best, double start)
+{
+    double elapsed = now() - start;
+    return (best < 0 || elapsed < best) ? elapsed : best;
+}
+
+/**
+ * Records a measurement together with the peak RSS reached so far.
+ * @param r: Result to fill
+ * @param kernel: Name of the timed function
+ * @param k: Number of columns of H, 0 if the kernel does not depend on it
+ * @param seconds: Fastest time
+ * @param flops: Floating point operations of one run
+ * @param bytes: Bytes one run must read and write
+ */
+static void record(BenchResult* r, const char* kernel, int k, double seconds, double flops, double bytes)
+{
+    r->kernel = kernel;
+    r->k = k;
+    r->seconds = seconds;
+    r->flops = flops;
+    r->bytes = bytes;
+    r->peak_rss_kb = peak_rss_kb();
+}
+
+/**
+ * Writes one result as a single line JSON object, so that a later run can read it back
+ * line by line (see compare_baseline).
+ * @param file: Output stream
+ * @param r: Result
+ * @param last: Nonzero for the last result of the list
+ */
+static void write_result(FILE* file, const BenchResult* r, int last)
+{
+    fprintf(file, "    {\"kernel\": \"%s\", \"n\": %d, \"d\": %d, \"k\": %d, \"seconds\": %.6e, "
+            "\"gflops\": %.4f, \"bytes\": %.0f, \"gbytes_per_s\": %.4f, \"iterations\": %d, \"peak_rss_kb\": %ld}%s\n",
+            r->kernel, r->n, r->d, r->k, r->seconds, r->flops / r->seconds / 1e9, r->bytes,
+            r->bytes / r->seconds / 1e9, r->iterations, r->peak_rss_kb, last ? "" : ",");
+}
+
+/**
+ * Runs every kernel on one (n, d) dataset and on each k of the grid.
+ * The flop counts are those of the arithmetic the kernels perform (exp counted as one
+ * flop); the byte counts are the matrices each kernel must read and write at least once.
+ * @param config: Benchmark configuration
+ * @param n: Number of points
+ * @param d: Dimension
+ * @param results: Output array, receives 5 + 2 * k_count results
+ * @return: Number of results written, -1 on failure
+ */
+static int bench_dataset(const BenchConfig* config, int n, int d, BenchResult* results)
+{
+    int r;
+    int c;
+    int count = 0;
+    int ok;
+    double nn = (double)n * n;
+    double best;
+    double start;
+    long file_bytes;
+    FILE* sink;
+    Matrix* points = matrix_create(n, d);
+    Matrix* loaded;
+    Matrix* A = NULL;
+    Matrix* D = NULL;
+    Matrix* W = NULL;
+    Matrix* H0 = NULL;
+    Matrix* H = NULL;
+    Matrix* product;
+    Graph graph;
+    Workspace* ws;
+    SolverResult solve;
+    if (points == NULL || !make_blobs(points, config->k[0], 1234UL + (unsigned long)n * 31UL + (unsigned long)d))
+    {
+        matrix_free(points);
+        return -1;
+    }
+    sink = fopen(POINTS_FILE, "w");
+    ok = sink != NULL && write_matrix(sink, points);
+    ok = (sink != NULL && fclose(sink) == 0) && ok;
+    for (best = -1, r = 0; ok && r < config->repeats; r++)
+    {
+        start = now();
+        loaded = load_points(POINTS_FILE, NULL);
+        best = keep_best(best, start);
+        ok = loaded != NULL;
+        matrix_free(loaded);
+    }
+    sink = fopen(POINTS_FILE, "r");
+    file_bytes = (sink != NULL && fseek(sink, 0, SEEK_END) == 0) ? ftell(sink) : 0;
+    if (sink != NULL)
+    {
+        fclose(sink);
+    }
+    remove(POINTS_FILE);
+    record(&results[count++], "load_points", 0, best, 0, (double)file_bytes + (double)n * d * sizeof(double));
+    for (best = -1, r = 0; ok && r < config->repeats; r++)
+    {
+        matrix_free(A);
+        start = now();
+        A = sym_mat(points);
+        best = keep_best(best, start);
+        ok = A != NULL;
+    }
+    record(&results[count++], "sym_mat", 0, best, nn / 2 * (3.0 * d + 2), ((double)n * d + nn) * sizeof(double));
+    for (best = -1, r = 0; ok && r < config->repeats; r++)
+    {
+        matrix_free(D);
+        start = now();
+        D = diag_mat(A);
+        best = keep_best(best, start);
+        ok = D != NULL;
+    }
+    record(&results[count++], "diag_mat", 0, best, nn, 2 * nn * sizeof(double));
+    for (best = -1, r = 0; ok && r < config->repeats; r++)
+    {
+        matrix_free(W);
+        start = now();
+        W = norm_mat(D, A);
+        best = keep_best(best, start);
+        ok = W != NULL;
+    }
+    record(&results[count++], "norm_mat", 0, best, 2 * nn, (2 * nn + n) * sizeof(double));
+    matrix_free(A);
+    matrix_free(D);
+    sink = ok ? tmpfile() : NULL;
+    ok = sink != NULL;
+    for (best = -1, r = 0; ok && r < config->repeats; r++)
+    {
+        rewind(sink);
+        start = now();
+        ok = write_matrix(sink, W) && fflush(sink) == 0;
+        best = keep_best(best, start);
+    }
+    file_bytes = ok ? ftell(sink) : 0;
+    if (sink != NULL)
+    {
+        fclose(sink);
+    }
+    record(&results[count++], "write_matrix", 0, best, 0, nn * sizeof(double) + (double)file_bytes);
+    for (c = 0; ok && c < config->k_count; c++)
+    {
+        if (config->k[c] > n)
+        {
+            continue;
+        }
+        matrix_free(H0);
+        matrix_free(H);
+        H0 = matrix_create(n, config->k[c]);
+        H = matrix_create(n, config->k[c]);
+        ok = H0 != NULL && H != NULL;
+        if (ok)
+        {
+            init_H(graph_dense(&graph, W), H0, 1234);
+        }
+        for (best = -1, r = 0; ok && r < config->repeats; r++)
+        {
+            start = now();
+            product = mat_mult(W, H0);
+            best = keep_best(best, start);
+            ok = product != NULL;
+            matrix_free(product);
+        }
+        record(&results[count++], "mat_mult", config->k[c], best, 2 * nn * config->k[c], (nn + 2.0 * n * config->k[c]) * sizeof(double));
+        ws = ok ? workspace_create(n, config->k[c]) : NULL;
+        ok = ws != NULL;
+        if (ok)
+        {
+            copy_matrix(H0, H);
+            symnmf_solve(H, &graph, ws, NULL, &solve, NULL);
+        }
+        workspace_free(ws);
+        for (best = -1, r = 0; ok && r < config->repeats; r++)
+        {
+            copy_matrix(H0, H);
+            start = now();
+            ok = opt_mat_with_H(H, W) != NULL;
+            best = keep_best(best, start);
+        }
+        results[count].iterations = ok ? solve.iterations : 0;
+        record(&results[count], "opt_mat_with_H", config->k[c], best,
+               (double)results[count].iterations * (2 * nn + 4.0 * n * config->k[c] + 8.0 * n) * config->k[c],
+               (double)results[count].iterations * (nn + 6.0 * n * config->k[c]) * sizeof(double));
+        count++;
+    }
+    for (r = 0; r < count; r++)
+    {
+        results[r].n = n;
+        results[r].d = d;
+    }
+    matrix_free(points);
+    matrix_free(W);
+    matrix_free(H0);
+    matrix_free(H);
+    return ok ? count : -1;
+}
+
+/**
+ * Compares the results with an earlier JSON output of this program and reports on stderr
+ * every kernel that became slower by more than the tolerance.
+ * @param config: Benchmark configuration (baseline and tolerance)
+ * @param results: Results of this run
+ * @param count: Number of results
+ * @return: Number of regressions, -1 if the baseline cannot be read
+ */
+static int compare_baseline(const BenchConfig* config, const BenchResult* results, int count)
+{
+    char line[512];
+    char kernel[64];
+    int n;
+    int d;
+    int k;
+    int i;
+    int regressions = 0;
+    double seconds;
+    FILE* file = fopen(config->baseline, "r");
+    if (file == NULL)
+    {
+        return -1;
+    }
+    while (fgets(line, sizeof(line), file) != NULL)
+    {
+        if (sscanf(line, " {\"kernel\": \"%63[^\"]\", \"n\": %d, \"d\": %d, \"k\": %d, \"seconds\": %lf", kernel, &n, &d, &k, &seconds) != 5)
+        {
+            continue;
+        }
+        for (i = 0; i < count; i++)
+        {
+            if (strcmp(results[i].kernel, kernel) == 0 && results[i].n == n && results[i].d == d && results[i].k == k
+                && results[i].seconds > seconds * (1 + config->tolerance))
+            {
+                fprintf(stderr, "regression: %s n=%d d=%d k=%d: %.4g s -> %.4g s (%+.1f%%)\n", kernel, n, d, k,
+                        seconds, results[i].seconds, 100 * (results[i].seconds / seconds - 1));
+                regressions++;
+            }
+        }
+    }
+    fclose(file);
+    return regressions;
+}
+
+/**
+ * Parses a comma separated list of positive integers.
+ * @param text: List, e.g. "500,1000,2000"
+ * @param values: Output array of MAX_GRID values
+ * @param count: Receives the number of values
+ * @return: 1 if the list is valid, 0 otherwise
+ */
+static int parse_list(const char* text, int* values, int* count)
+{
+    char* end;
+    long value;
+    *count = 0;
+    while (*text != '\0' && *count < MAX_GRID)
+    {
+        value = strtol(text, &end, 10);
+        if (end == text || value <= 0 || value > 1000000 || (*end != ',' && *end != '\0'))
+        {
+            return 0;
+        }
+        values[(*count)++] = (int)value;
+        text = (*end == ',') ? end + 1 : end;
+    }
+    return *count > 0 && *text == '\0';
+}
+
+/**
+ * Parses the command line.
+ * @param argc: Argument count
+ * @param argv: Argument vector
+ * @param config: Filled with the defaults, then the given flags
+ * @return: 1 if all flags were valid, 0 otherwise
+ */
+static int parse_config(int argc, char* argv[], BenchConfig* config)
+{
+    int i;
+    int threads;
+    memset(config, 0, sizeof(BenchConfig));
+    parse_list("500,1000,2000", config->n, &config->n_count);
+    parse_list("2,16", config->d, &config->d_count);
+    parse_list("2,8", config->k, &config->k_count);
+    config->repeats = 3;
+    config->tolerance = 0.10;
+    for (i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--quick") == 0)
+        {
+            parse_list("200,400", config->n, &config->n_count);
+            parse_list("2", config->d, &config->d_count);
+            parse_list("2", config->k, &config->k_count);
+            config->repeats = 1;
+        }
+        else if (strcmp(argv[i], "--n") == 0 && i + 1 < argc)
+        {
+            if (!parse_list(argv[++i], config->n, &config->n_count))
+            {
+                return 0;
+            }
+        }
+        else if (strcmp(argv[i], "--d") == 0 && i + 1 < argc)
+        {
+            if (!parse_list(argv[++i], config->d, &config->d_count))
+            {
+                return 0;
+            }
+        }
+        else if (strcmp(argv[i], "--k") == 0 && i + 1 < argc)
+        {
+            if (!parse_list(argv[++i], config->k, &config->k_count))
+            {
+                return 0;
+            }
+        }
+        else if (strcmp(argv[i], "--repeats") == 0 && i + 1 < argc)
+        {
+            config->repeats = atoi(argv[++i]);
+            if (config->repeats <= 0)
+            {
+                return 0;
+            }
+        }
+        else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+        {
+            threads = atoi(argv[++i]);
+            if (threads <= 0)
+            {
+                return 0;
+            }
+            set_num_threads(threads);
+        }
+        else if (strcmp(argv[i], "--out") == 0 && i + 1 < argc)
+        {
+            config->out = argv[++i];
+        }
+        else if (strcmp(argv[i], "--compare") == 0 && i + 1 < argc)
+        {
+            config->baseline = argv[++i];
+        }
+        else if (strcmp(argv[i], "--tolerance") == 0 && i + 1 < argc)
+        {
+            config->tolerance = atof(argv[++i]);
+            if (!(config->tolerance >= 0))
+            {
+                return 0;
+            }
+        }
+        else
+        {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/**
+ * Benchmarks the C core on synthetic Gaussian blob datasets over a grid of n, d and k, and
+ * writes the timings, GFLOP/s, bytes moved and peak RSS as JSON.
+ * Usage: symnmf_bench [--quick] [--n LIST] [--d LIST] [--k LIST] [--repeats R] [--threads T]
+ *                     [--out FILE] [--compare BASELINE.json [--tolerance 0.10]]
+ * The blobs of a dataset are as many as the first k of the grid. With --compare every kernel
+ * slower than the baseline by more than the tolerance is reported on stderr.
+ * @param argc: Argument count
+ * @param argv: Argument vector
+ * @return: 0 if ok, 1 on error, 2 if a regression was found
+ */
+int main(int argc, char* argv[])
+{
+    BenchConfig config;
+    BenchResult* results;
+    FILE* out;
+    int total;
+    int count = 0;
+    int got;
+    int a;
+    int b;
+    int regressions = 0;
+    if (!parse_config(argc, argv, &config))
+    {
+        printf("An Error Has Occurred\n");
+        return 1;
+    }
+    total = config.n_count * config.d_count * (5 + 2 * config.k_count);
+    results = (BenchResult*)calloc((size_t)total, sizeof(BenchResult));
+    if (results == NULL)
+    {
+        printf("An Error Has Occurred\n");
+        return 1;
+    }
+    for (a = 0; a < config.n_count; a++)
+    {
+        for (b = 0; b < config.d_count; b++)
+        {
+            fprintf(stderr, "n=%d d=%d\n", config.n[a], config.d[b]);
+            got = bench_dataset(&config, config.n[a], config.d[b], results + count);
+            if (got < 0)
+            {
+                printf("An Error Has Occurred\n");
+                free(results);
+                return 1;
+            }
+            count += got;
+        }
+    }
+    out = (config.out != NULL) ? fopen(config.out, "w") : stdout;
+    if (out == NULL)
+    {
+        printf("An Error Has Occurred\n");
+        free(results);
+        return 1;
+    }
+    fprintf(out, "{\n  \"version\": 1,\n  \"threads\": %d,\n  \"gemm_isa\": %d,\n  \"repeats\": %d,\n  \"results\": [\n",
+            get_num_threads(), gemm_isa_used(), config.repeats);
+    for (a = 0; a < count; a++)
+    {
+        write_result(out, &results[a], a == count - 1);
+    }
+    fprintf(out, "  ]\n}\n");
+    if (out != stdout)
+    {
+        fclose(out);
+    }
+    if (config.baseline != NULL)
+    {
+        regressions = compare_baseline(&config, results, count);
+        if (regressions < 0)
+        {
+            printf("An Error Has Occurred\n");
+            free(results);
+            return 1;
+        }
+    }
+    free(results);
+    return (regressions > 0) ? 2 : 0;
+}
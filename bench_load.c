@@ -0,0 +1,180 @@
+#define _POSIX_C_SOURCE 199309L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "symnmf.h"
+
+/* Times each loader is run; the fastest run is reported. */
+#define REPEATS 5
+
+/**
+ * Returns a monotonic time stamp.
+ * @return: Seconds since an arbitrary point
+ */
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+/**
+ * Reference loader: the three fscanf passes the program used before load_points
+ * (count the lines, count the commas of the first line, then read every value).
+ * @param filename: Name of the file
+ * @return: Pointer to the matrix of points, NULL on failure
+ */
+static Matrix* fscanf_load(const char* filename)
+{
+    int rows = 0;
+    int cols = 1;
+    int i;
+    int j;
+    int ch;
+    Matrix* M;
+    FILE* file = fopen(filename, "r");
+    if (file == NULL)
+    {
+        return NULL;
+    }
+    while ((ch = fgetc(file)) != EOF)
+    {
+        rows += (ch == '\n');
+    }
+    rewind(file);
+    while ((ch = fgetc(file)) != EOF && ch != '\n')
+    {
+        cols += (ch == ',');
+    }
+    rewind(file);
+    M = matrix_create(rows, cols);
+    for (i = 0; M != NULL && i < rows; i++)
+    {
+        for (j = 0; j < cols; j++)
+        {
+            if (fscanf(file, (j == cols - 1) ? "%lf" : "%lf,", &MAT_AT(M, i, j)) != 1)
+            {
+                matrix_free(M);
+                M = NULL;
+                break;
+            }
+        }
+    }
+    fclose(file);
+    return M;
+}
+
+/**
+ * Writes n random points of dimension d with a mix of number formats.
+ * @param filename: Name of the file to create
+ * @param n: Number of points
+ * @param d: Dimension
+ * @return: 1 on success, 0 on failure
+ */
+static int write_points(const char* filename, int n, int d)
+{
+    int i;
+    int j;
+    double value;
+    FILE* file = fopen(filename, "w");
+    if (file == NULL)
+    {
+        return 0;
+    }
+    srand(1234);
+    for (i = 0; i < n; i++)
+    {
+        for (j = 0; j < d; j++)
+        {
+            value = ((double)rand() / RAND_MAX - 0.5) * 20;
+            switch ((i + j) % 3)
+            {
+                case 0: fprintf(file, "%.4f", value); break;
+                case 1: fprintf(file, "%.17g", value); break;
+                default: fprintf(file, "%.6e", value); break;
+            }
+            fputc((j == d - 1) ? '\n' : ',', file);
+        }
+    }
+    return fclose(file) == 0;
+}
+
+/**
+ * Times a loader over REPEATS runs.
+ * @param filename: Name of the file
+ * @param fast: 1 for load_points, 0 for the fscanf reference
+ * @param result: Receives the matrix of the last run
+ * @return: Fastest time in seconds
+ */
+static double time_loader(const char* filename, int fast, Matrix** result)
+{
+    int r;
+    double start;
+    double best = 0.0;
+    Matrix* M;
+    *result = NULL;
+    for (r = 0; r < REPEATS; r++)
+    {
+        start = now();
+        M = fast ? load_points(filename, NULL) : fscanf_load(filename);
+        start = now() - start;
+        best = (r == 0 || start < best) ? start : best;
+        matrix_free(*result);
+        *result = M;
+    }
+    return best;
+}
+
+/**
+ * Compares load_points with the fscanf reader on a file of points, checks that both
+ * produce the same doubles bit for bit, and prints the throughput of each.
+ * Usage: bench_load [file] or bench_load --generate file n d
+ */
+int main(int argc, char* argv[])
+{
+    const char* filename = (argc > 1) ? argv[argc > 2 ? 2 : 1] : "bench_points.txt";
+    FILE* file;
+    long bytes;
+    double slow_time;
+    double fast_time;
+    Matrix* slow;
+    Matrix* fast;
+    int i;
+    int same = 1;
+    if (argc == 1 || (argc == 5 && strcmp(argv[1], "--generate") == 0))
+    {
+        if (!write_points(filename, (argc == 5) ? atoi(argv[3]) : 200000, (argc == 5) ? atoi(argv[4]) : 10))
+        {
+            printf("An Error Has Occurred\n");
+            return 1;
+        }
+    }
+    file = fopen(filename, "r");
+    if (file == NULL || fseek(file, 0, SEEK_END) != 0)
+    {
+        printf("An Error Has Occurred\n");
+        return 1;
+    }
+    bytes = ftell(file);
+    fclose(file);
+    slow_time = time_loader(filename, 0, &slow);
+    fast_time = time_loader(filename, 1, &fast);
+    if (slow == NULL || fast == NULL)
+    {
+        printf("An Error Has Occurred\n");
+        return 1;
+    }
+    same = slow->rows == fast->rows && slow->cols == fast->cols;
+    for (i = 0; same && i < fast->rows; i++)
+    {
+        same = memcmp(MAT_ROW(slow, i), MAT_ROW(fast, i), (size_t)fast->cols * sizeof(double)) == 0;
+    }
+    printf("file: %s, %ld bytes, %d x %d, %d threads\n", filename, bytes, fast->rows, fast->cols, get_num_threads());
+    printf("fscanf:     %8.4f s  %8.1f MB/s\n", slow_time, bytes / slow_time / 1e6);
+    printf("load_points: %7.4f s  %8.1f MB/s  (%.1fx)\n", fast_time, bytes / fast_time / 1e6, slow_time / fast_time);
+    printf("identical: %s\n", same ? "yes" : "NO");
+    matrix_free(slow);
+    matrix_free(fast);
+    return same ? 0 : 1;
+}
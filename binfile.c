@@ -0,0 +1,439 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include "symnmf.h"
+
+/*
+ * Binary matrix file: a BIN_HEADER_SIZE byte header followed by the raw float64 data.
+ *
+ *   offset  size  field
+ *        0     8  magic "SYMNMF\r\n"
+ *        8     4  format version (BIN_VERSION)
+ *       12     4  dtype (BIN_FLOAT64)
+ *       16     4  layout (BIN_DENSE: rows*cols row-major, BIN_PACKED: upper triangle row by row)
+ *       20     4  flags (BIN_LITTLE_ENDIAN if the data is little-endian)
+ *       24     4  rows
+ *       28     4  cols
+ *       32     4  offset of the data (BIN_HEADER_SIZE)
+ *       36     4  Adler-32 checksum of the data
+ *       40     4  checkpoint: solver + 1 (0 for a plain matrix)
+ *       44     4  checkpoint: iteration
+ *       48     8  checkpoint: previous objective, float64 in the byte order of the data
+ *       56     8  zero
+ *
+ * Header fields are little-endian. The data starts 64 bytes into the file, so a mapping of
+ * the file has 64-byte aligned data and can be used in place. A checkpoint (see
+ * checkpoint_save) is a dense file of H, followed by V for HALS; readers of plain matrices
+ * ignore the checkpoint fields.
+ */
+#define BIN_HEADER_SIZE 64
+#define BIN_VERSION 1
+#define BIN_FLOAT64 1
+#define BIN_LITTLE_ENDIAN 1
+#define BIN_STATE_OFFSET 40
+
+/* Largest number of bytes Adler-32 can sum before its 32-bit sums have to be reduced. */
+#define ADLER_NMAX 5552
+#define ADLER_BASE 65521UL
+
+static const char bin_magic[8] = {'S', 'Y', 'M', 'N', 'M', 'F', '\r', '\n'};
+
+/**
+ * Tells whether doubles are stored little-endian on this machine.
+ * @return: 1 if little-endian
+ */
+static int little_endian(void)
+{
+    const unsigned int one = 1;
+    return *(const unsigned char*)&one == 1;
+}
+
+/**
+ * Stores a 32-bit value little-endian.
+ * @param p: Destination (4 bytes)
+ * @param value: Value to store
+ */
+static void put_u32(unsigned char* p, unsigned long value)
+{
+    p[0] = (unsigned char)(value & 0xff);
+    p[1] = (unsigned char)((value >> 8) & 0xff);
+    p[2] = (unsigned char)((value >> 16) & 0xff);
+    p[3] = (unsigned char)((value >> 24) & 0xff);
+}
+
+/**
+ * Reads a little-endian 32-bit value.
+ * @param p: Source (4 bytes)
+ * @return: The value
+ */
+static unsigned long get_u32(const unsigned char* p)
+{
+    return (unsigned long)p[0] | ((unsigned long)p[1] << 8) | ((unsigned long)p[2] << 16) | ((unsigned long)p[3] << 24);
+}
+
+/**
+ * Continues an Adler-32 checksum over a block of bytes.
+ * @param adler: Checksum of the preceding bytes (1 for none)
+ * @param data: Bytes to add
+ * @param size: Number of bytes
+ * @return: Updated checksum
+ */
+static unsigned long adler32(unsigned long adler, const unsigned char* data, size_t size)
+{
+    unsigned long a = adler & 0xffff;
+    unsigned long b = (adler >> 16) & 0xffff;
+    size_t block;
+    size_t i;
+    while (size > 0)
+    {
+        block = (size < ADLER_NMAX) ? size : ADLER_NMAX;
+        for (i = 0; i < block; i++)
+        {
+            a += data[i];
+            b += a;
+        }
+        a %= ADLER_BASE;
+        b %= ADLER_BASE;
+        data += block;
+        size -= block;
+    }
+    return (b << 16) | a;
+}
+
+/**
+ * Number of doubles stored for a matrix of the given layout and shape.
+ * @param layout: BIN_DENSE or BIN_PACKED
+ * @param rows: Number of rows
+ * @param cols: Number of columns
+ * @return: Number of doubles
+ */
+static size_t data_count(int layout, int rows, int cols)
+{
+    return (layout == BIN_PACKED) ? (size_t)rows * ((size_t)rows + 1) / 2 : (size_t)rows * (size_t)cols;
+}
+
+/**
+ * Tells whether a file starts with the magic of a binary matrix file.
+ * @param filename: Name of the file
+ * @return: 1 if it does, 0 otherwise (including when the file cannot be read)
+ */
+int bin_is_matrix_file(const char* filename)
+{
+    char magic[sizeof(bin_magic)];
+    int found = 0;
+    FILE* file = fopen(filename, "rb");
+    if (file != NULL)
+    {
+        found = fread(magic, 1, sizeof(magic), file) == sizeof(magic) && memcmp(magic, bin_magic, sizeof(magic)) == 0;
+        fclose(file);
+    }
+    return found;
+}
+
+/**
+ * Opens a binary matrix file and exposes its data in place, without copying.
+ * The data is read-only: the views must not be written to.
+ * @param filename: Name of the file
+ * @param verify: Nonzero to check the checksum of the data (reads the whole file)
+ * @param error: Optional, receives the reason on failure
+ * @return: Open file, released with bin_close, NULL on failure
+ */
+BinFile* bin_open(const char* filename, int verify, LoadError* error)
+{
+    const unsigned char* header;
+    unsigned long rows;
+    unsigned long cols;
+    size_t count;
+    BinFile* bin;
+    if (error != NULL)
+    {
+        memset(error, 0, sizeof(LoadError));
+    }
+    bin = (BinFile*)calloc(1, sizeof(BinFile));
+    if (bin == NULL)
+    {
+        load_error_set(error, 0, 0, "out of memory");
+        return NULL;
+    }
+    if (!file_map(filename, &bin->file, error))
+    {
+        free(bin);
+        return NULL;
+    }
+    header = (const unsigned char*)bin->file.data;
+    if (bin->file.size < BIN_HEADER_SIZE || memcmp(header, bin_magic, sizeof(bin_magic)) != 0)
+    {
+        load_error_set(error, 0, 0, "not a binary matrix file");
+    }
+    else if (get_u32(header + 8) != BIN_VERSION)
+    {
+        load_error_set(error, 0, 0, "unsupported format version");
+    }
+    else if (get_u32(header + 12) != BIN_FLOAT64)
+    {
+        load_error_set(error, 0, 0, "unsupported dtype");
+    }
+    else if (get_u32(header + 20) != (little_endian() ? BIN_LITTLE_ENDIAN : 0UL))
+    {
+        load_error_set(error, 0, 0, "data has the wrong byte order");
+    }
+    else if (get_u32(header + 16) > BIN_PACKED || get_u32(header + 32) != BIN_HEADER_SIZE)
+    {
+        load_error_set(error, 0, 0, "corrupt header");
+    }
+    else
+    {
+        bin->layout = (int)get_u32(header + 16);
+        rows = get_u32(header + 24);
+        cols = get_u32(header + 28);
+        count = (rows > INT_MAX || cols > INT_MAX) ? 0 : data_count(bin->layout, (int)rows, (int)cols);
+        if (rows > INT_MAX || cols > INT_MAX || (bin->layout == BIN_PACKED && rows != cols))
+        {
+            load_error_set(error, 0, 0, "corrupt header");
+        }
+        else if ((bin->file.size - BIN_HEADER_SIZE) / sizeof(double) < count)
+        {
+            load_error_set(error, 0, 0, "file is truncated");
+        }
+        else if (verify && adler32(1, header + BIN_HEADER_SIZE, count * sizeof(double)) != get_u32(header + 36))
+        {
+            load_error_set(error, 0, 0, "checksum mismatch");
+        }
+        else
+        {
+            matrix_view(&bin->dense, (double*)(bin->file.data + BIN_HEADER_SIZE), (int)rows, (int)cols, (int)cols);
+            bin->packed.data = bin->dense.data;
+            bin->packed.n = (int)rows;
+            return bin;
+        }
+    }
+    bin_close(bin);
+    return NULL;
+}
+
+/**
+ * Closes a file opened with bin_open; its views become invalid.
+ * @param bin: Open file (may be NULL)
+ */
+void bin_close(BinFile* bin)
+{
+    if (bin != NULL)
+    {
+        file_unmap(&bin->file);
+        free(bin);
+    }
+}
+
+/**
+ * Returns the part of row i that a binary matrix file stores.
+ * @param M: Dense matrix, or NULL if P is given
+ * @param V: Optional dense matrix stored below M (may be NULL)
+ * @param P: Packed matrix, or NULL if M is given
+ * @param layout: BIN_DENSE or BIN_PACKED
+ * @param i: Row index
+ * @return: Pointer to the first stored element of the row (the diagonal for BIN_PACKED)
+ */
+static const double* stored_row(const Matrix* M, const Matrix* V, const PackedMatrix* P, int layout, int i)
+{
+    if (P != NULL)
+    {
+        return PACKED_ROW(P, i);
+    }
+    if (V != NULL && i >= M->rows)
+    {
+        return MAT_ROW(V, i - M->rows);
+    }
+    return MAT_ROW(M, i) + ((layout == BIN_PACKED) ? i : 0);
+}
+
+/**
+ * Writes the header and the data of a binary matrix file, row by row. The checksum is
+ * computed in a first pass so that the file is written sequentially.
+ * @param filename: Name of the file to create
+ * @param M: Dense matrix, or NULL if P is given
+ * @param V: Optional dense matrix written below M (may be NULL)
+ * @param P: Packed matrix, or NULL if M is given
+ * @param layout: BIN_DENSE or BIN_PACKED (the upper triangle of a square M, or P)
+ * @param rows: Number of rows
+ * @param cols: Number of columns
+ * @param state: Optional checkpoint fields of the header (16 bytes at BIN_STATE_OFFSET), NULL for a plain matrix
+ * @return: 1 on success, 0 on failure
+ */
+static int write_file(const char* filename, const Matrix* M, const Matrix* V, const PackedMatrix* P, int layout, int rows, int cols,
+                      const unsigned char* state)
+{
+    unsigned char header[BIN_HEADER_SIZE];
+    unsigned long checksum = 1;
+    size_t length;
+    int ok;
+    int i;
+    FILE* file;
+    for (i = 0; i < rows; i++)
+    {
+        length = (size_t)((layout == BIN_PACKED) ? cols - i : cols);
+        checksum = adler32(checksum, (const unsigned char*)stored_row(M, V, P, layout, i), length * sizeof(double));
+    }
+    memset(header, 0, sizeof(header));
+    memcpy(header, bin_magic, sizeof(bin_magic));
+    put_u32(header + 8, BIN_VERSION);
+    put_u32(header + 12, BIN_FLOAT64);
+    put_u32(header + 16, (unsigned long)layout);
+    put_u32(header + 20, little_endian() ? BIN_LITTLE_ENDIAN : 0UL);
+    put_u32(header + 24, (unsigned long)rows);
+    put_u32(header + 28, (unsigned long)cols);
+    put_u32(header + 32, BIN_HEADER_SIZE);
+    put_u32(header + 36, checksum);
+    if (state != NULL)
+    {
+        memcpy(header + BIN_STATE_OFFSET, state, 16);
+    }
+    file = fopen(filename, "wb");
+    if (file == NULL)
+    {
+        return 0;
+    }
+    ok = fwrite(header, 1, sizeof(header), file) == sizeof(header);
+    for (i = 0; ok && i < rows; i++)
+    {
+        length = (size_t)((layout == BIN_PACKED) ? cols - i : cols);
+        ok = fwrite(stored_row(M, V, P, layout, i), sizeof(double), length, file) == length;
+    }
+    return (fclose(file) == 0) && ok;
+}
+
+/**
+ * Writes a matrix to a binary matrix file.
+ * @param filename: Name of the file to create
+ * @param M: Matrix to write (any stride)
+ * @param layout: BIN_DENSE, or BIN_PACKED to store only the upper triangle of a square symmetric M
+ * @return: 1 on success, 0 on failure
+ */
+int bin_save_matrix(const char* filename, const Matrix* M, int layout)
+{
+    if (layout == BIN_PACKED && M->rows != M->cols)
+    {
+        return 0;
+    }
+    return write_file(filename, M, NULL, NULL, layout, M->rows, M->cols, NULL);
+}
+
+/**
+ * Writes a packed symmetric matrix to a binary matrix file with the BIN_PACKED layout.
+ * @param filename: Name of the file to create
+ * @param P: Packed matrix to write
+ * @return: 1 on success, 0 on failure
+ */
+int bin_save_packed(const char* filename, const PackedMatrix* P)
+{
+    return write_file(filename, NULL, NULL, P, BIN_PACKED, P->n, P->n, NULL);
+}
+
+/**
+ * Writes a checkpoint of a solve: a binary matrix file of H (and of V below it for HALS)
+ * whose header also records the solver, the iteration and the previous objective. The file
+ * is written next to filename and renamed over it, so a killed run leaves either the
+ * previous checkpoint or the new one. bin_open reads it as a plain matrix.
+ * @param filename: Name of the checkpoint file
+ * @param H: Iterate (n*k)
+ * @param state: Where the solve stands; V is required for SOLVER_HALS
+ * @return: 1 on success, 0 on failure
+ */
+int checkpoint_save(const char* filename, const Matrix* H, const SolverState* state)
+{
+    unsigned char fields[16];
+    const Matrix* V = (state->solver == SOLVER_HALS) ? state->V : NULL;
+    char* temporary;
+    int ok;
+    if ((state->solver == SOLVER_HALS && V == NULL) || (V != NULL && (V->rows != H->rows || V->cols != H->cols))
+        || H->rows > INT_MAX / 2)
+    {
+        return 0;
+    }
+    put_u32(fields, (unsigned long)state->solver + 1);
+    put_u32(fields + 4, (unsigned long)state->iteration);
+    memcpy(fields + 8, &state->previous, sizeof(double));
+    temporary = (char*)malloc(strlen(filename) + 5);
+    if (temporary == NULL)
+    {
+        return 0;
+    }
+    strcpy(temporary, filename);
+    strcat(temporary, ".tmp");
+    ok = write_file(temporary, H, V, NULL, BIN_DENSE, (V != NULL) ? 2 * H->rows : H->rows, H->cols, fields);
+    ok = ok && rename(temporary, filename) == 0;
+    if (!ok)
+    {
+        remove(temporary);
+    }
+    free(temporary);
+    return ok;
+}
+
+/**
+ * Copies n rows of a matrix, starting at row first, into a new matrix.
+ * @param M: Source matrix
+ * @param first: First row to copy
+ * @param n: Number of rows
+ * @return: New matrix, NULL if allocation failed
+ */
+static Matrix* copy_rows(const Matrix* M, int first, int n)
+{
+    int i;
+    Matrix* copy = matrix_create(n, M->cols);
+    for (i = 0; copy != NULL && i < n; i++)
+    {
+        memcpy(MAT_ROW(copy, i), MAT_ROW(M, first + i), (size_t)M->cols * sizeof(double));
+    }
+    return copy;
+}
+
+/**
+ * Reads a checkpoint written by checkpoint_save, checking its data against the checksum.
+ * @param filename: Name of the checkpoint file
+ * @param state: Receives the state; for SOLVER_HALS state->V is a new matrix, freed with matrix_free
+ * @param error: Optional, receives the reason on failure
+ * @return: New matrix holding H, NULL on failure
+ */
+Matrix* checkpoint_load(const char* filename, SolverState* state, LoadError* error)
+{
+    const unsigned char* fields;
+    unsigned long solver;
+    int n;
+    Matrix* H = NULL;
+    Matrix* V = NULL;
+    BinFile* bin = bin_open(filename, 1, error);
+    if (bin == NULL)
+    {
+        return NULL;
+    }
+    fields = (const unsigned char*)bin->file.data + BIN_STATE_OFFSET;
+    solver = get_u32(fields);
+    n = (solver == SOLVER_HALS + 1) ? bin->dense.rows / 2 : bin->dense.rows;
+    if (bin->layout != BIN_DENSE || solver < SOLVER_MU + 1 || solver > SOLVER_HALS + 1 || get_u32(fields + 4) > INT_MAX
+        || (solver == SOLVER_HALS + 1 && bin->dense.rows % 2 != 0) || n == 0)
+    {
+        load_error_set(error, 0, 0, "not a checkpoint");
+        bin_close(bin);
+        return NULL;
+    }
+    H = copy_rows(&bin->dense, 0, n);
+    if (solver == SOLVER_HALS + 1)
+    {
+        V = copy_rows(&bin->dense, n, n);
+    }
+    if (H == NULL || (solver == SOLVER_HALS + 1 && V == NULL))
+    {
+        load_error_set(error, 0, 0, "out of memory");
+        matrix_free(H);
+        matrix_free(V);
+        bin_close(bin);
+        return NULL;
+    }
+    state->solver = (int)solver - 1;
+    state->iteration = (int)get_u32(fields + 4);
+    memcpy(&state->previous, fields + 8, sizeof(double));
+    state->V = V;
+    bin_close(bin);
+    return H;
+}
@@ -0,0 +1,219 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "symnmf.h"
+
+/* Points whose distance sums are accumulated together by one task of silhouette_score. */
+#define SIL_ROWS 64
+
+/* Points streamed against a SIL_ROWS block at a time, sized to stay in cache. */
+#define SIL_COLS 256
+
+/*
+ * Affinities this close to 1 are not turned back into distances: -log(a) carries an absolute
+ * error of about 1e-16, so d^2 = -2 log(a) loses all accuracy as d^2 approaches that size
+ * and two distinct points can come out at distance 0. Above the cutoff d^2 > 2e-8, and the
+ * recovered distance is within about 1e-8 relative.
+ */
+#define SIL_CLOSE_AFFINITY 1e-8
+
+/**
+ * Labels every row of H with the index of its largest entry, the first one on ties.
+ * @param H: Matrix H (n*k)
+ * @param labels: Array of n ints receiving the labels
+ * @return: labels
+ */
+int* argmax_labels(const Matrix* H, int* labels)
+{
+    int i;
+    int c;
+    int best;
+    const double* H_row;
+#ifdef _OPENMP
+#pragma omp parallel for private(c, best, H_row) schedule(static) num_threads(get_num_threads()) if ((double)H->rows * H->cols > 1e5)
+#endif
+    for (i = 0; i < H->rows; i++)
+    {
+        H_row = MAT_ROW(H, i);
+        best = 0;
+        for (c = 1; c < H->cols; c++)
+        {
+            best = (H_row[c] > H_row[best]) ? c : best;
+        }
+        labels[i] = best;
+    }
+    return labels;
+}
+
+/**
+ * Labels every point with its nearest centroid (see nearest_row), the first one on ties.
+ * @param points: Matrix of points (n*d)
+ * @param C: Centroids (k*d)
+ * @param labels: Array of n ints receiving the labels
+ * @return: labels
+ */
+int* nearest_labels(const Matrix* points, const Matrix* C, int* labels)
+{
+    int i;
+    double best;
+#ifdef _OPENMP
+#pragma omp parallel for private(best) schedule(static) num_threads(get_num_threads()) if ((double)points->rows * C->rows * points->cols > 1e5)
+#endif
+    for (i = 0; i < points->rows; i++)
+    {
+        labels[i] = nearest_row(MAT_ROW(points, i), C, &best, NULL);
+    }
+    return labels;
+}
+
+/**
+ * Returns the Euclidean distance between points i and j, recovered from their Gaussian
+ * affinity exp(-d^2 / 2) when one is given, has not underflowed and is not within
+ * SIL_CLOSE_AFFINITY of 1; very close pairs are measured from the coordinates.
+ * @param points: Matrix of points
+ * @param A: Similarity matrix of the points, or NULL
+ * @param i: First point
+ * @param j: Second point
+ * @return: Distance
+ */
+static double pair_distance(const Matrix* points, const Matrix* A, int i, int j)
+{
+    double a;
+    if (A != NULL)
+    {
+        a = MAT_AT(A, i, j);
+        if (a > 0.0 && a < 1.0 - SIL_CLOSE_AFFINITY)
+        {
+            return sqrt(-2.0 * log(a));
+        }
+    }
+    return sqrt(squared_euc_dis(MAT_ROW(points, i), MAT_ROW(points, j), points->cols));
+}
+
+/**
+ * Sums the distances from every point to the points of every cluster. Rows are split into
+ * blocks of SIL_ROWS points, one task each, and every block streams the other points in
+ * tiles of SIL_COLS so a tile is reused by all the rows of the block while in cache.
+ * @param points: Matrix of points (n*d)
+ * @param labels: Cluster of every point
+ * @param A: Similarity matrix of the points, or NULL
+ * @param sums: Receives the sums (n*k), zero on entry
+ */
+static void distance_sums(const Matrix* points, const int* labels, const Matrix* A, Matrix* sums)
+{
+    int n = points->rows;
+    int blocks = (n + SIL_ROWS - 1) / SIL_ROWS;
+    int b;
+    int i;
+    int j;
+    int j0;
+    int i_end;
+    int j_end;
+    double* sums_row;
+#ifdef _OPENMP
+#pragma omp parallel for private(i, j, j0, i_end, j_end, sums_row) schedule(dynamic, 1) num_threads(get_num_threads()) if (n > SIL_ROWS)
+#endif
+    for (b = 0; b < blocks; b++)
+    {
+        i_end = (b + 1) * SIL_ROWS < n ? (b + 1) * SIL_ROWS : n;
+        for (j0 = 0; j0 < n; j0 += SIL_COLS)
+        {
+            j_end = j0 + SIL_COLS < n ? j0 + SIL_COLS : n;
+            for (i = b * SIL_ROWS; i < i_end; i++)
+            {
+                sums_row = MAT_ROW(sums, i);
+                for (j = j0; j < j_end; j++)
+                {
+                    if (j != i)
+                    {
+                        sums_row[labels[j]] += pair_distance(points, A, i, j);
+                    }
+                }
+            }
+        }
+    }
+}
+
+/**
+ * Computes the mean silhouette coefficient of a clustering with Euclidean distances, as
+ * sklearn.metrics.silhouette_score does: for every point, (b - a) / max(a, b) where a is its
+ * mean distance to the rest of its cluster and b the smallest mean distance to another
+ * cluster, 0 for a point alone in its cluster. The O(n^2 d) distance pass is blocked and
+ * multithreaded. Given the similarity matrix of sym_mat, distances are recovered from the
+ * affinities instead of the coordinates (to about 1e-8 relative; pairs whose affinity
+ * is within 1e-8 of 1 are measured from the coordinates, since their distance cannot be
+ * recovered), which saves the d-term for high-dimensional points.
+ * @param points: Matrix of points (n*d)
+ * @param labels: Cluster of every point, in 0 .. k - 1
+ * @param k: Number of cluster indices
+ * @param A: Similarity matrix of the points (n*n, see sym_mat), or NULL to use the coordinates
+ * @param score: Receives the score
+ * @return: 1 on success, 0 if the labels are out of range, do not form between 2 and n - 1 clusters, or an allocation failed
+ */
+int silhouette_score(const Matrix* points, const int* labels, int k, const Matrix* A, double* score)
+{
+    int n = points->rows;
+    int i;
+    int c;
+    int own;
+    int clusters = 0;
+    int* counts;
+    double a;
+    double b;
+    double total = 0.0;
+    const double* sums_row;
+    Matrix* sums;
+    if (k <= 0 || (A != NULL && (A->rows != n || A->cols != n)))
+    {
+        return 0;
+    }
+    counts = (int*)calloc((size_t)k, sizeof(int));
+    if (counts == NULL)
+    {
+        printf("An Error Has Occurred\n");
+        return 0;
+    }
+    for (i = 0; i < n; i++)
+    {
+        if (labels[i] < 0 || labels[i] >= k)
+        {
+            free(counts);
+            return 0;
+        }
+        clusters += counts[labels[i]]++ == 0;
+    }
+    sums = (clusters >= 2 && clusters < n) ? matrix_create(n, k) : NULL;
+    if (sums == NULL)
+    {
+        free(counts);
+        return 0;
+    }
+    distance_sums(points, labels, A, sums);
+    for (i = 0; i < n; i++)
+    {
+        own = labels[i];
+        sums_row = MAT_ROW(sums, i);
+        if (counts[own] == 1)
+        {
+            continue;
+        }
+        a = sums_row[own] / (counts[own] - 1);
+        b = HUGE_VAL;
+        for (c = 0; c < k; c++)
+        {
+            if (c != own && counts[c] > 0 && sums_row[c] / counts[c] < b)
+            {
+                b = sums_row[c] / counts[c];
+            }
+        }
+        if (a > 0.0 || b > 0.0)
+        {
+            total += (b - a) / (a > b ? a : b);
+        }
+    }
+    *score = total / n;
+    matrix_free(sums);
+    free(counts);
+    return 1;
+}
@@ -0,0 +1,279 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "symnmf.h"
+
+/*
+ * Relative margin a distance bound must clear before Hamerly skips a point. The bounds
+ * collect a rounding error every iteration; the margin keeps every skipped point one whose
+ * nearest centroid Lloyd's assignment would also have picked.
+ */
+#define BOUND_SLACK (1.0 + 1e-9)
+
+/**
+ * Assigns every point to its nearest centroid.
+ * @param points: Matrix of points (n*d)
+ * @param C: Centroids (k*d)
+ * @param labels: Receives the centroid of every point
+ */
+static void assign_lloyd(const Matrix* points, const Matrix* C, int* labels)
+{
+    int i;
+    double best;
+#ifdef _OPENMP
+#pragma omp parallel for private(best) schedule(static) num_threads(get_num_threads()) if ((double)points->rows * C->rows * points->cols > 1e5)
+#endif
+    for (i = 0; i < points->rows; i++)
+    {
+        labels[i] = nearest_row(MAT_ROW(points, i), C, &best, NULL);
+    }
+}
+
+/**
+ * Sets half[c] to half the distance from centroid c to its nearest other centroid: a point
+ * closer than that to c has no nearer centroid.
+ * @param C: Centroids (k*d)
+ * @param half: Array of k doubles
+ */
+static void half_separations(const Matrix* C, double* half)
+{
+    int c;
+    int other;
+    double d;
+    for (c = 0; c < C->rows; c++)
+    {
+        half[c] = HUGE_VAL;
+    }
+    for (c = 0; c < C->rows; c++)
+    {
+        for (other = c + 1; other < C->rows; other++)
+        {
+            d = 0.5 * sqrt(squared_euc_dis(MAT_ROW(C, c), MAT_ROW(C, other), C->cols));
+            half[c] = (d < half[c]) ? d : half[c];
+            half[other] = (d < half[other]) ? d : half[other];
+        }
+    }
+}
+
+/**
+ * Assigns every point to its nearest centroid with Hamerly's bounds: upper[i] bounds the
+ * distance of point i to its centroid and lower[i] the distance to any other centroid. A
+ * point is measured only if its bounds overlap, and compared with all centroids only if
+ * they still overlap after its upper bound is made exact.
+ * @param points: Matrix of points (n*d)
+ * @param C: Centroids (k*d)
+ * @param labels: Centroid of every point, updated
+ * @param upper: Upper bounds (n), updated
+ * @param lower: Lower bounds (n), updated
+ * @param half: Half separations of the centroids (see half_separations)
+ * @param first: Nonzero if the bounds are not set yet
+ */
+static void assign_hamerly(const Matrix* points, const Matrix* C, int* labels, double* upper, double* lower, const double* half, int first)
+{
+    int i;
+    double bound;
+    double best;
+    double second;
+    const double* point;
+#ifdef _OPENMP
+#pragma omp parallel for private(bound, best, second, point) schedule(static) num_threads(get_num_threads()) if ((double)points->rows * C->rows * points->cols > 1e5)
+#endif
+    for (i = 0; i < points->rows; i++)
+    {
+        point = MAT_ROW(points, i);
+        if (!first)
+        {
+            bound = (half[labels[i]] > lower[i]) ? half[labels[i]] : lower[i];
+            if (upper[i] * BOUND_SLACK < bound)
+            {
+                continue;
+            }
+            upper[i] = sqrt(squared_euc_dis(point, MAT_ROW(C, labels[i]), points->cols));
+            if (upper[i] * BOUND_SLACK < bound)
+            {
+                continue;
+            }
+        }
+        labels[i] = nearest_row(point, C, &best, &second);
+        upper[i] = sqrt(best);
+        lower[i] = sqrt(second);
+    }
+}
+
+/**
+ * Moves every centroid to the mean of its points, summed in point order, or to the origin if
+ * it has none, and records how far each centroid moved.
+ * @param points: Matrix of points (n*d)
+ * @param labels: Centroid of every point
+ * @param C: Centroids (k*d)
+ * @param next: Receives the new centroids (k*d)
+ * @param counts: Array of k ints used as scratch
+ * @param drift: Receives the distance every centroid moved (k)
+ * @return: Number of centroids that moved less than KMEANS_EPSILON
+ */
+static int update_centroids(const Matrix* points, const int* labels, const Matrix* C, Matrix* next, int* counts, double* drift)
+{
+    int i;
+    int c;
+    int j;
+    int settled = 0;
+    double* next_row;
+    const double* point;
+    memset(counts, 0, (size_t)C->rows * sizeof(int));
+    for (c = 0; c < C->rows; c++)
+    {
+        memset(MAT_ROW(next, c), 0, (size_t)C->cols * sizeof(double));
+    }
+    for (i = 0; i < points->rows; i++)
+    {
+        next_row = MAT_ROW(next, labels[i]);
+        point = MAT_ROW(points, i);
+        for (j = 0; j < points->cols; j++)
+        {
+            next_row[j] += point[j];
+        }
+        counts[labels[i]]++;
+    }
+    for (c = 0; c < C->rows; c++)
+    {
+        next_row = MAT_ROW(next, c);
+        for (j = 0; counts[c] > 0 && j < C->cols; j++)
+        {
+            next_row[j] /= counts[c];
+        }
+        drift[c] = sqrt(squared_euc_dis(next_row, MAT_ROW(C, c), C->cols));
+        settled += drift[c] < KMEANS_EPSILON;
+    }
+    return settled;
+}
+
+/**
+ * Moves the Hamerly bounds by the centroid drifts: the distance to the own centroid grows by
+ * at most its drift, the distance to any other by at most the largest drift of the others.
+ * @param labels: Centroid of every point
+ * @param upper: Upper bounds (n), updated
+ * @param lower: Lower bounds (n), updated
+ * @param drift: Distance every centroid moved (k)
+ * @param n: Number of points
+ * @param k: Number of centroids
+ */
+static void shift_bounds(const int* labels, double* upper, double* lower, const double* drift, int n, int k)
+{
+    int i;
+    int c;
+    int largest = 0;
+    double runner_up = 0.0;
+    for (c = 1; c < k; c++)
+    {
+        if (drift[c] > drift[largest])
+        {
+            runner_up = drift[largest];
+            largest = c;
+        }
+        else if (drift[c] > runner_up)
+        {
+            runner_up = drift[c];
+        }
+    }
+    for (i = 0; i < n; i++)
+    {
+        upper[i] += drift[labels[i]];
+        lower[i] -= (labels[i] == largest) ? runner_up : drift[largest];
+    }
+}
+
+/**
+ * Clusters the points with k-means exactly as kmeans.py does: the first k points are the
+ * starting centroids, each iteration assigns every point to its nearest centroid (the lowest
+ * index on ties) and moves every centroid to the mean of its points (to the origin if it has
+ * none), and the run stops once no centroid moved KMEANS_EPSILON or more, or after max_iter
+ * iterations. Both assignment methods produce the same centroids.
+ * @param points: Matrix of points (n*d), one point per row
+ * @param k: Number of clusters, 1 <= k <= n
+ * @param max_iter: Largest number of iterations
+ * @param method: KMEANS_LLOYD or KMEANS_HAMERLY
+ * @param labels: Optional array of n ints (may be NULL), receives the centroid of every point in the last assignment
+ * @param iterations: Optional (may be NULL), receives the number of iterations run
+ * @return: The centroids (k*d), NULL on failure
+ */
+Matrix* kmeans(const Matrix* points, int k, int max_iter, int method, int* labels, int* iterations)
+{
+    int n = points->rows;
+    int c;
+    int m;
+    int settled = 0;
+    int* scratch;
+    Matrix* C;
+    Matrix* next;
+    Matrix* swap;
+    Matrix* bounds = NULL;
+    Matrix* per_centroid;
+    if (k <= 0 || k > n || max_iter < 0)
+    {
+        printf("An Error Has Occurred\n");
+        return NULL;
+    }
+    C = matrix_create(k, points->cols);
+    next = matrix_create(k, points->cols);
+    per_centroid = matrix_create(2, k);
+    scratch = (int*)malloc(((size_t)n + (size_t)k) * sizeof(int));
+    if (method == KMEANS_HAMERLY)
+    {
+        bounds = matrix_create(2, n);
+    }
+    if (C == NULL || next == NULL || per_centroid == NULL || scratch == NULL || (method == KMEANS_HAMERLY && bounds == NULL))
+    {
+        if (scratch == NULL)
+        {
+            printf("An Error Has Occurred\n");
+        }
+        matrix_free(C);
+        matrix_free(next);
+        matrix_free(per_centroid);
+        matrix_free(bounds);
+        free(scratch);
+        return NULL;
+    }
+    for (c = 0; c < k; c++)
+    {
+        memcpy(MAT_ROW(C, c), MAT_ROW(points, c), (size_t)points->cols * sizeof(double));
+    }
+    for (m = 0; m < max_iter && settled < k; m++)
+    {
+        if (method == KMEANS_HAMERLY)
+        {
+            half_separations(C, MAT_ROW(per_centroid, 0));
+            assign_hamerly(points, C, scratch, MAT_ROW(bounds, 0), MAT_ROW(bounds, 1), MAT_ROW(per_centroid, 0), m == 0);
+        }
+        else
+        {
+            assign_lloyd(points, C, scratch);
+        }
+        settled = update_centroids(points, scratch, C, next, scratch + n, MAT_ROW(per_centroid, 1));
+        if (method == KMEANS_HAMERLY)
+        {
+            shift_bounds(scratch, MAT_ROW(bounds, 0), MAT_ROW(bounds, 1), MAT_ROW(per_centroid, 1), n, k);
+        }
+        swap = C;
+        C = next;
+        next = swap;
+    }
+    if (labels != NULL && m == 0)
+    {
+        assign_lloyd(points, C, labels);
+    }
+    else if (labels != NULL)
+    {
+        memcpy(labels, scratch, (size_t)n * sizeof(int));
+    }
+    if (iterations != NULL)
+    {
+        *iterations = m;
+    }
+    matrix_free(next);
+    matrix_free(per_centroid);
+    matrix_free(bounds);
+    free(scratch);
+    return C;
+}
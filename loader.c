@@ -0,0 +1,485 @@
+#define _POSIX_C_SOURCE 200112L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "symnmf.h"
+
+/* Number of chunks the file is split into per thread, to even out the work. */
+#define CHUNKS_PER_THREAD 4
+
+/* Longest number, in characters, handed to strtod by the slow path. */
+#define MAX_NUMBER_LEN 128
+
+/* Largest number of significant digits accumulated exactly in a double (10^15 < 2^53). */
+#define FAST_DIGITS 15
+
+/* Largest power of ten that is exactly representable as a double. */
+#define FAST_MAX_EXP 22
+
+static const double powers_of_ten[FAST_MAX_EXP + 1] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+/* A run of whole lines of the file, parsed by one thread. */
+typedef struct Chunk {
+    const char* begin;
+    const char* end;
+    long first_line;   /* 1-based number of the first line */
+    int first_row;     /* index of the first data row */
+    int rows;          /* data rows (non-blank lines) */
+    long lines;        /* all lines, including blank ones */
+    LoadError error;   /* first error of the chunk, line 0 if none */
+} Chunk;
+
+/**
+ * Records an error unless an earlier one was already recorded.
+ * @param error: Error to fill
+ * @param line: 1-based line number (0 for errors not tied to a line)
+ * @param column: 1-based field number (0 if not applicable)
+ * @param message: Description of the problem
+ */
+void load_error_set(LoadError* error, long line, int column, const char* message)
+{
+    if (error != NULL && error->message[0] == '\0')
+    {
+        error->line = line;
+        error->column = column;
+        strncpy(error->message, message, sizeof(error->message) - 1);
+        error->message[sizeof(error->message) - 1] = '\0';
+    }
+}
+
+/**
+ * Parses a decimal number occupying exactly [s, end), ignoring surrounding blanks.
+ * Numbers with at most FAST_DIGITS significant digits and a decimal exponent of at most
+ * FAST_MAX_EXP in magnitude are converted with one correctly rounded multiplication or
+ * division of two exact doubles (Clinger's fast path); everything else goes through strtod.
+ * Either way the result is the correctly rounded value strtod returns.
+ * @param s: First character of the field
+ * @param end: One past the last character of the field
+ * @param value: Receives the parsed value
+ * @return: 1 on success, 0 if the field is not a number
+ */
+static int parse_number(const char* s, const char* end, double* value)
+{
+    const char* p;
+    char buffer[MAX_NUMBER_LEN + 1];
+    char* stop;
+    double mantissa = 0.0;
+    int negative = 0;
+    int digits = 0;
+    int any_digit = 0;
+    int exponent = 0;
+    int exp_value = 0;
+    int exp_negative = 0;
+    while (s < end && (*s == ' ' || *s == '\t'))
+    {
+        s++;
+    }
+    while (end > s && (end[-1] == ' ' || end[-1] == '\t' || end[-1] == '\r'))
+    {
+        end--;
+    }
+    if (s == end)
+    {
+        return 0;
+    }
+    p = s;
+    if (*p == '-' || *p == '+')
+    {
+        negative = (*p == '-');
+        p++;
+    }
+    while (p < end && *p == '0')
+    {
+        p++;
+        any_digit = 1;
+    }
+    while (p < end && *p >= '0' && *p <= '9')
+    {
+        if (digits < FAST_DIGITS)
+        {
+            mantissa = mantissa * 10 + (*p - '0');
+        }
+        digits++;
+        any_digit = 1;
+        p++;
+    }
+    if (p < end && *p == '.')
+    {
+        p++;
+        if (digits == 0)
+        {
+            while (p < end && *p == '0')
+            {
+                exponent--;
+                any_digit = 1;
+                p++;
+            }
+        }
+        while (p < end && *p >= '0' && *p <= '9')
+        {
+            if (digits < FAST_DIGITS)
+            {
+                mantissa = mantissa * 10 + (*p - '0');
+                exponent--;
+            }
+            digits++;
+            any_digit = 1;
+            p++;
+        }
+    }
+    if (any_digit && p < end && (*p == 'e' || *p == 'E'))
+    {
+        p++;
+        if (p < end && (*p == '-' || *p == '+'))
+        {
+            exp_negative = (*p == '-');
+            p++;
+        }
+        if (p == end || *p < '0' || *p > '9')
+        {
+            return 0;
+        }
+        while (p < end && *p >= '0' && *p <= '9')
+        {
+            exp_value = (exp_value < 10000) ? exp_value * 10 + (*p - '0') : exp_value;
+            p++;
+        }
+        exponent += exp_negative ? -exp_value : exp_value;
+    }
+    if (any_digit && p == end && digits <= FAST_DIGITS && exponent >= -FAST_MAX_EXP && exponent <= FAST_MAX_EXP)
+    {
+        mantissa = (exponent < 0) ? mantissa / powers_of_ten[-exponent] : mantissa * powers_of_ten[exponent];
+        *value = negative ? -mantissa : mantissa;
+        return 1;
+    }
+    if (end - s > MAX_NUMBER_LEN || (any_digit && p != end && *p != 'x' && *p != 'X'))
+    {
+        return 0;
+    }
+    memcpy(buffer, s, (size_t)(end - s));
+    buffer[end - s] = '\0';
+    *value = strtod(buffer, &stop);
+    return stop == buffer + (end - s) && stop != buffer;
+}
+
+/**
+ * Tells whether a line holds nothing but blanks.
+ * @param s: First character of the line
+ * @param end: End of the line (its '\n' or the end of the file)
+ * @return: 1 if the line is blank
+ */
+static int blank_line(const char* s, const char* end)
+{
+    while (s < end && (*s == ' ' || *s == '\t' || *s == '\r'))
+    {
+        s++;
+    }
+    return s == end;
+}
+
+/**
+ * Counts the lines and the data rows of a chunk.
+ * @param chunk: Chunk to scan
+ */
+static void count_chunk(Chunk* chunk)
+{
+    const char* s = chunk->begin;
+    const char* eol;
+    chunk->rows = 0;
+    chunk->lines = 0;
+    while (s < chunk->end)
+    {
+        eol = (const char*)memchr(s, '\n', (size_t)(chunk->end - s));
+        eol = (eol == NULL) ? chunk->end : eol;
+        chunk->lines++;
+        chunk->rows += !blank_line(s, eol);
+        s = (eol < chunk->end) ? eol + 1 : eol;
+    }
+}
+
+/**
+ * Parses the data rows of a chunk into the matrix.
+ * @param chunk: Chunk to parse
+ * @param M: Output matrix
+ */
+static void parse_chunk(Chunk* chunk, Matrix* M)
+{
+    const char* s = chunk->begin;
+    const char* eol;
+    const char* field_end;
+    long line = chunk->first_line;
+    int row = chunk->first_row;
+    int col;
+    double* M_row;
+    for (; s < chunk->end && chunk->error.line == 0; s = (eol < chunk->end) ? eol + 1 : eol, line++)
+    {
+        eol = (const char*)memchr(s, '\n', (size_t)(chunk->end - s));
+        eol = (eol == NULL) ? chunk->end : eol;
+        if (blank_line(s, eol))
+        {
+            continue;
+        }
+        M_row = MAT_ROW(M, row);
+        for (col = 0; chunk->error.line == 0; col++)
+        {
+            field_end = (const char*)memchr(s, ',', (size_t)(eol - s));
+            field_end = (field_end == NULL) ? eol : field_end;
+            if (col >= M->cols)
+            {
+                load_error_set(&chunk->error, line, col + 1, "too many values on the line");
+            }
+            else if (!parse_number(s, field_end, &M_row[col]))
+            {
+                load_error_set(&chunk->error, line, col + 1, "not a number");
+            }
+            else if (field_end == eol)
+            {
+                col++;
+                break;
+            }
+            s = field_end + 1;
+        }
+        if (chunk->error.line == 0 && col != M->cols)
+        {
+            load_error_set(&chunk->error, line, col + 1, "too few values on the line");
+        }
+        row++;
+    }
+}
+
+/**
+ * Parses a whole CSV text of points into a matrix.
+ * The text is cut into chunks at line boundaries; the chunks are counted in parallel,
+ * assigned their first line and row by a prefix sum, and then parsed in parallel.
+ * @param text: The file contents
+ * @param size: Number of bytes
+ * @param error: Receives the first error (lowest line number) on failure
+ * @return: Pointer to the matrix, NULL on failure
+ */
+static Matrix* parse_text(const char* text, size_t size, LoadError* error)
+{
+    const char* end = text + size;
+    const char* s;
+    const char* eol;
+    int chunks = get_num_threads() * CHUNKS_PER_THREAD;
+    int c;
+    int cols = 1;
+    int rows = 0;
+    long lines = 1;
+    Chunk* chunk;
+    Matrix* M = NULL;
+    s = text;
+    while (s < end)
+    {
+        eol = (const char*)memchr(s, '\n', (size_t)(end - s));
+        eol = (eol == NULL) ? end : eol;
+        if (!blank_line(s, eol))
+        {
+            break;
+        }
+        s = eol + 1;
+    }
+    if (s >= end)
+    {
+        load_error_set(error, 0, 0, "no data");
+        return NULL;
+    }
+    for (; s < end && *s != '\n'; s++)
+    {
+        cols += (*s == ',');
+    }
+    chunks = ((size_t)chunks > size / 4096 + 1) ? (int)(size / 4096 + 1) : chunks;
+    chunk = (Chunk*)calloc((size_t)chunks, sizeof(Chunk));
+    if (chunk == NULL)
+    {
+        load_error_set(error, 0, 0, "out of memory");
+        return NULL;
+    }
+    s = text;
+    for (c = 0; c < chunks; c++)
+    {
+        chunk[c].begin = s;
+        s = (c == chunks - 1) ? end : text + size / (size_t)chunks * (size_t)(c + 1);
+        s = (s < chunk[c].begin) ? chunk[c].begin : s;
+        eol = (s < end) ? (const char*)memchr(s, '\n', (size_t)(end - s)) : NULL;
+        s = (eol == NULL) ? end : eol + 1;
+        chunk[c].end = s;
+    }
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic, 1) num_threads(get_num_threads()) if (chunks > 1)
+#endif
+    for (c = 0; c < chunks; c++)
+    {
+        count_chunk(&chunk[c]);
+    }
+    for (c = 0; c < chunks; c++)
+    {
+        chunk[c].first_line = lines;
+        chunk[c].first_row = rows;
+        lines += chunk[c].lines;
+        rows += chunk[c].rows;
+    }
+    M = matrix_create(rows, cols);
+    if (M == NULL)
+    {
+        free(chunk);
+        load_error_set(error, 0, 0, "out of memory");
+        return NULL;
+    }
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic, 1) num_threads(get_num_threads()) if (chunks > 1)
+#endif
+    for (c = 0; c < chunks; c++)
+    {
+        parse_chunk(&chunk[c], M);
+    }
+    for (c = 0; c < chunks; c++)
+    {
+        if (chunk[c].error.line != 0)
+        {
+            load_error_set(error, chunk[c].error.line, chunk[c].error.column, chunk[c].error.message);
+            matrix_free(M);
+            M = NULL;
+            break;
+        }
+    }
+    free(chunk);
+    return M;
+}
+
+/**
+ * Reads a whole stream into memory, for inputs that cannot be mapped (pipes, empty files).
+ * @param fd: Open file descriptor
+ * @param size: Receives the number of bytes read
+ * @return: malloc'ed buffer, NULL on failure
+ */
+static char* read_all(int fd, size_t* size)
+{
+    size_t capacity = 1 << 16;
+    ssize_t got;
+    char* buffer = (char*)malloc(capacity);
+    char* grown;
+    *size = 0;
+    while (buffer != NULL)
+    {
+        if (*size == capacity)
+        {
+            grown = (char*)realloc(buffer, capacity * 2);
+            if (grown == NULL)
+            {
+                break;
+            }
+            buffer = grown;
+            capacity *= 2;
+        }
+        got = read(fd, buffer + *size, capacity - *size);
+        if (got <= 0)
+        {
+            if (got == 0)
+            {
+                return buffer;
+            }
+            break;
+        }
+        *size += (size_t)got;
+    }
+    free(buffer);
+    return NULL;
+}
+
+/**
+ * Maps a whole file into memory for reading. Files that cannot be mapped (pipes, empty files)
+ * are read into a malloc'ed buffer instead.
+ * @param filename: Name of the file
+ * @param file: Receives the contents, released with file_unmap
+ * @param error: Optional, receives the reason on failure
+ * @return: 1 on success, 0 on failure
+ */
+int file_map(const char* filename, MappedFile* file, LoadError* error)
+{
+    int fd;
+    struct stat info;
+    void* mapped = MAP_FAILED;
+    file->data = NULL;
+    file->size = 0;
+    file->mapped = 0;
+    fd = open(filename, O_RDONLY);
+    if (fd < 0)
+    {
+        load_error_set(error, 0, 0, "cannot open the file");
+        return 0;
+    }
+    if (fstat(fd, &info) == 0 && S_ISREG(info.st_mode) && info.st_size > 0)
+    {
+        file->size = (size_t)info.st_size;
+        mapped = mmap(NULL, file->size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    if (mapped != MAP_FAILED)
+    {
+        file->data = (const char*)mapped;
+        file->mapped = 1;
+    }
+    else
+    {
+        file->data = read_all(fd, &file->size);
+    }
+    close(fd);
+    if (file->data == NULL)
+    {
+        load_error_set(error, 0, 0, "cannot read the file");
+        return 0;
+    }
+    return 1;
+}
+
+/**
+ * Releases the contents of a file obtained with file_map.
+ * @param file: Mapped file
+ */
+void file_unmap(MappedFile* file)
+{
+    if (file->mapped)
+    {
+        munmap((void*)file->data, file->size);
+    }
+    else
+    {
+        free((void*)file->data);
+    }
+    file->data = NULL;
+    file->size = 0;
+    file->mapped = 0;
+}
+
+/**
+ * Loads a comma separated file of points, one point per line, into a matrix in a single pass.
+ * The file is memory-mapped (or read at once if it cannot be mapped) and parsed in parallel
+ * chunks. Blank lines are skipped, the number of columns is taken from the first data line,
+ * and every value is converted to the double strtod would return.
+ * @param filename: Name of the file
+ * @param error: Optional, receives the line, field and reason of the first error on failure
+ * @return: Pointer to the matrix of points, NULL on failure
+ */
+Matrix* load_points(const char* filename, LoadError* error)
+{
+    MappedFile file;
+    Matrix* M;
+    if (error != NULL)
+    {
+        memset(error, 0, sizeof(LoadError));
+    }
+    if (!file_map(filename, &file, error))
+    {
+        return NULL;
+    }
+    M = parse_text(file.data, file.size, error);
+    file_unmap(&file);
+    return M;
+}
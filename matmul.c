@@ -0,0 +1,507 @@
+#include <stdlib.h>
+#include <string.h>
+#include "symnmf.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define GEMM_X86 1
+#include <immintrin.h>
+#endif
+
+/* Number of rows of B (columns of A) multiplied per pass, keeps the B panel in L1/L2. */
+#define GEMM_KC 256
+
+/* Number of rows of A/C handled together by a micro-kernel. */
+#define GEMM_MR 4
+
+/* Number of rows of C given to a thread at a time, a multiple of 2*GEMM_MR. */
+#define GEMM_ROWS 64
+
+/* Number of output rows handled together by the packed symmetric product. */
+#define SYMM_ROWS 128
+
+/*
+ * Every kernel computes C[i0:i1, :] += A[i0:i1, t0:t1] * B[t0:t1, :] (or the
+ * transposed-A equivalent) and adds products in increasing t order with
+ * separate multiply and add instructions. The scalar, AVX2 and AVX-512 paths
+ * therefore produce bit-identical results, and so does the original i-j-t loop,
+ * as long as the compiler does not contract them into FMAs (-ansi implies
+ * -ffp-contract=off, setup.py passes it explicitly). gemm_nn splits the rows
+ * of C between threads, which does not change any summation order.
+ */
+typedef void (*nn_kernel)(const Matrix* A, const Matrix* B, Matrix* C, int i0, int i1, int t0, int t1);
+typedef void (*tn_kernel)(const Matrix* A, const Matrix* B, Matrix* C, int t0, int t1);
+
+static int gemm_isa = -1;
+
+/**
+ * Scalar kernel for C += A * B over a block of rows and a block of t.
+ */
+static void nn_scalar(const Matrix* A, const Matrix* B, Matrix* C, int i0, int i1, int t0, int t1)
+{
+    int i;
+    int t;
+    int j;
+    int q = B->cols;
+    double a;
+    const double* A_row;
+    const double* B_row;
+    double* C_row;
+    for (i = i0; i < i1; i++)
+    {
+        A_row = MAT_ROW(A, i);
+        C_row = MAT_ROW(C, i);
+        for (t = t0; t < t1; t++)
+        {
+            a = A_row[t];
+            B_row = MAT_ROW(B, t);
+            for (j = 0; j < q; j++)
+            {
+                C_row[j] += a * B_row[j];
+            }
+        }
+    }
+}
+
+/**
+ * Scalar kernel for C += A^T * B over a block of t (rows of A and B).
+ */
+static void tn_scalar(const Matrix* A, const Matrix* B, Matrix* C, int t0, int t1)
+{
+    int t;
+    int a;
+    int j;
+    int k = A->cols;
+    int q = B->cols;
+    double alpha;
+    const double* B_row;
+    double* C_row;
+    for (t = t0; t < t1; t++)
+    {
+        B_row = MAT_ROW(B, t);
+        for (a = 0; a < k; a++)
+        {
+            alpha = MAT_AT(A, t, a);
+            C_row = MAT_ROW(C, a);
+            for (j = 0; j < q; j++)
+            {
+                C_row[j] += alpha * B_row[j];
+            }
+        }
+    }
+}
+
+#ifdef GEMM_X86
+
+/**
+ * Lane mask selecting the first `width` (0..4) lanes of a 256-bit vector of doubles.
+ */
+__attribute__((target("avx2")))
+static __m256i avx2_mask(int width)
+{
+    return _mm256_set_epi64x(width > 3 ? -1 : 0, width > 2 ? -1 : 0, width > 1 ? -1 : 0, width > 0 ? -1 : 0);
+}
+
+/**
+ * AVX2 kernel for C += A * B: tiles of GEMM_MR rows by 8 columns kept in registers,
+ * all column tiles of a row tile are done while its slice of A is in L1.
+ */
+__attribute__((target("avx2")))
+static void nn_avx2(const Matrix* A, const Matrix* B, Matrix* C, int i0, int i1, int t0, int t1)
+{
+    int i;
+    int r;
+    int t;
+    int j;
+    int q = B->cols;
+    __m256i mlo;
+    __m256i mhi;
+    __m256d c0[GEMM_MR];
+    __m256d c1[GEMM_MR];
+    __m256d b0;
+    __m256d b1;
+    __m256d a;
+    const double* B_row;
+    for (i = i0; i + GEMM_MR <= i1; i += GEMM_MR)
+    {
+        for (j = 0; j < q; j += 8)
+        {
+            mlo = avx2_mask(q - j);
+            mhi = avx2_mask(q - j - 4);
+            for (r = 0; r < GEMM_MR; r++)
+            {
+                c0[r] = _mm256_maskload_pd(MAT_ROW(C, i + r) + j, mlo);
+                c1[r] = _mm256_maskload_pd(MAT_ROW(C, i + r) + j + 4, mhi);
+            }
+            for (t = t0; t < t1; t++)
+            {
+                B_row = MAT_ROW(B, t) + j;
+                b0 = _mm256_maskload_pd(B_row, mlo);
+                b1 = _mm256_maskload_pd(B_row + 4, mhi);
+                for (r = 0; r < GEMM_MR; r++)
+                {
+                    a = _mm256_broadcast_sd(MAT_ROW(A, i + r) + t);
+                    c0[r] = _mm256_add_pd(c0[r], _mm256_mul_pd(a, b0));
+                    c1[r] = _mm256_add_pd(c1[r], _mm256_mul_pd(a, b1));
+                }
+            }
+            for (r = 0; r < GEMM_MR; r++)
+            {
+                _mm256_maskstore_pd(MAT_ROW(C, i + r) + j, mlo, c0[r]);
+                _mm256_maskstore_pd(MAT_ROW(C, i + r) + j + 4, mhi, c1[r]);
+            }
+        }
+    }
+    for (; i < i1; i++)
+    {
+        for (j = 0; j < q; j += 8)
+        {
+            mlo = avx2_mask(q - j);
+            mhi = avx2_mask(q - j - 4);
+            c0[0] = _mm256_maskload_pd(MAT_ROW(C, i) + j, mlo);
+            c1[0] = _mm256_maskload_pd(MAT_ROW(C, i) + j + 4, mhi);
+            for (t = t0; t < t1; t++)
+            {
+                B_row = MAT_ROW(B, t) + j;
+                a = _mm256_broadcast_sd(MAT_ROW(A, i) + t);
+                c0[0] = _mm256_add_pd(c0[0], _mm256_mul_pd(a, _mm256_maskload_pd(B_row, mlo)));
+                c1[0] = _mm256_add_pd(c1[0], _mm256_mul_pd(a, _mm256_maskload_pd(B_row + 4, mhi)));
+            }
+            _mm256_maskstore_pd(MAT_ROW(C, i) + j, mlo, c0[0]);
+            _mm256_maskstore_pd(MAT_ROW(C, i) + j + 4, mhi, c1[0]);
+        }
+    }
+}
+
+/**
+ * AVX2 kernel for C += A^T * B, vectorized over the columns of B.
+ */
+__attribute__((target("avx2")))
+static void tn_avx2(const Matrix* A, const Matrix* B, Matrix* C, int t0, int t1)
+{
+    int t;
+    int a;
+    int j;
+    int k = A->cols;
+    int q = B->cols;
+    __m256i m;
+    __m256d alpha;
+    __m256d b;
+    double* C_row;
+    for (t = t0; t < t1; t++)
+    {
+        for (j = 0; j < q; j += 4)
+        {
+            m = avx2_mask(q - j);
+            b = _mm256_maskload_pd(MAT_ROW(B, t) + j, m);
+            for (a = 0; a < k; a++)
+            {
+                alpha = _mm256_broadcast_sd(MAT_ROW(A, t) + a);
+                C_row = MAT_ROW(C, a) + j;
+                _mm256_maskstore_pd(C_row, m, _mm256_add_pd(_mm256_maskload_pd(C_row, m), _mm256_mul_pd(alpha, b)));
+            }
+        }
+    }
+}
+
+/**
+ * Lane mask selecting the first `width` lanes of a 512-bit vector of doubles.
+ */
+static __mmask8 avx512_mask(int width)
+{
+    return (__mmask8)(width >= 8 ? 0xff : (1 << (width > 0 ? width : 0)) - 1);
+}
+
+/**
+ * AVX-512 kernel for C += A * B: tiles of 2*GEMM_MR rows by 8 columns kept in registers.
+ */
+__attribute__((target("avx512f")))
+static void nn_avx512(const Matrix* A, const Matrix* B, Matrix* C, int i0, int i1, int t0, int t1)
+{
+    int i;
+    int r;
+    int t;
+    int j;
+    int q = B->cols;
+    __mmask8 m;
+    __m512d c[2 * GEMM_MR];
+    __m512d b;
+    __m512d a;
+    for (i = i0; i + 2 * GEMM_MR <= i1; i += 2 * GEMM_MR)
+    {
+        for (j = 0; j < q; j += 8)
+        {
+            m = avx512_mask(q - j);
+            for (r = 0; r < 2 * GEMM_MR; r++)
+            {
+                c[r] = _mm512_maskz_loadu_pd(m, MAT_ROW(C, i + r) + j);
+            }
+            for (t = t0; t < t1; t++)
+            {
+                b = _mm512_maskz_loadu_pd(m, MAT_ROW(B, t) + j);
+                for (r = 0; r < 2 * GEMM_MR; r++)
+                {
+                    a = _mm512_set1_pd(MAT_AT(A, i + r, t));
+                    c[r] = _mm512_add_pd(c[r], _mm512_mul_pd(a, b));
+                }
+            }
+            for (r = 0; r < 2 * GEMM_MR; r++)
+            {
+                _mm512_mask_storeu_pd(MAT_ROW(C, i + r) + j, m, c[r]);
+            }
+        }
+    }
+    for (; i < i1; i++)
+    {
+        for (j = 0; j < q; j += 8)
+        {
+            m = avx512_mask(q - j);
+            c[0] = _mm512_maskz_loadu_pd(m, MAT_ROW(C, i) + j);
+            for (t = t0; t < t1; t++)
+            {
+                a = _mm512_set1_pd(MAT_AT(A, i, t));
+                c[0] = _mm512_add_pd(c[0], _mm512_mul_pd(a, _mm512_maskz_loadu_pd(m, MAT_ROW(B, t) + j)));
+            }
+            _mm512_mask_storeu_pd(MAT_ROW(C, i) + j, m, c[0]);
+        }
+    }
+}
+
+/**
+ * AVX-512 kernel for C += A^T * B, vectorized over the columns of B.
+ */
+__attribute__((target("avx512f")))
+static void tn_avx512(const Matrix* A, const Matrix* B, Matrix* C, int t0, int t1)
+{
+    int t;
+    int a;
+    int j;
+    int k = A->cols;
+    int q = B->cols;
+    __mmask8 m;
+    __m512d alpha;
+    __m512d b;
+    double* C_row;
+    for (t = t0; t < t1; t++)
+    {
+        for (j = 0; j < q; j += 8)
+        {
+            m = avx512_mask(q - j);
+            b = _mm512_maskz_loadu_pd(m, MAT_ROW(B, t) + j);
+            for (a = 0; a < k; a++)
+            {
+                alpha = _mm512_set1_pd(MAT_AT(A, t, a));
+                C_row = MAT_ROW(C, a) + j;
+                _mm512_mask_storeu_pd(C_row, m, _mm512_add_pd(_mm512_maskz_loadu_pd(m, C_row), _mm512_mul_pd(alpha, b)));
+            }
+        }
+    }
+}
+
+#endif
+
+/**
+ * Picks the widest instruction set supported by the CPU, once.
+ * The SYMNMF_GEMM environment variable ("scalar", "avx2", "avx512") caps the choice.
+ */
+static int detect_isa(void)
+{
+    const char* env;
+    int isa;
+#ifdef _OPENMP
+#pragma omp atomic read
+#endif
+    isa = gemm_isa;
+    if (isa >= 0)
+    {
+        return isa;
+    }
+    isa = GEMM_ISA_SCALAR;
+#ifdef GEMM_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+    {
+        isa = GEMM_ISA_AVX2;
+    }
+    if (__builtin_cpu_supports("avx512f"))
+    {
+        isa = GEMM_ISA_AVX512;
+    }
+#endif
+    env = getenv("SYMNMF_GEMM");
+    if (env != NULL)
+    {
+        if (strcmp(env, "scalar") == 0)
+        {
+            isa = GEMM_ISA_SCALAR;
+        }
+        else if (strcmp(env, "avx2") == 0 && isa > GEMM_ISA_AVX2)
+        {
+            isa = GEMM_ISA_AVX2;
+        }
+    }
+#ifdef _OPENMP
+#pragma omp atomic write
+#endif
+    gemm_isa = isa;
+    return isa;
+}
+
+/**
+ * Returns the instruction set used by the matrix multiplication kernels.
+ * @return: One of GEMM_ISA_SCALAR, GEMM_ISA_AVX2, GEMM_ISA_AVX512
+ */
+int gemm_isa_used(void)
+{
+    return detect_isa();
+}
+
+/**
+ * Computes C = A * B, or C += A * B when accumulate is non-zero.
+ * @param A: Matrix of size n*m
+ * @param B: Matrix of size m*q
+ * @param C: Output matrix of size n*q, must not alias A or B
+ * @param accumulate: Non-zero to add to the current contents of C
+ */
+void gemm_nn(const Matrix* A, const Matrix* B, Matrix* C, int accumulate)
+{
+    int i;
+    int b;
+    int i1;
+    int t0;
+    int t1;
+    int nblocks = (A->rows + GEMM_ROWS - 1) / GEMM_ROWS;
+    nn_kernel kernel = nn_scalar;
+#ifdef GEMM_X86
+    switch (detect_isa())
+    {
+    case GEMM_ISA_AVX512:
+        kernel = nn_avx512;
+        break;
+    case GEMM_ISA_AVX2:
+        kernel = nn_avx2;
+        break;
+    default:
+        break;
+    }
+#endif
+#ifdef _OPENMP
+#pragma omp parallel for private(i, i1, t0, t1) schedule(static) num_threads(get_num_threads()) if (nblocks > 1 && (double)A->rows * A->cols * B->cols > 1e6)
+#endif
+    for (b = 0; b < nblocks; b++)
+    {
+        i1 = (b + 1) * GEMM_ROWS < A->rows ? (b + 1) * GEMM_ROWS : A->rows;
+        if (!accumulate)
+        {
+            for (i = b * GEMM_ROWS; i < i1; i++)
+            {
+                memset(MAT_ROW(C, i), 0, (size_t)C->cols * sizeof(double));
+            }
+        }
+        for (t0 = 0; t0 < A->cols; t0 += GEMM_KC)
+        {
+            t1 = (t0 + GEMM_KC < A->cols) ? t0 + GEMM_KC : A->cols;
+            kernel(A, B, C, b * GEMM_ROWS, i1, t0, t1);
+        }
+    }
+}
+
+/**
+ * Computes C = A^T * B, or C += A^T * B when accumulate is non-zero.
+ * @param A: Matrix of size m*n
+ * @param B: Matrix of size m*q
+ * @param C: Output matrix of size n*q, must not alias A or B
+ * @param accumulate: Non-zero to add to the current contents of C
+ */
+void gemm_tn(const Matrix* A, const Matrix* B, Matrix* C, int accumulate)
+{
+    int i;
+    tn_kernel kernel = tn_scalar;
+#ifdef GEMM_X86
+    switch (detect_isa())
+    {
+    case GEMM_ISA_AVX512:
+        kernel = tn_avx512;
+        break;
+    case GEMM_ISA_AVX2:
+        kernel = tn_avx2;
+        break;
+    default:
+        break;
+    }
+#endif
+    if (!accumulate)
+    {
+        for (i = 0; i < C->rows; i++)
+        {
+            memset(MAT_ROW(C, i), 0, (size_t)C->cols * sizeof(double));
+        }
+    }
+    kernel(A, B, C, 0, A->rows);
+}
+
+/**
+ * Computes out = P * H for a packed symmetric matrix P.
+ * For a block of output rows, the part of P left of the diagonal is read from the
+ * rows above (contiguous segments of each row) and the part right of it from the
+ * rows themselves, so every entry of out is summed over the columns in order and
+ * equals gemm_nn on the expanded matrix bit for bit.
+ * @param P: Packed symmetric matrix of size n*n
+ * @param H: Matrix of size n*k
+ * @param out: Output matrix of size n*k, must not alias H
+ */
+void symm_packed(const PackedMatrix* P, const Matrix* H, Matrix* out)
+{
+    int n = P->n;
+    int k = H->cols;
+    int blocks = (n + SYMM_ROWS - 1) / SYMM_ROWS;
+    int b;
+    int i;
+    int j;
+    int c;
+    int j0;
+    int j1;
+    double a;
+    const double* P_row;
+    const double* H_row;
+    double* out_row;
+#ifdef _OPENMP
+#pragma omp parallel for private(i, j, c, j0, j1, a, P_row, H_row, out_row) schedule(dynamic, 1) num_threads(get_num_threads()) if (blocks > 1 && (double)n * n * k > 1e6)
+#endif
+    for (b = 0; b < blocks; b++)
+    {
+        j0 = b * SYMM_ROWS;
+        j1 = (j0 + SYMM_ROWS < n) ? j0 + SYMM_ROWS : n;
+        for (j = j0; j < j1; j++)
+        {
+            memset(MAT_ROW(out, j), 0, (size_t)k * sizeof(double));
+        }
+        for (i = 0; i < j1 - 1; i++)
+        {
+            P_row = PACKED_ROW(P, i) - i;
+            H_row = MAT_ROW(H, i);
+            for (j = (i + 1 > j0) ? i + 1 : j0; j < j1; j++)
+            {
+                a = P_row[j];
+                out_row = MAT_ROW(out, j);
+                for (c = 0; c < k; c++)
+                {
+                    out_row[c] += a * H_row[c];
+                }
+            }
+        }
+        for (j = j0; j < j1; j++)
+        {
+            P_row = PACKED_ROW(P, j) - j;
+            out_row = MAT_ROW(out, j);
+            for (i = j; i < n; i++)
+            {
+                a = P_row[i];
+                H_row = MAT_ROW(H, i);
+                for (c = 0; c < k; c++)
+                {
+                    out_row[c] += a * H_row[c];
+                }
+            }
+        }
+    }
+}
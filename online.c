@@ -0,0 +1,329 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "symnmf.h"
+
+/* Coordinate descent sweeps, and relative size of the last step, that end the projection of a row. */
+#define PROJECT_SWEEPS 100
+#define PROJECT_TOL 1e-10
+
+/**
+ * Describes the first n rows of a matrix.
+ * @param view: Header to fill
+ * @param M: Matrix with at least n rows
+ * @param n: Number of rows
+ * @return: The filled header
+ */
+static Matrix* first_rows(Matrix* view, const Matrix* M, int n)
+{
+    return matrix_view(view, M->data, n, M->cols, M->stride);
+}
+
+/**
+ * Copies the first n rows of src into dst (same number of columns, any strides).
+ * @param src: Source matrix
+ * @param dst: Destination matrix
+ * @param n: Number of rows
+ */
+static void copy_rows(const Matrix* src, Matrix* dst, int n)
+{
+    int i;
+    for (i = 0; i < n; i++)
+    {
+        memcpy(MAT_ROW(dst, i), MAT_ROW(src, i), (size_t)src->cols * sizeof(double));
+    }
+}
+
+/**
+ * Moves the model to storage for capacity points, keeping its contents.
+ * @param model: Online model
+ * @param capacity: New capacity, at least model->n
+ * @return: 1 on success, 0 if an allocation failed (the model is left unchanged)
+ */
+static int online_reserve(OnlineModel* model, int capacity)
+{
+    Matrix* points = matrix_create(capacity, model->points->cols);
+    Matrix* H = matrix_create(capacity, model->H->cols);
+    Matrix* vectors = matrix_create(2, capacity);
+    if (points == NULL || H == NULL || vectors == NULL)
+    {
+        matrix_free(points);
+        matrix_free(H);
+        matrix_free(vectors);
+        return 0;
+    }
+    copy_rows(model->points, points, model->n);
+    copy_rows(model->H, H, model->n);
+    memcpy(MAT_ROW(vectors, 0), MAT_ROW(model->vectors, 0), (size_t)model->n * sizeof(double));
+    matrix_free(model->points);
+    matrix_free(model->H);
+    matrix_free(model->vectors);
+    model->points = points;
+    model->H = H;
+    model->vectors = vectors;
+    model->capacity = capacity;
+    return 1;
+}
+
+/**
+ * Creates an online model from a fitted factorization. The points and H are copied.
+ * @param points: Matrix of the fitted points (n*d)
+ * @param H: Fitted H (n*k)
+ * @param degrees: Degree of every point in the similarity graph (see norm_mat_packed), or NULL to compute them
+ * @param refit_every: Refit once this many points were kept, 0 to refit only on request
+ * @param options: Solver options of the refits, NULL for the defaults
+ * @return: The model, NULL on failure
+ */
+OnlineModel* online_create(const Matrix* points, const Matrix* H, const double* degrees, int refit_every, const SolverOptions* options)
+{
+    int n = points->rows;
+    Matrix view;
+    OnlineModel* model;
+    StreamGraph* stream;
+    if (H->rows != n || n <= 0 || H->cols <= 0 || refit_every < 0)
+    {
+        return NULL;
+    }
+    model = (OnlineModel*)calloc(1, sizeof(OnlineModel));
+    if (model == NULL)
+    {
+        printf("An Error Has Occurred\n");
+        return NULL;
+    }
+    model->points = matrix_create(0, points->cols);
+    model->H = matrix_create(0, H->cols);
+    model->vectors = matrix_create(2, 0);
+    model->gram = matrix_create(H->cols, H->cols);
+    model->work = matrix_create(2, H->cols);
+    model->refit_every = refit_every;
+    if (options != NULL)
+    {
+        model->options = *options;
+    }
+    else
+    {
+        solver_options_default(&model->options);
+    }
+    if (model->points == NULL || model->H == NULL || model->vectors == NULL || model->gram == NULL
+        || model->work == NULL || !online_reserve(model, n))
+    {
+        online_free(model);
+        return NULL;
+    }
+    copy_rows(points, model->points, n);
+    copy_rows(H, model->H, n);
+    model->n = n;
+    if (degrees != NULL)
+    {
+        memcpy(MAT_ROW(model->vectors, 0), degrees, (size_t)n * sizeof(double));
+    }
+    else
+    {
+        stream = stream_graph_create(first_rows(&view, model->points, n), 0, MAT_ROW(model->vectors, 0));
+        if (stream == NULL)
+        {
+            online_free(model);
+            return NULL;
+        }
+        stream_graph_free(stream);
+    }
+    gemm_tn(first_rows(&view, model->H, n), &view, model->gram, 0);
+    return model;
+}
+
+/**
+ * Frees an online model.
+ * @param model: Model to free (may be NULL)
+ */
+void online_free(OnlineModel* model)
+{
+    if (model != NULL)
+    {
+        matrix_free(model->points);
+        matrix_free(model->H);
+        matrix_free(model->vectors);
+        matrix_free(model->gram);
+        matrix_free(model->work);
+        free(model);
+    }
+}
+
+/**
+ * Finds the nonnegative h minimizing ||w - H*h|| from the normal equations G*h = H^T*w,
+ * by cyclic coordinate descent on the k coordinates of h, starting from zero.
+ * @param gram: G = H^T*H (k*k)
+ * @param target: H^T*w (k)
+ * @param h: Receives the row (k)
+ */
+static void project_row(const Matrix* gram, const double* target, double* h)
+{
+    int k = gram->cols;
+    int sweep;
+    int c;
+    int l;
+    double value;
+    double step;
+    double largest;
+    const double* G_row;
+    memset(h, 0, (size_t)k * sizeof(double));
+    for (sweep = 0; sweep < PROJECT_SWEEPS; sweep++)
+    {
+        step = 0.0;
+        largest = 0.0;
+        for (c = 0; c < k; c++)
+        {
+            G_row = MAT_ROW(gram, c);
+            if (G_row[c] <= 0.0)
+            {
+                continue;
+            }
+            value = target[c];
+            for (l = 0; l < k; l++)
+            {
+                value -= G_row[l] * h[l];
+            }
+            value = h[c] + value / G_row[c];
+            value = (value > 0.0) ? value : 0.0;
+            step = (fabs(value - h[c]) > step) ? fabs(value - h[c]) : step;
+            largest = (value > largest) ? value : largest;
+            h[c] = value;
+        }
+        if (step <= PROJECT_TOL * largest)
+        {
+            break;
+        }
+    }
+}
+
+/**
+ * Assigns a new point to a cluster without refactorizing. Its affinities a_j to the n points
+ * are normalized with the degrees of the graph that includes it, w_j = a_j / sqrt(d * (d_j + a_j))
+ * where d is the sum of the a_j, and its row of H is the nonnegative h minimizing ||w - H*h||.
+ * Points whose affinity underflowed to 0 add nothing; a point isolated from all of them
+ * (d = 0) gets h = 0 and label 0, and is never kept, since it would be a vertex without
+ * edges in the graph. With keep any other point joins the model: the degrees d_j grow by a_j, the point, d and h are
+ * appended, H^T*H is updated, and once refit_every points were kept the model refits (see
+ * online_refit). Costs O(n*(d + k)) per point, plus the refits.
+ * @param model: Online model
+ * @param point: Point of d coordinates
+ * @param keep: Nonzero to add the point to the model
+ * @param h: Optional (may be NULL), receives the row of H of the point (k)
+ * @return: The cluster of the point (largest entry of h, the first one on ties), -1 if an allocation failed
+ */
+int online_assign(OnlineModel* model, const double* point, int keep, double* h)
+{
+    int n = model->n;
+    int k = model->H->cols;
+    int j;
+    int c;
+    int l;
+    int label = 0;
+    double degree = 0.0;
+    double scale;
+    double* affinity;
+    double* degrees;
+    double* target = MAT_ROW(model->work, 0);
+    double* row = MAT_ROW(model->work, 1);
+    const double* H_row;
+    if (keep && n == model->capacity && !online_reserve(model, 2 * model->capacity))
+    {
+        return -1;
+    }
+    degrees = MAT_ROW(model->vectors, 0);
+    affinity = MAT_ROW(model->vectors, 1);
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static) num_threads(get_num_threads()) if ((double)n * model->points->cols > 1e5)
+#endif
+    for (j = 0; j < n; j++)
+    {
+        affinity[j] = exp((-0.5) * squared_euc_dis(point, MAT_ROW(model->points, j), model->points->cols));
+    }
+    for (j = 0; j < n; j++)
+    {
+        degree += affinity[j];
+    }
+    memset(target, 0, (size_t)k * sizeof(double));
+    for (j = 0; j < n; j++)
+    {
+        if (affinity[j] <= 0.0)
+        {
+            continue;
+        }
+        scale = affinity[j] / sqrt(degree * (degrees[j] + affinity[j]));
+        H_row = MAT_ROW(model->H, j);
+        for (c = 0; c < k; c++)
+        {
+            target[c] += scale * H_row[c];
+        }
+    }
+    project_row(model->gram, target, row);
+    for (c = 1; c < k; c++)
+    {
+        label = (row[c] > row[label]) ? c : label;
+    }
+    if (h != NULL)
+    {
+        memcpy(h, row, (size_t)k * sizeof(double));
+    }
+    if (!keep || degree <= 0.0)
+    {
+        return label;
+    }
+    for (j = 0; j < n; j++)
+    {
+        degrees[j] += affinity[j];
+    }
+    degrees[n] = degree;
+    memcpy(MAT_ROW(model->points, n), point, (size_t)model->points->cols * sizeof(double));
+    memcpy(MAT_ROW(model->H, n), row, (size_t)k * sizeof(double));
+    for (c = 0; c < k; c++)
+    {
+        for (l = 0; l < k; l++)
+        {
+            MAT_AT(model->gram, c, l) += row[c] * row[l];
+        }
+    }
+    model->n = n + 1;
+    model->pending++;
+    if (model->refit_every > 0 && model->pending >= model->refit_every && !online_refit(model, NULL))
+    {
+        return -1;
+    }
+    return label;
+}
+
+/**
+ * Refits the model on all its points: rebuilds the packed normalized W with exact degrees and
+ * runs the solver from the current H (a warm start), so the rows of the kept points move from
+ * their projections to the factorization of the whole graph.
+ * @param model: Online model
+ * @param result: Optional (may be NULL), receives the iteration count and the stop reason
+ * @return: 1 on success, 0 if an allocation failed (the model is left as it was, but for the degrees)
+ */
+int online_refit(OnlineModel* model, SolverResult* result)
+{
+    int n = model->n;
+    Matrix points;
+    Matrix H;
+    Graph W;
+    PackedMatrix* W_packed;
+    Workspace* ws;
+    Matrix* solved = NULL;
+    W_packed = norm_mat_packed(first_rows(&points, model->points, n), MAT_ROW(model->vectors, 0));
+    ws = workspace_create(n, model->H->cols);
+    if (W_packed != NULL && ws != NULL)
+    {
+        graph_packed(&W, W_packed);
+        solved = symnmf_solve(first_rows(&H, model->H, n), &W, ws, &model->options, result, NULL);
+    }
+    workspace_free(ws);
+    packed_free(W_packed);
+    if (solved == NULL)
+    {
+        return 0;
+    }
+    gemm_tn(&H, &H, model->gram, 0);
+    model->pending = 0;
+    return 1;
+}
@@ -0,0 +1,199 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "symnmf.h"
+
+/* Number of output rows computed together by the W*H kernel (as SYMM_ROWS in matmul.c). */
+#define SYMM_ROWS 128
+
+/* Number of rows whose degrees are accumulated together (as DEG_BLOCK in symnmf.c). */
+#define DEG_BLOCK 256
+
+/* Number of floats in one MATRIX_ALIGN sized block. */
+#define ALIGN_FLOATS ((int)(MATRIX_ALIGN / sizeof(float)))
+
+/**
+ * Creates a contiguous, row-aligned float matrix of size rows*cols initialized to zero.
+ * The header and the data share a single allocation.
+ * @param rows: Number of rows
+ * @param cols: Number of columns
+ * @return: Pointer to the allocated matrix, NULL if allocation failed
+ */
+MatrixF* matrix_f_create(int rows, int cols)
+{
+    MatrixF* M;
+    char* block;
+    size_t offset;
+    size_t bytes;
+    int stride;
+    if (rows < 0 || cols < 0)
+    {
+        printf("An Error Has Occurred\n");
+        return NULL;
+    }
+    stride = ((cols + ALIGN_FLOATS - 1) / ALIGN_FLOATS) * ALIGN_FLOATS;
+    if (stride > 0 && (size_t)rows > ((size_t)-1 - 2 * MATRIX_ALIGN) / sizeof(float) / (size_t)stride)
+    {
+        printf("An Error Has Occurred\n");
+        return NULL;
+    }
+    bytes = (size_t)rows * (size_t)stride * sizeof(float);
+    block = (char*)calloc(1, sizeof(MatrixF) + MATRIX_ALIGN + bytes);
+    if (block == NULL)
+    {
+        printf("An Error Has Occurred\n");
+        return NULL;
+    }
+    matrix_add_bytes(sizeof(MatrixF) + MATRIX_ALIGN + bytes);
+    offset = sizeof(MatrixF) + MATRIX_ALIGN - 1;
+    offset -= ((size_t)block + offset) % MATRIX_ALIGN;
+    M = (MatrixF*)block;
+    M->data = (float*)(block + offset);
+    M->rows = rows;
+    M->cols = cols;
+    M->stride = stride;
+    return M;
+}
+
+/**
+ * Frees a float matrix allocated with matrix_f_create.
+ * @param M: Pointer to the matrix to free (may be NULL)
+ */
+void matrix_f_free(MatrixF* M)
+{
+    free(M);
+}
+
+/**
+ * Fills a caller-provided MatrixF header describing existing memory (see matrix_view).
+ * @param view: Header to fill
+ * @param data: Pointer to the first element
+ * @param rows: Number of rows
+ * @param cols: Number of columns
+ * @param stride: Distance in floats between consecutive rows
+ * @return: The filled header
+ */
+MatrixF* matrix_f_view(MatrixF* view, float* data, int rows, int cols, int stride)
+{
+    view->data = data;
+    view->rows = rows;
+    view->cols = cols;
+    view->stride = stride;
+    return view;
+}
+
+/**
+ * Creates a packed symmetric float n*n matrix initialized to zero (see packed_create).
+ * @param n: Number of rows and columns
+ * @return: Pointer to the allocated matrix, NULL if allocation failed
+ */
+PackedMatrixF* packed_f_create(int n)
+{
+    PackedMatrixF* P;
+    char* block;
+    size_t offset;
+    size_t count;
+    if (n < 0)
+    {
+        printf("An Error Has Occurred\n");
+        return NULL;
+    }
+    if (n > 0 && (size_t)n / 2 + 1 > ((size_t)-1 - 2 * MATRIX_ALIGN) / sizeof(float) / (size_t)n)
+    {
+        printf("An Error Has Occurred\n");
+        return NULL;
+    }
+    count = (size_t)n * ((size_t)n + 1) / 2;
+    block = (char*)calloc(1, sizeof(PackedMatrixF) + MATRIX_ALIGN + count * sizeof(float));
+    if (block == NULL)
+    {
+        printf("An Error Has Occurred\n");
+        return NULL;
+    }
+    matrix_add_bytes(sizeof(PackedMatrixF) + MATRIX_ALIGN + count * sizeof(float));
+    offset = sizeof(PackedMatrixF) + MATRIX_ALIGN - 1;
+    offset -= ((size_t)block + offset) % MATRIX_ALIGN;
+    P = (PackedMatrixF*)block;
+    P->data = (float*)(block + offset);
+    P->n = n;
+    return P;
+}
+
+/**
+ * Frees a packed float matrix allocated with packed_f_create.
+ * @param P: Pointer to the matrix to free (may be NULL)
+ */
+void packed_f_free(PackedMatrixF* P)
+{
+    free(P);
+}
+
+/**
+ * Computes the average entry of a packed float matrix, summed in double in the order
+ * graph_entry_avg sums a packed double matrix.
+ * @param P: Packed symmetric matrix
+ * @return: Average of the n*n entries
+ */
+double packed_f_entry_avg(const PackedMatrixF* P)
+{
+    int i;
+    int j;
+    double sum = 0.0;
+    const float* P_row;
+    for (i = 0; i < P->n; i++)
+    {
+        for (j = 0; j < i; j++)
+        {
+            sum += PACKED_ROW(P, j)[i - j];
+        }
+        P_row = PACKED_ROW(P, i);
+        for (j = 0; j < P->n - i; j++)
+        {
+            sum += P_row[j];
+        }
+    }
+    return sum / ((double)P->n * P->n);
+}
+
+/**
+ * Computes the squared Frobenius norm of a packed float matrix, in double.
+ * @param P: Packed symmetric matrix
+ * @return: Sum of the squares of the n*n entries
+ */
+double packed_f_squared_norm(const PackedMatrixF* P)
+{
+    int i;
+    int j;
+    double diagonal = 0.0;
+    double off = 0.0;
+    const float* P_row;
+    for (i = 0; i < P->n; i++)
+    {
+        P_row = PACKED_ROW(P, i);
+        diagonal += (double)P_row[0] * P_row[0];
+        for (j = 1; j < P->n - i; j++)
+        {
+            off += (double)P_row[j] * P_row[j];
+        }
+    }
+    return diagonal + 2 * off;
+}
+
+/* Single precision: float points, float H, float sums. */
+#define ACC float
+#define ACC_MATRIX MatrixF
+#define ACC_CREATE matrix_f_create
+#define ACC_FREE matrix_f_free
+#define ACC_COLS 8
+#define PRECISION(name) name##_f32
+#include "precision_template.h"
+
+/* Mixed precision: float W, double points, double H, double sums. */
+#define ACC double
+#define ACC_MATRIX Matrix
+#define ACC_CREATE matrix_create
+#define ACC_FREE matrix_free
+#define ACC_COLS 4
+#define PRECISION(name) name##_mixed
+#include "precision_template.h"
@@ -0,0 +1,453 @@
+/*
+ * SymNMF kernels for a reduced-precision W, compiled once per precision by precision.c.
+ * W is always stored as float (half the memory and twice the SIMD width of double);
+ * the points, H and every accumulation use the type ACC. The includer defines:
+ *
+ *   ACC               float (single precision) or double (mixed precision)
+ *   ACC_MATRIX        matrix type whose elements are ACC (MatrixF or Matrix)
+ *   ACC_CREATE        allocator of ACC_MATRIX (matrix_f_create or matrix_create)
+ *   ACC_FREE          deallocator of ACC_MATRIX
+ *   ACC_COLS          columns of H the W*H kernel keeps in local accumulators (32 bytes
+ *                     of ACC); must divide the row stride of ACC_MATRIX
+ *   PRECISION(name)   name with the precision suffix appended
+ *
+ * Every parameter is undefined again at the end of this file.
+ */
+
+/**
+ * Computes the similarity matrix of the points in packed float storage.
+ * Distances are accumulated in ACC, each pair is evaluated once and stored once.
+ * @param points: Matrix of points, one point per row
+ * @return: Pointer to the packed similarity matrix, NULL on failure
+ */
+PackedMatrixF* PRECISION(sym_mat_packed)(const ACC_MATRIX* points)
+{
+    int i;
+    int j;
+    int c;
+    int n = points->rows;
+    int dim = points->cols;
+    ACC dist;
+    ACC diff;
+    const ACC* p_i;
+    const ACC* p_j;
+    float* A_row;
+    PackedMatrixF* A = packed_f_create(n);
+    if (A == NULL)
+    {
+        return NULL;
+    }
+#ifdef _OPENMP
+#pragma omp parallel for private(j, c, dist, diff, p_i, p_j, A_row) schedule(dynamic, 16) num_threads(get_num_threads()) if (n > 64)
+#endif
+    for (i = 0; i < n; i++)
+    {
+        A_row = PACKED_ROW(A, i);
+        p_i = MAT_ROW(points, i);
+        for (j = i + 1; j < n; j++)
+        {
+            p_j = MAT_ROW(points, j);
+            dist = 0;
+            for (c = 0; c < dim; c++)
+            {
+                diff = p_i[c] - p_j[c];
+                dist += diff * diff;
+            }
+            A_row[j - i] = (float)exp((-0.5) * (double)dist);
+        }
+    }
+    return A;
+}
+
+/**
+ * Computes the row sums of a packed float matrix in ACC, in the blocked order of
+ * packed_row_sums, so the result does not depend on the number of threads.
+ * @param P: Packed symmetric matrix
+ * @param sums: Output array of n values
+ */
+static void PRECISION(row_sums)(const PackedMatrixF* P, ACC* sums)
+{
+    int n = P->n;
+    int blocks = (n + DEG_BLOCK - 1) / DEG_BLOCK;
+    int b;
+    int i;
+    int j;
+    int j0;
+    int j1;
+    const float* P_row;
+#ifdef _OPENMP
+#pragma omp parallel for private(i, j, j0, j1, P_row) schedule(dynamic, 1) num_threads(get_num_threads()) if (n > DEG_BLOCK)
+#endif
+    for (b = 0; b < blocks; b++)
+    {
+        j0 = b * DEG_BLOCK;
+        j1 = (j0 + DEG_BLOCK < n) ? j0 + DEG_BLOCK : n;
+        for (j = j0; j < j1; j++)
+        {
+            sums[j] = 0;
+        }
+        for (i = 0; i < j1 - 1; i++)
+        {
+            P_row = PACKED_ROW(P, i) - i;
+            for (j = (i + 1 > j0) ? i + 1 : j0; j < j1; j++)
+            {
+                sums[j] += P_row[j];
+            }
+        }
+        for (j = j0; j < j1; j++)
+        {
+            P_row = PACKED_ROW(P, j) - j;
+            for (i = j; i < n; i++)
+            {
+                sums[j] += P_row[i];
+            }
+        }
+    }
+}
+
+/**
+ * Computes the normalized similarity matrix W = D^-1/2 * A * D^-1/2 in packed float storage.
+ * Degrees and scale factors are computed in ACC, the entries are rounded to float once.
+ * @param points: Matrix of points, one point per row
+ * @return: Pointer to the packed normalized matrix, NULL on failure
+ */
+PackedMatrixF* PRECISION(norm_mat_packed)(const ACC_MATRIX* points)
+{
+    int n = points->rows;
+    int i;
+    int j;
+    ACC rev_sqr_i;
+    ACC* rev_sqr;
+    float* W_row;
+    PackedMatrixF* W = PRECISION(sym_mat_packed)(points);
+    if (W == NULL)
+    {
+        return NULL;
+    }
+    rev_sqr = (ACC*)malloc(((size_t)n + 1) * sizeof(ACC));
+    if (rev_sqr == NULL)
+    {
+        printf("An Error Has Occurred\n");
+        packed_f_free(W);
+        return NULL;
+    }
+    PRECISION(row_sums)(W, rev_sqr);
+    for (i = 0; i < n; i++)
+    {
+        rev_sqr[i] = (ACC)(1 / sqrt((double)rev_sqr[i]));
+    }
+#ifdef _OPENMP
+#pragma omp parallel for private(j, rev_sqr_i, W_row) schedule(dynamic, 64) num_threads(get_num_threads()) if (n > 256)
+#endif
+    for (i = 0; i < n; i++)
+    {
+        W_row = PACKED_ROW(W, i) - i;
+        rev_sqr_i = rev_sqr[i];
+        for (j = i; j < n; j++)
+        {
+            W_row[j] = (float)((rev_sqr_i * W_row[j]) * rev_sqr[j]);
+        }
+    }
+    free(rev_sqr);
+    return W;
+}
+
+/**
+ * Computes out = W * H for a packed float W, accumulating in ACC (see symm_packed).
+ * Columns are processed ACC_COLS at a time through local copies of the H row and of the
+ * output row, so that the float pointers, which may alias, are not reloaded, and the inner
+ * loop has a fixed trip count the compiler vectorizes. Every entry is summed in the same
+ * order as symm_packed.
+ * @param P: Packed symmetric matrix (n*n)
+ * @param H: Matrix (n*k) from ACC_CREATE, whose row padding is zero, so whole groups of
+ *           ACC_COLS columns can be read
+ * @param out: Output matrix (n*k) from ACC_CREATE, must not overlap H
+ */
+static void PRECISION(symm)(const PackedMatrixF* P, const ACC_MATRIX* H, ACC_MATRIX* out)
+{
+    int n = P->n;
+    int k = H->cols;
+    int blocks = (n + SYMM_ROWS - 1) / SYMM_ROWS;
+    int b;
+    int i;
+    int j;
+    int c;
+    int c0;
+    int j0;
+    int j1;
+    ACC a;
+    ACC local[ACC_COLS];
+    const float* P_row;
+    const ACC* H_row;
+    ACC* out_row;
+#ifdef _OPENMP
+#pragma omp parallel for private(i, j, c, c0, j0, j1, a, local, P_row, H_row, out_row) schedule(dynamic, 1) num_threads(get_num_threads()) if (blocks > 1 && (double)n * n * k > 1e6)
+#endif
+    for (b = 0; b < blocks; b++)
+    {
+        j0 = b * SYMM_ROWS;
+        j1 = (j0 + SYMM_ROWS < n) ? j0 + SYMM_ROWS : n;
+        for (j = j0; j < j1; j++)
+        {
+            memset(MAT_ROW(out, j), 0, (size_t)out->stride * sizeof(ACC));
+        }
+        for (c0 = 0; c0 < k; c0 += ACC_COLS)
+        {
+            for (i = 0; i < j1 - 1; i++)
+            {
+                P_row = PACKED_ROW(P, i) - i;
+                memcpy(local, MAT_ROW(H, i) + c0, sizeof(local));
+                for (j = (i + 1 > j0) ? i + 1 : j0; j < j1; j++)
+                {
+                    a = P_row[j];
+                    out_row = MAT_ROW(out, j) + c0;
+                    for (c = 0; c < ACC_COLS; c++)
+                    {
+                        out_row[c] += a * local[c];
+                    }
+                }
+            }
+            for (j = j0; j < j1; j++)
+            {
+                P_row = PACKED_ROW(P, j) - j;
+                out_row = MAT_ROW(out, j) + c0;
+                memcpy(local, out_row, sizeof(local));
+                for (i = j; i < n; i++)
+                {
+                    a = P_row[i];
+                    H_row = MAT_ROW(H, i) + c0;
+                    for (c = 0; c < ACC_COLS; c++)
+                    {
+                        local[c] += a * H_row[c];
+                    }
+                }
+                memcpy(out_row, local, sizeof(local));
+            }
+        }
+    }
+}
+
+/**
+ * Computes the Gram matrix G = H^T * H, row by row of H.
+ * @param H: Matrix (n*k)
+ * @param G: Output matrix (k*k)
+ */
+static void PRECISION(gram)(const ACC_MATRIX* H, ACC_MATRIX* G)
+{
+    int i;
+    int c;
+    int d;
+    const ACC* H_row;
+    ACC* G_row;
+    for (c = 0; c < G->rows; c++)
+    {
+        memset(MAT_ROW(G, c), 0, (size_t)G->cols * sizeof(ACC));
+    }
+    for (i = 0; i < H->rows; i++)
+    {
+        H_row = MAT_ROW(H, i);
+        for (c = 0; c < H->cols; c++)
+        {
+            G_row = MAT_ROW(G, c);
+            for (d = c; d < H->cols; d++)
+            {
+                G_row[d] += H_row[c] * H_row[d];
+            }
+        }
+    }
+    for (c = 0; c < G->rows; c++)
+    {
+        for (d = 0; d < c; d++)
+        {
+            MAT_AT(G, c, d) = MAT_AT(G, d, c);
+        }
+    }
+}
+
+/**
+ * Applies one multiplicative update H = old_H * (1/2 + 1/2 * (W*old_H) / (old_H*G)), forming
+ * each row of old_H*G on the fly. The squared change of every row is stored in moved and,
+ * when cross is given, every row of the trace tr(old_H^T * W * old_H) in cross; the caller
+ * sums them in row order, so the result does not depend on the number of threads.
+ * @param H: Matrix H (n*k), receives the updated values
+ * @param old_H: Previous H (n*k)
+ * @param WH: W*old_H (n*k)
+ * @param G: old_H^T*old_H (k*k)
+ * @param moved: Output array of n values
+ * @param cross: Optional output array of n values (may be NULL)
+ */
+static void PRECISION(mu_update)(ACC_MATRIX* H, const ACC_MATRIX* old_H, const ACC_MATRIX* WH, const ACC_MATRIX* G, double* moved, double* cross)
+{
+    int n = H->rows;
+    int k = H->cols;
+    int i;
+    int c;
+    int d;
+    ACC denominator;
+    ACC diff;
+    double row_moved;
+    double row_cross;
+    const ACC* old_row;
+    const ACC* WH_row;
+    ACC* H_row;
+#ifdef _OPENMP
+#pragma omp parallel for private(c, d, denominator, diff, row_moved, row_cross, old_row, WH_row, H_row) schedule(static) num_threads(get_num_threads()) if ((double)n * k * k > 1e5)
+#endif
+    for (i = 0; i < n; i++)
+    {
+        H_row = MAT_ROW(H, i);
+        old_row = MAT_ROW(old_H, i);
+        WH_row = MAT_ROW(WH, i);
+        row_moved = 0.0;
+        row_cross = 0.0;
+        for (c = 0; c < k; c++)
+        {
+            denominator = 0;
+            for (d = 0; d < k; d++)
+            {
+                denominator += old_row[d] * MAT_AT(G, d, c);
+            }
+            H_row[c] = old_row[c] * ((ACC)0.5 + (ACC)0.5 * (WH_row[c] / denominator));
+            diff = H_row[c] - old_row[c];
+            row_moved += (double)diff * diff;
+            row_cross += (double)old_row[c] * WH_row[c];
+        }
+        moved[i] = row_moved;
+        if (cross != NULL)
+        {
+            cross[i] = row_cross;
+        }
+    }
+}
+
+/**
+ * Fills H like init_H: entries drawn uniformly from [0, 2 * sqrt(m / k)), where m is the
+ * average entry of W (summed in double), from the same generator stream as init_H.
+ * @param W: Packed float W (n*n)
+ * @param H: Output matrix of size n*k
+ * @param seed: Seed of the generator
+ * @return: H
+ */
+ACC_MATRIX* PRECISION(init_H)(const PackedMatrixF* W, ACC_MATRIX* H, unsigned long seed)
+{
+    int i;
+    int j;
+    double bound = 2 * sqrt(packed_f_entry_avg(W) / H->cols);
+    Mt19937 rng;
+    mt_seed(&rng, seed);
+    for (i = 0; i < H->rows; i++)
+    {
+        for (j = 0; j < H->cols; j++)
+        {
+            MAT_AT(H, i, j) = (ACC)(0.0 + bound * mt_uniform(&rng));
+        }
+    }
+    return H;
+}
+
+/**
+ * Runs the damped multiplicative update of calcul against a packed float W, with the
+ * stopping criteria of options (see SolverOptions). Only SOLVER_MU is available here.
+ * The objective for rel_obj is formed from the products the update already computes.
+ * @param H: Matrix H (n*k), updated in place
+ * @param W: Packed float W (n*n)
+ * @param options: Stopping criteria, NULL for the defaults
+ * @param result: Optional (may be NULL), receives the iteration count and the stop reason
+ * @return: H, or NULL if an allocation failed, the sizes disagree or the solver is not SOLVER_MU
+ */
+ACC_MATRIX* PRECISION(symnmf_solve)(ACC_MATRIX* H, const PackedMatrixF* W, const SolverOptions* options, SolverResult* result)
+{
+    int n = H->rows;
+    int k = H->cols;
+    int i;
+    int m;
+    double moved;
+    double objective;
+    double previous = 0.0;
+    double w_sq;
+    double* rows;
+    ACC_MATRIX* old_H;
+    ACC_MATRIX* WH;
+    ACC_MATRIX* G;
+    SolverOptions defaults;
+    SolverResult local;
+    options = (options == NULL) ? solver_options_default(&defaults) : options;
+    result = (result == NULL) ? &local : result;
+    result->start = 0;
+    result->iterations = 0;
+    result->stop = STOP_MAX_ITER;
+    result->delta = 0.0;
+    if (W->n != n || options->solver != SOLVER_MU)
+    {
+        return NULL;
+    }
+    w_sq = packed_f_squared_norm(W);
+    old_H = ACC_CREATE(n, k);
+    WH = ACC_CREATE(n, k);
+    G = ACC_CREATE(k, k);
+    rows = (double*)malloc(2 * ((size_t)n + 1) * sizeof(double));
+    if (old_H == NULL || WH == NULL || G == NULL || rows == NULL)
+    {
+        ACC_FREE(old_H);
+        ACC_FREE(WH);
+        ACC_FREE(G);
+        free(rows);
+        return NULL;
+    }
+    for (m = 0; m < options->max_iter; m++)
+    {
+        for (i = 0; i < n; i++)
+        {
+            memcpy(MAT_ROW(old_H, i), MAT_ROW(H, i), (size_t)k * sizeof(ACC));
+        }
+        PRECISION(symm)(W, old_H, WH);
+        PRECISION(gram)(old_H, G);
+        PRECISION(mu_update)(H, old_H, WH, G, rows, (options->rel_obj > 0) ? rows + n : NULL);
+        if (options->rel_obj > 0)
+        {
+            objective = w_sq;
+            for (i = 0; i < n; i++)
+            {
+                objective -= 2 * rows[n + i];
+            }
+            for (i = 0; i < k * k; i++)
+            {
+                objective += (double)MAT_AT(G, i / k, i % k) * MAT_AT(G, i / k, i % k);
+            }
+            if (m > 0 && fabs(previous - objective) <= options->rel_obj * fabs(previous))
+            {
+                for (i = 0; i < n; i++)
+                {
+                    memcpy(MAT_ROW(H, i), MAT_ROW(old_H, i), (size_t)k * sizeof(ACC));
+                }
+                result->stop = STOP_OBJECTIVE;
+                break;
+            }
+            previous = objective;
+        }
+        result->iterations = m + 1;
+        moved = 0.0;
+        for (i = 0; i < n; i++)
+        {
+            moved += rows[i];
+        }
+        result->delta = sqrt(moved);
+        if (moved < options->tol)
+        {
+            result->stop = STOP_TOLERANCE;
+            break;
+        }
+    }
+    ACC_FREE(old_H);
+    ACC_FREE(WH);
+    ACC_FREE(G);
+    free(rows);
+    return H;
+}
+
+#undef ACC
+#undef ACC_MATRIX
+#undef ACC_CREATE
+#undef ACC_FREE
+#undef ACC_COLS
+#undef PRECISION
@@ -0,0 +1,114 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include "symnmf.h"
+
+#define MT_M 397
+#define MT_MATRIX_A 0x9908b0dfUL
+#define MT_UPPER_MASK 0x80000000UL
+#define MT_LOWER_MASK 0x7fffffffUL
+#define MT_WORD 0xffffffffUL
+
+/**
+ * Seeds a Mersenne Twister with a 32-bit integer (init_genrand), as numpy.random.seed(seed) does.
+ * @param rng: Generator state to initialize
+ * @param seed: Seed, only the low 32 bits are used
+ */
+void mt_seed(Mt19937* rng, unsigned long seed)
+{
+    int i;
+    rng->state[0] = seed & MT_WORD;
+    for (i = 1; i < MT_N; i++)
+    {
+        rng->state[i] = (1812433253UL * (rng->state[i - 1] ^ (rng->state[i - 1] >> 30)) + (unsigned long)i) & MT_WORD;
+    }
+    rng->pos = MT_N;
+}
+
+/**
+ * Regenerates the MT_N words of the state.
+ * @param rng: Generator state
+ */
+static void mt_twist(Mt19937* rng)
+{
+    int i;
+    unsigned long y;
+    unsigned long* mt = rng->state;
+    for (i = 0; i < MT_N; i++)
+    {
+        y = (mt[i] & MT_UPPER_MASK) | (mt[(i + 1) % MT_N] & MT_LOWER_MASK);
+        mt[i] = mt[(i + MT_M) % MT_N] ^ (y >> 1) ^ ((y & 1UL) ? MT_MATRIX_A : 0UL);
+    }
+    rng->pos = 0;
+}
+
+/**
+ * Returns the next 32-bit output of the generator.
+ * @param rng: Generator state
+ * @return: Value in [0, 2^32)
+ */
+static unsigned long mt_next(Mt19937* rng)
+{
+    unsigned long y;
+    if (rng->pos >= MT_N)
+    {
+        mt_twist(rng);
+    }
+    y = rng->state[rng->pos++];
+    y ^= (y >> 11);
+    y ^= (y << 7) & 0x9d2c5680UL;
+    y ^= (y << 15) & 0xefc60000UL;
+    y ^= (y >> 18);
+    return y & MT_WORD;
+}
+
+/**
+ * Returns a double uniformly distributed in [0, 1) with 53 random bits,
+ * the same value numpy.random.random_sample draws from the same state.
+ * @param rng: Generator state
+ * @return: Value in [0, 1)
+ */
+double mt_uniform(Mt19937* rng)
+{
+    unsigned long a = mt_next(rng) >> 5;
+    unsigned long b = mt_next(rng) >> 6;
+    return ((double)a * 67108864.0 + (double)b) / 9007199254740992.0;
+}
+
+/**
+ * Fills H with the SymNMF starting point: entries drawn uniformly from [0, 2 * sqrt(m / k)),
+ * where m is the average entry of W, in row-major order. With the same seed this is the
+ * matrix np.random.seed(seed); np.random.uniform(0, 2 * np.sqrt(m / k), (n, k)) returns.
+ * @param W: Graph operand for W (n*n)
+ * @param H: Output matrix of size n*k
+ * @param seed: Seed of the generator
+ * @return: H
+ */
+Matrix* init_H(const Graph* W, Matrix* H, unsigned long seed)
+{
+    return init_H_from_avg(graph_entry_avg(W), H, seed);
+}
+
+/**
+ * Fills H like init_H from a precomputed average entry of W.
+ * @param avg: Average entry of W
+ * @param H: Output matrix of size n*k
+ * @param seed: Seed of the generator
+ * @return: H
+ */
+Matrix* init_H_from_avg(double avg, Matrix* H, unsigned long seed)
+{
+    int i;
+    int j;
+    double bound = 2 * sqrt(avg / H->cols);
+    Mt19937 rng;
+    mt_seed(&rng, seed);
+    for (i = 0; i < H->rows; i++)
+    {
+        for (j = 0; j < H->cols; j++)
+        {
+            MAT_AT(H, i, j) = 0.0 + bound * mt_uniform(&rng);
+        }
+    }
+    return H;
+}
@@ -1,6 +1,11 @@
 from setuptools import Extension, setup
 
-module = Extension('mysymnmf', sources=['symnmfmodule.c', 'symnmf.c'])
+module = Extension('mysymnmf',
+                   sources=['symnmfmodule.c', 'symnmf.c', 'matmul.c', 'sparse.c', 'stream.c', 'rng.c', 'batch.c', 'loader.c', 'binfile.c', 'writer.c', 'solver.c', 'precision.c', 'stats.c', 'kmeans.c', 'evaluate.c', 'online.c'],
+                   depends=['symnmf.h', 'precision_template.h'],
+                   define_macros=[('SYMNMF_NO_MAIN', None)],
+                   extra_compile_args=['-ffp-contract=off', '-fopenmp'],
+                   extra_link_args=['-fopenmp'])
  
 setup(name='mysymnmf',
      version='1.0',
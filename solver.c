@@ -0,0 +1,490 @@
+#define _POSIX_C_SOURCE 199309L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <math.h>
+#include "symnmf.h"
+
+/**
+ * Returns a monotonic time stamp.
+ * @return: Seconds since an arbitrary point
+ */
+static double wall_time(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+/**
+ * Fills options with the defaults: the multiplicative update, tol = EPSILON,
+ * max_iter = MAXITER, no objective criterion and no checkpoints.
+ * @param options: Options to fill
+ * @return: options
+ */
+SolverOptions* solver_options_default(SolverOptions* options)
+{
+    options->solver = SOLVER_MU;
+    options->tol = EPSILON;
+    options->max_iter = MAXITER;
+    options->rel_obj = 0.0;
+    options->checkpoint_every = 0;
+    options->checkpoint = NULL;
+    return options;
+}
+
+/**
+ * Fills a state for a fresh start of a solver (iteration 0, V started from H).
+ * @param state: State to fill
+ * @param solver: SOLVER_MU or SOLVER_HALS
+ * @return: state
+ */
+SolverState* solver_state_init(SolverState* state, int solver)
+{
+    state->solver = solver;
+    state->iteration = 0;
+    state->previous = 0.0;
+    state->V = NULL;
+    return state;
+}
+
+/**
+ * Allocates a trace with room for capacity iterations.
+ * @param capacity: Largest number of iterations to record (the max_iter of the solve)
+ * @return: Pointer to the trace, NULL if allocation failed
+ */
+SolverTrace* trace_create(int capacity)
+{
+    SolverTrace* trace = (SolverTrace*)calloc(1, sizeof(SolverTrace));
+    if (trace == NULL)
+    {
+        printf("An Error Has Occurred\n");
+        return NULL;
+    }
+    trace->capacity = capacity;
+    trace->objective = (double*)calloc((size_t)capacity + 1, sizeof(double));
+    trace->seconds = (double*)calloc((size_t)capacity + 1, sizeof(double));
+    if (trace->objective == NULL || trace->seconds == NULL)
+    {
+        printf("An Error Has Occurred\n");
+        trace_free(trace);
+        return NULL;
+    }
+    return trace;
+}
+
+/**
+ * Frees a trace created with trace_create.
+ * @param trace: Trace to free (may be NULL)
+ */
+void trace_free(SolverTrace* trace)
+{
+    if (trace != NULL)
+    {
+        free(trace->objective);
+        free(trace->seconds);
+        free(trace);
+    }
+}
+
+/**
+ * Copies src into dst (same size, any strides).
+ * @param src: Source matrix
+ * @param dst: Destination matrix
+ */
+static void copy_matrix(const Matrix* src, Matrix* dst)
+{
+    int i;
+    for (i = 0; i < src->rows; i++)
+    {
+        memcpy(MAT_ROW(dst, i), MAT_ROW(src, i), (size_t)src->cols * sizeof(double));
+    }
+}
+
+/**
+ * Tells whether the objective went from previous to current by less than rel_obj of previous.
+ * @param previous: Objective before the iteration
+ * @param current: Objective after the iteration
+ * @param rel_obj: Relative threshold, 0 to disable
+ * @return: 1 if the objective criterion stops the solve
+ */
+static int objective_stalled(double previous, double current, double rel_obj)
+{
+    return rel_obj > 0 && fabs(previous - current) <= rel_obj * fabs(previous);
+}
+
+/**
+ * Tells whether a solve evaluates the objective every iteration: for rel_obj, for a trace,
+ * and for checkpoints, which record it so that a resumed rel_obj compares the same values.
+ * @param options: Stopping criteria and checkpoints
+ * @param trace: Optional trace (may be NULL)
+ * @return: 1 if the objective is evaluated
+ */
+static int tracks_objective(const SolverOptions* options, const SolverTrace* trace)
+{
+    return trace != NULL || options->rel_obj > 0 || (options->checkpoint_every > 0 && options->checkpoint != NULL);
+}
+
+/**
+ * Writes a checkpoint if the iteration the state reached is a multiple of checkpoint_every.
+ * @param H: Current iterate
+ * @param V: Second factor of HALS, NULL for the multiplicative update
+ * @param options: Checkpoint settings
+ * @param state: Where the solve stands
+ * @return: 1 on success or if no checkpoint was due, 0 if it could not be written
+ */
+static int write_checkpoint(const Matrix* H, Matrix* V, const SolverOptions* options, const SolverState* state)
+{
+    SolverState saved;
+    if (options->checkpoint_every <= 0 || options->checkpoint == NULL || state->iteration % options->checkpoint_every != 0)
+    {
+        return 1;
+    }
+    saved = *state;
+    saved.V = V;
+    if (!checkpoint_save(options->checkpoint, H, &saved))
+    {
+        printf("An Error Has Occurred\n");
+        return 0;
+    }
+    return 1;
+}
+
+/**
+ * Runs the damped multiplicative update (see mu_update) from the iteration of the state.
+ * When the objective is needed (see tracks_objective), the objective of the iterate each
+ * iteration starts from is computed from the product W*H the update needs anyway; a trace
+ * takes one extra product for the final iterate.
+ * @param H: Matrix H (n*k), updated in place
+ * @param W: Graph operand for W (n*n)
+ * @param ws: Workspace created for the size of H
+ * @param options: Stopping criteria and checkpoints
+ * @param state: Where the solve starts, updated as it goes
+ * @param result: Receives the number of iterations and the reason for stopping
+ * @param trace: Optional trace to fill (may be NULL)
+ * @param w_sq: Squared Frobenius norm of W, used only for the objective
+ * @return: 1 on success, 0 if a checkpoint could not be written
+ */
+static int run_mu(Matrix* H, const Graph* W, Workspace* ws, const SolverOptions* options, SolverState* state, SolverResult* result, SolverTrace* trace, double w_sq)
+{
+    int m;
+    int t;
+    int first = state->iteration;
+    int track = tracks_objective(options, trace);
+    double start = 0.0;
+    double excluded;
+    double objective;
+    for (m = first; m < options->max_iter; m++)
+    {
+        t = m - first;
+        start = (trace != NULL) ? wall_time() : 0.0;
+        copy_matrix(H, ws->old_H);
+        graph_mult(W, ws->old_H, ws->mone);
+        if (track)
+        {
+            excluded = (trace != NULL) ? wall_time() : 0.0;
+            objective = symnmf_objective(w_sq, ws->old_H, ws->mone, ws->gram);
+            if (trace != NULL)
+            {
+                trace->objective[t] = objective;
+                start += wall_time() - excluded;
+            }
+            if (m > 0 && objective_stalled(state->previous, objective, options->rel_obj))
+            {
+                result->stop = STOP_OBJECTIVE;
+                return 1;
+            }
+            state->previous = objective;
+        }
+        objective = mu_update(H, ws->old_H, ws->mone, ws->gram, ws->mechane);
+        state->iteration = m + 1;
+        result->iterations = m + 1;
+        result->delta = sqrt(objective);
+        if (trace != NULL)
+        {
+            trace->seconds[t] = wall_time() - start;
+            trace->iterations = t + 1;
+        }
+        if (!write_checkpoint(H, NULL, options, state))
+        {
+            return 0;
+        }
+        if (objective < options->tol)
+        {
+            result->stop = STOP_TOLERANCE;
+            break;
+        }
+    }
+    if (trace != NULL)
+    {
+        graph_mult(W, H, ws->mone);
+        trace->objective[trace->iterations] = symnmf_objective(w_sq, H, ws->mone, ws->gram);
+    }
+    return 1;
+}
+
+/**
+ * Returns the largest absolute row sum of W, an upper bound on its spectral norm.
+ * @param W: Graph operand for W (n*n)
+ * @param ones: n*1 scratch matrix
+ * @param sums: n*1 scratch matrix
+ * @return: max_i |sum_j W_ij|
+ */
+static double max_row_sum(const Graph* W, Matrix* ones, Matrix* sums)
+{
+    int i;
+    double largest = 0.0;
+    double value;
+    for (i = 0; i < ones->rows; i++)
+    {
+        MAT_AT(ones, i, 0) = 1.0;
+    }
+    graph_mult(W, ones, sums);
+    for (i = 0; i < sums->rows; i++)
+    {
+        value = MAT_AT(sums, i, 0);
+        value = (value < 0) ? -value : value;
+        largest = (value > largest) ? value : largest;
+    }
+    return largest;
+}
+
+/**
+ * One HALS sweep over the columns of U for min ||W - U*V^T||^2 + lambda * ||U - V||^2:
+ * column j is set to max(0, ((W*V)_j - sum_{l != j} U_l * G_lj + lambda * V_j) / (G_jj + lambda)).
+ * Row i of the new column only depends on row i of U, so the sweep runs row by row.
+ * @param U: Factor to update (n*k)
+ * @param V: Other factor (n*k)
+ * @param WV: W*V (n*k)
+ * @param G: V^T*V (k*k)
+ * @param lambda: Penalty tying U to V
+ * @param moved: Optional (may be NULL), receives the squared change of every row of U (n entries)
+ */
+static void hals_sweep(Matrix* U, const Matrix* V, const Matrix* WV, const Matrix* G, double lambda, double* moved)
+{
+    int i;
+    int j;
+    int l;
+    int k = U->cols;
+    double num;
+    double row_moved;
+    double* U_row;
+    const double* V_row;
+    const double* WV_row;
+    const double* G_row;
+#ifdef _OPENMP
+#pragma omp parallel for private(j, l, num, row_moved, U_row, V_row, WV_row, G_row) schedule(static) num_threads(get_num_threads()) if ((double)U->rows * k * k > 1e5)
+#endif
+    for (i = 0; i < U->rows; i++)
+    {
+        U_row = MAT_ROW(U, i);
+        V_row = MAT_ROW(V, i);
+        WV_row = MAT_ROW(WV, i);
+        row_moved = 0.0;
+        for (j = 0; j < k; j++)
+        {
+            G_row = MAT_ROW(G, j);
+            num = WV_row[j] + lambda * V_row[j];
+            for (l = 0; l < k; l++)
+            {
+                num -= (l == j) ? 0.0 : U_row[l] * G_row[l];
+            }
+            num /= G_row[j] + lambda;
+            num = (num > 0.0) ? num : 0.0;
+            row_moved += (num - U_row[j]) * (num - U_row[j]);
+            U_row[j] = num;
+        }
+        if (moved != NULL)
+        {
+            moved[i] = row_moved;
+        }
+    }
+}
+
+/**
+ * Runs symmetric HALS (Zhu, Li, Tang and Wakin, "Dropping Symmetry for Fast Symmetric
+ * Nonnegative Matrix Factorization", 2018): H is split into U = H and a copy V, and
+ * min ||W - U*V^T||^2 + lambda * ||U - V||^2 is solved by alternating HALS sweeps over
+ * the columns of U and of V. U and V meet for lambda > ||W||_2 / 2; half the largest row sum
+ * of W is used, since it bounds that from above at the cost of one product with a vector.
+ * Every iteration costs two products with W. The change of U is measured during its sweep
+ * and the objective of U comes from the product W*U the sweep of V needs. lambda only
+ * depends on W, so a resumed run needs U, V and the previous objective.
+ * @param H: Matrix H (n*k), updated in place (receives U)
+ * @param W: Graph operand for W (n*n)
+ * @param ws: Workspace created for the size of H; mechane holds V unless the state has one, old_H the change of each row
+ * @param options: Stopping criteria and checkpoints
+ * @param state: Where the solve starts, updated as it goes
+ * @param result: Receives the number of iterations and the reason for stopping
+ * @param trace: Optional trace to fill (may be NULL)
+ * @param w_sq: Squared Frobenius norm of W, used only for the objective
+ * @return: 1 on success, 0 if a checkpoint could not be written
+ */
+static int run_hals(Matrix* H, const Graph* W, Workspace* ws, const SolverOptions* options, SolverState* state, SolverResult* result, SolverTrace* trace, double w_sq)
+{
+    int m;
+    int t;
+    int i;
+    int stop;
+    int first = state->iteration;
+    int track = tracks_objective(options, trace);
+    double lambda;
+    double start = 0.0;
+    double excluded;
+    double objective;
+    double moved;
+    double* row_moved = ws->old_H->data;
+    Matrix ones;
+    Matrix sums;
+    Matrix* V = (state->V != NULL) ? state->V : ws->mechane;
+    lambda = 0.5 * max_row_sum(W, matrix_view(&ones, ws->old_H->data, H->rows, 1, ws->old_H->stride),
+                               matrix_view(&sums, ws->mone->data, H->rows, 1, ws->mone->stride));
+    if (state->V == NULL)
+    {
+        copy_matrix(H, V);
+    }
+    for (m = first; m < options->max_iter; m++)
+    {
+        t = m - first;
+        start = (trace != NULL) ? wall_time() : 0.0;
+        graph_mult(W, V, ws->mone);
+        gemm_tn(V, V, ws->gram, 0);
+        if (track && m == 0)
+        {
+            excluded = (trace != NULL) ? wall_time() : 0.0;
+            state->previous = symnmf_objective(w_sq, V, ws->mone, ws->gram);
+            start += (trace != NULL) ? wall_time() - excluded : 0.0;
+        }
+        if (trace != NULL && t == 0)
+        {
+            trace->objective[0] = state->previous;
+        }
+        hals_sweep(H, V, ws->mone, ws->gram, lambda, row_moved);
+        moved = 0.0;
+        for (i = 0; i < H->rows; i++)
+        {
+            moved += row_moved[i];
+        }
+        graph_mult(W, H, ws->mone);
+        gemm_tn(H, H, ws->gram, 0);
+        objective = 0.0;
+        if (track)
+        {
+            excluded = (trace != NULL) ? wall_time() : 0.0;
+            objective = symnmf_objective(w_sq, H, ws->mone, ws->gram);
+            if (trace != NULL)
+            {
+                trace->objective[t + 1] = objective;
+                start += wall_time() - excluded;
+            }
+        }
+        hals_sweep(V, H, ws->mone, ws->gram, lambda, NULL);
+        state->iteration = m + 1;
+        result->iterations = m + 1;
+        result->delta = sqrt(moved);
+        if (trace != NULL)
+        {
+            trace->seconds[t] = wall_time() - start;
+            trace->iterations = t + 1;
+        }
+        stop = -1;
+        if (moved < options->tol)
+        {
+            stop = STOP_TOLERANCE;
+        }
+        else if (track && objective_stalled(state->previous, objective, options->rel_obj))
+        {
+            stop = STOP_OBJECTIVE;
+        }
+        state->previous = objective;
+        if (!write_checkpoint(H, V, options, state))
+        {
+            return 0;
+        }
+        if (stop >= 0)
+        {
+            result->stop = stop;
+            return 1;
+        }
+    }
+    return 1;
+}
+
+/**
+ * Optimizes H with the chosen algorithm until one of the stopping criteria holds,
+ * optionally recording its progress. The objective is evaluated every iteration only when
+ * rel_obj is set, a trace is requested or checkpoints are written; with the multiplicative
+ * update it reuses the product W*H the update needs.
+ * @param H: Matrix H (n*k), the starting point, updated in place
+ * @param W: Graph operand for W (n*n), dense, packed, sparse or streamed
+ * @param ws: Workspace created with workspace_create(n, k)
+ * @param options: Algorithm and stopping criteria, NULL for the defaults
+ * @param result: Optional, receives the number of iterations and the reason for stopping
+ * @param trace: Optional trace created with trace_create(max_iter) (may be NULL); receives the
+ *               objective after every iteration and the time each iteration took
+ * @return: Pointer to the optimized matrix H, NULL if the arguments do not match
+ */
+Matrix* symnmf_solve(Matrix* H, const Graph* W, Workspace* ws, const SolverOptions* options, SolverResult* result, SolverTrace* trace)
+{
+    return symnmf_resume(H, W, ws, options, NULL, result, trace);
+}
+
+/**
+ * Continues a solve from H and a state, e.g. one read back with checkpoint_load, as if it had
+ * never stopped: the iterations are numbered from state->iteration, max_iter counts them all,
+ * and a resumed run reaches the same H as an uninterrupted one. symnmf_solve is the resume
+ * of a fresh state. With checkpoint_every set, H and the state are written to the checkpoint
+ * file after every checkpoint_every-th iteration (counted from the start of the trajectory).
+ * @param H: Matrix H (n*k), the iterate of the state, updated in place
+ * @param W: Graph operand for W (n*n), dense, packed, sparse or streamed
+ * @param ws: Workspace created with workspace_create(n, k)
+ * @param options: Algorithm, stopping criteria and checkpoints, NULL for the defaults
+ * @param state: Optional (may be NULL for a fresh start), updated to where the solve stopped
+ * @param result: Optional, receives the number of iterations and the reason for stopping
+ * @param trace: Optional trace created with trace_create(max_iter) (may be NULL); records the
+ *               iterations of this call only
+ * @return: Pointer to the optimized matrix H, NULL if the arguments or the state do not match
+ *          or a checkpoint could not be written
+ */
+Matrix* symnmf_resume(Matrix* H, const Graph* W, Workspace* ws, const SolverOptions* options, SolverState* state, SolverResult* result, SolverTrace* trace)
+{
+    int ok;
+    double w_sq = 0.0;
+    SolverOptions defaults;
+    SolverResult local;
+    SolverState fresh;
+    options = (options == NULL) ? solver_options_default(&defaults) : options;
+    result = (result == NULL) ? &local : result;
+    state = (state == NULL) ? solver_state_init(&fresh, options->solver) : state;
+    if (ws->n != H->rows || ws->k != H->cols || W->n != H->rows || options->max_iter < 0
+        || (trace != NULL && trace->capacity < options->max_iter) || state->solver != options->solver
+        || state->iteration < 0 || (state->V != NULL && (state->V->rows != H->rows || state->V->cols != H->cols)))
+    {
+        return NULL;
+    }
+    result->start = state->iteration;
+    result->iterations = state->iteration;
+    result->stop = STOP_MAX_ITER;
+    result->delta = 0.0;
+    if (trace != NULL)
+    {
+        trace->iterations = 0;
+    }
+    if (tracks_objective(options, trace))
+    {
+        w_sq = graph_squared_norm(W);
+    }
+    switch (options->solver)
+    {
+    case SOLVER_MU:
+        ok = run_mu(H, W, ws, options, state, result, trace, w_sq);
+        break;
+    case SOLVER_HALS:
+        ok = run_hals(H, W, ws, options, state, result, trace, w_sq);
+        break;
+    default:
+        return NULL;
+    }
+    return ok ? H : NULL;
+}
@@ -0,0 +1,804 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "symnmf.h"
+
+/**
+ * Creates an empty n*n CSR matrix with room for nnz non-zeros.
+ * The header, values, row pointers and column indices share one allocation.
+ * @param n: Number of rows and columns
+ * @param nnz: Number of stored entries
+ * @return: Pointer to the allocated matrix, NULL if allocation failed
+ */
+CsrMatrix* csr_create(int n, size_t nnz)
+{
+    CsrMatrix* S;
+    char* block;
+    size_t values_at;
+    size_t row_ptr_at;
+    size_t col_idx_at;
+    if (n < 0 || nnz > ((size_t)-1 / 2) / (sizeof(double) + sizeof(int)))
+    {
+        printf("An Error Has Occurred\n");
+        return NULL;
+    }
+    values_at = (sizeof(CsrMatrix) + sizeof(double) - 1) / sizeof(double) * sizeof(double);
+    row_ptr_at = values_at + nnz * sizeof(double);
+    col_idx_at = row_ptr_at + ((size_t)n + 1) * sizeof(size_t);
+    block = (char*)calloc(1, col_idx_at + nnz * sizeof(int) + 1);
+    if (block == NULL)
+    {
+        printf("An Error Has Occurred\n");
+        return NULL;
+    }
+    matrix_add_bytes(col_idx_at + nnz * sizeof(int) + 1);
+    S = (CsrMatrix*)block;
+    S->n = n;
+    S->nnz = nnz;
+    S->values = (double*)(block + values_at);
+    S->row_ptr = (size_t*)(block + row_ptr_at);
+    S->col_idx = (int*)(block + col_idx_at);
+    return S;
+}
+
+/**
+ * Frees a CSR matrix allocated with csr_create.
+ * @param S: Pointer to the matrix to free (may be NULL)
+ */
+void csr_free(CsrMatrix* S)
+{
+    free(S);
+}
+
+/**
+ * Orders neighbour candidates by distance, ties broken by index.
+ * @return: Non-zero if (d1, j1) comes after (d2, j2)
+ */
+static int farther(double d1, int j1, double d2, int j2)
+{
+    return d1 > d2 || (d1 == d2 && j1 > j2);
+}
+
+/**
+ * Offers candidate (dist, j) to a max-heap holding the `size` nearest candidates seen so far.
+ * @param dist: Heap distances
+ * @param idx: Heap indices
+ * @param size: Current heap size
+ * @param capacity: Maximum heap size
+ * @param d: Candidate distance
+ * @param j: Candidate index
+ * @return: New heap size
+ */
+static int heap_offer(double* dist, int* idx, int size, int capacity, double d, int j)
+{
+    int pos;
+    int child;
+    if (size == capacity)
+    {
+        if (!farther(dist[0], idx[0], d, j))
+        {
+            return size;
+        }
+        pos = 0;
+        for (;;)
+        {
+            child = 2 * pos + 1;
+            if (child >= size)
+            {
+                break;
+            }
+            if (child + 1 < size && farther(dist[child + 1], idx[child + 1], dist[child], idx[child]))
+            {
+                child++;
+            }
+            if (!farther(dist[child], idx[child], d, j))
+            {
+                break;
+            }
+            dist[pos] = dist[child];
+            idx[pos] = idx[child];
+            pos = child;
+        }
+        dist[pos] = d;
+        idx[pos] = j;
+        return size;
+    }
+    pos = size;
+    while (pos > 0 && farther(d, j, dist[(pos - 1) / 2], idx[(pos - 1) / 2]))
+    {
+        dist[pos] = dist[(pos - 1) / 2];
+        idx[pos] = idx[(pos - 1) / 2];
+        pos = (pos - 1) / 2;
+    }
+    dist[pos] = d;
+    idx[pos] = j;
+    return size + 1;
+}
+
+/**
+ * qsort comparator for column indices.
+ */
+static int compare_int(const void* a, const void* b)
+{
+    int x = *(const int*)a;
+    int y = *(const int*)b;
+    return (x > y) - (x < y);
+}
+
+/*
+ * Leaf size of the k-d tree, the largest dimension it is built for, and the fewest points
+ * worth building it for. Beyond about ten coordinates the boxes stop pruning and the tree
+ * only adds overhead to the exhaustive search.
+ */
+#define KD_LEAF 16
+#define KD_MAX_DIM 10
+#define KD_MIN_POINTS 256
+
+/*
+ * Relative margin a box distance must clear before its points are skipped. The bound sums
+ * the per-axis gaps in another order than squared_euc_dis; the margin keeps every skipped
+ * point one the exhaustive search would also have rejected.
+ */
+#define BOUND_SLACK (1.0 + 1e-9)
+
+/**
+ * Node of a k-d tree: the points order[begin..end) and the children, -1 for a leaf.
+ */
+typedef struct
+{
+    int begin;
+    int end;
+    int left;
+    int right;
+} KdNode;
+
+/**
+ * k-d tree over the rows of a matrix. boxes holds the bounding box of every node,
+ * dim lower bounds followed by dim upper bounds.
+ */
+typedef struct
+{
+    int* order;
+    KdNode* nodes;
+    double* boxes;
+    int dim;
+} KdTree;
+
+/**
+ * Partially sorts order[lo..hi) by one coordinate so the element of rank nth lands at nth,
+ * with no larger coordinate before it and no smaller one after it.
+ * @param order: Point indices
+ * @param points: Matrix of points, one point per row
+ * @param axis: Coordinate to order by
+ * @param lo: First position
+ * @param hi: One past the last position
+ * @param nth: Position to select
+ */
+static void kd_select(int* order, const Matrix* points, int axis, int lo, int hi, int nth)
+{
+    int i;
+    int j;
+    int t;
+    double pivot;
+    while (hi - lo > 1)
+    {
+        pivot = MAT_AT(points, order[lo + (hi - lo) / 2], axis);
+        i = lo;
+        j = hi - 1;
+        while (i <= j)
+        {
+            while (MAT_AT(points, order[i], axis) < pivot)
+            {
+                i++;
+            }
+            while (MAT_AT(points, order[j], axis) > pivot)
+            {
+                j--;
+            }
+            if (i <= j)
+            {
+                t = order[i];
+                order[i] = order[j];
+                order[j] = t;
+                i++;
+                j--;
+            }
+        }
+        if (nth <= j)
+        {
+            hi = j + 1;
+        }
+        else if (nth >= i)
+        {
+            lo = i;
+        }
+        else
+        {
+            return;
+        }
+    }
+}
+
+/**
+ * Builds the subtree over order[begin..end), splitting the widest side of the box at the median.
+ * @param T: Tree being built
+ * @param points: Matrix of points, one point per row
+ * @param begin: First position
+ * @param end: One past the last position
+ * @param count: Number of nodes used so far, advanced here
+ * @return: Index of the subtree root
+ */
+static int kd_build(KdTree* T, const Matrix* points, int begin, int end, int* count)
+{
+    int node = (*count)++;
+    int dim = T->dim;
+    int e;
+    int c;
+    int axis = 0;
+    double x;
+    double* low = T->boxes + (size_t)node * 2 * dim;
+    double* high = low + dim;
+    for (c = 0; c < dim; c++)
+    {
+        low[c] = high[c] = MAT_AT(points, T->order[begin], c);
+    }
+    for (e = begin + 1; e < end; e++)
+    {
+        for (c = 0; c < dim; c++)
+        {
+            x = MAT_AT(points, T->order[e], c);
+            if (x < low[c])
+            {
+                low[c] = x;
+            }
+            if (x > high[c])
+            {
+                high[c] = x;
+            }
+        }
+    }
+    T->nodes[node].begin = begin;
+    T->nodes[node].end = end;
+    T->nodes[node].left = -1;
+    T->nodes[node].right = -1;
+    if (end - begin <= KD_LEAF)
+    {
+        return node;
+    }
+    for (c = 1; c < dim; c++)
+    {
+        if (high[c] - low[c] > high[axis] - low[axis])
+        {
+            axis = c;
+        }
+    }
+    kd_select(T->order, points, axis, begin, end, begin + (end - begin) / 2);
+    T->nodes[node].left = kd_build(T, points, begin, begin + (end - begin) / 2, count);
+    T->nodes[node].right = kd_build(T, points, begin + (end - begin) / 2, end, count);
+    return node;
+}
+
+/**
+ * Builds a k-d tree over the rows of points (at least one row).
+ * @param T: Tree to fill
+ * @param points: Matrix of points, one point per row
+ * @return: 1 on success, 0 if allocation failed
+ */
+static int kd_create(KdTree* T, const Matrix* points)
+{
+    int n = points->rows;
+    /* Every leaf keeps at least KD_LEAF / 2 points. */
+    size_t max_nodes = 2 * ((size_t)n / (KD_LEAF / 2) + 1);
+    int count = 0;
+    int i;
+    T->dim = points->cols;
+    T->order = (int*)malloc((size_t)n * sizeof(int));
+    T->nodes = (KdNode*)malloc(max_nodes * sizeof(KdNode));
+    T->boxes = (double*)malloc(max_nodes * 2 * (size_t)T->dim * sizeof(double));
+    if (T->order == NULL || T->nodes == NULL || T->boxes == NULL)
+    {
+        free(T->order);
+        free(T->nodes);
+        free(T->boxes);
+        return 0;
+    }
+    for (i = 0; i < n; i++)
+    {
+        T->order[i] = i;
+    }
+    kd_build(T, points, 0, n, &count);
+    return 1;
+}
+
+/**
+ * Frees the arrays of a tree built with kd_create.
+ * @param T: Tree to free
+ */
+static void kd_free(KdTree* T)
+{
+    free(T->order);
+    free(T->nodes);
+    free(T->boxes);
+}
+
+/**
+ * Squared distance from a point to the bounding box of a node, a lower bound on its
+ * distance to every point of the node.
+ * @param T: Tree
+ * @param node: Node index
+ * @param point: Point of T->dim coordinates
+ * @return: Squared distance, 0 inside the box
+ */
+static double kd_box_dis(const KdTree* T, int node, const double* point)
+{
+    const double* low = T->boxes + (size_t)node * 2 * T->dim;
+    const double* high = low + T->dim;
+    double sum = 0.0;
+    double gap;
+    int c;
+    for (c = 0; c < T->dim; c++)
+    {
+        gap = 0.0;
+        if (point[c] < low[c])
+        {
+            gap = low[c] - point[c];
+        }
+        else if (point[c] > high[c])
+        {
+            gap = point[c] - high[c];
+        }
+        sum += gap * gap;
+    }
+    return sum;
+}
+
+/**
+ * Offers every point of a subtree to the nearest-neighbour heap of point i, as the
+ * exhaustive search does, skipping subtrees that cannot hold a point it would keep.
+ * @param T: Tree
+ * @param points: Matrix of points, one point per row
+ * @param node: Subtree root
+ * @param i: Query point, never its own neighbour
+ * @param limit: Squared radius, negative for no limit
+ * @param dist: Heap distances
+ * @param idx: Heap indices
+ * @param size: Current heap size
+ * @param capacity: Maximum heap size
+ * @return: New heap size
+ */
+static int kd_nearest(const KdTree* T, const Matrix* points, int node, int i, double limit,
+                      double* dist, int* idx, int size, int capacity)
+{
+    const KdNode* N = T->nodes + node;
+    int e;
+    int j;
+    int near;
+    int far;
+    double d;
+    double near_dis;
+    double far_dis;
+    double bound;
+    if (N->left < 0)
+    {
+        for (e = N->begin; e < N->end; e++)
+        {
+            j = T->order[e];
+            if (j == i)
+            {
+                continue;
+            }
+            d = squared_euc_dis(MAT_ROW(points, i), MAT_ROW(points, j), T->dim);
+            if (limit < 0 || d <= limit)
+            {
+                size = heap_offer(dist, idx, size, capacity, d, j);
+            }
+        }
+        return size;
+    }
+    near = N->left;
+    far = N->right;
+    near_dis = kd_box_dis(T, near, MAT_ROW(points, i));
+    far_dis = kd_box_dis(T, far, MAT_ROW(points, i));
+    if (far_dis < near_dis)
+    {
+        near = N->right;
+        far = N->left;
+        d = near_dis;
+        near_dis = far_dis;
+        far_dis = d;
+    }
+    bound = (size == capacity) ? dist[0] : limit;
+    if (bound < 0 || bound * BOUND_SLACK >= near_dis)
+    {
+        size = kd_nearest(T, points, near, i, limit, dist, idx, size, capacity);
+    }
+    bound = (size == capacity) ? dist[0] : limit;
+    if (bound < 0 || bound * BOUND_SLACK >= far_dis)
+    {
+        size = kd_nearest(T, points, far, i, limit, dist, idx, size, capacity);
+    }
+    return size;
+}
+
+/**
+ * Counts, and optionally lists, the points of a subtree within the squared radius of point i.
+ * @param T: Tree
+ * @param points: Matrix of points, one point per row
+ * @param node: Subtree root
+ * @param i: Query point, never its own neighbour
+ * @param limit: Squared radius
+ * @param out: Receives the indices found (may be NULL to only count)
+ * @return: Number of points found
+ */
+static int kd_within(const KdTree* T, const Matrix* points, int node, int i, double limit, int* out)
+{
+    const KdNode* N = T->nodes + node;
+    int e;
+    int j;
+    int count = 0;
+    if (N->left < 0)
+    {
+        for (e = N->begin; e < N->end; e++)
+        {
+            j = T->order[e];
+            if (j != i && squared_euc_dis(MAT_ROW(points, i), MAT_ROW(points, j), T->dim) <= limit)
+            {
+                if (out != NULL)
+                {
+                    out[count] = j;
+                }
+                count++;
+            }
+        }
+        return count;
+    }
+    if (kd_box_dis(T, N->left, MAT_ROW(points, i)) <= limit * BOUND_SLACK)
+    {
+        count += kd_within(T, points, N->left, i, limit, out);
+    }
+    if (kd_box_dis(T, N->right, MAT_ROW(points, i)) <= limit * BOUND_SLACK)
+    {
+        count += kd_within(T, points, N->right, i, limit, out == NULL ? NULL : out + count);
+    }
+    return count;
+}
+
+/**
+ * Finds the directed neighbour lists of every point.
+ * With neighbors > 0 row i keeps its `neighbors` nearest points (within radius if radius > 0),
+ * otherwise it keeps every point within radius. Points of up to KD_MAX_DIM coordinates are
+ * searched through a k-d tree, which finds the same lists in about O(n log n) distances for
+ * well-spread points; higher dimensions fall back to the exhaustive O(n^2 * d) search.
+ * @param points: Matrix of points, one point per row
+ * @param neighbors: Number of nearest neighbours, 0 or less for a pure radius graph
+ * @param radius: Neighbourhood radius, 0 or less for no limit
+ * @param dir_ptr: Output array of n + 1 offsets into *dir_idx
+ * @param dir_idx: Output neighbour indices, allocated here
+ * @return: 1 on success, 0 if allocation failed
+ */
+static int directed_neighbors(const Matrix* points, int neighbors, double radius, size_t* dir_ptr, int** dir_idx)
+{
+    int n = points->rows;
+    int dim = points->cols;
+    int i;
+    int j;
+    int size;
+    double d;
+    double limit = (radius > 0) ? radius * radius : -1.0;
+    double* heap_dist = NULL;
+    size_t* counts = dir_ptr + 1;
+    KdTree tree;
+    int use_tree = dim <= KD_MAX_DIM && n >= KD_MIN_POINTS;
+    if (neighbors > n - 1)
+    {
+        neighbors = n - 1;
+    }
+    if (use_tree && !kd_create(&tree, points))
+    {
+        return 0;
+    }
+    if (neighbors > 0)
+    {
+        heap_dist = (double*)malloc(((size_t)n * (size_t)neighbors + 1) * sizeof(double));
+        *dir_idx = (int*)malloc(((size_t)n * (size_t)neighbors + 1) * sizeof(int));
+        if (heap_dist == NULL || *dir_idx == NULL)
+        {
+            free(heap_dist);
+            free(*dir_idx);
+            if (use_tree)
+            {
+                kd_free(&tree);
+            }
+            return 0;
+        }
+#ifdef _OPENMP
+#pragma omp parallel for private(j, size, d) schedule(dynamic, 16) num_threads(get_num_threads()) if (n > 64)
+#endif
+        for (i = 0; i < n; i++)
+        {
+            size = 0;
+            if (use_tree)
+            {
+                size = kd_nearest(&tree, points, 0, i, limit, heap_dist + (size_t)i * neighbors,
+                                  *dir_idx + (size_t)i * neighbors, size, neighbors);
+            }
+            else
+            {
+                for (j = 0; j < n; j++)
+                {
+                    if (j == i)
+                    {
+                        continue;
+                    }
+                    d = squared_euc_dis(MAT_ROW(points, i), MAT_ROW(points, j), dim);
+                    if (limit < 0 || d <= limit)
+                    {
+                        size = heap_offer(heap_dist + (size_t)i * neighbors, *dir_idx + (size_t)i * neighbors, size, neighbors, d, j);
+                    }
+                }
+            }
+            counts[i] = (size_t)size;
+        }
+        free(heap_dist);
+        if (use_tree)
+        {
+            kd_free(&tree);
+        }
+        dir_ptr[0] = 0;
+        for (i = 0; i < n; i++)
+        {
+            dir_ptr[i + 1] = (size_t)i * neighbors + counts[i];
+        }
+        /* Rows are stored at a fixed stride, shift them together. */
+        for (i = 1; i < n; i++)
+        {
+            size = (int)(dir_ptr[i + 1] - (size_t)i * neighbors);
+            memmove(*dir_idx + dir_ptr[i], *dir_idx + (size_t)i * neighbors, (size_t)size * sizeof(int));
+            dir_ptr[i + 1] = dir_ptr[i] + (size_t)size;
+        }
+        return 1;
+    }
+#ifdef _OPENMP
+#pragma omp parallel for private(j, size) schedule(dynamic, 16) num_threads(get_num_threads()) if (n > 64)
+#endif
+    for (i = 0; i < n; i++)
+    {
+        size = 0;
+        if (use_tree)
+        {
+            size = kd_within(&tree, points, 0, i, limit, NULL);
+        }
+        else
+        {
+            for (j = 0; j < n; j++)
+            {
+                if (j != i && squared_euc_dis(MAT_ROW(points, i), MAT_ROW(points, j), dim) <= limit)
+                {
+                    size++;
+                }
+            }
+        }
+        counts[i] = (size_t)size;
+    }
+    dir_ptr[0] = 0;
+    for (i = 0; i < n; i++)
+    {
+        dir_ptr[i + 1] += dir_ptr[i];
+    }
+    *dir_idx = (int*)malloc((dir_ptr[n] + 1) * sizeof(int));
+    if (*dir_idx == NULL)
+    {
+        if (use_tree)
+        {
+            kd_free(&tree);
+        }
+        return 0;
+    }
+#ifdef _OPENMP
+#pragma omp parallel for private(j, size) schedule(dynamic, 16) num_threads(get_num_threads()) if (n > 64)
+#endif
+    for (i = 0; i < n; i++)
+    {
+        size = 0;
+        if (use_tree)
+        {
+            kd_within(&tree, points, 0, i, limit, *dir_idx + dir_ptr[i]);
+        }
+        else
+        {
+            for (j = 0; j < n; j++)
+            {
+                if (j != i && squared_euc_dis(MAT_ROW(points, i), MAT_ROW(points, j), dim) <= limit)
+                {
+                    (*dir_idx)[dir_ptr[i] + size] = j;
+                    size++;
+                }
+            }
+        }
+    }
+    if (use_tree)
+    {
+        kd_free(&tree);
+    }
+    return 1;
+}
+
+/**
+ * Builds the symmetric sparse affinity graph of the points and normalizes it like norm_mat.
+ * Point j is a neighbour of i if it is among the `neighbors` nearest points of i or i is among
+ * those of j (union symmetrization), optionally restricted to the radius. Stored entries are
+ * exp(-||x_i - x_j||^2 / 2) scaled by D^-1/2 on both sides, where D holds the sparse row sums.
+ * Points without neighbours get a zero row instead of a division by zero. Up to ten coordinates
+ * the neighbours are found through a k-d tree; in higher dimensions the search compares every
+ * pair of points, O(n^2 * d), which dominates the build for large n.
+ * @param points: Matrix of points, one point per row
+ * @param neighbors: Number of nearest neighbours, 0 or less for a pure radius graph
+ * @param radius: Neighbourhood radius, 0 or less for no limit
+ * @param degrees: Optional output array of n doubles receiving the degree of each point (may be NULL)
+ * @return: Pointer to the normalized CSR matrix, NULL on failure
+ */
+CsrMatrix* knn_graph(const Matrix* points, int neighbors, double radius, double* degrees)
+{
+    int n = points->rows;
+    int i;
+    int j;
+    size_t e;
+    size_t e_end;
+    size_t out;
+    size_t* dir_ptr;
+    size_t* fill;
+    int* dir_idx = NULL;
+    int* sym_idx;
+    double row_sum;
+    double* deg;
+    CsrMatrix* S = NULL;
+    if (neighbors <= 0 && radius <= 0)
+    {
+        printf("An Error Has Occurred\n");
+        return NULL;
+    }
+    dir_ptr = (size_t*)calloc(2 * ((size_t)n + 1), sizeof(size_t));
+    deg = (double*)malloc(((size_t)n + 1) * sizeof(double));
+    if (dir_ptr == NULL || deg == NULL || !directed_neighbors(points, neighbors, radius, dir_ptr, &dir_idx))
+    {
+        printf("An Error Has Occurred\n");
+        free(dir_ptr);
+        free(deg);
+        return NULL;
+    }
+    /* Union of the directed lists: row i gets its own neighbours and every j pointing at i. */
+    fill = dir_ptr + n + 1;
+    for (i = 0; i < n; i++)
+    {
+        fill[i + 1] += dir_ptr[i + 1] - dir_ptr[i];
+        for (e = dir_ptr[i]; e < dir_ptr[i + 1]; e++)
+        {
+            fill[dir_idx[e] + 1]++;
+        }
+    }
+    for (i = 0; i < n; i++)
+    {
+        fill[i + 1] += fill[i];
+    }
+    sym_idx = (int*)malloc((fill[n] + 1) * sizeof(int));
+    if (sym_idx == NULL)
+    {
+        printf("An Error Has Occurred\n");
+        free(dir_ptr);
+        free(dir_idx);
+        free(deg);
+        return NULL;
+    }
+    for (i = 0; i < n; i++)
+    {
+        for (e = dir_ptr[i]; e < dir_ptr[i + 1]; e++)
+        {
+            sym_idx[fill[i]++] = dir_idx[e];
+            sym_idx[fill[dir_idx[e]]++] = i;
+        }
+    }
+    free(dir_idx);
+    /* fill[i] now points at the end of row i, which starts where row i - 1 ended. */
+    for (i = n; i > 0; i--)
+    {
+        fill[i] = fill[i - 1];
+    }
+    fill[0] = 0;
+    out = 0;
+    for (i = 0; i < n; i++)
+    {
+        qsort(sym_idx + fill[i], fill[i + 1] - fill[i], sizeof(int), compare_int);
+        dir_ptr[i] = out;
+        for (e = fill[i]; e < fill[i + 1]; e++)
+        {
+            if (out == dir_ptr[i] || sym_idx[out - 1] != sym_idx[e])
+            {
+                sym_idx[out++] = sym_idx[e];
+            }
+        }
+    }
+    dir_ptr[n] = out;
+    S = csr_create(n, out);
+    if (S != NULL)
+    {
+        memcpy(S->row_ptr, dir_ptr, ((size_t)n + 1) * sizeof(size_t));
+        memcpy(S->col_idx, sym_idx, out * sizeof(int));
+#ifdef _OPENMP
+#pragma omp parallel for private(e, e_end, row_sum) schedule(dynamic, 64) num_threads(get_num_threads()) if (n > 256)
+#endif
+        for (i = 0; i < n; i++)
+        {
+            row_sum = 0.0;
+            e_end = S->row_ptr[i + 1];
+            for (e = S->row_ptr[i]; e < e_end; e++)
+            {
+                S->values[e] = exp((-0.5) * squared_euc_dis(MAT_ROW(points, i), MAT_ROW(points, S->col_idx[e]), points->cols));
+                row_sum += S->values[e];
+            }
+            deg[i] = row_sum;
+        }
+        if (degrees != NULL)
+        {
+            memcpy(degrees, deg, (size_t)n * sizeof(double));
+        }
+        for (i = 0; i < n; i++)
+        {
+            deg[i] = (deg[i] > 0) ? 1 / (sqrt(deg[i])) : 0.0;
+        }
+#ifdef _OPENMP
+#pragma omp parallel for private(j, e, e_end) schedule(dynamic, 64) num_threads(get_num_threads()) if (n > 256)
+#endif
+        for (i = 0; i < n; i++)
+        {
+            e_end = S->row_ptr[i + 1];
+            for (e = S->row_ptr[i]; e < e_end; e++)
+            {
+                j = S->col_idx[e];
+                S->values[e] = (deg[i] * S->values[e]) * deg[j];
+            }
+        }
+    }
+    free(sym_idx);
+    free(dir_ptr);
+    free(deg);
+    return S;
+}
+
+/**
+ * Computes out = S * H for a CSR matrix S (SpMM).
+ * Rows are independent, so the result does not depend on the number of threads.
+ * @param S: Sparse n*n matrix
+ * @param H: Matrix of size n*k
+ * @param out: Output matrix of size n*k, must not alias H
+ */
+void csr_mult(const CsrMatrix* S, const Matrix* H, Matrix* out)
+{
+    int n = S->n;
+    int k = H->cols;
+    int i;
+    int c;
+    size_t e;
+    size_t e_end;
+    double a;
+    const double* H_row;
+    double* out_row;
+#ifdef _OPENMP
+#pragma omp parallel for private(c, e, e_end, a, H_row, out_row) schedule(dynamic, 64) num_threads(get_num_threads()) if ((double)S->nnz * k > 1e5)
+#endif
+    for (i = 0; i < n; i++)
+    {
+        out_row = MAT_ROW(out, i);
+        memset(out_row, 0, (size_t)k * sizeof(double));
+        e_end = S->row_ptr[i + 1];
+        for (e = S->row_ptr[i]; e < e_end; e++)
+        {
+            a = S->values[e];
+            H_row = MAT_ROW(H, S->col_idx[e]);
+            for (c = 0; c < k; c++)
+            {
+                out_row[c] += a * H_row[c];
+            }
+        }
+    }
+}
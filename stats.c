@@ -0,0 +1,175 @@
+#define _POSIX_C_SOURCE 200112L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "symnmf.h"
+
+static const char* phase_names[PHASE_COUNT] = {"load", "sym", "ddg", "norm", "init", "solve", "output"};
+static const char* stop_names[] = {"tolerance", "max_iter", "objective"};
+
+/**
+ * Returns a monotonic time stamp.
+ * @return: Seconds since an arbitrary point
+ */
+static double wall_time(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+/**
+ * Returns the CPU time the process has used so far, over all its threads.
+ * @return: CPU seconds
+ */
+static double cpu_time(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+/**
+ * Clears the statistics.
+ * @param stats: Statistics to clear
+ * @param trace: Optional trace for the per-iteration objective (may be NULL)
+ * @return: stats
+ */
+SymnmfStats* stats_init(SymnmfStats* stats, SolverTrace* trace)
+{
+    memset(stats, 0, sizeof(SymnmfStats));
+    stats->trace = trace;
+    stats->phase = -1;
+    stats->stop = -1;
+    return stats;
+}
+
+/**
+ * Starts timing a phase.
+ * @param stats: Statistics (may be NULL)
+ * @param phase: One of the PHASE_ constants
+ */
+void stats_begin(SymnmfStats* stats, int phase)
+{
+    if (stats == NULL)
+    {
+        return;
+    }
+    stats->phase = phase;
+    stats->started_bytes = (double)matrix_alloc_bytes();
+    stats->started_cpu = cpu_time();
+    stats->started_wall = wall_time();
+}
+
+/**
+ * Stops timing the current phase and adds its time, allocations and flops to it.
+ * @param stats: Statistics (may be NULL)
+ * @param flops: Estimated floating point operations of the phase
+ */
+void stats_end(SymnmfStats* stats, double flops)
+{
+    int phase;
+    if (stats == NULL || stats->phase < 0)
+    {
+        return;
+    }
+    phase = stats->phase;
+    stats->wall[phase] += wall_time() - stats->started_wall;
+    stats->cpu[phase] += cpu_time() - stats->started_cpu;
+    stats->bytes[phase] += (double)matrix_alloc_bytes() - stats->started_bytes;
+    stats->flops[phase] += flops;
+    stats->phase = -1;
+}
+
+/**
+ * Estimates the floating point operations of one multiplicative update iteration:
+ * the product W*H (2 per stored entry of W and column of H), H^T*H, H*(H^T*H) and the update.
+ * @param n: Number of rows of H
+ * @param stored: Entries of W the product reads: n*n for dense, packed and streamed graphs, nnz for CSR
+ * @param k: Number of columns of H
+ * @return: Estimated flops
+ */
+double solve_iteration_flops(int n, double stored, int k)
+{
+    return 2 * stored * k + 4.0 * n * k * k + 8.0 * n * k;
+}
+
+/**
+ * Stops timing the PHASE_SOLVE phase and records the outcome of the solve. The flops count
+ * the iterations this solve ran, not those before a resumed state.
+ * @param stats: Statistics (may be NULL)
+ * @param iteration_flops: Estimated flops of one iteration (see solve_iteration_flops)
+ * @param result: Outcome of the solve
+ */
+void stats_end_solve(SymnmfStats* stats, double iteration_flops, const SolverResult* result)
+{
+    if (stats == NULL)
+    {
+        return;
+    }
+    stats_end(stats, (result->iterations - result->start) * iteration_flops);
+    stats->iterations = result->iterations;
+    stats->stop = result->stop;
+    stats->delta = result->delta;
+}
+
+/**
+ * Returns the name of a phase as used in the JSON and dict outputs.
+ * @param phase: One of the PHASE_ constants
+ * @return: Name, e.g. "solve"
+ */
+const char* stats_phase_name(int phase)
+{
+    return (phase >= 0 && phase < PHASE_COUNT) ? phase_names[phase] : "unknown";
+}
+
+/**
+ * Writes the statistics as a JSON object: per phase wall and CPU seconds, allocated bytes
+ * and flops, the totals, the iteration count and stop reason, the final ||H - old_H||_F and
+ * the objective after every iteration when a trace was attached.
+ * @param file: Output stream
+ * @param stats: Statistics
+ * @return: 1 on success, 0 if a write failed
+ */
+int stats_write_json(FILE* file, const SymnmfStats* stats)
+{
+    int p;
+    int m;
+    double wall = 0.0;
+    double cpu = 0.0;
+    double bytes = 0.0;
+    double flops = 0.0;
+    fprintf(file, "{\n  \"phases\": {\n");
+    for (p = 0; p < PHASE_COUNT; p++)
+    {
+        fprintf(file, "    \"%s\": {\"wall\": %.6e, \"cpu\": %.6e, \"bytes\": %.0f, \"flops\": %.0f}%s\n", phase_names[p],
+                stats->wall[p], stats->cpu[p], stats->bytes[p], stats->flops[p], (p == PHASE_COUNT - 1) ? "" : ",");
+        wall += stats->wall[p];
+        cpu += stats->cpu[p];
+        bytes += stats->bytes[p];
+        flops += stats->flops[p];
+    }
+    fprintf(file, "  },\n  \"wall\": %.6e,\n  \"cpu\": %.6e,\n  \"bytes_allocated\": %.0f,\n  \"flops\": %.0f,\n",
+            wall, cpu, bytes, flops);
+    fprintf(file, "  \"iterations\": %d,\n  \"stop\": ", stats->iterations);
+    if (stats->stop >= 0)
+    {
+        fprintf(file, "\"%s\",\n", stop_names[stats->stop]);
+    }
+    else
+    {
+        fprintf(file, "null,\n");
+    }
+    fprintf(file, "  \"delta\": %.6e", stats->delta);
+    if (stats->trace != NULL)
+    {
+        fprintf(file, ",\n  \"objective\": [");
+        for (m = 0; m <= stats->trace->iterations; m++)
+        {
+            fprintf(file, "%s%.10e", (m == 0) ? "" : ", ", stats->trace->objective[m]);
+        }
+        fprintf(file, "]");
+    }
+    return fprintf(file, "\n}\n") > 0 && !ferror(file);
+}
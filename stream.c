@@ -0,0 +1,186 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "symnmf.h"
+
+/**
+ * Creates a streamed representation of W = D^-1/2 * A * D^-1/2 that keeps only the points,
+ * the degree vector and one tile of rows of W, sized to fit the memory budget.
+ * Building it evaluates every affinity once to obtain the degrees (O(n^2 d) time, O(n) memory).
+ * @param points: Matrix of points, one point per row; must outlive the stream graph
+ * @param memory_budget: Bytes available for the tile of W (at least one row is always used)
+ * @param degrees: Optional output array of n doubles receiving the degree of each point (may be NULL)
+ * @return: Pointer to the stream graph, NULL on failure
+ */
+StreamGraph* stream_graph_create(const Matrix* points, size_t memory_budget, double* degrees)
+{
+    int n = points->rows;
+    int dim = points->cols;
+    int i;
+    int j;
+    size_t tile_rows;
+    double row_sum;
+    StreamGraph* G = (StreamGraph*)calloc(1, sizeof(StreamGraph));
+    if (G == NULL)
+    {
+        printf("An Error Has Occurred\n");
+        return NULL;
+    }
+    tile_rows = (n > 0) ? memory_budget / ((size_t)n * sizeof(double)) : 1;
+    tile_rows = (tile_rows < 1) ? 1 : tile_rows;
+    tile_rows = (tile_rows > (size_t)n && n > 0) ? (size_t)n : tile_rows;
+    G->points = points;
+    G->tile_rows = (int)tile_rows;
+    G->rev_sqr = matrix_create(1, n);
+    G->tile = matrix_create(G->tile_rows, n);
+    if (G->rev_sqr == NULL || G->tile == NULL)
+    {
+        stream_graph_free(G);
+        return NULL;
+    }
+#ifdef _OPENMP
+#pragma omp parallel for private(j, row_sum) schedule(dynamic, 16) num_threads(get_num_threads()) if (n > 64)
+#endif
+    for (i = 0; i < n; i++)
+    {
+        row_sum = 0.0;
+        for (j = 0; j < n; j++)
+        {
+            if (j != i)
+            {
+                row_sum += exp((-0.5) * squared_euc_dis(MAT_ROW(points, i), MAT_ROW(points, j), dim));
+            }
+        }
+        G->rev_sqr->data[i] = row_sum;
+    }
+    if (degrees != NULL)
+    {
+        memcpy(degrees, G->rev_sqr->data, (size_t)n * sizeof(double));
+    }
+    for (i = 0; i < n; i++)
+    {
+        G->rev_sqr->data[i] = 1 / (sqrt(G->rev_sqr->data[i]));
+    }
+    return G;
+}
+
+/**
+ * Frees a stream graph created with stream_graph_create (not the points).
+ * @param G: Stream graph to free (may be NULL)
+ */
+void stream_graph_free(StreamGraph* G)
+{
+    if (G != NULL)
+    {
+        matrix_free(G->rev_sqr);
+        matrix_free(G->tile);
+        free(G);
+    }
+}
+
+/**
+ * Recomputes rows i0 .. i0 + rows - 1 of W into the tile.
+ * The entries equal those of norm_mat_from_points bit for bit.
+ * @param G: Stream graph
+ * @param i0: First row
+ * @param rows: Number of rows, at most G->tile_rows
+ */
+static void fill_tile(StreamGraph* G, int i0, int rows)
+{
+    const Matrix* points = G->points;
+    const double* rev_sqr = G->rev_sqr->data;
+    int n = points->rows;
+    int r;
+    int i;
+    int j;
+    double* T_row;
+#ifdef _OPENMP
+#pragma omp parallel for private(i, j, T_row) schedule(static) num_threads(get_num_threads()) if ((double)rows * n > 4096)
+#endif
+    for (r = 0; r < rows; r++)
+    {
+        i = i0 + r;
+        T_row = MAT_ROW(G->tile, r);
+        for (j = 0; j < n; j++)
+        {
+            T_row[j] = (j == i) ? 0.0 : (rev_sqr[i] * exp((-0.5) * squared_euc_dis(MAT_ROW(points, i), MAT_ROW(points, j), points->cols))) * rev_sqr[j];
+        }
+    }
+}
+
+/**
+ * Computes out = W * H, regenerating W tile by tile from the points.
+ * Each tile is multiplied with gemm_nn, so the result equals the dense product bit for bit.
+ * The tile is scratch space: a stream graph must not be used by two solves at once.
+ * @param G: Stream graph
+ * @param H: Matrix of size n*k
+ * @param out: Output matrix of size n*k, must not alias H
+ */
+void stream_mult(StreamGraph* G, const Matrix* H, Matrix* out)
+{
+    int n = G->points->rows;
+    int i0;
+    int rows;
+    Matrix tile;
+    Matrix out_rows;
+    for (i0 = 0; i0 < n; i0 += G->tile_rows)
+    {
+        rows = (i0 + G->tile_rows < n) ? G->tile_rows : n - i0;
+        fill_tile(G, i0, rows);
+        matrix_view(&tile, G->tile->data, rows, n, G->tile->stride);
+        matrix_view(&out_rows, MAT_ROW(out, i0), rows, out->cols, out->stride);
+        gemm_nn(&tile, H, &out_rows, 0);
+    }
+}
+
+/**
+ * Sums the entries (or their squares) of W tile by tile, in row-major order.
+ * @param G: Stream graph
+ * @param squared: Nonzero to sum the squares of the entries
+ * @return: The sum
+ */
+static double tile_sum(StreamGraph* G, int squared)
+{
+    int n = G->points->rows;
+    int i0;
+    int rows;
+    int r;
+    int j;
+    double sum = 0.0;
+    const double* T_row;
+    for (i0 = 0; i0 < n; i0 += G->tile_rows)
+    {
+        rows = (i0 + G->tile_rows < n) ? G->tile_rows : n - i0;
+        fill_tile(G, i0, rows);
+        for (r = 0; r < rows; r++)
+        {
+            T_row = MAT_ROW(G->tile, r);
+            for (j = 0; j < n; j++)
+            {
+                sum += squared ? T_row[j] * T_row[j] : T_row[j];
+            }
+        }
+    }
+    return sum;
+}
+
+/**
+ * Computes the sum of all entries of W, tile by tile.
+ * @param G: Stream graph
+ * @return: Sum of the entries of W
+ */
+double stream_graph_sum(StreamGraph* G)
+{
+    return tile_sum(G, 0);
+}
+
+/**
+ * Computes the sum of the squares of all entries of W, tile by tile.
+ * @param G: Stream graph
+ * @return: Squared Frobenius norm of W
+ */
+double stream_graph_sum_sq(StreamGraph* G)
+{
+    return tile_sum(G, 1);
+}
@@ -3,12 +3,171 @@
 #include <string.h>
 #include <math.h>
 #include "symnmf.h"
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
-#define EPSILON 0.0001
-#define MAXITER 300
+
+/* Side of the square tiles in which the fused kernel fills the affinity matrix. */
+#define SYM_TILE 64
+
+/* Number of rows whose degrees are accumulated together from packed storage. */
+#define DEG_BLOCK 256
+
+/* Number of doubles in one MATRIX_ALIGN sized block. */
+#define ALIGN_DOUBLES ((int)(MATRIX_ALIGN / sizeof(double)))
+
+static unsigned long matrix_allocations = 0;
+static size_t matrix_bytes = 0;
+static int num_threads = 0;
+
+/**
+ * Sets the number of threads used by the parallel kernels.
+ * @param threads: Number of threads, 0 or less for the OpenMP default
+ */
+void set_num_threads(int threads)
+{
+    threads = (threads > 0) ? threads : 0;
+#ifdef _OPENMP
+#pragma omp atomic write
+#endif
+    num_threads = threads;
+}
+
+/**
+ * Returns the number of threads the parallel kernels will use.
+ * @return: Number of threads (1 when built without OpenMP)
+ */
+int get_num_threads(void)
+{
+#ifdef _OPENMP
+    int threads;
+#pragma omp atomic read
+    threads = num_threads;
+    return (threads > 0) ? threads : omp_get_max_threads();
+#else
+    return 1;
+#endif
+}
+
+/**
+ * Creates a contiguous, row-aligned matrix of size rows*cols initialized to zero.
+ * The header and the data share a single allocation.
+ * @param rows: Number of rows
+ * @param cols: Number of columns
+ * @return: Pointer to the allocated matrix, NULL if allocation failed
+ */
+Matrix* matrix_create(int rows, int cols)
+{
+    Matrix* M;
+    char* block;
+    size_t offset;
+    size_t bytes;
+    int stride;
+    if (rows < 0 || cols < 0)
+    {
+        printf("An Error Has Occurred\n");
+        return NULL;
+    }
+    stride = ((cols + ALIGN_DOUBLES - 1) / ALIGN_DOUBLES) * ALIGN_DOUBLES;
+    if (stride > 0 && (size_t)rows > ((size_t)-1 - 2 * MATRIX_ALIGN) / sizeof(double) / (size_t)stride)
+    {
+        printf("An Error Has Occurred\n");
+        return NULL;
+    }
+    bytes = (size_t)rows * (size_t)stride * sizeof(double);
+    block = (char*)calloc(1, sizeof(Matrix) + MATRIX_ALIGN + bytes);
+    if (block == NULL)
+    {
+        printf("An Error Has Occurred\n");
+        return NULL;
+    }
+    offset = sizeof(Matrix) + MATRIX_ALIGN - 1;
+    offset -= ((size_t)block + offset) % MATRIX_ALIGN;
+#ifdef _OPENMP
+#pragma omp atomic
+#endif
+    matrix_allocations++;
+    matrix_add_bytes(sizeof(Matrix) + MATRIX_ALIGN + bytes);
+    M = (Matrix*)block;
+    M->data = (double*)(block + offset);
+    M->rows = rows;
+    M->cols = cols;
+    M->stride = stride;
+    return M;
+}
+
+/**
+ * Frees a matrix allocated with matrix_create.
+ * @param M: Pointer to the matrix to free (may be NULL)
+ */
+void matrix_free(Matrix* M)
+{
+    free(M);
+}
+
+/**
+ * Returns the number of matrices allocated with matrix_create so far.
+ * @return: Allocation count
+ */
+unsigned long matrix_alloc_count(void)
+{
+    unsigned long count;
+#ifdef _OPENMP
+#pragma omp atomic read
+#endif
+    count = matrix_allocations;
+    return count;
+}
+
+/**
+ * Adds to the number of bytes allocated for matrices (see matrix_alloc_bytes).
+ * @param bytes: Size of a new allocation
+ */
+void matrix_add_bytes(size_t bytes)
+{
+#ifdef _OPENMP
+#pragma omp atomic
+#endif
+    matrix_bytes += bytes;
+}
 
 /**
- * Creates a 2D matrix of size n*k initialized to zero.
+ * Returns the number of bytes allocated so far for dense, packed, sparse and float matrices.
+ * @return: Byte count
+ */
+size_t matrix_alloc_bytes(void)
+{
+    size_t bytes;
+#ifdef _OPENMP
+#pragma omp atomic read
+#endif
+    bytes = matrix_bytes;
+    return bytes;
+}
+
+/**
+ * Fills a caller-provided Matrix header describing existing memory.
+ * The header does not own the memory and must not be passed to matrix_free.
+ * @param view: Header to fill
+ * @param data: Pointer to the first element
+ * @param rows: Number of rows
+ * @param cols: Number of columns
+ * @param stride: Distance in doubles between consecutive rows
+ * @return: The filled header
+ */
+Matrix* matrix_view(Matrix* view, double* data, int rows, int cols, int stride)
+{
+    view->data = data;
+    view->rows = rows;
+    view->cols = cols;
+    view->stride = stride;
+    return view;
+}
+
+/**
+ * Creates a 2D matrix of size n*k initialized to zero (array of row pointers).
+ * Kept for callers that still work with double**.
  * @param n: Number of rows
  * @param k: Number of columns
  * @return: Pointer to the allocated matrix
@@ -41,7 +200,7 @@ double** create_matrix(int n, int k)
 }
 
 /**
- * Frees the allocated memory for a 2D matrix.
+ * Frees the allocated memory for a 2D matrix created with create_matrix.
  * @param matrix: Pointer to the matrix to free
  * @param n: Number of rows in the matrix
  */
@@ -59,462 +218,1657 @@ void free_matrix(double** matrix, int n)
 }
 
 /**
- * Multiplies two matrices.
- * @param M1: First matrix
- * @param M2: Second matrix
- * @param n: Number of rows in M1
- * @param m: Number of columns in M1 and rows in M2
- * @param q: Number of columns in M2
- * @return: Pointer to the resulting matrix
+ * Copies a double** matrix into a new contiguous matrix.
+ * @param rows_ptr: Array of row pointers
+ * @param n: Number of rows
+ * @param k: Number of columns
+ * @return: Pointer to the new matrix, NULL if allocation failed
  */
-double** mat_mult(double** M1, double** M2, int n, int m, int q) 
+Matrix* matrix_from_rows(double** rows_ptr, int n, int k)
 {
     int i;
-    int j;
-    int t;
-    double** M3 = create_matrix(n, q);
-    if (M3 == NULL){
-        free_matrix(M1, n);
-        free_matrix(M2, m);
+    Matrix* M = matrix_create(n, k);
+    if (M == NULL)
+    {
         return NULL;
     }
-    for (i = 0; i < n; i++){
-        for (j = 0; j < q; j++) 
-        {
-            M3[i][j] = 0.0;
-        }
-    }
-    for (i = 0; i < n; i++) {
-        for (j = 0; j < q; j++) 
-        {
-            for (t = 0; t < m; t++) 
-            {
-                M3[i][j] += M1[i][t] * M2[t][j];
-            }
-        }
-    }
-    return M3; 
-}
-
-/**
- * Calculates the squared Euclidean distance between two points.
- * @param point1: First point
- * @param point2: Second point
- * @param dim: Dimensionality of the points
- * @return: Squared Euclidean distance
- */
-double squared_euc_dis(double *point1, double *point2, int dim)
-{
-    double accu = 0.0;
-    int counter = 0;
-    while (counter < dim)
+    for (i = 0; i < n; i++)
     {
-        accu += pow((point1[counter] - point2[counter]), 2);
-        counter++;
+        memcpy(MAT_ROW(M, i), rows_ptr[i], (size_t)k * sizeof(double));
     }
-    return accu;
+    return M;
 }
 
 /**
- * Computes the similarity matrix from a set of points.
- * 
- * @param points: Pointer to the array of points
- * @param n: Number of points
- * @param dim: Dimensionality of each point
- * @return: Pointer to the similarity matrix
+ * Copies a contiguous matrix into a new double** matrix (see create_matrix).
+ * @param M: Matrix to copy
+ * @return: Array of row pointers, NULL if allocation failed
  */
-double** sym_mat(double** points, int n, int dim)
+double** matrix_to_rows(const Matrix* M)
 {
     int i;
-    int j;
-    double** A = create_matrix(n, n);
-    if (A == NULL)
+    double** rows_ptr = create_matrix(M->rows, M->cols);
+    if (rows_ptr == NULL)
     {
-        free_matrix(points, n);
         return NULL;
     }
-    for (i = 0; i < n; i++)
+    for (i = 0; i < M->rows; i++)
     {
-        for (j = 0; j < n; j++)
-        {
-            if (i != j)
-            {
-                A[i][j] = exp((-0.5) * squared_euc_dis(points[i], points[j], dim));
-            }
-            else
-            {
-                A[i][j] = 0.0;
-            }
-        }
+        memcpy(rows_ptr[i], MAT_ROW(M, i), (size_t)M->cols * sizeof(double));
     }
-    return A;
+    return rows_ptr;
 }
 
 /**
- * Computes the diagonal degree matrix from a similarity matrix.
- * 
- * @param A: Similarity matrix
- * @param n: Size of the matrix
- * @return: Pointer to the diagonal degree matrix
+ * Creates a packed symmetric n*n matrix initialized to zero.
+ * Only the upper triangle (including the diagonal) is stored, row by row.
+ * @param n: Number of rows and columns
+ * @return: Pointer to the allocated matrix, NULL if allocation failed
  */
-double** diag_mat(double** A, int n)
+PackedMatrix* packed_create(int n)
 {
-    double row_sum = 0.0;
-    int i;
-    int j;
-    double** D = create_matrix(n, n);
-    if (D == NULL)
+    PackedMatrix* P;
+    char* block;
+    size_t offset;
+    size_t count;
+    if (n < 0)
     {
-        free_matrix(A, n);
+        printf("An Error Has Occurred\n");
         return NULL;
     }
-    for (i = 0; i < n; i++)
+    if (n > 0 && (size_t)n / 2 + 1 > ((size_t)-1 - 2 * MATRIX_ALIGN) / sizeof(double) / (size_t)n)
     {
-        for (j = 0; j < n; j++)
-        {
-            row_sum += A[i][j];
-        }
-        D[i][i] = row_sum;
-        row_sum = 0.0;
+        printf("An Error Has Occurred\n");
+        return NULL;
     }
-    return D;
+    count = (size_t)n * ((size_t)n + 1) / 2;
+    block = (char*)calloc(1, sizeof(PackedMatrix) + MATRIX_ALIGN + count * sizeof(double));
+    if (block == NULL)
+    {
+        printf("An Error Has Occurred\n");
+        return NULL;
+    }
+#ifdef _OPENMP
+#pragma omp atomic
+#endif
+    matrix_allocations++;
+    matrix_add_bytes(sizeof(PackedMatrix) + MATRIX_ALIGN + count * sizeof(double));
+    offset = sizeof(PackedMatrix) + MATRIX_ALIGN - 1;
+    offset -= ((size_t)block + offset) % MATRIX_ALIGN;
+    P = (PackedMatrix*)block;
+    P->data = (double*)(block + offset);
+    P->n = n;
+    return P;
 }
 
 /**
- * Normalizes a similarity matrix using the diagonal degree matrix.
- * @param D: Diagonal degree matrix
- * @param A: Similarity matrix
- * @param n: Size of the matrices
- * @return: Pointer to the normalized matrix
+ * Frees a packed matrix allocated with packed_create.
+ * @param P: Pointer to the matrix to free (may be NULL)
  */
-double** norm_mat(double** D, double** A, int n)
+void packed_free(PackedMatrix* P)
 {
-    int i;
-    double** rev_sqr_D = create_matrix(n, n);
-    double** temp_res;
-    double** res;
-    if (rev_sqr_D == NULL){
-        free_matrix(D, n);
-        free_matrix(A, n);
-        return NULL;
-    }
-    for (i = 0; i < n; i++){
-        rev_sqr_D[i][i] = 1 / (sqrt(D[i][i]));
-    }
-    temp_res = mat_mult(rev_sqr_D, A, n, n, n);
-    if (temp_res == NULL){
-        free_matrix(D, n);
-        return NULL;
-    }
-    res = mat_mult(temp_res, rev_sqr_D, n, n, n);
-    if (res == NULL){
-        free_matrix(D, n);
-        free_matrix(A, n);
-        return NULL;
-    }
-    free_matrix(temp_res, n);
-    free_matrix(rev_sqr_D, n);
-    return res;
+    free(P);
 }
 
 /**
- * Computes the average of the entries in a matrix.
- * @param M: Pointer to the matrix
- * @param n: Size of the matrix
- * @return: Average value of the matrix entries
+ * Packs the upper triangle of a square matrix.
+ * @param M: Square matrix, assumed symmetric
+ * @return: Pointer to the packed matrix, NULL if allocation failed
  */
-double mat_entry_avg(double** M, int n)
+PackedMatrix* packed_from_matrix(const Matrix* M)
 {
     int i;
-    int j;
-    double sum = 0.0;
-    double avg = 0.0;
+    int n = M->rows;
+    PackedMatrix* P = packed_create(n);
+    if (P == NULL)
+    {
+        return NULL;
+    }
     for (i = 0; i < n; i++)
     {
-        for (j = 0; j < n; j++)
-        {
-            sum += M[i][j];
-        }
+        memcpy(PACKED_ROW(P, i), MAT_ROW(M, i) + i, (size_t)(n - i) * sizeof(double));
     }
-    avg = sum / (n * n);
-    return avg;
+    return P;
 }
 
 /**
- * Transposes a matrix.
- * @param M: Pointer to the matrix
- * @param n: Number of rows
- * @param m: Number of columns
- * @return: Pointer to the transposed matrix
+ * Expands a packed symmetric matrix into a full square matrix.
+ * @param P: Packed matrix
+ * @return: Pointer to the full matrix, NULL if allocation failed
  */
-double** transpose_matrix(double** M, int n, int m) 
+Matrix* packed_to_matrix(const PackedMatrix* P)
 {
     int i;
     int j;
-    double** trans = create_matrix(m, n);
-    if (trans == NULL)
+    int n = P->n;
+    const double* P_row;
+    Matrix* M = matrix_create(n, n);
+    if (M == NULL)
     {
-        free_matrix(M, n);
         return NULL;
     }
     for (i = 0; i < n; i++)
     {
-        for (j = 0; j < m; j++)
+        P_row = PACKED_ROW(P, i);
+        for (j = i; j < n; j++)
         {
-            trans[j][i] = M[i][j];
+            MAT_AT(M, i, j) = P_row[j - i];
+            MAT_AT(M, j, i) = P_row[j - i];
         }
     }
-    return trans;
+    return M;
 }
 
 /**
- * Calculates the Frobenius norm of a matrix.
- * @param M: Pointer to the matrix
- * @param n: Number of rows
- * @param m: Number of columns
- * @return: Frobenius norm
+ * Multiplies two matrices.
+ * @param M1: First matrix (n*m)
+ * @param M2: Second matrix (m*q)
+ * @return: Pointer to the resulting n*q matrix, NULL on failure
  */
-double forb(double** M, int n, int m)
+Matrix* mat_mult(const Matrix* M1, const Matrix* M2) 
 {
-    int i;
-    double** temp_mat;
-    double trace = 0.0;
-    double** trans_mat = transpose_matrix(M, n, m);
-    temp_mat = mat_mult(trans_mat, M, m, n, m);
-    for (i = 0; i < m; i++)
+    Matrix* M3 = matrix_create(M1->rows, M2->cols);
+    if (M3 == NULL){
+        return NULL;
+    }
+    gemm_nn(M1, M2, M3, 1);
+    return M3; 
+}
+
+/**
+ * Calculates the squared Euclidean distance between two points.
+ * @param point1: First point
+ * @param point2: Second point
+ * @param dim: Dimensionality of the points
+ * @return: Squared Euclidean distance
+ */
+double squared_euc_dis(const double* point1, const double* point2, int dim)
+{
+    double accu = 0.0;
+    double diff;
+    int counter = 0;
+    while (counter < dim)
     {
-        trace += temp_mat[i][i];
+        diff = point1[counter] - point2[counter];
+        accu += diff * diff;
+        counter++;
     }
-    return trace;
+    return accu;
 }
 
 /**
- * performnig the calculations needed to compute H when calling opt_mat_with_H using the matrices H and W.
- * @param H: Matrix H
- * @param W: Matrix W
- * @param n: Number of rows in H
- * @param k: Number of columns in H
- * @param mone: Matrix mone
- * @param mechane: Matrix mechane
- * @param old_H: Matrix old_H
- * @return: an integer =0 if memory allocation failed, else returns integer = 1
+ * Keeps the nearest and second nearest candidates of nearest_row.
+ * @param d: Squared distance to candidate c
+ * @param c: Candidate index, increasing from call to call
+ * @param nearest: Index of the nearest candidate so far
+ * @param best: Squared distance to the nearest candidate so far
+ * @param second: Squared distance to the second nearest candidate so far
  */
-double calcul(double **H, double** W, int n, int k,double**mone,double** mechane,double** old_H)
+static void keep_nearest(double d, int c, int* nearest, double* best, double* second)
 {
-    int m;
-    int i;
-    int j;
-    for (m = 0; m < MAXITER; m++) {
-        for (i = 0; i < n; i++) {
-            for (j = 0; j < k; j++) {
-                old_H[i][j] = H[i][j];}}
-        mone = mat_mult(W, old_H, n, n, k);
-        if (mone == NULL) {
-            if (H != NULL) { free_matrix(H, n); }
-            if (mechane != NULL) { free_matrix(mechane, n); }
-            return 0;}
-        mechane = mat_mult(mat_mult(old_H, transpose_matrix(old_H, n, k), n, k, n), old_H, n, n, k);
-        if (mechane == NULL) {
-            free_matrix(H, n);
-            free_matrix(mone, n);
-            return 0; }
-        for (i = 0; i < n; i++) {
-            for (j = 0; j < k; j++) {
-                H[i][j] = old_H[i][j] * (0.5 + 0.5 * (mone[i][j] / mechane[i][j]));}}
-        for (i = 0; i < n; i++) {
-            for (j = 0; j < k; j++) {
-                old_H[i][j] = H[i][j] - old_H[i][j];}}
-        if (forb(old_H, n, k) < EPSILON) { break; }}
-        return 1;
+    if (d < *best)
+    {
+        *second = *best;
+        *best = d;
+        *nearest = c;
+    }
+    else if (d < *second)
+    {
+        *second = d;
+    }
 }
 
 /**
- * Optimizes the matrix H using the matrices H and W.
- * @param H: Matrix H
- * @param W: Matrix W
- * @param n: Number of rows in H
- * @param k: Number of columns in H
- * @return: Pointer to the optimized matrix H
+ * Finds the row of C nearest to a point. Four rows are measured together, each with its own
+ * accumulator summed in the order of squared_euc_dis, so the distances are identical to it.
+ * @param point: Point of C->cols coordinates
+ * @param C: Candidate rows (at least one)
+ * @param best: Receives the squared distance to the nearest row
+ * @param second: Optional, receives the squared distance to the second nearest row (HUGE_VAL if C has one row)
+ * @return: Index of the nearest row, the lowest one on ties
  */
-double ** opt_mat_with_H(double **H, double** W, int n, int k)
+int nearest_row(const double* point, const Matrix* C, double* best, double* second)
 {
-    double** mone = NULL;
-    double** mechane = NULL;
-    double** old_H = NULL;
-    old_H = create_matrix(n, k);
-    if (old_H == NULL) 
+    int c;
+    int j;
+    int dim = C->cols;
+    int nearest = 0;
+    double d0, d1, d2, d3;
+    double diff;
+    double best_d = HUGE_VAL;
+    double second_d = HUGE_VAL;
+    const double *r0, *r1, *r2, *r3;
+    for (c = 0; c + 4 <= C->rows; c += 4)
     {
-        free_matrix(H, n);
-        free_matrix(W, n);
-        return NULL;}
-    if(calcul(H,  W, n,  k, mone, mechane, old_H) ==0)
+        r0 = MAT_ROW(C, c);
+        r1 = MAT_ROW(C, c + 1);
+        r2 = MAT_ROW(C, c + 2);
+        r3 = MAT_ROW(C, c + 3);
+        d0 = d1 = d2 = d3 = 0.0;
+        for (j = 0; j < dim; j++)
+        {
+            diff = point[j] - r0[j];
+            d0 += diff * diff;
+            diff = point[j] - r1[j];
+            d1 += diff * diff;
+            diff = point[j] - r2[j];
+            d2 += diff * diff;
+            diff = point[j] - r3[j];
+            d3 += diff * diff;
+        }
+        keep_nearest(d0, c, &nearest, &best_d, &second_d);
+        keep_nearest(d1, c + 1, &nearest, &best_d, &second_d);
+        keep_nearest(d2, c + 2, &nearest, &best_d, &second_d);
+        keep_nearest(d3, c + 3, &nearest, &best_d, &second_d);
+    }
+    for (; c < C->rows; c++)
     {
-        return NULL;
+        keep_nearest(squared_euc_dis(point, MAT_ROW(C, c), dim), c, &nearest, &best_d, &second_d);
     }
-    else
+    *best = best_d;
+    if (second != NULL)
     {
-        free_matrix(old_H, n);
-        free_matrix(mone, n);
-        free_matrix(mechane, n);
-        return H;
+        *second = second_d;
     }
+    return nearest;
 }
- 
+
 /**
- * Prints a matrix to the console.
- * @param res: Pointer to the matrix
- * @param rows: Number of rows
- * @param cols: Number of columns
+ * Fills the off-diagonal entries of A with the Gaussian affinities of the points.
+ * Only pairs i < j are evaluated, in SYM_TILE*SYM_TILE tiles, and mirrored into the lower triangle.
+ * @param points: Matrix of points, one point per row
+ * @param A: n*n output matrix whose diagonal is already zero
  */
-void printMatrix(double** res, int rows, int cols) 
+static void fill_affinities(const Matrix* points, Matrix* A)
 {
+    int n = points->rows;
+    int dim = points->cols;
+    int tiles = (n + SYM_TILE - 1) / SYM_TILE;
+    int ti;
+    int tj;
     int i;
     int j;
-    for (i = 0; i < rows; i++) 
+    int i_end;
+    int j_end;
+    double a;
+    double* A_row;
+#ifdef _OPENMP
+#pragma omp parallel for private(tj, i, j, i_end, j_end, a, A_row) schedule(dynamic, 1) num_threads(get_num_threads()) if (n > 64)
+#endif
+    for (ti = 0; ti < tiles; ti++)
     {
-        for (j = 0; j < cols; j++) 
+        i_end = (ti + 1) * SYM_TILE < n ? (ti + 1) * SYM_TILE : n;
+        for (tj = ti; tj < tiles; tj++)
         {
-            if (j == cols - 1) 
-            {
-                printf("%.4f", res[i][j]); 
-            } else 
+            j_end = (tj + 1) * SYM_TILE < n ? (tj + 1) * SYM_TILE : n;
+            for (i = ti * SYM_TILE; i < i_end; i++)
             {
-                printf("%.4f,", res[i][j]); 
+                A_row = MAT_ROW(A, i);
+                for (j = (tj == ti) ? i + 1 : tj * SYM_TILE; j < j_end; j++)
+                {
+                    a = exp((-0.5) * squared_euc_dis(MAT_ROW(points, i), MAT_ROW(points, j), dim));
+                    A_row[j] = a;
+                    MAT_AT(A, j, i) = a;
+                }
             }
         }
-        printf("\n"); 
     }
 }
 
 /**
- * Counts the number of rows in a file.
- * @param filename: Name of the file
- * @return: Number of rows in the file
+ * Computes the similarity matrix from a set of points.
+ * Each pair is evaluated once and mirrored.
+ * 
+ * @param points: Matrix of points, one point per row
+ * @return: Pointer to the similarity matrix
  */
-int count_rows_from_file(char* filename)
+Matrix* sym_mat(const Matrix* points)
 {
-    char ch;
-    int rows = 0;
-    FILE *file;
-    file = fopen(filename, "r");
-    if (!file)
-    {
-        return -1;
-    }
-    while (fscanf(file, "%c", &ch) == 1)
+    Matrix* A = matrix_create(points->rows, points->rows);
+    if (A == NULL)
     {
-        if (ch == '\n')
-        {
-            rows += 1;
-        }
+        return NULL;
     }
-    fclose(file);
-    return rows;
+    fill_affinities(points, A);
+    return A;
 }
 
 /**
- * Counts the number of columns in a file.
- * @param filename: Name of the file
- * @return: Number of columns in the first row of the file
+ * Computes the similarity matrix from a set of points into a caller-provided matrix.
+ * @param points: Matrix of points, one point per row
+ * @param A: n*n output matrix (any stride), must not overlap the points
+ * @return: A
  */
-int count_cols_from_file(char* filename)
+Matrix* sym_mat_into(const Matrix* points, Matrix* A)
 {
-    char ch;
-    int cols = 1;
-    FILE *file;
-    file = fopen(filename, "r");
-    if (!file)
-    {
-        return -1;
-    }
-    while (fscanf(file, "%c", &ch) == 1 && ch != '\n') 
+    int i;
+    for (i = 0; i < A->rows; i++)
     {
-        if (ch == ',') 
-        {
-            cols++;
-        }
+        MAT_AT(A, i, i) = 0.0;
     }
-    fclose(file);
-    return cols;
+    fill_affinities(points, A);
+    return A;
 }
 
 /**
- * Creates a 2D array from a file.
- * @param filename: Name of the file
- * @param rows: Number of rows
- * @param cols: Number of columns
- * @return: Pointer to the created array
+ * Computes the diagonal degree matrix from a similarity matrix.
+ * Every row sum is accumulated by a single thread in column order,
+ * so the result does not depend on the number of threads.
+ * 
+ * @param A: Similarity matrix
+ * @return: Pointer to the diagonal degree matrix
  */
-double** create_array_from_file(char* filename, int rows, int cols)
+Matrix* diag_mat(const Matrix* A)
 {
-    int i;
-    int j;
-    double** final_array = create_matrix(rows, cols);
-    FILE *file;
-    file = fopen(filename, "r");
-    if (!file){
-        printf("An Error Has Occurred\n");
+    Matrix* D = matrix_create(A->rows, A->rows);
+    if (D == NULL)
+    {
         return NULL;
     }
-    for (i = 0; i < rows; i++) {
-        for (j = 0; j < cols; j++){
-            if (j == cols - 1) {
-                if (fscanf(file, "%lf", &final_array[i][j]) != 1) {
-                    fclose(file);
-                    free_matrix(final_array, rows);
-                    return NULL;  
-                }
-            } else 
-            {
-                if (fscanf(file, "%lf,", &final_array[i][j]) != 1) {
-                    fclose(file);
-                    free_matrix(final_array, rows);
-                    return NULL;  
-                }
-            }
-        }
-    }
-    fclose(file);  
-    return final_array;  
+    return diag_mat_into(A, D);
 }
 
-
 /**
- * Main function for the program, checks if reading the inputs went ok and calls the right functions according to the chosen goal.
- * @param argc: Argument count
- * @param argv: Argument vector
- * @return: Exit status, 0 if ok, 1 if error
+ * Computes the diagonal degree matrix from a similarity matrix into a caller-provided matrix.
+ * Row i of A is read only before row i of D is written, so D may be A itself.
+ * @param A: Similarity matrix
+ * @param D: n*n output matrix (any stride), may be the same matrix as A
+ * @return: D
+ */
+Matrix* diag_mat_into(const Matrix* A, Matrix* D)
+{
+    double row_sum;
+    int i;
+    int j;
+    int n = A->rows;
+    const double* A_row;
+    double* D_row;
+#ifdef _OPENMP
+#pragma omp parallel for private(j, A_row, D_row, row_sum) schedule(static) num_threads(get_num_threads()) if (n > 256)
+#endif
+    for (i = 0; i < n; i++)
+    {
+        A_row = MAT_ROW(A, i);
+        row_sum = 0.0;
+        for (j = 0; j < n; j++)
+        {
+            row_sum += A_row[j];
+        }
+        D_row = MAT_ROW(D, i);
+        for (j = 0; j < n; j++)
+        {
+            D_row[j] = 0.0;
+        }
+        D_row[i] = row_sum;
+    }
+    return D;
+}
+
+/**
+ * Normalizes a similarity matrix using the diagonal degree matrix.
+ * D^-1/2 * A * D^-1/2 is applied as a row and column scaling of A
+ * instead of two products with a dense diagonal matrix.
+ * @param D: Diagonal degree matrix
+ * @param A: Similarity matrix
+ * @return: Pointer to the normalized matrix
+ */
+Matrix* norm_mat(const Matrix* D, const Matrix* A)
+{
+    int i;
+    int j;
+    int n = A->rows;
+    double rev_sqr_i;
+    const double* A_row;
+    double* res_row;
+    Matrix* rev_sqr_D = matrix_create(1, n);
+    Matrix* res;
+    if (rev_sqr_D == NULL){
+        return NULL;
+    }
+    res = matrix_create(n, n);
+    if (res == NULL){
+        matrix_free(rev_sqr_D);
+        return NULL;
+    }
+    for (i = 0; i < n; i++){
+        rev_sqr_D->data[i] = 1 / (sqrt(MAT_AT(D, i, i)));
+    }
+#ifdef _OPENMP
+#pragma omp parallel for private(j, rev_sqr_i, A_row, res_row) schedule(static) num_threads(get_num_threads()) if (n > 256)
+#endif
+    for (i = 0; i < n; i++){
+        rev_sqr_i = rev_sqr_D->data[i];
+        A_row = MAT_ROW(A, i);
+        res_row = MAT_ROW(res, i);
+        for (j = 0; j < n; j++){
+            res_row[j] = (rev_sqr_i * A_row[j]) * rev_sqr_D->data[j];
+        }
+    }
+    matrix_free(rev_sqr_D);
+    return res;
+}
+
+/**
+ * Computes the normalized similarity matrix W = D^-1/2 * A * D^-1/2 directly from the points.
+ * Only the upper triangle of the Gaussian affinities is evaluated, tile by tile, and mirrored;
+ * the degrees are kept as a vector and the scaling is done in place, so the only n*n
+ * buffer is the returned matrix. The values are identical to norm_mat(diag_mat(A), A).
+ * @param points: Matrix of points, one point per row
+ * @param degrees: Optional output array of n doubles receiving the degree of each point (may be NULL)
+ * @return: Pointer to the normalized matrix, NULL on failure
+ */
+Matrix* norm_mat_from_points(const Matrix* points, double* degrees)
+{
+    Matrix* W = matrix_create(points->rows, points->rows);
+    if (W == NULL)
+    {
+        return NULL;
+    }
+    if (norm_mat_into(points, W, degrees) == NULL)
+    {
+        matrix_free(W);
+        return NULL;
+    }
+    return W;
+}
+
+/**
+ * Computes the normalized similarity matrix from the points into a caller-provided matrix,
+ * exactly as norm_mat_from_points does.
+ * @param points: Matrix of points, one point per row
+ * @param W: n*n output matrix (any stride), must not overlap the points
+ * @param degrees: Optional output array of n doubles receiving the degree of each point (may be NULL)
+ * @return: W, NULL if the temporary degree vectors could not be allocated
+ */
+Matrix* norm_mat_into(const Matrix* points, Matrix* W, double* degrees)
+{
+    return norm_mat_in_place(sym_mat_into(points, W), degrees);
+}
+
+/**
+ * Normalizes a similarity matrix A in place into W = D^-1/2 * A * D^-1/2, where D holds
+ * the row sums of A. norm_mat_in_place(sym_mat(points)) is identical to norm_mat_from_points.
+ * @param W: n*n similarity matrix (any stride), overwritten with the normalized matrix
+ * @param degrees: Optional output array of n doubles receiving the degree of each point (may be NULL)
+ * @return: W, NULL if the temporary degree vectors could not be allocated
+ */
+Matrix* norm_mat_in_place(Matrix* W, double* degrees)
+{
+    int n = W->rows;
+    int i;
+    int j;
+    double row_sum;
+    double rev_sqr_i;
+    double* W_row;
+    double* deg;
+    double* rev_sqr;
+    Matrix* vectors = matrix_create(2, n);
+    if (vectors == NULL)
+    {
+        return NULL;
+    }
+    deg = MAT_ROW(vectors, 0);
+    rev_sqr = MAT_ROW(vectors, 1);
+#ifdef _OPENMP
+#pragma omp parallel num_threads(get_num_threads()) if (n > 64) private(i, j, row_sum, rev_sqr_i, W_row)
+#endif
+    {
+#ifdef _OPENMP
+#pragma omp for schedule(static)
+#endif
+        for (i = 0; i < n; i++)
+        {
+            W_row = MAT_ROW(W, i);
+            row_sum = 0.0;
+            for (j = 0; j < n; j++)
+            {
+                row_sum += W_row[j];
+            }
+            deg[i] = row_sum;
+            rev_sqr[i] = 1 / (sqrt(row_sum));
+        }
+#ifdef _OPENMP
+#pragma omp for schedule(static)
+#endif
+        for (i = 0; i < n; i++)
+        {
+            W_row = MAT_ROW(W, i);
+            rev_sqr_i = rev_sqr[i];
+            for (j = 0; j < n; j++)
+            {
+                W_row[j] = (rev_sqr_i * W_row[j]) * rev_sqr[j];
+            }
+        }
+    }
+    if (degrees != NULL)
+    {
+        memcpy(degrees, deg, (size_t)n * sizeof(double));
+    }
+    matrix_free(vectors);
+    return W;
+}
+
+/**
+ * Computes the similarity matrix from a set of points in packed storage.
+ * Each pair is evaluated once and stored once.
+ * @param points: Matrix of points, one point per row
+ * @return: Pointer to the packed similarity matrix, NULL on failure
+ */
+PackedMatrix* sym_mat_packed(const Matrix* points)
+{
+    int i;
+    int j;
+    int n = points->rows;
+    int dim = points->cols;
+    double* A_row;
+    PackedMatrix* A = packed_create(n);
+    if (A == NULL)
+    {
+        return NULL;
+    }
+#ifdef _OPENMP
+#pragma omp parallel for private(j, A_row) schedule(dynamic, 16) num_threads(get_num_threads()) if (n > 64)
+#endif
+    for (i = 0; i < n; i++)
+    {
+        A_row = PACKED_ROW(A, i);
+        for (j = i + 1; j < n; j++)
+        {
+            A_row[j - i] = exp((-0.5) * squared_euc_dis(MAT_ROW(points, i), MAT_ROW(points, j), dim));
+        }
+    }
+    return A;
+}
+
+/**
+ * Computes the row sums of a packed symmetric matrix.
+ * Row i is summed over columns 0..n-1 in order (the entries left of the diagonal are read
+ * from the rows above), which matches diag_mat on the expanded matrix bit for bit.
+ * Output rows are processed in blocks so that the column reads stay contiguous.
+ * @param P: Packed symmetric matrix
+ * @param sums: Output array of n doubles
+ */
+static void packed_row_sums(const PackedMatrix* P, double* sums)
+{
+    int n = P->n;
+    int blocks = (n + DEG_BLOCK - 1) / DEG_BLOCK;
+    int b;
+    int i;
+    int j;
+    int j0;
+    int j1;
+    const double* P_row;
+#ifdef _OPENMP
+#pragma omp parallel for private(i, j, j0, j1, P_row) schedule(dynamic, 1) num_threads(get_num_threads()) if (n > DEG_BLOCK)
+#endif
+    for (b = 0; b < blocks; b++)
+    {
+        j0 = b * DEG_BLOCK;
+        j1 = (j0 + DEG_BLOCK < n) ? j0 + DEG_BLOCK : n;
+        for (j = j0; j < j1; j++)
+        {
+            sums[j] = 0.0;
+        }
+        for (i = 0; i < j1 - 1; i++)
+        {
+            P_row = PACKED_ROW(P, i) - i;
+            for (j = (i + 1 > j0) ? i + 1 : j0; j < j1; j++)
+            {
+                sums[j] += P_row[j];
+            }
+        }
+        for (j = j0; j < j1; j++)
+        {
+            P_row = PACKED_ROW(P, j) - j;
+            for (i = j; i < n; i++)
+            {
+                sums[j] += P_row[i];
+            }
+        }
+    }
+}
+
+/**
+ * Computes the normalized similarity matrix W = D^-1/2 * A * D^-1/2 in packed storage.
+ * Uses half the memory and half the exp() calls of norm_mat_from_points; the stored
+ * upper triangle is bit-identical to the upper triangle of the dense result.
+ * @param points: Matrix of points, one point per row
+ * @param degrees: Optional output array of n doubles receiving the degree of each point (may be NULL)
+ * @return: Pointer to the packed normalized matrix, NULL on failure
+ */
+PackedMatrix* norm_mat_packed(const Matrix* points, double* degrees)
+{
+    PackedMatrix* W = sym_mat_packed(points);
+    if (W == NULL || norm_packed_in_place(W, degrees) != NULL)
+    {
+        return W;
+    }
+    packed_free(W);
+    return NULL;
+}
+
+/**
+ * Normalizes a packed similarity matrix in place, as norm_mat_in_place does a dense one:
+ * norm_packed_in_place(sym_mat_packed(points)) is identical to norm_mat_packed.
+ * @param W: Packed similarity matrix, overwritten with the normalized matrix
+ * @param degrees: Optional output array of n doubles receiving the degree of each point (may be NULL)
+ * @return: W, NULL if the temporary degree vectors could not be allocated (W is left unchanged)
+ */
+PackedMatrix* norm_packed_in_place(PackedMatrix* W, double* degrees)
+{
+    int n = W->n;
+    int i;
+    int j;
+    double rev_sqr_i;
+    double* W_row;
+    double* rev_sqr;
+    Matrix* vectors = matrix_create(2, n);
+    if (vectors == NULL)
+    {
+        return NULL;
+    }
+    rev_sqr = MAT_ROW(vectors, 1);
+    packed_row_sums(W, MAT_ROW(vectors, 0));
+    for (i = 0; i < n; i++)
+    {
+        rev_sqr[i] = 1 / (sqrt(MAT_AT(vectors, 0, i)));
+    }
+#ifdef _OPENMP
+#pragma omp parallel for private(j, rev_sqr_i, W_row) schedule(dynamic, 64) num_threads(get_num_threads()) if (n > 256)
+#endif
+    for (i = 0; i < n; i++)
+    {
+        W_row = PACKED_ROW(W, i) - i;
+        rev_sqr_i = rev_sqr[i];
+        for (j = i; j < n; j++)
+        {
+            W_row[j] = (rev_sqr_i * W_row[j]) * rev_sqr[j];
+        }
+    }
+    if (degrees != NULL)
+    {
+        memcpy(degrees, MAT_ROW(vectors, 0), (size_t)n * sizeof(double));
+    }
+    matrix_free(vectors);
+    return W;
+}
+
+/**
+ * Computes the average of the entries in a matrix.
+ * @param M: Pointer to the matrix
+ * @return: Average value of the matrix entries
+ */
+double mat_entry_avg(const Matrix* M)
+{
+    int i;
+    int j;
+    double sum = 0.0;
+    double avg = 0.0;
+    const double* M_row;
+    for (i = 0; i < M->rows; i++)
+    {
+        M_row = MAT_ROW(M, i);
+        for (j = 0; j < M->cols; j++)
+        {
+            sum += M_row[j];
+        }
+    }
+    avg = sum / ((double)M->rows * M->cols);
+    return avg;
+}
+
+/**
+ * Transposes a matrix.
+ * @param M: Pointer to the matrix
+ * @return: Pointer to the transposed matrix
+ */
+Matrix* transpose_matrix(const Matrix* M) 
+{
+    int i;
+    int j;
+    const double* M_row;
+    Matrix* trans = matrix_create(M->cols, M->rows);
+    if (trans == NULL)
+    {
+        return NULL;
+    }
+    for (i = 0; i < M->rows; i++)
+    {
+        M_row = MAT_ROW(M, i);
+        for (j = 0; j < M->cols; j++)
+        {
+            MAT_AT(trans, j, i) = M_row[j];
+        }
+    }
+    return trans;
+}
+
+/**
+ * Computes the k*k Gram matrix H^T * H.
+ * @param H: Matrix of size n*k
+ * @return: Pointer to the Gram matrix, NULL on failure
+ */
+Matrix* gram_mat(const Matrix* H)
+{
+    Matrix* G = matrix_create(H->cols, H->cols);
+    if (G == NULL)
+    {
+        return NULL;
+    }
+    gemm_tn(H, H, G, 0);
+    return G;
+}
+
+/**
+ * Calculates the squared Frobenius norm of a matrix.
+ * @param M: Pointer to the matrix
+ * @return: Squared Frobenius norm
+ */
+double forb(const Matrix* M)
+{
+    int i;
+    int t;
+    double col_sum;
+    double trace = 0.0;
+    for (i = 0; i < M->cols; i++)
+    {
+        col_sum = 0.0;
+        for (t = 0; t < M->rows; t++)
+        {
+            col_sum += MAT_AT(M, t, i) * MAT_AT(M, t, i);
+        }
+        trace += col_sum;
+    }
+    return trace;
+}
+
+/**
+ * Describes a dense n*n matrix W as a graph operand for the solver.
+ * @param graph: Header to fill
+ * @param W: Dense square matrix
+ * @return: The filled header
+ */
+Graph* graph_dense(Graph* graph, const Matrix* W)
+{
+    memset(graph, 0, sizeof(Graph));
+    graph->kind = GRAPH_DENSE;
+    graph->n = W->rows;
+    graph->dense = W;
+    return graph;
+}
+
+/**
+ * Describes a packed symmetric matrix W as a graph operand for the solver.
+ * @param graph: Header to fill
+ * @param W: Packed symmetric matrix
+ * @return: The filled header
+ */
+Graph* graph_packed(Graph* graph, const PackedMatrix* W)
+{
+    memset(graph, 0, sizeof(Graph));
+    graph->kind = GRAPH_PACKED;
+    graph->n = W->n;
+    graph->packed = W;
+    return graph;
+}
+
+/**
+ * Describes a sparse matrix W as a graph operand for the solver.
+ * @param graph: Header to fill
+ * @param W: CSR matrix
+ * @return: The filled header
+ */
+Graph* graph_csr(Graph* graph, const CsrMatrix* W)
+{
+    memset(graph, 0, sizeof(Graph));
+    graph->kind = GRAPH_CSR;
+    graph->n = W->n;
+    graph->csr = W;
+    return graph;
+}
+
+/**
+ * Describes a streamed W as a graph operand for the solver.
+ * @param graph: Header to fill
+ * @param W: Stream graph
+ * @return: The filled header
+ */
+Graph* graph_stream(Graph* graph, StreamGraph* W)
+{
+    memset(graph, 0, sizeof(Graph));
+    graph->kind = GRAPH_STREAM;
+    graph->n = W->points->rows;
+    graph->stream = W;
+    return graph;
+}
+
+/**
+ * Computes the average of the entries of W for any storage format.
+ * The entries are summed in row-major order, so the result equals mat_entry_avg
+ * on the expanded dense matrix bit for bit.
+ * @param W: Graph operand
+ * @return: Average value of the n*n entries of W
+ */
+double graph_entry_avg(const Graph* W)
+{
+    int i;
+    int j;
+    size_t e;
+    double sum = 0.0;
+    const double* P_row;
+    switch (W->kind)
+    {
+    case GRAPH_PACKED:
+        for (i = 0; i < W->n; i++)
+        {
+            for (j = 0; j < i; j++)
+            {
+                sum += PACKED_ROW(W->packed, j)[i - j];
+            }
+            P_row = PACKED_ROW(W->packed, i);
+            for (j = 0; j < W->n - i; j++)
+            {
+                sum += P_row[j];
+            }
+        }
+        break;
+    case GRAPH_CSR:
+        for (e = 0; e < W->csr->nnz; e++)
+        {
+            sum += W->csr->values[e];
+        }
+        break;
+    case GRAPH_STREAM:
+        sum = stream_graph_sum(W->stream);
+        break;
+    default:
+        return mat_entry_avg(W->dense);
+    }
+    return sum / ((double)W->n * W->n);
+}
+
+/**
+ * Computes the squared Frobenius norm of W for any storage format.
+ * @param W: Graph operand
+ * @return: Sum of the squares of the n*n entries of W
+ */
+double graph_squared_norm(const Graph* W)
+{
+    int i;
+    int j;
+    size_t e;
+    double sum = 0.0;
+    double off_diag = 0.0;
+    const double* P_row;
+    const double* M_row;
+    switch (W->kind)
+    {
+    case GRAPH_PACKED:
+        for (i = 0; i < W->n; i++)
+        {
+            P_row = PACKED_ROW(W->packed, i);
+            sum += P_row[0] * P_row[0];
+            for (j = 1; j < W->n - i; j++)
+            {
+                off_diag += P_row[j] * P_row[j];
+            }
+        }
+        return sum + 2 * off_diag;
+    case GRAPH_CSR:
+        for (e = 0; e < W->csr->nnz; e++)
+        {
+            sum += W->csr->values[e] * W->csr->values[e];
+        }
+        return sum;
+    case GRAPH_STREAM:
+        return stream_graph_sum_sq(W->stream);
+    default:
+        for (i = 0; i < W->n; i++)
+        {
+            M_row = MAT_ROW(W->dense, i);
+            for (j = 0; j < W->n; j++)
+            {
+                sum += M_row[j] * M_row[j];
+            }
+        }
+        return sum;
+    }
+}
+
+/**
+ * Computes out = W * H for any storage format of W.
+ * @param W: Graph operand
+ * @param H: Matrix of size n*k
+ * @param out: Output matrix of size n*k, must not alias H
+ */
+void graph_mult(const Graph* W, const Matrix* H, Matrix* out)
+{
+    switch (W->kind)
+    {
+    case GRAPH_PACKED:
+        symm_packed(W->packed, H, out);
+        break;
+    case GRAPH_CSR:
+        csr_mult(W->csr, H, out);
+        break;
+    case GRAPH_STREAM:
+        stream_mult(W->stream, H, out);
+        break;
+    default:
+        gemm_nn(W->dense, H, out, 0);
+        break;
+    }
+}
+
+/**
+ * Allocates every buffer the solver needs for an n*k factor H.
+ * @param n: Number of rows in H
+ * @param k: Number of columns in H
+ * @return: Pointer to the workspace, NULL if allocation failed
+ */
+Workspace* workspace_create(int n, int k)
+{
+    Workspace* ws = (Workspace*)calloc(1, sizeof(Workspace));
+    if (ws == NULL)
+    {
+        printf("An Error Has Occurred\n");
+        return NULL;
+    }
+    ws->n = n;
+    ws->k = k;
+    ws->old_H = matrix_create(n, k);
+    ws->mone = matrix_create(n, k);
+    ws->mechane = matrix_create(n, k);
+    ws->gram = matrix_create(k, k);
+    if (ws->old_H == NULL || ws->mone == NULL || ws->mechane == NULL || ws->gram == NULL)
+    {
+        workspace_free(ws);
+        return NULL;
+    }
+    return ws;
+}
+
+/**
+ * Frees a workspace created with workspace_create.
+ * @param ws: Workspace to free (may be NULL)
+ */
+void workspace_free(Workspace* ws)
+{
+    if (ws != NULL)
+    {
+        matrix_free(ws->old_H);
+        matrix_free(ws->mone);
+        matrix_free(ws->mechane);
+        matrix_free(ws->gram);
+        free(ws);
+    }
+}
+
+/**
+ * Applies one multiplicative update H = old_H * (1/2 + 1/2 * (W*old_H) / (old_H*(old_H^T*old_H)))
+ * given mone = W*old_H, and measures how far H moved in the same pass. The squared
+ * differences are summed per column, in the order forb would sum them.
+ * @param H: Matrix H (n*k), receives the updated values
+ * @param old_H: Previous H (n*k), left unchanged
+ * @param mone: W*old_H (n*k)
+ * @param gram: k*k scratch matrix
+ * @param mechane: n*k scratch matrix
+ * @return: The squared Frobenius norm of H - old_H
+ */
+double mu_update(Matrix* H, const Matrix* old_H, const Matrix* mone, Matrix* gram, Matrix* mechane)
+{
+    int i;
+    int j;
+    int n = H->rows;
+    int k = H->cols;
+    double diff;
+    double trace = 0.0;
+    double* col_sum = MAT_ROW(gram, 0);
+    const double* old_row;
+    const double* mone_row;
+    const double* mechane_row;
+    double* H_row;
+    gemm_tn(old_H, old_H, gram, 0);
+    gemm_nn(old_H, gram, mechane, 0);
+    for (j = 0; j < k; j++) {
+        col_sum[j] = 0.0;}
+    for (i = 0; i < n; i++) {
+        H_row = MAT_ROW(H, i);
+        old_row = MAT_ROW(old_H, i);
+        mone_row = MAT_ROW(mone, i);
+        mechane_row = MAT_ROW(mechane, i);
+        for (j = 0; j < k; j++) {
+            H_row[j] = old_row[j] * (0.5 + 0.5 * (mone_row[j] / mechane_row[j]));
+            diff = H_row[j] - old_row[j];
+            col_sum[j] += diff * diff;}}
+    for (j = 0; j < k; j++) {
+        trace += col_sum[j];}
+    return trace;
+}
+
+/**
+ * performnig the calculations needed to compute H when calling opt_mat_with_H using the matrices H and W.
+ * The denominator H*H^T*H is evaluated as H*(H^T*H), so only a k*k Gram matrix is formed.
+ * All intermediate results live in the workspace, the loop itself does not allocate.
+ * @param H: Matrix H (n*k), updated in place
+ * @param W: Graph operand for W (n*n)
+ * @param ws: Workspace created for the size of H
+ */
+void calcul(Matrix* H, const Graph* W, Workspace* ws)
+{
+    symnmf_solve(H, W, ws, NULL, NULL, NULL);
+}
+
+/**
+ * Optimizes the matrix H using the matrices H and W.
+ * @param H: Matrix H (n*k), updated in place
+ * @param W: Matrix W (n*n)
+ * @return: Pointer to the optimized matrix H, NULL on failure
+ */
+Matrix* opt_mat_with_H(Matrix* H, const Matrix* W)
+{
+    Graph graph;
+    Workspace* ws = workspace_create(H->rows, H->cols);
+    if (ws == NULL) 
+    {
+        return NULL;}
+    opt_mat_with_workspace(H, graph_dense(&graph, W), ws);
+    workspace_free(ws);
+    return H;
+}
+
+/**
+ * Optimizes the matrix H using the matrices H and W and a caller-owned workspace,
+ * which can be reused across calls with the same n and k.
+ * @param H: Matrix H (n*k), updated in place
+ * @param W: Graph operand for W (n*n), dense, packed, sparse or streamed
+ * @param ws: Workspace created with workspace_create(n, k)
+ * @return: Pointer to the optimized matrix H, NULL if the workspace does not match H
+ */
+Matrix* opt_mat_with_workspace(Matrix* H, const Graph* W, Workspace* ws)
+{
+    if (ws->n != H->rows || ws->k != H->cols || W->n != H->rows)
+    {
+        return NULL;
+    }
+    calcul(H, W, ws);
+    return H;
+}
+ 
+/**
+ * Prints a matrix to the console (see write_matrix).
+ * @param res: Pointer to the matrix
+ */
+void printMatrix(const Matrix* res) 
+{
+    write_matrix(stdout, res);
+}
+
+#ifndef SYMNMF_NO_MAIN
+/* Command line options that follow the goal and the file name. */
+typedef struct CliOptions {
+    int neighbors;
+    double radius;
+    const char* out;    /* file to write the result to, NULL to print it */
+    int packed;         /* store the result as an upper triangle */
+    int text;           /* write the result to out as text instead of a binary matrix file */
+    int k;              /* number of clusters of the symnmf goal */
+    unsigned long seed; /* seed of the starting H (see init_H) */
+    char precision;     /* 'd'ouble, 's'ingle or 'm'ixed precision of the symnmf goal */
+    int stats;          /* write per-phase statistics as JSON to stderr */
+    const char* init;   /* file of the starting H of the symnmf goal, NULL to seed it */
+    SolverOptions solver;
+} CliOptions;
+
+/* Iterations between two checkpoints when --checkpoint is given without --checkpoint-every. */
+#define CHECKPOINT_EVERY 100
+
+/**
+ * Loads the points from a binary matrix file, used in place, or from a comma separated file.
+ * @param filename: Name of the file
+ * @param bin: Receives the open binary file, NULL for a text file
+ * @param error: Receives the reason on failure
+ * @return: Matrix of points, released with close_points, NULL on failure
+ */
+static Matrix* open_points(const char* filename, BinFile** bin, LoadError* error)
+{
+    *bin = NULL;
+    if (!bin_is_matrix_file(filename))
+    {
+        return load_points(filename, error);
+    }
+    *bin = bin_open(filename, 1, error);
+    if (*bin != NULL && (*bin)->layout != BIN_DENSE)
+    {
+        load_error_set(error, 0, 0, "expected a dense matrix of points");
+        bin_close(*bin);
+        *bin = NULL;
+    }
+    return (*bin == NULL) ? NULL : &(*bin)->dense;
+}
+
+/**
+ * Releases points obtained with open_points.
+ * @param points: Matrix of points
+ * @param bin: Binary file the points are in, NULL if they were loaded from text
+ */
+static void close_points(Matrix* points, BinFile* bin)
+{
+    if (bin != NULL)
+    {
+        bin_close(bin);
+    }
+    else
+    {
+        matrix_free(points);
+    }
+}
+
+/**
+ * Prints the stored entries of a sparse matrix as "row,column,value" lines.
+ * @param S: Sparse matrix
+ */
+static void print_sparse(const CsrMatrix* S)
+{
+    int i;
+    size_t e;
+    for (i = 0; i < S->n; i++)
+    {
+        for (e = S->row_ptr[i]; e < S->row_ptr[i + 1]; e++)
+        {
+            printf("%d,%d,%.4f\n", i, S->col_idx[e], S->values[e]);
+        }
+    }
+}
+
+/**
+ * Estimates the floating point operations of the similarity matrix: per pair of points,
+ * a subtraction, a multiplication and an addition per coordinate, plus the exponential.
+ * Every layout evaluates each of the n(n - 1) / 2 pairs once; the dense one mirrors it.
+ * @param points: Matrix of points
+ * @return: Estimated flops
+ */
+static double sym_flops(const Matrix* points)
+{
+    double n = points->rows;
+    return n * (n - 1) / 2 * (3.0 * points->cols + 1);
+}
+
+/**
+ * Factorizes the normalized similarity matrix of the points in single precision.
+ * @param points: Matrix of points
+ * @param options: Command line options (k, seed and the solver options)
+ * @param result: Receives the iteration count and the stop reason
+ * @param stats: Optional statistics (may be NULL)
+ * @return: The optimized H (n*k) widened to double, NULL on failure
+ */
+static Matrix* symnmf_points_f32(const Matrix* points, const CliOptions* options, SolverResult* result, SymnmfStats* stats)
+{
+    int i;
+    int j;
+    PackedMatrixF* W = NULL;
+    MatrixF* points_f = matrix_f_create(points->rows, points->cols);
+    MatrixF* H_f = matrix_f_create(points->rows, options->k);
+    Matrix* H = matrix_create(points->rows, options->k);
+    MatrixF* solved = NULL;
+    stats_begin(stats, PHASE_NORM);
+    if (points_f != NULL && H_f != NULL && H != NULL)
+    {
+        for (i = 0; i < points->rows; i++)
+        {
+            for (j = 0; j < points->cols; j++)
+            {
+                MAT_AT(points_f, i, j) = (float)MAT_AT(points, i, j);
+            }
+        }
+        W = norm_mat_packed_f32(points_f);
+    }
+    stats_end(stats, sym_flops(points));
+    if (W != NULL)
+    {
+        stats_begin(stats, PHASE_INIT);
+        init_H_f32(W, H_f, options->seed);
+        stats_end(stats, 0);
+        stats_begin(stats, PHASE_SOLVE);
+        solved = symnmf_solve_f32(H_f, W, &options->solver, result);
+        stats_end_solve(stats, solve_iteration_flops(W->n, (double)W->n * W->n, options->k), result);
+    }
+    for (i = 0; solved != NULL && i < H->rows; i++)
+    {
+        for (j = 0; j < H->cols; j++)
+        {
+            MAT_AT(H, i, j) = MAT_AT(H_f, i, j);
+        }
+    }
+    packed_f_free(W);
+    matrix_f_free(points_f);
+    matrix_f_free(H_f);
+    if (solved == NULL)
+    {
+        matrix_free(H);
+        return NULL;
+    }
+    return H;
+}
+
+/**
+ * Sets the starting H of the symnmf goal and the state the solve continues from: the
+ * --checkpoint file if it exists (the run resumes), else the --init matrix, else init_H.
+ * The reason a file is rejected is reported on stderr.
+ * @param W: Normalized similarity graph
+ * @param H: Receives the starting H (n*K)
+ * @param options: Command line options
+ * @param state: Receives the state; state->V is a new matrix when a HALS checkpoint is resumed
+ * @return: 1 on success, 0 if the file could not be read or does not match n*K and the solver
+ */
+static int start_H(const Graph* W, Matrix* H, const CliOptions* options, SolverState* state)
+{
+    int i;
+    int ok;
+    FILE* probe = NULL;
+    BinFile* bin = NULL;
+    Matrix* start;
+    const char* filename = options->init;
+    LoadError error;
+    solver_state_init(state, options->solver.solver);
+    if (options->solver.checkpoint != NULL)
+    {
+        probe = fopen(options->solver.checkpoint, "rb");
+    }
+    if (probe != NULL)
+    {
+        fclose(probe);
+        filename = options->solver.checkpoint;
+        start = checkpoint_load(filename, state, &error);
+    }
+    else if (filename != NULL)
+    {
+        start = open_points(filename, &bin, &error);
+    }
+    else
+    {
+        init_H(W, H, options->seed);
+        return 1;
+    }
+    if (start == NULL)
+    {
+        fprintf(stderr, "%s: %s\n", filename, error.message);
+        return 0;
+    }
+    ok = start->rows == H->rows && start->cols == H->cols && state->solver == options->solver.solver;
+    for (i = 0; ok && i < H->rows; i++)
+    {
+        memcpy(MAT_ROW(H, i), MAT_ROW(start, i), (size_t)H->cols * sizeof(double));
+    }
+    if (!ok)
+    {
+        fprintf(stderr, "%s: does not match the points, --k or --solver\n", filename);
+    }
+    close_points(start, bin);
+    return ok;
+}
+
+/**
+ * Factorizes the normalized similarity matrix of the points with the chosen solver and
+ * precision, and reports on stderr how many iterations ran and which criterion stopped them
+ * unless statistics are collected (they carry the same information).
+ * @param points: Matrix of points
+ * @param options: Command line options (k, seed, precision and the solver options)
+ * @param stats: Optional statistics (may be NULL); the objective is traced if a trace is attached
+ * @return: The optimized H (n*k), NULL on failure
+ */
+static Matrix* symnmf_points(const Matrix* points, const CliOptions* options, SymnmfStats* stats)
+{
+    static const char* reasons[] = {"tolerance", "max_iter", "objective"};
+    int n = points->rows;
+    PackedMatrix* W_packed = NULL;
+    PackedMatrixF* W_float = NULL;
+    Graph W;
+    Workspace* ws = NULL;
+    Matrix* H = NULL;
+    Matrix* solved = NULL;
+    SolverResult result;
+    SolverState state;
+    int started;
+    if (options->k <= 0 || options->k > n)
+    {
+        fprintf(stderr, "--k must be between 1 and the number of points (%d)\n", n);
+        return NULL;
+    }
+    if (options->precision == 's')
+    {
+        solved = H = symnmf_points_f32(points, options, &result, stats);
+    }
+    else if (options->precision == 'm')
+    {
+        stats_begin(stats, PHASE_NORM);
+        W_float = norm_mat_packed_mixed(points);
+        stats_end(stats, sym_flops(points));
+        H = matrix_create(n, options->k);
+        if (W_float != NULL && H != NULL)
+        {
+            stats_begin(stats, PHASE_INIT);
+            init_H_mixed(W_float, H, options->seed);
+            stats_end(stats, 0);
+            stats_begin(stats, PHASE_SOLVE);
+            solved = symnmf_solve_mixed(H, W_float, &options->solver, &result);
+            stats_end_solve(stats, solve_iteration_flops(n, (double)n * n, options->k), &result);
+        }
+    }
+    else
+    {
+        stats_begin(stats, PHASE_SYM);
+        W_packed = sym_mat_packed(points);
+        stats_end(stats, sym_flops(points));
+        stats_begin(stats, PHASE_NORM);
+        if (W_packed != NULL && norm_packed_in_place(W_packed, NULL) == NULL)
+        {
+            packed_free(W_packed);
+            W_packed = NULL;
+        }
+        stats_end(stats, 3.0 * n * (n + 1) / 2);
+        H = matrix_create(n, options->k);
+        ws = workspace_create(n, options->k);
+        if (W_packed != NULL && H != NULL && ws != NULL)
+        {
+            graph_packed(&W, W_packed);
+            stats_begin(stats, PHASE_INIT);
+            started = start_H(&W, H, options, &state);
+            stats_end(stats, 0);
+            if (started)
+            {
+                stats_begin(stats, PHASE_SOLVE);
+                solved = symnmf_resume(H, &W, ws, &options->solver, &state, &result, (stats != NULL) ? stats->trace : NULL);
+                stats_end_solve(stats, solve_iteration_flops(n, (double)n * n, options->k), &result);
+            }
+            matrix_free(state.V);
+        }
+    }
+    workspace_free(ws);
+    packed_free(W_packed);
+    packed_f_free(W_float);
+    if (solved == NULL)
+    {
+        matrix_free(H);
+        return NULL;
+    }
+    if (stats == NULL)
+    {
+        fprintf(stderr, "%d iterations, stopped by %s\n", result.iterations, reasons[result.stop]);
+    }
+    return H;
+}
+
+/**
+ * Parses the optional command line flags that follow the goal and the file name.
+ * @param argc: Argument count
+ * @param argv: Argument vector
+ * @param options: Filled with the parsed values
+ * @return: 1 if all flags were valid, 0 otherwise
+ */
+static int parse_options(int argc, char* argv[], CliOptions* options)
+{
+    int i;
+    int threads;
+    options->neighbors = 0;
+    options->radius = 0.0;
+    options->out = NULL;
+    options->packed = 0;
+    options->text = 0;
+    options->k = 0;
+    options->seed = 1234;
+    options->precision = 'd';
+    options->stats = 0;
+    options->init = NULL;
+    solver_options_default(&options->solver);
+    for (i = 3; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+        {
+            threads = atoi(argv[++i]);
+            if (threads <= 0)
+            {
+                return 0;
+            }
+            set_num_threads(threads);
+        }
+        else if (strcmp(argv[i], "--neighbors") == 0 && i + 1 < argc)
+        {
+            options->neighbors = atoi(argv[++i]);
+            if (options->neighbors <= 0)
+            {
+                return 0;
+            }
+        }
+        else if (strcmp(argv[i], "--radius") == 0 && i + 1 < argc)
+        {
+            options->radius = atof(argv[++i]);
+            if (options->radius <= 0)
+            {
+                return 0;
+            }
+        }
+        else if (strcmp(argv[i], "--out") == 0 && i + 1 < argc)
+        {
+            options->out = argv[++i];
+        }
+        else if (strcmp(argv[i], "--packed") == 0)
+        {
+            options->packed = 1;
+        }
+        else if (strcmp(argv[i], "--text") == 0)
+        {
+            options->text = 1;
+        }
+        else if (strcmp(argv[i], "--stats") == 0)
+        {
+            options->stats = 1;
+        }
+        else if (strcmp(argv[i], "--k") == 0 && i + 1 < argc)
+        {
+            options->k = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc)
+        {
+            options->seed = strtoul(argv[++i], NULL, 10);
+        }
+        else if (strcmp(argv[i], "--solver") == 0 && i + 1 < argc)
+        {
+            i++;
+            if (strcmp(argv[i], "mu") != 0 && strcmp(argv[i], "hals") != 0)
+            {
+                return 0;
+            }
+            options->solver.solver = (strcmp(argv[i], "hals") == 0) ? SOLVER_HALS : SOLVER_MU;
+        }
+        else if (strcmp(argv[i], "--precision") == 0 && i + 1 < argc)
+        {
+            i++;
+            if (strcmp(argv[i], "double") != 0 && strcmp(argv[i], "single") != 0 && strcmp(argv[i], "mixed") != 0)
+            {
+                return 0;
+            }
+            options->precision = argv[i][0];
+        }
+        else if (strcmp(argv[i], "--tol") == 0 && i + 1 < argc)
+        {
+            options->solver.tol = atof(argv[++i]);
+            if (!(options->solver.tol >= 0))
+            {
+                return 0;
+            }
+        }
+        else if (strcmp(argv[i], "--max-iter") == 0 && i + 1 < argc)
+        {
+            options->solver.max_iter = atoi(argv[++i]);
+            if (options->solver.max_iter < 0)
+            {
+                return 0;
+            }
+        }
+        else if (strcmp(argv[i], "--init") == 0 && i + 1 < argc)
+        {
+            options->init = argv[++i];
+        }
+        else if (strcmp(argv[i], "--checkpoint") == 0 && i + 1 < argc)
+        {
+            options->solver.checkpoint = argv[++i];
+            options->solver.checkpoint_every = (options->solver.checkpoint_every > 0) ? options->solver.checkpoint_every : CHECKPOINT_EVERY;
+        }
+        else if (strcmp(argv[i], "--checkpoint-every") == 0 && i + 1 < argc)
+        {
+            options->solver.checkpoint_every = atoi(argv[++i]);
+            if (options->solver.checkpoint_every <= 0)
+            {
+                return 0;
+            }
+        }
+        else if (strcmp(argv[i], "--rel-obj") == 0 && i + 1 < argc)
+        {
+            options->solver.rel_obj = atof(argv[++i]);
+            if (!(options->solver.rel_obj >= 0))
+            {
+                return 0;
+            }
+        }
+        else
+        {
+            return 0;
+        }
+    }
+    if (options->out != NULL && strcmp(argv[1], "knn") == 0)
+    {
+        fprintf(stderr, "--out is not supported by knn, which prints its sparse graph\n");
+        return 0;
+    }
+    return options->precision == 'd' || (options->solver.solver == SOLVER_MU && options->init == NULL && options->solver.checkpoint == NULL);
+}
+
+/**
+ * Writes the result of a goal to the --out file or prints it.
+ * @param res: Result matrix
+ * @param options: Command line options
+ * @return: 1 on success, 0 if the file could not be written
+ */
+static int output_result(const Matrix* res, const CliOptions* options)
+{
+    FILE* text_file;
+    int saved;
+    if (options->out == NULL)
+    {
+        printMatrix(res);
+        return 1;
+    }
+    if (options->text)
+    {
+        text_file = fopen(options->out, "w");
+        saved = text_file != NULL && write_matrix(text_file, res);
+        return (text_file != NULL && fclose(text_file) == 0) && saved;
+    }
+    return bin_save_matrix(options->out, res, options->packed ? BIN_PACKED : BIN_DENSE);
+}
+
+/**
+ * Main function for the program, checks if reading the inputs went ok and calls the right functions according to the chosen goal.
+ * Usage: symnmf goal file [--threads N] [--neighbors M] [--radius R] [--out FILE [--packed | --text]] [--stats]
+ *        symnmf symnmf file --k K [--seed S] [--solver mu|hals] [--tol T] [--max-iter N] [--rel-obj R]
+ *                           [--precision double|single|mixed] [--init FILE] [--checkpoint FILE [--checkpoint-every N]]
+ * The points file is either comma separated text or a binary matrix file (see bin_open).
+ * The knn goal prints the sparse normalized graph (10 neighbours unless --neighbors or --radius is given).
+ * The symnmf goal factorizes the normalized matrix into H (n*K) and reports on stderr the
+ * number of iterations and the criterion that stopped them (see SolverOptions); single and
+ * mixed precision store W as float and run the multiplicative update only.
+ * --init starts double precision from the H in FILE (text or binary, n*K) instead of a seeded one.
+ * --checkpoint writes H and the solver state to FILE every N iterations (CHECKPOINT_EVERY by
+ * default, see checkpoint_save); if FILE exists the run resumes from it and ends where an
+ * uninterrupted run with the same options would.
+ * With --out the result is written to a binary matrix file instead of being printed, as its
+ * upper triangle with --packed, or as the same text that would be printed with --text;
+ * knn always prints its graph and rejects --out.
+ * With --stats the time, allocations and flops of every phase are written to stderr as JSON
+ * (see stats_write_json), with the objective after every iteration of a double precision solve.
+ * @param argc: Argument count
+ * @param argv: Argument vector
+ * @return: Exit status, 0 if ok, 1 if error
  */
 int main(int argc, char* argv[])
-{   double** pnt_arr;
-    int rows;
-    int cols;
-    char* goal = argv[1];
-    double** tmp_mat1;
-    double** tmp_mat2;
-    double** res;
-    if (argc < 3) {
+{   Matrix* pnt_arr;
+    char* goal;
+    Matrix* tmp_mat1;
+    Matrix* res;
+    CsrMatrix* sparse;
+    CliOptions options;
+    LoadError load_error;
+    BinFile* bin;
+    SymnmfStats stats_data;
+    SymnmfStats* stats = NULL;
+    SolverTrace* trace = NULL;
+    int n;
+    int saved;
+    if (argc < 3 || parse_options(argc, argv, &options) == 0) {
+        printf("An Error Has Occurred\n");
+        return 1;}
+    goal = argv[1];
+    if (options.stats){
+        if (strcmp(goal, "symnmf") == 0 && options.precision == 'd'){
+            trace = trace_create(options.solver.max_iter);
+            if (trace == NULL) {return 1;}}
+        stats = stats_init(&stats_data, trace);}
+    stats_begin(stats, PHASE_LOAD);
+    pnt_arr = open_points(argv[2], &bin, &load_error);
+    stats_end(stats, 0);
+    if (pnt_arr == NULL){
+        if (load_error.line > 0){
+            fprintf(stderr, "%s:%ld: field %d: %s\n", argv[2], load_error.line, load_error.column, load_error.message);}
+        else{
+            fprintf(stderr, "%s: %s\n", argv[2], load_error.message);}
+        printf("An Error Has Occurred\n");
+        trace_free(trace);
+        return 1;}
+    n = pnt_arr->rows;
+    if (strcmp(goal, "knn") == 0){
+        stats_begin(stats, PHASE_NORM);
+        sparse = knn_graph(pnt_arr, (options.neighbors > 0 || options.radius > 0) ? options.neighbors : 10, options.radius, NULL);
+        stats_end(stats, sym_flops(pnt_arr));
+        close_points(pnt_arr, bin);
+        if (sparse == NULL) {return 1;}
+        stats_begin(stats, PHASE_OUTPUT);
+        print_sparse(sparse);
+        stats_end(stats, 0);
+        csr_free(sparse);
+        if (stats != NULL) {stats_write_json(stderr, stats);}
+        return 0;}
+    if (strcmp(goal, "symnmf") == 0){res = symnmf_points(pnt_arr, &options, stats);}
+    else{
+        stats_begin(stats, PHASE_SYM);
+        res = sym_mat(pnt_arr);
+        stats_end(stats, sym_flops(pnt_arr));
+        if (res != NULL && strcmp(goal, "ddg") == 0){
+            tmp_mat1 = res;
+            stats_begin(stats, PHASE_DDG);
+            res = diag_mat(tmp_mat1);
+            stats_end(stats, (double)n * n);
+            matrix_free(tmp_mat1);}
+        else if (res != NULL && strcmp(goal, "sym") != 0){
+            stats_begin(stats, PHASE_NORM);
+            if (norm_mat_in_place(res, NULL) == NULL){
+                matrix_free(res);
+                res = NULL;}
+            stats_end(stats, 3.0 * n * n);}}
+    close_points(pnt_arr, bin);
+    if (res == NULL) {
         printf("An Error Has Occurred\n");
+        trace_free(trace);
         return 1;}
-    rows = count_rows_from_file(argv[2]);
-    cols = count_cols_from_file(argv[2]);
-    if (rows == -1 || cols == -1){
+    stats_begin(stats, PHASE_OUTPUT);
+    saved = output_result(res, &options);
+    stats_end(stats, 0);
+    matrix_free(res);
+    if (stats != NULL) {stats_write_json(stderr, stats);}
+    trace_free(trace);
+    if (!saved){
         printf("An Error Has Occurred\n");
         return 1;}
-    pnt_arr = create_array_from_file(argv[2], rows, cols);
-    if(pnt_arr==NULL){return 1;}
-    if (strcmp(goal, "sym") == 0){res = sym_mat(pnt_arr, rows, cols);}
-    else{ if (strcmp(goal, "ddg") == 0){
-            tmp_mat1 = sym_mat(pnt_arr, rows, cols);
-            res = diag_mat(tmp_mat1, rows);
-            free_matrix(tmp_mat1, rows);} 
-        else{ tmp_mat1 = sym_mat(pnt_arr, rows, cols);
-            tmp_mat2 = diag_mat(tmp_mat1, rows);
-            res = norm_mat(tmp_mat2, tmp_mat1, rows);
-            free_matrix(tmp_mat1, rows);
-            free_matrix(tmp_mat2, rows);}}
-    printMatrix(res, rows, rows);
-    free_matrix(res, rows);
-    free_matrix(pnt_arr, rows);
     return 0;
 }
+#endif
@@ -1,8 +1,173 @@
 #ifndef LINKER_H_
 #define LINKER_H_
 
+#include <stddef.h>
+#include <stdio.h>
+
+/*
+ * Thread safety: every function may run concurrently with any other as long as the calls
+ * do not share an object they write to (an output matrix, a Workspace or a StreamGraph,
+ * whose tile is scratch space). Inputs may be shared read-only. The only process-wide state
+ * is the allocation counter, the thread count and the detected GEMM ISA, all accessed
+ * atomically. Every call starts its own OpenMP team of get_num_threads() threads, so callers
+ * running many solves at once should lower the thread count to avoid oversubscription.
+ */
+
+/* Convergence threshold on the squared norm of the change of H, and iteration cap. */
+#define EPSILON 0.0001
+#define MAXITER 300
+
+/* Alignment (in bytes) of the first element of every matrix row. */
+#define MATRIX_ALIGN 64
+
+/**
+ * A dense row-major matrix stored in a single contiguous allocation.
+ * Row i starts at data + i * stride; stride >= cols and is padded so that
+ * every row of an owned matrix starts on a MATRIX_ALIGN byte boundary.
+ * Matrices returned by matrix_create are released with matrix_free.
+ * A Matrix may also describe memory it does not own (see matrix_view).
+ */
+typedef struct Matrix {
+    double* data;
+    int rows;
+    int cols;
+    int stride;
+} Matrix;
+
+/* Pointer to the first element of row i of matrix M. */
+#define MAT_ROW(M, i) ((M)->data + (size_t)(i) * (size_t)(M)->stride)
+
+/* Element (i, j) of matrix M. */
+#define MAT_AT(M, i, j) (MAT_ROW(M, i)[j])
+
+/**
+ * Creates a contiguous, row-aligned matrix of size rows*cols initialized to zero.
+ * @param rows: Number of rows
+ * @param cols: Number of columns
+ * @return: Pointer to the allocated matrix, NULL if allocation failed
+ */
+Matrix* matrix_create(int rows, int cols);
+
+/**
+ * Frees a matrix allocated with matrix_create.
+ * @param M: Pointer to the matrix to free (may be NULL)
+ */
+void matrix_free(Matrix* M);
+
+/**
+ * Returns the number of matrices allocated with matrix_create so far.
+ * @return: Allocation count
+ */
+unsigned long matrix_alloc_count(void);
+
+/**
+ * Adds to the number of bytes allocated for matrices (see matrix_alloc_bytes).
+ * @param bytes: Size of a new allocation
+ */
+void matrix_add_bytes(size_t bytes);
+
+/**
+ * Returns the number of bytes allocated so far for dense, packed, sparse and float matrices.
+ * @return: Byte count
+ */
+size_t matrix_alloc_bytes(void);
+
+/**
+ * Sets the number of threads used by the parallel kernels.
+ * @param threads: Number of threads, 0 or less for the OpenMP default
+ */
+void set_num_threads(int threads);
+
+/**
+ * Returns the number of threads the parallel kernels will use.
+ * @return: Number of threads (1 when built without OpenMP)
+ */
+int get_num_threads(void);
+
 /**
- * Creates a 2D matrix of size n*k initialized to zero.
+ * Fills a caller-provided Matrix header describing existing memory.
+ * The header does not own the memory and must not be passed to matrix_free.
+ * @param view: Header to fill
+ * @param data: Pointer to the first element
+ * @param rows: Number of rows
+ * @param cols: Number of columns
+ * @param stride: Distance in doubles between consecutive rows
+ * @return: The filled header
+ */
+Matrix* matrix_view(Matrix* view, double* data, int rows, int cols, int stride);
+
+/**
+ * A symmetric n*n matrix of which only the upper triangle is stored.
+ * Row i holds the n - i entries (i, i), (i, i + 1), ..., (i, n - 1) contiguously,
+ * and rows follow each other without padding. Released with packed_free.
+ */
+typedef struct PackedMatrix {
+    double* data;
+    int n;
+} PackedMatrix;
+
+/* Pointer to the diagonal element (i, i) of packed matrix P; element (i, j), j >= i, is PACKED_ROW(P, i)[j - i]. */
+#define PACKED_ROW(P, i) ((P)->data + ((size_t)(i) * (size_t)(P)->n - ((size_t)(i) * (size_t)(i) - (size_t)(i)) / 2))
+
+/**
+ * Creates a packed symmetric n*n matrix initialized to zero.
+ * Only the upper triangle (including the diagonal) is stored, row by row.
+ * @param n: Number of rows and columns
+ * @return: Pointer to the allocated matrix, NULL if allocation failed
+ */
+PackedMatrix* packed_create(int n);
+
+/**
+ * Frees a packed matrix allocated with packed_create.
+ * @param P: Pointer to the matrix to free (may be NULL)
+ */
+void packed_free(PackedMatrix* P);
+
+/**
+ * Packs the upper triangle of a square matrix.
+ * @param M: Square matrix, assumed symmetric
+ * @return: Pointer to the packed matrix, NULL if allocation failed
+ */
+PackedMatrix* packed_from_matrix(const Matrix* M);
+
+/**
+ * Expands a packed symmetric matrix into a full square matrix.
+ * @param P: Packed matrix
+ * @return: Pointer to the full matrix, NULL if allocation failed
+ */
+Matrix* packed_to_matrix(const PackedMatrix* P);
+
+/**
+ * A sparse n*n matrix in compressed sparse row format.
+ * The entries of row i are values[row_ptr[i] .. row_ptr[i + 1] - 1], in increasing column order,
+ * with their columns in col_idx. Released with csr_free.
+ */
+typedef struct CsrMatrix {
+    int n;
+    size_t nnz;
+    size_t* row_ptr;
+    int* col_idx;
+    double* values;
+} CsrMatrix;
+
+/**
+ * Creates an empty n*n CSR matrix with room for nnz non-zeros.
+ * The header, values, row pointers and column indices share one allocation.
+ * @param n: Number of rows and columns
+ * @param nnz: Number of stored entries
+ * @return: Pointer to the allocated matrix, NULL if allocation failed
+ */
+CsrMatrix* csr_create(int n, size_t nnz);
+
+/**
+ * Frees a CSR matrix allocated with csr_create.
+ * @param S: Pointer to the matrix to free (may be NULL)
+ */
+void csr_free(CsrMatrix* S);
+
+/**
+ * Creates a 2D matrix of size n*k initialized to zero (array of row pointers).
+ * Kept for callers that still work with double**.
  * @param n: Number of rows
  * @param k: Number of columns
  * @return: Pointer to the allocated matrix
@@ -10,22 +175,85 @@
 double** create_matrix(int n, int k);
 
 /**
- * Frees the allocated memory for a 2D matrix.
+ * Frees the allocated memory for a 2D matrix created with create_matrix.
  * @param matrix: Pointer to the matrix to free
  * @param n: Number of rows in the matrix
  */
 void free_matrix(double** matrix, int n);
 
+/**
+ * Copies a double** matrix into a new contiguous matrix.
+ * @param rows_ptr: Array of row pointers
+ * @param n: Number of rows
+ * @param k: Number of columns
+ * @return: Pointer to the new matrix, NULL if allocation failed
+ */
+Matrix* matrix_from_rows(double** rows_ptr, int n, int k);
+
+/**
+ * Copies a contiguous matrix into a new double** matrix (see create_matrix).
+ * @param M: Matrix to copy
+ * @return: Array of row pointers, NULL if allocation failed
+ */
+double** matrix_to_rows(const Matrix* M);
+
 /**
  * Multiplies two matrices.
- * @param M1: First matrix
- * @param M2: Second matrix
- * @param n: Number of rows in M1
- * @param m: Number of columns in M1 and rows in M2
- * @param q: Number of columns in M2
- * @return: Pointer to the resulting matrix
+ * @param M1: First matrix (n*m)
+ * @param M2: Second matrix (m*q)
+ * @return: Pointer to the resulting n*q matrix, NULL on failure
+ */
+Matrix* mat_mult(const Matrix* M1, const Matrix* M2);
+
+/* Instruction sets the matrix multiplication kernels can be dispatched to. */
+#define GEMM_ISA_SCALAR 0
+#define GEMM_ISA_AVX2 1
+#define GEMM_ISA_AVX512 2
+
+/**
+ * Computes C = A * B, or C += A * B when accumulate is non-zero.
+ * Uses cache-blocked SIMD kernels chosen at runtime from the CPU features.
+ * @param A: Matrix of size n*m
+ * @param B: Matrix of size m*q
+ * @param C: Output matrix of size n*q, must not alias A or B
+ * @param accumulate: Non-zero to add to the current contents of C
+ */
+void gemm_nn(const Matrix* A, const Matrix* B, Matrix* C, int accumulate);
+
+/**
+ * Computes C = A^T * B, or C += A^T * B when accumulate is non-zero.
+ * @param A: Matrix of size m*n
+ * @param B: Matrix of size m*q
+ * @param C: Output matrix of size n*q, must not alias A or B
+ * @param accumulate: Non-zero to add to the current contents of C
+ */
+void gemm_tn(const Matrix* A, const Matrix* B, Matrix* C, int accumulate);
+
+/**
+ * Computes out = P * H for a packed symmetric matrix P.
+ * Every entry of out is summed over the columns of P in order, so the result equals
+ * gemm_nn on the expanded matrix bit for bit.
+ * @param P: Packed symmetric matrix of size n*n
+ * @param H: Matrix of size n*k
+ * @param out: Output matrix of size n*k, must not alias H
+ */
+void symm_packed(const PackedMatrix* P, const Matrix* H, Matrix* out);
+
+/**
+ * Computes out = S * H for a CSR matrix S (SpMM).
+ * Rows are independent, so the result does not depend on the number of threads.
+ * @param S: Sparse n*n matrix
+ * @param H: Matrix of size n*k
+ * @param out: Output matrix of size n*k, must not alias H
  */
-double** mat_mult(double** M1, double** M2, int n,int m, int q); 
+void csr_mult(const CsrMatrix* S, const Matrix* H, Matrix* out);
+
+/**
+ * Returns the instruction set used by the matrix multiplication kernels.
+ * The SYMNMF_GEMM environment variable ("scalar", "avx2") can lower it.
+ * @return: One of GEMM_ISA_SCALAR, GEMM_ISA_AVX2, GEMM_ISA_AVX512
+ */
+int gemm_isa_used(void);
 
 /**
  * Calculates the squared Euclidean distance between two points.
@@ -34,114 +262,1026 @@ double** mat_mult(double** M1, double** M2, int n,int m, int q);
  * @param dim: Dimensionality of the points
  * @return: Squared Euclidean distance
  */
-double squared_euc_dis(double *point1, double *point2, int dim);
+double squared_euc_dis(const double* point1, const double* point2, int dim);
+
+/**
+ * Finds the row of C nearest to a point. Four rows are measured together, each with its own
+ * accumulator summed in the order of squared_euc_dis, so the distances are identical to it.
+ * @param point: Point of C->cols coordinates
+ * @param C: Candidate rows (at least one)
+ * @param best: Receives the squared distance to the nearest row
+ * @param second: Optional, receives the squared distance to the second nearest row (HUGE_VAL if C has one row)
+ * @return: Index of the nearest row, the lowest one on ties
+ */
+int nearest_row(const double* point, const Matrix* C, double* best, double* second);
 
 /**
  * Computes the similarity matrix from a set of points.
- * 
- * @param points: Pointer to the array of points
- * @param n: Number of points
- * @param dim: Dimensionality of each point
+ * Each pair is evaluated once and mirrored.
+ *
+ * @param points: Matrix of points, one point per row
  * @return: Pointer to the similarity matrix
  */
-double** sym_mat(double**points,int n, int dim);
+Matrix* sym_mat(const Matrix* points);
+
+/**
+ * Computes the similarity matrix from a set of points into a caller-provided matrix.
+ * @param points: Matrix of points, one point per row
+ * @param A: n*n output matrix (any stride), must not overlap the points
+ * @return: A
+ */
+Matrix* sym_mat_into(const Matrix* points, Matrix* A);
 
 /**
  * Computes the diagonal degree matrix from a similarity matrix.
- * 
+ * Every row sum is accumulated by a single thread in column order,
+ * so the result does not depend on the number of threads.
+ *
  * @param A: Similarity matrix
- * @param n: Size of the matrix
  * @return: Pointer to the diagonal degree matrix
  */
-double** diag_mat(double**A,int n);
+Matrix* diag_mat(const Matrix* A);
+
+/**
+ * Computes the diagonal degree matrix from a similarity matrix into a caller-provided matrix.
+ * Row i of A is read only before row i of D is written, so D may be A itself.
+ * @param A: Similarity matrix
+ * @param D: n*n output matrix (any stride), may be the same matrix as A
+ * @return: D
+ */
+Matrix* diag_mat_into(const Matrix* A, Matrix* D);
 
 /**
  * Normalizes a similarity matrix using the diagonal degree matrix.
+ * D^-1/2 * A * D^-1/2 is applied as a row and column scaling of A
+ * instead of two products with a dense diagonal matrix.
  * @param D: Diagonal degree matrix
  * @param A: Similarity matrix
- * @param n: Size of the matrices
  * @return: Pointer to the normalized matrix
  */
-double** norm_mat(double**D,double**A, int n);
+Matrix* norm_mat(const Matrix* D, const Matrix* A);
+
+/**
+ * Computes the normalized similarity matrix W = D^-1/2 * A * D^-1/2 directly from the points.
+ * Only the upper triangle of the Gaussian affinities is evaluated, tile by tile, and mirrored;
+ * the degrees are kept as a vector and the scaling is done in place, so the only n*n
+ * buffer is the returned matrix. The values are identical to norm_mat(diag_mat(A), A).
+ * @param points: Matrix of points, one point per row
+ * @param degrees: Optional output array of n doubles receiving the degree of each point (may be NULL)
+ * @return: Pointer to the normalized matrix, NULL on failure
+ */
+Matrix* norm_mat_from_points(const Matrix* points, double* degrees);
+
+/**
+ * Computes the normalized similarity matrix from the points into a caller-provided matrix,
+ * exactly as norm_mat_from_points does.
+ * @param points: Matrix of points, one point per row
+ * @param W: n*n output matrix (any stride), must not overlap the points
+ * @param degrees: Optional output array of n doubles receiving the degree of each point (may be NULL)
+ * @return: W, NULL if the temporary degree vectors could not be allocated
+ */
+Matrix* norm_mat_into(const Matrix* points, Matrix* W, double* degrees);
+
+/**
+ * Normalizes a similarity matrix A in place into W = D^-1/2 * A * D^-1/2, where D holds
+ * the row sums of A. norm_mat_in_place(sym_mat(points)) is identical to norm_mat_from_points.
+ * @param W: n*n similarity matrix (any stride), overwritten with the normalized matrix
+ * @param degrees: Optional output array of n doubles receiving the degree of each point (may be NULL)
+ * @return: W, NULL if the temporary degree vectors could not be allocated
+ */
+Matrix* norm_mat_in_place(Matrix* W, double* degrees);
+
+/**
+ * Computes the similarity matrix from a set of points in packed storage.
+ * Each pair is evaluated once and stored once.
+ * @param points: Matrix of points, one point per row
+ * @return: Pointer to the packed similarity matrix, NULL on failure
+ */
+PackedMatrix* sym_mat_packed(const Matrix* points);
+
+/**
+ * Computes the normalized similarity matrix W = D^-1/2 * A * D^-1/2 in packed storage.
+ * Uses half the memory and half the exp() calls of norm_mat_from_points; the stored
+ * upper triangle is bit-identical to the upper triangle of the dense result.
+ * @param points: Matrix of points, one point per row
+ * @param degrees: Optional output array of n doubles receiving the degree of each point (may be NULL)
+ * @return: Pointer to the packed normalized matrix, NULL on failure
+ */
+PackedMatrix* norm_mat_packed(const Matrix* points, double* degrees);
+
+/**
+ * Normalizes a packed similarity matrix in place, as norm_mat_in_place does a dense one:
+ * norm_packed_in_place(sym_mat_packed(points)) is identical to norm_mat_packed.
+ * @param W: Packed similarity matrix, overwritten with the normalized matrix
+ * @param degrees: Optional output array of n doubles receiving the degree of each point (may be NULL)
+ * @return: W, NULL if the temporary degree vectors could not be allocated (W is left unchanged)
+ */
+PackedMatrix* norm_packed_in_place(PackedMatrix* W, double* degrees);
+
+/**
+ * Builds the symmetric sparse affinity graph of the points and normalizes it like norm_mat.
+ * Point j is a neighbour of i if it is among the `neighbors` nearest points of i or i is among
+ * those of j (union symmetrization), optionally restricted to the radius. Stored entries are
+ * exp(-||x_i - x_j||^2 / 2) scaled by D^-1/2 on both sides, where D holds the sparse row sums.
+ * Points without neighbours get a zero row instead of a division by zero. Up to ten coordinates
+ * the neighbours are found through a k-d tree; in higher dimensions the search compares every
+ * pair of points, O(n^2 * d), which dominates the build for large n.
+ * @param points: Matrix of points, one point per row
+ * @param neighbors: Number of nearest neighbours, 0 or less for a pure radius graph
+ * @param radius: Neighbourhood radius, 0 or less for no limit
+ * @param degrees: Optional output array of n doubles receiving the degree of each point (may be NULL)
+ * @return: Pointer to the normalized CSR matrix, NULL on failure
+ */
+CsrMatrix* knn_graph(const Matrix* points, int neighbors, double radius, double* degrees);
 
 /**
  * Computes the average of the entries in a matrix.
  * @param M: Pointer to the matrix
- * @param n: Size of the matrix
  * @return: Average value of the matrix entries
  */
-double mat_entry_avg(double** M,int n);
+double mat_entry_avg(const Matrix* M);
 
 /**
  * Transposes a matrix.
  * @param M: Pointer to the matrix
- * @param n: Number of rows
- * @param m: Number of columns
  * @return: Pointer to the transposed matrix
  */
-double** transpose_matrix(double** M, int n,int m);
+Matrix* transpose_matrix(const Matrix* M);
+
+/**
+ * Computes the k*k Gram matrix H^T * H.
+ * @param H: Matrix of size n*k
+ * @return: Pointer to the Gram matrix, NULL on failure
+ */
+Matrix* gram_mat(const Matrix* H);
 
 /**
- * Calculates the Frobenius norm of a matrix.
+ * Calculates the squared Frobenius norm of a matrix.
  * @param M: Pointer to the matrix
- * @param n: Number of rows
- * @param m: Number of columns
- * @return: Frobenius norm
+ * @return: Squared Frobenius norm
  */
-double forb(double** M,int n,int m);
+double forb(const Matrix* M);
+
+/* Storage formats of the normalized similarity matrix W accepted by the solver. */
+#define GRAPH_DENSE 0
+#define GRAPH_PACKED 1
+#define GRAPH_CSR 2
+#define GRAPH_STREAM 3
 
 /**
- * performnig the calculations needed to compute H when calling opt_mat_with_H using the matrices H and W.
- * @param H: Matrix H
- * @param W: Matrix W
+ * W = D^-1/2 * A * D^-1/2 kept implicitly: the points, D^-1/2 as a vector and a scratch tile
+ * of tile_rows rows of W that is regenerated whenever W is applied. Memory is O(nd + n * tile_rows).
+ */
+typedef struct StreamGraph {
+    const Matrix* points;
+    Matrix* rev_sqr;   /* 1*n, D^-1/2 */
+    Matrix* tile;      /* tile_rows*n scratch */
+    int tile_rows;
+} StreamGraph;
+
+/**
+ * Creates a streamed representation of W = D^-1/2 * A * D^-1/2 that keeps only the points,
+ * the degree vector and one tile of rows of W, sized to fit the memory budget.
+ * Building it evaluates every affinity once to obtain the degrees (O(n^2 d) time, O(n) memory).
+ * @param points: Matrix of points, one point per row; must outlive the stream graph
+ * @param memory_budget: Bytes available for the tile of W (at least one row is always used)
+ * @param degrees: Optional output array of n doubles receiving the degree of each point (may be NULL)
+ * @return: Pointer to the stream graph, NULL on failure
+ */
+StreamGraph* stream_graph_create(const Matrix* points, size_t memory_budget, double* degrees);
+
+/**
+ * Frees a stream graph created with stream_graph_create (not the points).
+ * @param G: Stream graph to free (may be NULL)
+ */
+void stream_graph_free(StreamGraph* G);
+
+/**
+ * Computes out = W * H, regenerating W tile by tile from the points.
+ * Each tile is multiplied with gemm_nn, so the result equals the dense product bit for bit.
+ * The tile is scratch space: a stream graph must not be used by two solves at once.
+ * @param G: Stream graph
+ * @param H: Matrix of size n*k
+ * @param out: Output matrix of size n*k, must not alias H
+ */
+void stream_mult(StreamGraph* G, const Matrix* H, Matrix* out);
+
+/**
+ * Computes the sum of all entries of W, tile by tile.
+ * @param G: Stream graph
+ * @return: Sum of the entries of W
+ */
+double stream_graph_sum(StreamGraph* G);
+
+/**
+ * Computes the sum of the squares of all entries of W, tile by tile.
+ * @param G: Stream graph
+ * @return: Squared Frobenius norm of W
+ */
+double stream_graph_sum_sq(StreamGraph* G);
+
+/**
+ * A non-owning view of W in one of the GRAPH_* storage formats.
+ * Filled with graph_dense, graph_packed, graph_csr or graph_stream; the matrix it points to must outlive it.
+ */
+typedef struct Graph {
+    int kind;
+    int n;
+    const Matrix* dense;
+    const PackedMatrix* packed;
+    const CsrMatrix* csr;
+    StreamGraph* stream;
+} Graph;
+
+/**
+ * Describes a dense n*n matrix W as a graph operand for the solver.
+ * @param graph: Header to fill
+ * @param W: Dense square matrix
+ * @return: The filled header
+ */
+Graph* graph_dense(Graph* graph, const Matrix* W);
+
+/**
+ * Describes a packed symmetric matrix W as a graph operand for the solver.
+ * @param graph: Header to fill
+ * @param W: Packed symmetric matrix
+ * @return: The filled header
+ */
+Graph* graph_packed(Graph* graph, const PackedMatrix* W);
+
+/**
+ * Describes a sparse matrix W as a graph operand for the solver.
+ * @param graph: Header to fill
+ * @param W: CSR matrix
+ * @return: The filled header
+ */
+Graph* graph_csr(Graph* graph, const CsrMatrix* W);
+
+/**
+ * Describes a streamed W as a graph operand for the solver.
+ * @param graph: Header to fill
+ * @param W: Stream graph
+ * @return: The filled header
+ */
+Graph* graph_stream(Graph* graph, StreamGraph* W);
+
+/**
+ * Computes the average of the entries of W for any storage format.
+ * The entries are summed in row-major order, so the result equals mat_entry_avg
+ * on the expanded dense matrix bit for bit.
+ * @param W: Graph operand
+ * @return: Average value of the n*n entries of W
+ */
+double graph_entry_avg(const Graph* W);
+
+/**
+ * Computes the squared Frobenius norm of W for any storage format.
+ * @param W: Graph operand
+ * @return: Sum of the squares of the n*n entries of W
+ */
+double graph_squared_norm(const Graph* W);
+
+/**
+ * Computes out = W * H for any storage format of W.
+ * @param W: Graph operand
+ * @param H: Matrix of size n*k
+ * @param out: Output matrix of size n*k, must not alias H
+ */
+void graph_mult(const Graph* W, const Matrix* H, Matrix* out);
+
+/**
+ * Preallocated buffers for the SymNMF iterations on an n*k factor.
+ * A workspace can be reused for any number of solves with the same n and k.
+ */
+typedef struct Workspace {
+    int n;
+    int k;
+    Matrix* old_H;    /* H of the previous iteration, then H - old_H (n*k) */
+    Matrix* mone;     /* numerator W*H (n*k) */
+    Matrix* mechane;  /* denominator H*(H^T*H) (n*k) */
+    Matrix* gram;     /* H^T*H (k*k) */
+} Workspace;
+
+/**
+ * Allocates every buffer the solver needs for an n*k factor H.
  * @param n: Number of rows in H
  * @param k: Number of columns in H
- * @param mone: Matrix mone
- * @param mechane: Matrix mechane
- * @param old_H: Matrix old_H
- * @return: an integer =0 if memory allocation failed, else returns integer = 1
+ * @return: Pointer to the workspace, NULL if allocation failed
+ */
+Workspace* workspace_create(int n, int k);
+
+/**
+ * Frees a workspace created with workspace_create.
+ * @param ws: Workspace to free (may be NULL)
+ */
+void workspace_free(Workspace* ws);
+
+/**
+ * Applies one multiplicative update H = old_H * (1/2 + 1/2 * (W*old_H) / (old_H*(old_H^T*old_H)))
+ * given mone = W*old_H, and measures how far H moved in the same pass. The squared
+ * differences are summed per column, in the order forb would sum them.
+ * @param H: Matrix H (n*k), receives the updated values
+ * @param old_H: Previous H (n*k), left unchanged
+ * @param mone: W*old_H (n*k)
+ * @param gram: k*k scratch matrix
+ * @param mechane: n*k scratch matrix
+ * @return: The squared Frobenius norm of H - old_H
  */
-double calcul(double **H, double** W, int n, int k,double**mone,double** mechane,double** old_H);
+double mu_update(Matrix* H, const Matrix* old_H, const Matrix* mone, Matrix* gram, Matrix* mechane);
+
+/**
+ * performnig the calculations needed to compute H when calling opt_mat_with_H using the matrices H and W.
+ * The denominator H*H^T*H is evaluated as H*(H^T*H), so only a k*k Gram matrix is formed.
+ * All intermediate results live in the workspace, the loop itself does not allocate.
+ * @param H: Matrix H (n*k), updated in place
+ * @param W: Graph operand for W (n*n)
+ * @param ws: Workspace created for the size of H
+ */
+void calcul(Matrix* H, const Graph* W, Workspace* ws);
 
 /**
  * Optimizes the matrix H using the matrices H and W.
- * @param H: Matrix H
- * @param W: Matrix W
- * @param n: Number of rows in H
- * @param k: Number of columns in H
- * @return: Pointer to the optimized matrix H
+ * @param H: Matrix H (n*k), updated in place
+ * @param W: Matrix W (n*n)
+ * @return: Pointer to the optimized matrix H, NULL on failure
  */
-double** opt_mat_with_H(double **H, double**W,int n,int k);
+Matrix* opt_mat_with_H(Matrix* H, const Matrix* W);
 
 /**
- * Prints a matrix to the console.
+ * Optimizes the matrix H using the matrices H and W and a caller-owned workspace,
+ * which can be reused across calls with the same n and k.
+ * @param H: Matrix H (n*k), updated in place
+ * @param W: Graph operand for W (n*n), dense, packed, sparse or streamed
+ * @param ws: Workspace created with workspace_create(n, k)
+ * @return: Pointer to the optimized matrix H, NULL if the workspace does not match H
+ */
+Matrix* opt_mat_with_workspace(Matrix* H, const Graph* W, Workspace* ws);
+
+/* Algorithms symnmf_solve can run. */
+#define SOLVER_MU 0     /* damped multiplicative update H = H * (1/2 + 1/2 * (W*H) / (H*H^T*H)) */
+#define SOLVER_HALS 1   /* symmetric HALS: column-wise updates of two factors tied by a penalty */
+
+/* Reasons symnmf_solve stops. */
+#define STOP_TOLERANCE 0    /* H moved less than tol in one iteration */
+#define STOP_MAX_ITER 1     /* max_iter iterations ran */
+#define STOP_OBJECTIVE 2    /* the objective decreased by less than rel_obj of its value */
+
+/* Algorithm, stopping criteria and checkpoints of a solve, see solver_options_default. */
+typedef struct SolverOptions {
+    int solver;          /* SOLVER_MU or SOLVER_HALS */
+    double tol;          /* stop when ||H - old_H||_F^2 < tol */
+    int max_iter;        /* stop once this many iterations ran, counting those of a resumed state */
+    double rel_obj;      /* stop when |f(old_H) - f(H)| <= rel_obj * f(old_H), 0 to disable */
+    int checkpoint_every;    /* write a checkpoint every this many iterations, 0 for none */
+    const char* checkpoint;  /* file the checkpoints replace (see checkpoint_save) */
+} SolverOptions;
+
+/* Outcome of a solve. */
+typedef struct SolverResult {
+    int start;           /* iterations run before the solve started (SolverState.iteration) */
+    int iterations;      /* iterations run, counting the start ones */
+    int stop;            /* STOP_TOLERANCE, STOP_MAX_ITER or STOP_OBJECTIVE */
+    double delta;        /* ||H - old_H||_F of the last iteration, 0 if none ran */
+} SolverResult;
+
+/* Progress of one solve: the objective after every iteration and the time each iteration took. */
+typedef struct SolverTrace {
+    int capacity;        /* iterations the arrays have room for */
+    int iterations;      /* iterations run */
+    double* objective;   /* objective[m] = ||W - H*H^T||_F^2 after m iterations, iterations + 1 entries */
+    double* seconds;     /* seconds[m] = wall time of iteration m + 1, without computing the objective */
+} SolverTrace;
+
+/*
+ * Where a solve stands besides H: what symnmf_resume needs to continue its trajectory
+ * exactly. The multiplicative update only depends on H; HALS also carries its second factor.
+ * previous is kept up to date while the objective is evaluated (rel_obj, a trace or checkpoints).
+ */
+typedef struct SolverState {
+    int solver;          /* SOLVER_MU or SOLVER_HALS, the algorithm the state belongs to */
+    int iteration;       /* iterations run so far, 0 for a fresh start */
+    double previous;     /* objective the next iteration is compared with by rel_obj */
+    Matrix* V;           /* SOLVER_HALS: second factor (n*k), updated in place; NULL to start it from H */
+} SolverState;
+
+/**
+ * Fills options with the defaults: the multiplicative update, tol = EPSILON,
+ * max_iter = MAXITER, no objective criterion and no checkpoints.
+ * @param options: Options to fill
+ * @return: options
+ */
+SolverOptions* solver_options_default(SolverOptions* options);
+
+/**
+ * Fills a state for a fresh start of a solver (iteration 0, V started from H).
+ * @param state: State to fill
+ * @param solver: SOLVER_MU or SOLVER_HALS
+ * @return: state
+ */
+SolverState* solver_state_init(SolverState* state, int solver);
+
+/**
+ * Allocates a trace with room for capacity iterations.
+ * @param capacity: Largest number of iterations to record (the max_iter of the solve)
+ * @return: Pointer to the trace, NULL if allocation failed
+ */
+SolverTrace* trace_create(int capacity);
+
+/**
+ * Frees a trace created with trace_create.
+ * @param trace: Trace to free (may be NULL)
+ */
+void trace_free(SolverTrace* trace);
+
+/**
+ * Optimizes H with the chosen algorithm until one of the stopping criteria holds,
+ * optionally recording its progress. The objective is evaluated every iteration only when
+ * rel_obj is set or a trace is requested; with the multiplicative update it reuses the
+ * product W*H the update needs.
+ * @param H: Matrix H (n*k), the starting point, updated in place
+ * @param W: Graph operand for W (n*n), dense, packed, sparse or streamed
+ * @param ws: Workspace created with workspace_create(n, k)
+ * @param options: Algorithm and stopping criteria, NULL for the defaults
+ * @param result: Optional, receives the number of iterations and the reason for stopping
+ * @param trace: Optional trace created with trace_create(max_iter) (may be NULL); receives the
+ *               objective after every iteration and the time each iteration took
+ * @return: Pointer to the optimized matrix H, NULL if the arguments do not match
+ */
+Matrix* symnmf_solve(Matrix* H, const Graph* W, Workspace* ws, const SolverOptions* options, SolverResult* result, SolverTrace* trace);
+
+/**
+ * Continues a solve from H and a state, e.g. one read back with checkpoint_load, as if it had
+ * never stopped: the iterations are numbered from state->iteration, max_iter counts them all,
+ * and a resumed run reaches the same H as an uninterrupted one. symnmf_solve is the resume
+ * of a fresh state. With checkpoint_every set, H and the state are written to the checkpoint
+ * file after every checkpoint_every-th iteration (counted from the start of the trajectory).
+ * @param H: Matrix H (n*k), the iterate of the state, updated in place
+ * @param W: Graph operand for W (n*n), dense, packed, sparse or streamed
+ * @param ws: Workspace created with workspace_create(n, k)
+ * @param options: Algorithm, stopping criteria and checkpoints, NULL for the defaults
+ * @param state: Optional (may be NULL for a fresh start), updated to where the solve stopped
+ * @param result: Optional, receives the number of iterations and the reason for stopping
+ * @param trace: Optional trace created with trace_create(max_iter) (may be NULL); records the
+ *               iterations of this call only
+ * @return: Pointer to the optimized matrix H, NULL if the arguments or the state do not match
+ *          or a checkpoint could not be written
+ */
+Matrix* symnmf_resume(Matrix* H, const Graph* W, Workspace* ws, const SolverOptions* options, SolverState* state, SolverResult* result, SolverTrace* trace);
+
+/* Phases of a run timed by SymnmfStats. */
+#define PHASE_LOAD 0         /* reading or converting the points */
+#define PHASE_SYM 1          /* similarity matrix */
+#define PHASE_DDG 2          /* diagonal degree matrix */
+#define PHASE_NORM 3         /* degrees and normalization (the whole W for kNN, streamed and float graphs) */
+#define PHASE_INIT 4         /* starting H */
+#define PHASE_SOLVE 5        /* iterations of the solver */
+#define PHASE_OUTPUT 6       /* writing the result */
+#define PHASE_COUNT 7
+
+/*
+ * Timings and counters of one run, filled by the caller around each phase with stats_begin
+ * and stats_end. The stats functions accept a NULL pointer and then measure nothing, so
+ * callers pass NULL when instrumentation is off. Allocated bytes come from matrix_alloc_bytes, which is
+ * process-wide: concurrent runs count each other's allocations.
+ */
+typedef struct SymnmfStats {
+    double wall[PHASE_COUNT];    /* wall seconds of each phase */
+    double cpu[PHASE_COUNT];     /* process CPU seconds of each phase, summed over threads */
+    double bytes[PHASE_COUNT];   /* bytes allocated for matrices during each phase */
+    double flops[PHASE_COUNT];   /* estimated floating point operations of each phase */
+    int iterations;              /* iterations of the solver */
+    int stop;                    /* STOP_ reason of the solver, -1 if none ran */
+    double delta;                /* ||H - old_H||_F of the last iteration */
+    SolverTrace* trace;          /* optional, receives the objective after every iteration */
+    int phase;                   /* phase being timed, -1 if none */
+    double started_wall;
+    double started_cpu;
+    double started_bytes;
+} SymnmfStats;
+
+/**
+ * Clears the statistics.
+ * @param stats: Statistics to clear
+ * @param trace: Optional trace for the per-iteration objective (may be NULL)
+ * @return: stats
+ */
+SymnmfStats* stats_init(SymnmfStats* stats, SolverTrace* trace);
+
+/**
+ * Starts timing a phase.
+ * @param stats: Statistics (may be NULL)
+ * @param phase: One of the PHASE_ constants
+ */
+void stats_begin(SymnmfStats* stats, int phase);
+
+/**
+ * Stops timing the current phase and adds its time, allocations and flops to it.
+ * @param stats: Statistics (may be NULL)
+ * @param flops: Estimated floating point operations of the phase
+ */
+void stats_end(SymnmfStats* stats, double flops);
+
+/**
+ * Stops timing the PHASE_SOLVE phase and records the outcome of the solve. The flops count
+ * the iterations this solve ran, not those before a resumed state.
+ * @param stats: Statistics (may be NULL)
+ * @param iteration_flops: Estimated flops of one iteration (see solve_iteration_flops)
+ * @param result: Outcome of the solve
+ */
+void stats_end_solve(SymnmfStats* stats, double iteration_flops, const SolverResult* result);
+
+/**
+ * Estimates the floating point operations of one multiplicative update iteration:
+ * the product W*H (2 per stored entry of W and column of H), H^T*H, H*(H^T*H) and the update.
+ * @param n: Number of rows of H
+ * @param stored: Entries of W the product reads: n*n for dense, packed and streamed graphs, nnz for CSR
+ * @param k: Number of columns of H
+ * @return: Estimated flops
+ */
+double solve_iteration_flops(int n, double stored, int k);
+
+/**
+ * Returns the name of a phase as used in the JSON and dict outputs.
+ * @param phase: One of the PHASE_ constants
+ * @return: Name, e.g. "solve"
+ */
+const char* stats_phase_name(int phase);
+
+/**
+ * Writes the statistics as a JSON object: per phase wall and CPU seconds, allocated bytes
+ * and flops, the totals, the iteration count and stop reason, the final ||H - old_H||_F and
+ * the objective after every iteration when a trace was attached.
+ * @param file: Output stream
+ * @param stats: Statistics
+ * @return: 1 on success, 0 if a write failed
+ */
+int stats_write_json(FILE* file, const SymnmfStats* stats);
+
+/**
+ * Computes the SymNMF objective ||W - H*H^T||_F^2 from its expansion
+ * ||W||^2 - 2 * tr(H^T*W*H) + ||H^T*H||^2, without forming an n*n matrix.
+ * The expansion loses absolute precision when the residual is small compared to ||W||,
+ * which is enough to rank factorizations of the same W.
+ * @param w_sq: Squared Frobenius norm of W (see graph_squared_norm)
+ * @param H: Matrix H (n*k)
+ * @param WH: W*H (n*k)
+ * @param gram: k*k scratch matrix, receives H^T*H
+ * @return: The objective
+ */
+double symnmf_objective(double w_sq, const Matrix* H, const Matrix* WH, Matrix* gram);
+
+/**
+ * Runs several SymNMF factorizations of the same W, one per (k, seed) configuration.
+ * The factors of all running restarts sit side by side in one n*K matrix, so every
+ * iteration does a single wide product W*[H_1 ... H_r]; the k*k Gram matrices and the
+ * updates are then done in parallel across restarts. A restart leaves the wide matrix
+ * as soon as one of the stopping criteria of options holds for it. Every column of the
+ * wide product is summed exactly as in a separate product, so each H equals the one
+ * symnmf_solve computes from init_H(W, H, seed) with the same options bit for bit.
+ * @param W: Graph operand for W (n*n)
+ * @param ks: Number of clusters of each restart
+ * @param seeds: Seed of each restart (see init_H)
+ * @param r: Number of restarts
+ * @param options: Stopping criteria (tol, max_iter, rel_obj) of every restart, NULL for the defaults;
+ *                 only SOLVER_MU is batched and checkpoints are not written
+ * @param H: Output matrices, H[i] of size n*ks[i] (views are allowed)
+ * @param objectives: Optional output array of r objectives ||W - H*H^T||_F^2 (may be NULL)
+ * @return: 1 on success, 0 if the solver is not SOLVER_MU or an allocation failed
+ */
+int symnmf_batch(const Graph* W, const int* ks, const unsigned long* seeds, int r, const SolverOptions* options, Matrix** H, double* objectives);
+
+/* Number of 32-bit words in the Mersenne Twister state. */
+#define MT_N 624
+
+/**
+ * MT19937 generator state, compatible with numpy's legacy RandomState.
+ */
+typedef struct Mt19937 {
+    unsigned long state[MT_N];
+    int pos;
+} Mt19937;
+
+/**
+ * Seeds a Mersenne Twister with a 32-bit integer (init_genrand), as numpy.random.seed(seed) does.
+ * @param rng: Generator state to initialize
+ * @param seed: Seed, only the low 32 bits are used
+ */
+void mt_seed(Mt19937* rng, unsigned long seed);
+
+/**
+ * Returns a double uniformly distributed in [0, 1) with 53 random bits,
+ * the same value numpy.random.random_sample draws from the same state.
+ * @param rng: Generator state
+ * @return: Value in [0, 1)
+ */
+double mt_uniform(Mt19937* rng);
+
+/**
+ * Fills H with the SymNMF starting point: entries drawn uniformly from [0, 2 * sqrt(m / k)),
+ * where m is the average entry of W, in row-major order. With the same seed this is the
+ * matrix np.random.seed(seed); np.random.uniform(0, 2 * np.sqrt(m / k), (n, k)) returns.
+ * @param W: Graph operand for W (n*n)
+ * @param H: Output matrix of size n*k
+ * @param seed: Seed of the generator
+ * @return: H
+ */
+Matrix* init_H(const Graph* W, Matrix* H, unsigned long seed);
+
+/**
+ * Fills H like init_H from a precomputed average entry of W.
+ * @param avg: Average entry of W
+ * @param H: Output matrix of size n*k
+ * @param seed: Seed of the generator
+ * @return: H
+ */
+Matrix* init_H_from_avg(double avg, Matrix* H, unsigned long seed);
+
+/**
+ * Formats a double exactly as printf("%.4f") does.
+ * |x| * 10^4 is rounded to the nearest integer in double arithmetic, which gives the
+ * correctly rounded result unless the product is within TIE_MARGIN of a tie; those values,
+ * very large values, infinities and NaNs are handed to sprintf.
+ * @param x: Value to format
+ * @param out: Destination, at least MAX_FIXED_LEN (320) bytes
+ * @return: Number of characters written (no terminating NUL)
+ */
+int format_fixed4(double x, char* out);
+
+/**
+ * Writes a matrix as text, one comma separated row per line with every value formatted
+ * as "%.4f", byte for byte what printf produces. Rows are formatted into large blocks,
+ * several blocks in parallel when more than one thread is available, and the blocks are
+ * written to the stream in order.
+ * @param file: Output stream (stdout or a file)
+ * @param M: Matrix to write
+ * @return: 1 on success, 0 if an allocation or a write failed
+ */
+int write_matrix(FILE* file, const Matrix* M);
+
+/**
+ * Prints a matrix to the console (see write_matrix).
  * @param res: Pointer to the matrix
- * @param rows: Number of rows
- * @param cols: Number of columns
  */
-void printMatrix(double** res, int rows, int cols);
+void printMatrix(const Matrix* res);
+
+/**
+ * Where and why loading a file of points failed.
+ */
+typedef struct LoadError {
+    long line;          /* 1-based line number, 0 if the error is not tied to a line */
+    int column;         /* 1-based field number, 0 if not applicable */
+    char message[64];
+} LoadError;
 
 /**
- * Counts the number of rows in a file.
+ * Loads a comma separated file of points, one point per line, into a matrix in a single pass.
+ * The file is memory-mapped (or read at once if it cannot be mapped) and parsed in parallel
+ * chunks. Blank lines are skipped, the number of columns is taken from the first data line,
+ * and every value is converted to the double strtod would return.
  * @param filename: Name of the file
- * @return: Number of rows in the file
+ * @param error: Optional, receives the line, field and reason of the first error on failure
+ * @return: Pointer to the matrix of points, NULL on failure
  */
-int count_rows_from_file(char* filename);
+Matrix* load_points(const char* filename, LoadError* error);
 
 /**
- * Counts the number of columns in a file.
+ * Records an error unless an earlier one was already recorded.
+ * @param error: Error to fill (may be NULL)
+ * @param line: 1-based line number (0 for errors not tied to a line)
+ * @param column: 1-based field number (0 if not applicable)
+ * @param message: Description of the problem
+ */
+void load_error_set(LoadError* error, long line, int column, const char* message);
+
+/* Contents of a file, mapped or read into memory (see file_map). */
+typedef struct MappedFile {
+    const char* data;
+    size_t size;
+    int mapped;         /* 1 if data is a mapping, 0 if it was malloc'ed */
+} MappedFile;
+
+/**
+ * Maps a whole file into memory for reading. Files that cannot be mapped (pipes, empty files)
+ * are read into a malloc'ed buffer instead.
  * @param filename: Name of the file
- * @return: Number of columns in the first row of the file
+ * @param file: Receives the contents, released with file_unmap
+ * @param error: Optional, receives the reason on failure
+ * @return: 1 on success, 0 on failure
  */
-int count_cols_from_file(char* filename);
+int file_map(const char* filename, MappedFile* file, LoadError* error);
 
 /**
- * Creates a 2D array from a file.
+ * Releases the contents of a file obtained with file_map.
+ * @param file: Mapped file
+ */
+void file_unmap(MappedFile* file);
+
+/* Layouts of the data of a binary matrix file. */
+#define BIN_DENSE 0     /* rows*cols values, row-major */
+#define BIN_PACKED 1    /* upper triangle of a symmetric n*n matrix, row by row (see PackedMatrix) */
+
+/* A binary matrix file opened in place with bin_open. The views point into the file and are read-only. */
+typedef struct BinFile {
+    MappedFile file;
+    int layout;          /* BIN_DENSE or BIN_PACKED */
+    Matrix dense;        /* rows and cols of the file; a view of the data if layout is BIN_DENSE */
+    PackedMatrix packed; /* a view of the data if layout is BIN_PACKED */
+} BinFile;
+
+/**
+ * Tells whether a file starts with the magic of a binary matrix file.
+ * @param filename: Name of the file
+ * @return: 1 if it does, 0 otherwise (including when the file cannot be read)
+ */
+int bin_is_matrix_file(const char* filename);
+
+/**
+ * Opens a binary matrix file and exposes its data in place, without copying.
+ * The data is read-only: the views must not be written to.
  * @param filename: Name of the file
+ * @param verify: Nonzero to check the checksum of the data (reads the whole file)
+ * @param error: Optional, receives the reason on failure
+ * @return: Open file, released with bin_close, NULL on failure
+ */
+BinFile* bin_open(const char* filename, int verify, LoadError* error);
+
+/**
+ * Closes a file opened with bin_open; its views become invalid.
+ * @param bin: Open file (may be NULL)
+ */
+void bin_close(BinFile* bin);
+
+/**
+ * Writes a matrix to a binary matrix file.
+ * @param filename: Name of the file to create
+ * @param M: Matrix to write (any stride)
+ * @param layout: BIN_DENSE, or BIN_PACKED to store only the upper triangle of a square symmetric M
+ * @return: 1 on success, 0 on failure
+ */
+int bin_save_matrix(const char* filename, const Matrix* M, int layout);
+
+/**
+ * Writes a packed symmetric matrix to a binary matrix file with the BIN_PACKED layout.
+ * @param filename: Name of the file to create
+ * @param P: Packed matrix to write
+ * @return: 1 on success, 0 on failure
+ */
+int bin_save_packed(const char* filename, const PackedMatrix* P);
+
+/**
+ * Writes a checkpoint of a solve: a binary matrix file of H (and of V below it for HALS)
+ * whose header also records the solver, the iteration and the previous objective. The file
+ * is written next to filename and renamed over it, so a killed run leaves either the
+ * previous checkpoint or the new one. bin_open reads it as a plain matrix.
+ * @param filename: Name of the checkpoint file
+ * @param H: Iterate (n*k)
+ * @param state: Where the solve stands; V is required for SOLVER_HALS
+ * @return: 1 on success, 0 on failure
+ */
+int checkpoint_save(const char* filename, const Matrix* H, const SolverState* state);
+
+/**
+ * Reads a checkpoint written by checkpoint_save, checking its data against the checksum.
+ * @param filename: Name of the checkpoint file
+ * @param state: Receives the state; for SOLVER_HALS state->V is a new matrix, freed with matrix_free
+ * @param error: Optional, receives the reason on failure
+ * @return: New matrix holding H, NULL on failure
+ */
+Matrix* checkpoint_load(const char* filename, SolverState* state, LoadError* error);
+
+
+/*
+ * Reduced precision. W is stored as float; in single precision (suffix _f32) the points,
+ * H and all sums are float too, in mixed precision (suffix _mixed) they are double. Both
+ * variants are generated from precision_template.h. The double path is the one above.
+ */
+
+/* A dense row-major float matrix, laid out like Matrix (MAT_ROW and MAT_AT apply). */
+typedef struct MatrixF {
+    float* data;
+    int rows;
+    int cols;
+    int stride;
+} MatrixF;
+
+/* A packed symmetric float matrix, laid out like PackedMatrix (PACKED_ROW applies). */
+typedef struct PackedMatrixF {
+    float* data;
+    int n;
+} PackedMatrixF;
+
+/**
+ * Creates a contiguous, row-aligned float matrix of size rows*cols initialized to zero.
+ * @param rows: Number of rows
+ * @param cols: Number of columns
+ * @return: Pointer to the allocated matrix, NULL if allocation failed
+ */
+MatrixF* matrix_f_create(int rows, int cols);
+
+/**
+ * Frees a float matrix allocated with matrix_f_create.
+ * @param M: Pointer to the matrix to free (may be NULL)
+ */
+void matrix_f_free(MatrixF* M);
+
+/**
+ * Fills a caller-provided MatrixF header describing existing memory (see matrix_view).
+ * @param view: Header to fill
+ * @param data: Pointer to the first element
  * @param rows: Number of rows
  * @param cols: Number of columns
- * @return: Pointer to the created array
+ * @param stride: Distance in floats between consecutive rows
+ * @return: The filled header
+ */
+MatrixF* matrix_f_view(MatrixF* view, float* data, int rows, int cols, int stride);
+
+/**
+ * Creates a packed symmetric float n*n matrix initialized to zero (see packed_create).
+ * @param n: Number of rows and columns
+ * @return: Pointer to the allocated matrix, NULL if allocation failed
+ */
+PackedMatrixF* packed_f_create(int n);
+
+/**
+ * Frees a packed float matrix allocated with packed_f_create.
+ * @param P: Pointer to the matrix to free (may be NULL)
+ */
+void packed_f_free(PackedMatrixF* P);
+
+/**
+ * Computes the average entry of a packed float matrix, summed in double in the order
+ * graph_entry_avg sums a packed double matrix.
+ * @param P: Packed symmetric matrix
+ * @return: Average of the n*n entries
+ */
+double packed_f_entry_avg(const PackedMatrixF* P);
+
+/**
+ * Computes the squared Frobenius norm of a packed float matrix, in double.
+ * @param P: Packed symmetric matrix
+ * @return: Sum of the squares of the n*n entries
+ */
+double packed_f_squared_norm(const PackedMatrixF* P);
+
+/**
+ * Computes the similarity matrix of the points in packed float storage.
+ * Distances are accumulated in float (_f32) or double (_mixed).
+ * @param points: Matrix of points, one point per row
+ * @return: Pointer to the packed similarity matrix, NULL on failure
+ */
+PackedMatrixF* sym_mat_packed_f32(const MatrixF* points);
+PackedMatrixF* sym_mat_packed_mixed(const Matrix* points);
+
+/**
+ * Computes the normalized similarity matrix W = D^-1/2 * A * D^-1/2 in packed float storage.
+ * Degrees are accumulated in float (_f32) or double (_mixed).
+ * @param points: Matrix of points, one point per row
+ * @return: Pointer to the packed normalized matrix, NULL on failure
+ */
+PackedMatrixF* norm_mat_packed_f32(const MatrixF* points);
+PackedMatrixF* norm_mat_packed_mixed(const Matrix* points);
+
+/**
+ * Fills H like init_H from the average entry of a packed float W.
+ * @param W: Packed float W (n*n)
+ * @param H: Output matrix of size n*k
+ * @param seed: Seed of the generator
+ * @return: H
+ */
+MatrixF* init_H_f32(const PackedMatrixF* W, MatrixF* H, unsigned long seed);
+Matrix* init_H_mixed(const PackedMatrixF* W, Matrix* H, unsigned long seed);
+
+/**
+ * Runs the multiplicative update against a packed float W until one of the stopping
+ * criteria of options holds, accumulating W*H, H^T*H and H*(H^T*H) in float (_f32) or
+ * double (_mixed). Only SOLVER_MU is available in reduced precision.
+ * @param H: Matrix H (n*k), the starting point, updated in place
+ * @param W: Packed float W (n*n)
+ * @param options: Stopping criteria, NULL for the defaults
+ * @param result: Optional (may be NULL), receives the iteration count and the stop reason
+ * @return: H, or NULL if an allocation failed, the sizes disagree or the solver is not SOLVER_MU
+ */
+MatrixF* symnmf_solve_f32(MatrixF* H, const PackedMatrixF* W, const SolverOptions* options, SolverResult* result);
+Matrix* symnmf_solve_mixed(Matrix* H, const PackedMatrixF* W, const SolverOptions* options, SolverResult* result);
+
+/* Convergence threshold of kmeans on the distance every centroid moved, as in kmeans.py. */
+#define KMEANS_EPSILON 0.0001
+
+/* Assignment step of kmeans. */
+#define KMEANS_LLOYD 0       /* distances from every point to every centroid */
+#define KMEANS_HAMERLY 1     /* skips points whose distance bounds prove their centroid unchanged */
+
+/**
+ * Clusters the points with k-means exactly as kmeans.py does: the first k points are the
+ * starting centroids, each iteration assigns every point to its nearest centroid (the lowest
+ * index on ties) and moves every centroid to the mean of its points (to the origin if it has
+ * none), and the run stops once no centroid moved KMEANS_EPSILON or more, or after max_iter
+ * iterations. Both assignment methods produce the same centroids.
+ * @param points: Matrix of points (n*d), one point per row
+ * @param k: Number of clusters, 1 <= k <= n
+ * @param max_iter: Largest number of iterations
+ * @param method: KMEANS_LLOYD or KMEANS_HAMERLY
+ * @param labels: Optional array of n ints (may be NULL), receives the centroid of every point in the last assignment
+ * @param iterations: Optional (may be NULL), receives the number of iterations run
+ * @return: The centroids (k*d), NULL on failure
+ */
+Matrix* kmeans(const Matrix* points, int k, int max_iter, int method, int* labels, int* iterations);
+
+/**
+ * Labels every row of H with the index of its largest entry, the first one on ties.
+ * @param H: Matrix H (n*k)
+ * @param labels: Array of n ints receiving the labels
+ * @return: labels
+ */
+int* argmax_labels(const Matrix* H, int* labels);
+
+/**
+ * Labels every point with its nearest centroid (see nearest_row), the first one on ties.
+ * @param points: Matrix of points (n*d)
+ * @param C: Centroids (k*d)
+ * @param labels: Array of n ints receiving the labels
+ * @return: labels
+ */
+int* nearest_labels(const Matrix* points, const Matrix* C, int* labels);
+
+/**
+ * Computes the mean silhouette coefficient of a clustering with Euclidean distances, as
+ * sklearn.metrics.silhouette_score does: for every point, (b - a) / max(a, b) where a is its
+ * mean distance to the rest of its cluster and b the smallest mean distance to another
+ * cluster, 0 for a point alone in its cluster. The O(n^2 d) distance pass is blocked and
+ * multithreaded. Given the similarity matrix of sym_mat, distances are recovered from the
+ * affinities instead of the coordinates (to about 1e-8 relative; pairs whose affinity
+ * is within 1e-8 of 1 are measured from the coordinates, since their distance cannot be
+ * recovered), which saves the d-term for high-dimensional points.
+ * @param points: Matrix of points (n*d)
+ * @param labels: Cluster of every point, in 0 .. k - 1
+ * @param k: Number of cluster indices
+ * @param A: Similarity matrix of the points (n*n, see sym_mat), or NULL to use the coordinates
+ * @param score: Receives the score
+ * @return: 1 on success, 0 if the labels are out of range, do not form between 2 and n - 1 clusters, or an allocation failed
+ */
+int silhouette_score(const Matrix* points, const int* labels, int k, const Matrix* A, double* score);
+
+/*
+ * A fitted factorization that assigns new points without refactorizing (see online_assign).
+ * Kept points are appended; storage grows by doubling. A model must not be used by two
+ * calls at once.
+ */
+typedef struct OnlineModel {
+    Matrix* points;          /* capacity*d, the first n rows hold the points */
+    Matrix* H;               /* capacity*k, the first n rows hold their rows of H */
+    Matrix* vectors;         /* 2*capacity: the degrees of the n points, and scratch for affinities */
+    Matrix* gram;            /* H^T*H over the n rows */
+    Matrix* work;            /* 2*k scratch: H^T*w and the projected row */
+    int n;                   /* number of points */
+    int capacity;            /* rows allocated */
+    int refit_every;         /* refit once this many points were kept, 0 for never */
+    int pending;             /* points kept since the last fit */
+    SolverOptions options;   /* solver options of the refits */
+} OnlineModel;
+
+/**
+ * Creates an online model from a fitted factorization. The points and H are copied.
+ * @param points: Matrix of the fitted points (n*d)
+ * @param H: Fitted H (n*k)
+ * @param degrees: Degree of every point in the similarity graph (see norm_mat_packed), or NULL to compute them
+ * @param refit_every: Refit once this many points were kept, 0 to refit only on request
+ * @param options: Solver options of the refits, NULL for the defaults
+ * @return: The model, NULL on failure
+ */
+OnlineModel* online_create(const Matrix* points, const Matrix* H, const double* degrees, int refit_every, const SolverOptions* options);
+
+/**
+ * Frees an online model.
+ * @param model: Model to free (may be NULL)
+ */
+void online_free(OnlineModel* model);
+
+/**
+ * Assigns a new point to a cluster without refactorizing. Its affinities a_j to the n points
+ * are normalized with the degrees of the graph that includes it, w_j = a_j / sqrt(d * (d_j + a_j))
+ * where d is the sum of the a_j, and its row of H is the nonnegative h minimizing ||w - H*h||.
+ * Points whose affinity underflowed to 0 add nothing; a point isolated from all of them
+ * (d = 0) gets h = 0 and label 0, and is never kept, since it would be a vertex without
+ * edges in the graph. With keep any other point joins the model: the degrees d_j grow by a_j, the point, d and h are
+ * appended, H^T*H is updated, and once refit_every points were kept the model refits (see
+ * online_refit). Costs O(n*(d + k)) per point, plus the refits.
+ * @param model: Online model
+ * @param point: Point of d coordinates
+ * @param keep: Nonzero to add the point to the model
+ * @param h: Optional (may be NULL), receives the row of H of the point (k)
+ * @return: The cluster of the point (largest entry of h, the first one on ties), -1 if an allocation failed
+ */
+int online_assign(OnlineModel* model, const double* point, int keep, double* h);
+
+/**
+ * Refits the model on all its points: rebuilds the packed normalized W with exact degrees and
+ * runs the solver from the current H (a warm start), so the rows of the kept points move from
+ * their projections to the factorization of the whole graph.
+ * @param model: Online model
+ * @param result: Optional (may be NULL), receives the iteration count and the stop reason
+ * @return: 1 on success, 0 if an allocation failed (the model is left as it was, but for the degrees)
  */
-double** create_array_from_file(char* filename, int rows, int cols);
+int online_refit(OnlineModel* model, SolverResult* result);
 
 #endif
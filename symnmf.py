@@ -1,8 +1,8 @@
 import sys
-import numpy as np
 import mysymnmf as symn
 
-np.random.seed(1234)
+SEED = 1234
+KNN_NEIGHBORS = 10
 
 def parse_arguments():
     """
@@ -22,15 +22,17 @@ def read_array_from_file(filename):
     """
     Reads a 2D array of points from the given file.
     :param filename: The name of the file to read from
-    :return: 2D list of floats representing the data
+    :return: 2D float64 array representing the data
     """
-    with open(filename, 'r') as file:
-        lines = file.readlines()        
-        array = [
-            [float(value) for value in line.strip().split(',')]
-            for line in lines
-        ]
-    return array
+    return symn.load(filename)
+
+
+def print_matrix(matrix):
+    """
+    Prints a matrix with 4 decimal places, one comma separated row per line.
+    :param matrix: 2D float64 array
+    """
+    symn.write_matrix(matrix)
 
 
 def main():
@@ -42,30 +44,22 @@ def main():
     try:
         k, goal, file_name = parse_arguments()
         pnt_array = read_array_from_file(file_name)
-        rows = len(pnt_array)
-        cols = len(pnt_array[0])
-        if goal == "symnmf":
-            norm_matrix = symn.norm(pnt_array)
-            total_sum = sum(sum(row) for row in norm_matrix)
-            num_elements = sum(len(row) for row in norm_matrix)
-            average = total_sum / num_elements
-            upper_bound = 2 * np.sqrt(average / int(float(k)))
-            H = np.random.uniform(0, upper_bound, (rows, int(float(k)))).tolist()
-            final_H = symn.symnmf(H, norm_matrix, int(float(k)), rows)
-            for row in final_H:
-                print(','.join('%.4f' % value for value in row))
+        if goal == "symnmf_knn":
+            graph = symn.Graph(pnt_array, kind="knn", neighbors=KNN_NEIGHBORS)
+            final_H = symn.fit(graph, int(float(k)), seed=SEED)
+            print_matrix(final_H)
+        elif goal == "symnmf":
+            final_H = symn.fit(pnt_array, int(float(k)), seed=SEED)
+            print_matrix(final_H)
         elif goal == "sym":
-            sym_matrix = symn.sym(pnt_array)
-            for row in sym_matrix:
-                print(','.join('%.4f' % value for value in row))
+            sym_matrix = symn.sym_array(pnt_array)
+            print_matrix(sym_matrix)
         elif goal == "ddg":
-            diag_matrix = symn.ddg(pnt_array)
-            for row in diag_matrix:
-                print(','.join('%.4f' % value for value in row))
+            diag_matrix = symn.ddg_array(pnt_array)
+            print_matrix(diag_matrix)
         elif goal == "norm":
-            norm_matrix = symn.norm(pnt_array)
-            for row in norm_matrix:
-                print(','.join('%.4f' % value for value in row))
+            norm_matrix = symn.norm_array(pnt_array)
+            print_matrix(norm_matrix)
     except Exception as e:
         print("An Error Has Occurred")
         exit()
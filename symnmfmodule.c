@@ -5,83 +5,531 @@
 #include <string.h>
 #include <math.h>
 #include <stdlib.h>
+#include <limits.h>
 
 /**
- * Converts a Python list of lists (2D array) to a C double pointer (matrix like).
- * @param lst_py: Python list to convert
+ * Exposes a C-contiguous 2D float64 buffer (NumPy array, memoryview, ...) as a Matrix view
+ * without copying. On success the caller must release the buffer with PyBuffer_Release.
+ * @param obj: Python object supporting the buffer protocol
+ * @param view: Buffer to fill
+ * @param M: Matrix header to point at the buffer data (stride = cols)
+ * @param rows: Required number of rows, or -1 to accept any
+ * @param cols: Required number of columns, or -1 to accept any
+ * @param writable: Nonzero if the matrix will be written to
+ * @return: 1 on success, 0 with a Python exception set on failure
+ */
+static int buffer_to_matrix(PyObject* obj, Py_buffer* view, Matrix* M, Py_ssize_t rows, Py_ssize_t cols, int writable) {
+    const char *fmt;
+    if (PyObject_GetBuffer(obj, view, PyBUF_C_CONTIGUOUS | PyBUF_FORMAT | (writable ? PyBUF_WRITABLE : 0)) < 0) {
+        return 0;
+    }
+    fmt = (view->format == NULL) ? "B" : view->format;
+    if (fmt[0] == '@' || fmt[0] == '=' || fmt[0] == '<') {
+        fmt++;
+    }
+    if (view->ndim != 2 || view->itemsize != sizeof(double) || strcmp(fmt, "d") != 0) {
+        PyErr_SetString(PyExc_TypeError, "expected a C-contiguous 2D float64 buffer");
+    } else if ((rows >= 0 && view->shape[0] != rows) || (cols >= 0 && view->shape[1] != cols)) {
+        PyErr_SetString(PyExc_ValueError, "buffer has the wrong shape");
+    } else if (view->shape[0] > INT_MAX || view->shape[1] > INT_MAX) {
+        PyErr_SetString(PyExc_ValueError, "buffer is too large");
+    } else {
+        matrix_view(M, (double*)view->buf, (int)view->shape[0], (int)view->shape[1], (int)view->shape[1]);
+        return 1;
+    }
+    PyBuffer_Release(view);
+    return 0;
+}
+
+/**
+ * Copies a float64 buffer of the given shape (-1 for any) into a contiguous C matrix.
+ * @param obj: Python object supporting the buffer protocol
+ * @param rows: Required number of rows, or -1 to accept any
+ * @param cols: Required number of columns, or -1 to accept any
+ * @return: Pointer to the C matrix, NULL on failure
+ */
+static Matrix* buffer_to_lst_c(PyObject* obj, Py_ssize_t rows, Py_ssize_t cols) {
+    int i;
+    Py_buffer view;
+    Matrix M;
+    Matrix *lst_c;
+    if (!buffer_to_matrix(obj, &view, &M, rows, cols, 0)) {
+        return NULL;
+    }
+    lst_c = matrix_create(M.rows, M.cols);
+    if (lst_c == NULL) {
+        PyErr_NoMemory();
+    } else {
+        for (i = 0; i < M.rows; i++) {
+            memcpy(MAT_ROW(lst_c, i), MAT_ROW(&M, i), (size_t)M.cols * sizeof(double));
+        }
+    }
+    PyBuffer_Release(&view);
+    return lst_c;
+}
+
+/**
+ * Converts a Python list of lists (2D array), or a 2D float64 buffer, to a contiguous C matrix.
+ * @param lst_py: Python list or buffer-protocol object to convert
  * @param rows: Number of rows in the matrix
  * @param cols: Number of columns in the matrix
- * @return: Pointer to the C matrix (double**)
+ * @return: Pointer to the C matrix, NULL on failure
  */
-static double** lst_Py_to_lst_c(PyObject* lst_py, int rows, int cols) {
+static Matrix* lst_Py_to_lst_c(PyObject* lst_py, int rows, int cols) {
     int i, j;
     PyObject *place_holder_lst;
     PyObject *place_holder_cord;
-    double **lst_c = create_matrix(rows, cols);
+    double *row;
+    Matrix *lst_c;
+    if (PyObject_CheckBuffer(lst_py)) {
+        return buffer_to_lst_c(lst_py, rows, cols);
+    }
+    if (!PyList_Check(lst_py) || PyList_Size(lst_py) != rows) {
+        PyErr_SetString(PyExc_ValueError, "expected a list of rows of the right length");
+        return NULL;
+    }
+    lst_c = matrix_create(rows, cols);
+    if (lst_c == NULL) {
+        return (Matrix*)PyErr_NoMemory();
+    }
     for (i = 0; i < rows; i++) {   
         place_holder_lst = PyList_GetItem(lst_py, i);
+        row = MAT_ROW(lst_c, i);
         for (j = 0; j < cols; j++) {
             place_holder_cord = PyList_GetItem(place_holder_lst, j);
-            lst_c[i][j] = PyFloat_AsDouble(place_holder_cord);
+            row[j] = PyFloat_AsDouble(place_holder_cord);
         }
     }
+    if (PyErr_Occurred()) {
+        matrix_free(lst_c);
+        return NULL;
+    }
     return lst_c;
 }
 
 /**
- * Converts a C double pointer (matrix) to a Python list of lists.
+ * Converts the upper triangle of a symmetric Python list of lists to packed C storage.
+ * @param lst_py: Python list to convert
+ * @param n: Number of rows and columns
+ * @return: Pointer to the packed matrix, NULL on failure
+ */
+static PackedMatrix* lst_Py_to_packed(PyObject* lst_py, int n) {
+    int i, j;
+    PyObject *place_holder_lst;
+    double *row;
+    PackedMatrix *packed = packed_create(n);
+    if (packed == NULL) {
+        return (PackedMatrix*)PyErr_NoMemory();
+    }
+    for (i = 0; i < n; i++) {
+        place_holder_lst = PyList_GetItem(lst_py, i);
+        row = PACKED_ROW(packed, i) - i;
+        for (j = i; j < n; j++) {
+            row[j] = PyFloat_AsDouble(PyList_GetItem(place_holder_lst, j));
+        }
+    }
+    if (PyErr_Occurred()) {
+        packed_free(packed);
+        return NULL;
+    }
+    return packed;
+}
+
+/**
+ * Converts a (row_ptr, col_idx, values) tuple of Python lists to a C CSR matrix.
+ * @param csr_py: Python tuple to convert
+ * @param n: Number of rows and columns
+ * @return: Pointer to the CSR matrix, NULL on failure
+ */
+static CsrMatrix* csr_Py_to_csr_c(PyObject* csr_py, int n) {
+    int i;
+    size_t e, nnz;
+    PyObject *row_ptr_py, *col_idx_py, *values_py;
+    CsrMatrix *csr_c;
+    if (!PyArg_ParseTuple(csr_py, "O!O!O!", &PyList_Type, &row_ptr_py, &PyList_Type, &col_idx_py, &PyList_Type, &values_py)) {
+        return NULL;
+    }
+    nnz = (size_t)PyList_Size(values_py);
+    if (PyList_Size(row_ptr_py) != n + 1 || (size_t)PyList_Size(col_idx_py) != nnz) {
+        PyErr_SetString(PyExc_ValueError, "inconsistent CSR arrays");
+        return NULL;
+    }
+    csr_c = csr_create(n, nnz);
+    if (csr_c == NULL) {
+        return (CsrMatrix*)PyErr_NoMemory();
+    }
+    for (i = 0; i <= n; i++) {
+        csr_c->row_ptr[i] = PyLong_AsSize_t(PyList_GetItem(row_ptr_py, i));
+    }
+    for (e = 0; e < nnz; e++) {
+        csr_c->col_idx[e] = (int)PyLong_AsLong(PyList_GetItem(col_idx_py, e));
+        csr_c->values[e] = PyFloat_AsDouble(PyList_GetItem(values_py, e));
+    }
+    if (!PyErr_Occurred()) {
+        for (i = 0; i < n; i++) {
+            if (csr_c->row_ptr[i] > csr_c->row_ptr[i + 1] || csr_c->row_ptr[n] != nnz) {
+                PyErr_SetString(PyExc_ValueError, "inconsistent CSR arrays");
+                break;
+            }
+        }
+        for (e = 0; e < nnz && !PyErr_Occurred(); e++) {
+            if (csr_c->col_idx[e] < 0 || csr_c->col_idx[e] >= n) {
+                PyErr_SetString(PyExc_ValueError, "CSR column index out of range");
+            }
+        }
+    }
+    if (PyErr_Occurred()) {
+        csr_free(csr_c);
+        return NULL;
+    }
+    return csr_c;
+}
+
+/**
+ * Converts a C CSR matrix to a (row_ptr, col_idx, values) tuple of Python lists.
+ * @param csr_c: C CSR matrix to convert
+ * @return: Python tuple containing the matrix
+ */
+static PyObject* csr_c_to_csr_Py(const CsrMatrix* csr_c) {
+    int i;
+    size_t e;
+    PyObject *row_ptr_py = PyList_New(csr_c->n + 1);
+    PyObject *col_idx_py = PyList_New((Py_ssize_t)csr_c->nnz);
+    PyObject *values_py = PyList_New((Py_ssize_t)csr_c->nnz);
+    if (row_ptr_py == NULL || col_idx_py == NULL || values_py == NULL) {
+        Py_XDECREF(row_ptr_py);
+        Py_XDECREF(col_idx_py);
+        Py_XDECREF(values_py);
+        return NULL;
+    }
+    for (i = 0; i <= csr_c->n; i++) {
+        PyList_SET_ITEM(row_ptr_py, i, PyLong_FromSize_t(csr_c->row_ptr[i]));
+    }
+    for (e = 0; e < csr_c->nnz; e++) {
+        PyList_SET_ITEM(col_idx_py, e, PyLong_FromLong(csr_c->col_idx[e]));
+        PyList_SET_ITEM(values_py, e, PyFloat_FromDouble(csr_c->values[e]));
+    }
+    return Py_BuildValue("(NNN)", row_ptr_py, col_idx_py, values_py);
+}
+
+/**
+ * Converts a contiguous C matrix to a Python list of lists.
  * @param lst_c: C matrix to convert
- * @param rows: Number of rows in the matrix
- * @param cols: Number of columns in the matrix
  * @return: Python list containing the matrix
  */
-static PyObject* lst_c_to_lst_Py(double** lst_c, int rows, int cols) {
+static PyObject* lst_c_to_lst_Py(const Matrix* lst_c) {
     int i, j;
-    PyObject* py_lst = PyList_New(rows);
-    for (i = 0; i < rows; i++) {
-        PyObject *temp_pnt = PyList_New(cols);
-        for (j = 0; j < cols; j++) {
-            PyObject *temp_cord = PyFloat_FromDouble(lst_c[i][j]);
+    const double *row;
+    PyObject* py_lst = PyList_New(lst_c->rows);
+    if (py_lst == NULL) {
+        return NULL;
+    }
+    for (i = 0; i < lst_c->rows; i++) {
+        PyObject *temp_pnt = PyList_New(lst_c->cols);
+        if (temp_pnt == NULL) {
+            Py_DECREF(py_lst);
+            return NULL;
+        }
+        row = MAT_ROW(lst_c, i);
+        for (j = 0; j < lst_c->cols; j++) {
+            PyObject *temp_cord = PyFloat_FromDouble(row[j]);
             if (PyList_SetItem(temp_pnt, j, temp_cord) < 0) {
+                Py_DECREF(temp_pnt);
+                Py_DECREF(py_lst);
                 return NULL;
             }
         }
         if (PyList_SetItem(py_lst, i, temp_pnt) < 0) {
+            Py_DECREF(py_lst);
             return NULL;
         }
     }
     return py_lst; 
 }
 
+/**
+ * Reads a Python list of points, or a 2D float64 buffer of points, into a C matrix,
+ * taking the dimensions from the input.
+ * @param pnt_lst_py: Python list of points or buffer-protocol object
+ * @return: Pointer to the C matrix, NULL on failure
+ */
+static Matrix* points_from_py(PyObject* pnt_lst_py) {
+    int rows, cols;
+    Matrix *pnt_lst;
+    if (PyObject_CheckBuffer(pnt_lst_py)) {
+        pnt_lst = buffer_to_lst_c(pnt_lst_py, -1, -1);
+        if (pnt_lst != NULL && pnt_lst->rows == 0) {
+            matrix_free(pnt_lst);
+            PyErr_SetString(PyExc_ValueError, "expected a non-empty list of points");
+            return NULL;
+        }
+        return pnt_lst;
+    }
+    if (!PyList_Check(pnt_lst_py) || PyList_Size(pnt_lst_py) == 0) {
+        PyErr_SetString(PyExc_ValueError, "expected a non-empty list of points");
+        return NULL;
+    }
+    rows = (int)PyList_Size(pnt_lst_py);
+    cols = (int)PyList_Size(PyList_GetItem(pnt_lst_py, 0));
+    return lst_Py_to_lst_c(pnt_lst_py, rows, cols);
+}
+
+/**
+ * Returns the object that receives a result of size rows*cols: out itself if one was given,
+ * otherwise a new numpy.empty((rows, cols)) array, and exposes it as a writable Matrix view.
+ * @param out: Caller-provided output object, or NULL / None to allocate one
+ * @param rows: Number of rows of the result
+ * @param cols: Number of columns of the result
+ * @param view: Buffer to fill
+ * @param M: Matrix header to point at the output data
+ * @return: New reference to the output object, NULL with a Python exception set on failure
+ */
+static PyObject* output_matrix(PyObject* out, int rows, int cols, Py_buffer* view, Matrix* M) {
+    PyObject *numpy;
+    if (out != NULL && out != Py_None) {
+        Py_INCREF(out);
+    } else {
+        numpy = PyImport_ImportModule("numpy");
+        if (numpy == NULL) {
+            return NULL;
+        }
+        out = PyObject_CallMethod(numpy, "empty", "((ii))", rows, cols);
+        Py_DECREF(numpy);
+        if (out == NULL) {
+            return NULL;
+        }
+    }
+    if (!buffer_to_matrix(out, view, M, rows, cols, 1)) {
+        Py_DECREF(out);
+        return NULL;
+    }
+    return out;
+}
+
+/**
+ * Fills solver options from the Python keyword arguments of a solve.
+ * @param solver_name: "mu" or "hals"
+ * @param tol: Tolerance on the squared change of H
+ * @param max_iter: Largest number of iterations
+ * @param rel_obj: Relative objective criterion, 0 to disable
+ * @param options: Options to fill
+ * @return: 1 on success, 0 with ValueError set if an argument is invalid
+ */
+static int solver_options_from_py(const char *solver_name, double tol, int max_iter, double rel_obj, SolverOptions *options) {
+    solver_options_default(options);
+    if (strcmp(solver_name, "mu") == 0) {
+        options->solver = SOLVER_MU;
+    } else if (strcmp(solver_name, "hals") == 0) {
+        options->solver = SOLVER_HALS;
+    } else {
+        PyErr_SetString(PyExc_ValueError, "solver must be 'mu' or 'hals'");
+        return 0;
+    }
+    if (!(tol >= 0) || max_iter < 0 || !(rel_obj >= 0)) {
+        PyErr_SetString(PyExc_ValueError, "tol, max_iter and rel_obj must not be negative");
+        return 0;
+    }
+    options->tol = tol;
+    options->max_iter = max_iter;
+    options->rel_obj = rel_obj;
+    return 1;
+}
+
+/**
+ * Converts a double array to a Python list of floats.
+ * @param values: Array
+ * @param count: Number of entries
+ * @return: New list, NULL on failure
+ */
+static PyObject* doubles_to_py(const double *values, int count) {
+    PyObject *lst, *value;
+    int i;
+    lst = PyList_New(count);
+    for (i = 0; lst != NULL && i < count; i++) {
+        value = PyFloat_FromDouble(values[i]);
+        if (value == NULL) {
+            Py_DECREF(lst);
+            return NULL;
+        }
+        PyList_SET_ITEM(lst, i, value);
+    }
+    return lst;
+}
+
+/**
+ * Describes the outcome of a solve as a dict: {"start": s, "iterations": n, "stop": reason,
+ * "delta": d} where s is the iteration a resumed solve started at (0 otherwise), reason is
+ * "tolerance", "max_iter" or "objective" and d is ||H - old_H||_F of the last iteration, plus the lists "objective" (iterations + 1
+ * entries, the objective after m iterations) and "seconds" (time of every iteration) when
+ * a trace was recorded.
+ * @param result: Outcome of the solve
+ * @param trace: Recorded trace, or NULL
+ * @return: New dict, NULL on failure
+ */
+static PyObject* solve_info_to_py(const SolverResult *result, const SolverTrace *trace) {
+    static const char *reasons[] = {"tolerance", "max_iter", "objective"};
+    PyObject *info, *objective, *seconds;
+    info = Py_BuildValue("{sisisUsd}", "start", result->start, "iterations", result->iterations, "stop", reasons[result->stop],
+                         "delta", result->delta);
+    if (info != NULL && trace != NULL) {
+        objective = doubles_to_py(trace->objective, trace->iterations + 1);
+        seconds = doubles_to_py(trace->seconds, trace->iterations);
+        if (objective == NULL || seconds == NULL || PyDict_SetItemString(info, "objective", objective) < 0
+            || PyDict_SetItemString(info, "seconds", seconds) < 0) {
+            Py_CLEAR(info);
+        }
+        Py_XDECREF(objective);
+        Py_XDECREF(seconds);
+    }
+    return info;
+}
+
+/**
+ * Returns H alone, or (H, info) when the caller asked for the outcome of the solve.
+ * @param res_py: Solved H (reference is stolen)
+ * @param want_info: Nonzero to return (H, info)
+ * @param result: Outcome of the solve
+ * @param trace: Recorded trace, or NULL
+ * @return: H or (H, info), NULL on failure
+ */
+static PyObject* solve_output(PyObject *res_py, int want_info, const SolverResult *result, const SolverTrace *trace) {
+    PyObject *info;
+    if (!want_info) {
+        return res_py;
+    }
+    info = solve_info_to_py(result, trace);
+    if (info == NULL) {
+        Py_DECREF(res_py);
+        return NULL;
+    }
+    return Py_BuildValue("(NN)", res_py, info);
+}
+
+/**
+ * Describes the statistics of a run as a dict with the fields of stats_write_json:
+ * {"phases": {name: {"wall", "cpu", "bytes", "flops"}}, "wall", "cpu", "bytes_allocated",
+ * "flops", "iterations", "stop", "delta"}, plus "objective" when a trace was attached.
+ * @param stats: Statistics
+ * @return: New dict, NULL on failure
+ */
+static PyObject* stats_to_py(const SymnmfStats *stats) {
+    static const char *reasons[] = {"tolerance", "max_iter", "objective"};
+    PyObject *dict, *phases, *phase;
+    double wall = 0.0, cpu = 0.0, bytes = 0.0, flops = 0.0;
+    int p, ok;
+    phases = PyDict_New();
+    for (p = 0; phases != NULL && p < PHASE_COUNT; p++) {
+        phase = Py_BuildValue("{sdsdsdsd}", "wall", stats->wall[p], "cpu", stats->cpu[p],
+                              "bytes", stats->bytes[p], "flops", stats->flops[p]);
+        if (phase == NULL || PyDict_SetItemString(phases, stats_phase_name(p), phase) < 0) {
+            Py_XDECREF(phase);
+            Py_CLEAR(phases);
+            break;
+        }
+        Py_DECREF(phase);
+        wall += stats->wall[p];
+        cpu += stats->cpu[p];
+        bytes += stats->bytes[p];
+        flops += stats->flops[p];
+    }
+    if (phases == NULL) {
+        return NULL;
+    }
+    dict = Py_BuildValue("{sNsdsdsdsdsisssd}", "phases", phases, "wall", wall, "cpu", cpu, "bytes_allocated", bytes,
+                         "flops", flops, "iterations", stats->iterations,
+                         "stop", (stats->stop >= 0) ? reasons[stats->stop] : NULL, "delta", stats->delta);
+    if (dict != NULL && stats->trace != NULL) {
+        phase = doubles_to_py(stats->trace->objective, stats->trace->iterations + 1);
+        ok = phase != NULL && PyDict_SetItemString(dict, "objective", phase) == 0;
+        Py_XDECREF(phase);
+        if (!ok) {
+            Py_CLEAR(dict);
+        }
+    }
+    return dict;
+}
+
+/**
+ * Adds the statistics of a run to the info dict of a (H, info) result.
+ * @param res_py: (H, info) tuple (reference is stolen)
+ * @param stats: Statistics
+ * @return: res_py, NULL on failure
+ */
+static PyObject* add_stats(PyObject *res_py, const SymnmfStats *stats) {
+    PyObject *stats_py;
+    if (res_py == NULL) {
+        return NULL;
+    }
+    stats_py = stats_to_py(stats);
+    if (stats_py == NULL || PyDict_SetItemString(PyTuple_GET_ITEM(res_py, 1), "stats", stats_py) < 0) {
+        Py_XDECREF(stats_py);
+        Py_DECREF(res_py);
+        return NULL;
+    }
+    Py_DECREF(stats_py);
+    return res_py;
+}
+
 /**
  * Does the optimization of the matrix H using the non-negative matrix factorization.
+ * W is either a list of lists or a (row_ptr, col_idx, values) tuple as returned by knn().
+ * tol, max_iter, rel_obj and solver are the stopping criteria and method of SolverOptions;
+ * with info=True the result is (H, {"iterations": n, "stop": reason}).
  * @param self: Pointer to the module
- * @param args: Arguments passed from Python
- * @return: Optimized matrix H as a Python object
+ * @param args: Arguments passed from Python (H, W, k, n[, tol, max_iter, rel_obj, solver, info])
+ * @param kwargs: Keyword arguments passed from Python
+ * @return: Optimized matrix H as a Python object, or (H, info)
  */
-static PyObject* opt_mat_py(PyObject *self, PyObject *args) {
-    int k, rows;
+static PyObject* opt_mat_py(PyObject *self, PyObject *args, PyObject *kwargs) {
+    static char *kwlist[] = {"H", "W", "k", "n", "tol", "max_iter", "rel_obj", "solver", "info", NULL};
+    int k, rows, max_iter = MAXITER, want_info = 0;
+    double tol = EPSILON, rel_obj = 0.0;
+    const char *solver_name = "mu";
     PyObject *H_py, *W_py, *final_H_py;
-    double** H_c;
-    double** W_c;
-    double** final_H_c;
-    if (!PyArg_ParseTuple(args, "OOii", &H_py, &W_py, &k, &rows)) {
+    Matrix* H_c;
+    PackedMatrix* W_c = NULL;
+    CsrMatrix* W_sparse = NULL;
+    Graph W_graph;
+    Workspace* ws;
+    Matrix* solved;
+    SolverOptions options;
+    SolverResult result;
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "OOii|didsp", kwlist, &H_py, &W_py, &k, &rows,
+                                     &tol, &max_iter, &rel_obj, &solver_name, &want_info)) {
+        return NULL;
+    }
+    if (!solver_options_from_py(solver_name, tol, max_iter, rel_obj, &options)) {
         return NULL;
     }
     H_c = lst_Py_to_lst_c(H_py, rows, k);
     if (H_c == NULL) {
         return NULL;
     }
-    W_c = lst_Py_to_lst_c(W_py, rows, rows);
-    if (W_c == NULL) {
-        free_matrix(H_c, rows);
+    if (PyTuple_Check(W_py)) {
+        W_sparse = csr_Py_to_csr_c(W_py, rows);
+        if (W_sparse != NULL) {
+            graph_csr(&W_graph, W_sparse);
+        }
+    } else {
+        W_c = lst_Py_to_packed(W_py, rows);
+        if (W_c != NULL) {
+            graph_packed(&W_graph, W_c);
+        }
+    }
+    if (W_c == NULL && W_sparse == NULL) {
+        matrix_free(H_c);
         return NULL;
     }
-    final_H_c = opt_mat_with_H(H_c, W_c, rows, k);
-    final_H_py = lst_c_to_lst_Py(final_H_c, rows, k);
-    free_matrix(H_c, rows);
-    free_matrix(W_c, rows);
-    return final_H_py; 
+    Py_BEGIN_ALLOW_THREADS
+    ws = workspace_create(rows, k);
+    solved = (ws == NULL) ? NULL : symnmf_solve(H_c, &W_graph, ws, &options, &result, NULL);
+    workspace_free(ws);
+    Py_END_ALLOW_THREADS
+    final_H_py = (solved == NULL) ? PyErr_NoMemory() : lst_c_to_lst_Py(H_c);
+    matrix_free(H_c);
+    packed_free(W_c);
+    csr_free(W_sparse);
+    return (final_H_py == NULL) ? NULL : solve_output(final_H_py, want_info, &result, NULL);
 }
 
 /**
@@ -92,19 +540,22 @@ static PyObject* opt_mat_py(PyObject *self, PyObject *args) {
  */
 static PyObject* sym_mat_py(PyObject *self, PyObject *args) {
     PyObject *pnt_lst_py;
-    double **pnt_lst;
-    int rows, cols;
+    Matrix *pnt_lst;
+    Matrix *sym_mat_c;
     PyObject *final_similarity_matrix;
     if (!PyArg_ParseTuple(args, "O", &pnt_lst_py)) {
         return NULL;
     }
-    rows = PyList_Size(pnt_lst_py);
-    cols = PyList_Size(PyList_GetItem(pnt_lst_py, 0));
-    pnt_lst = lst_Py_to_lst_c(pnt_lst_py, rows, cols);
-    double** sym_mat_c = sym_mat(pnt_lst, rows, cols);
-    final_similarity_matrix = lst_c_to_lst_Py(sym_mat_c, rows, rows);
-    free_matrix(pnt_lst, rows);
-    free_matrix(sym_mat_c, rows);
+    pnt_lst = points_from_py(pnt_lst_py);
+    if (pnt_lst == NULL) {
+        return NULL;
+    }
+    Py_BEGIN_ALLOW_THREADS
+    sym_mat_c = sym_mat(pnt_lst);
+    Py_END_ALLOW_THREADS
+    final_similarity_matrix = (sym_mat_c == NULL) ? PyErr_NoMemory() : lst_c_to_lst_Py(sym_mat_c);
+    matrix_free(pnt_lst);
+    matrix_free(sym_mat_c);
     return final_similarity_matrix; 
 }
 
@@ -116,21 +567,26 @@ static PyObject* sym_mat_py(PyObject *self, PyObject *args) {
  */
 static PyObject* diag_mat_py(PyObject *self, PyObject *args) {
     PyObject *pnt_lst_py;
-    double **pnt_lst;
-    int rows, cols;
+    Matrix *pnt_lst;
+    Matrix *sym_mat_c;
+    Matrix *diag_mat_c = NULL;
     PyObject *final_diag_deg_matrix;
     if (!PyArg_ParseTuple(args, "O", &pnt_lst_py)) {
         return NULL;
     }
-    rows = PyList_Size(pnt_lst_py);
-    cols = PyList_Size(PyList_GetItem(pnt_lst_py, 0));
-    pnt_lst = lst_Py_to_lst_c(pnt_lst_py, rows, cols);
-    double** sym_mat_c = sym_mat(pnt_lst, rows, cols);
-    double** diag_mat_c = diag_mat(sym_mat_c, rows);
-    final_diag_deg_matrix = lst_c_to_lst_Py(diag_mat_c, rows, rows);
-    free_matrix(pnt_lst, rows);
-    free_matrix(sym_mat_c, rows);
-    free_matrix(diag_mat_c, rows);
+    pnt_lst = points_from_py(pnt_lst_py);
+    if (pnt_lst == NULL) {
+        return NULL;
+    }
+    Py_BEGIN_ALLOW_THREADS
+    sym_mat_c = sym_mat(pnt_lst);
+    if (sym_mat_c != NULL) {
+        diag_mat_c = diag_mat_into(sym_mat_c, sym_mat_c);
+    }
+    Py_END_ALLOW_THREADS
+    final_diag_deg_matrix = (diag_mat_c == NULL) ? PyErr_NoMemory() : lst_c_to_lst_Py(diag_mat_c);
+    matrix_free(pnt_lst);
+    matrix_free(sym_mat_c);
     return final_diag_deg_matrix; 
 }
 
@@ -142,55 +598,1927 @@ static PyObject* diag_mat_py(PyObject *self, PyObject *args) {
  */
 static PyObject* norm_mat_py(PyObject *self, PyObject *args) {
     PyObject *pnt_lst_py;
-    double **pnt_lst;
-    int rows, cols;
+    Matrix *pnt_lst;
+    Matrix *norm_mat_c;
     PyObject *final_norm_similarity_matrix;
     if (!PyArg_ParseTuple(args, "O", &pnt_lst_py)) {
         return NULL;
     }
-    rows = PyList_Size(pnt_lst_py);
-    cols = PyList_Size(PyList_GetItem(pnt_lst_py, 0));
-    pnt_lst = lst_Py_to_lst_c(pnt_lst_py, rows, cols);
-    double** sym_mat_c = sym_mat(pnt_lst, rows, cols);
-    double** diag_mat_c = diag_mat(sym_mat_c, rows);
-    double** norm_mat_c = norm_mat(diag_mat_c, sym_mat_c, rows);
-    final_norm_similarity_matrix = lst_c_to_lst_Py(norm_mat_c, rows, rows);
-    free_matrix(pnt_lst, rows);
-    free_matrix(sym_mat_c, rows);
-    free_matrix(diag_mat_c, rows);
-    free_matrix(norm_mat_c, rows);
+    pnt_lst = points_from_py(pnt_lst_py);
+    if (pnt_lst == NULL) {
+        return NULL;
+    }
+    Py_BEGIN_ALLOW_THREADS
+    norm_mat_c = norm_mat_from_points(pnt_lst, NULL);
+    Py_END_ALLOW_THREADS
+    final_norm_similarity_matrix = (norm_mat_c == NULL) ? PyErr_NoMemory() : lst_c_to_lst_Py(norm_mat_c);
+    matrix_free(pnt_lst);
+    matrix_free(norm_mat_c);
     return final_norm_similarity_matrix; 
 }
 
 /**
- * Method definitions for the module.
+ * Builds the normalized sparse k-nearest-neighbour (or radius) graph of the input points.
+ * @param self: Pointer to the module
+ * @param args: Arguments passed from Python (points, neighbors[, radius])
+ * @return: (row_ptr, col_idx, values) tuple of Python lists
  */
-static PyMethodDef symnmf_methods[] = {
-    {"symnmf", (PyCFunction)opt_mat_py, METH_VARARGS, PyDoc_STR("Optimize the matrix H")},
-    {"sym", (PyCFunction)sym_mat_py, METH_VARARGS, PyDoc_STR("Construct a symmetric matrix")},
-    {"ddg", (PyCFunction)diag_mat_py, METH_VARARGS, PyDoc_STR("Construct a diagonal degree matrix")},
-    {"norm", (PyCFunction)norm_mat_py, METH_VARARGS, PyDoc_STR("Normalize a matrix")},
-    {NULL, NULL, 0, NULL}
-};
+static PyObject* knn_graph_py(PyObject *self, PyObject *args) {
+    PyObject *pnt_lst_py;
+    PyObject *final_graph;
+    Matrix *pnt_lst;
+    CsrMatrix *graph_c;
+    int neighbors;
+    double radius = 0.0;
+    if (!PyArg_ParseTuple(args, "Oi|d", &pnt_lst_py, &neighbors, &radius)) {
+        return NULL;
+    }
+    if (neighbors <= 0 && radius <= 0) {
+        PyErr_SetString(PyExc_ValueError, "neighbors or radius must be positive");
+        return NULL;
+    }
+    pnt_lst = points_from_py(pnt_lst_py);
+    if (pnt_lst == NULL) {
+        return NULL;
+    }
+    Py_BEGIN_ALLOW_THREADS
+    graph_c = knn_graph(pnt_lst, neighbors, radius, NULL);
+    Py_END_ALLOW_THREADS
+    final_graph = (graph_c == NULL) ? PyErr_NoMemory() : csr_c_to_csr_Py(graph_c);
+    matrix_free(pnt_lst);
+    csr_free(graph_c);
+    return final_graph;
+}
 
 /**
- * Module definition structure.
+ * Does the optimization of H on float64 buffers without converting through Python lists.
+ * W is read in place as a dense n*n buffer; H is copied once into the output, which is then
+ * updated in place (out may be H itself).
+ * @param self: Pointer to the module
+ * @param args: Arguments passed from Python (H, W[, out])
+ * @param kwargs: Keyword arguments passed from Python
+ * @return: The output array holding the optimized H
  */
-static struct PyModuleDef symmmodule = {
-    PyModuleDef_HEAD_INIT,
-    "mysymnmf",
-    NULL,
-    -1,
-    symnmf_methods
-};
+static PyObject* opt_mat_array_py(PyObject *self, PyObject *args, PyObject *kwargs) {
+    static char *kwlist[] = {"H", "W", "out", NULL};
+    int i;
+    PyObject *H_py, *W_py, *out_py = NULL, *res_py = NULL;
+    Py_buffer H_view, W_view, out_view;
+    Matrix H_c, W_c, out_c;
+    Graph W_graph;
+    Workspace *ws;
+    Matrix *solved;
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "OO|O", kwlist, &H_py, &W_py, &out_py)) {
+        return NULL;
+    }
+    if (!buffer_to_matrix(H_py, &H_view, &H_c, -1, -1, 0)) {
+        return NULL;
+    }
+    if (!buffer_to_matrix(W_py, &W_view, &W_c, H_c.rows, H_c.rows, 0)) {
+        PyBuffer_Release(&H_view);
+        return NULL;
+    }
+    res_py = output_matrix(out_py, H_c.rows, H_c.cols, &out_view, &out_c);
+    if (res_py != NULL) {
+        Py_BEGIN_ALLOW_THREADS
+        if (out_c.data != H_c.data) {
+            for (i = 0; i < H_c.rows; i++) {
+                memmove(MAT_ROW(&out_c, i), MAT_ROW(&H_c, i), (size_t)H_c.cols * sizeof(double));
+            }
+        }
+        ws = workspace_create(H_c.rows, H_c.cols);
+        solved = (ws == NULL) ? NULL : opt_mat_with_workspace(&out_c, graph_dense(&W_graph, &W_c), ws);
+        workspace_free(ws);
+        Py_END_ALLOW_THREADS
+        if (solved == NULL) {
+            Py_CLEAR(res_py);
+            PyErr_NoMemory();
+        }
+        PyBuffer_Release(&out_view);
+    }
+    PyBuffer_Release(&W_view);
+    PyBuffer_Release(&H_view);
+    return res_py;
+}
 
 /**
- * Module initialization function.
+ * Computes one of the n*n goal matrices from a float64 buffer of points into a float64 output.
+ * @param args: Arguments passed from Python (points[, out])
+ * @param kwargs: Keyword arguments passed from Python
+ * @param goal: 's' for sym, 'd' for ddg, 'n' for norm
+ * @return: The output array, NULL with a Python exception set on failure
  */
-PyMODINIT_FUNC PyInit_mysymnmf(void) {
-    PyObject *m;
-    m = PyModule_Create(&symmmodule);
-    if (!m) {
+static PyObject* goal_array(PyObject *args, PyObject *kwargs, char goal) {
+    static char *kwlist[] = {"points", "out", NULL};
+    PyObject *pnt_py, *out_py = NULL, *res_py;
+    Py_buffer pnt_view, out_view;
+    Matrix pnt_c, out_c;
+    Matrix *res_c;
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O|O", kwlist, &pnt_py, &out_py)) {
+        return NULL;
+    }
+    if (!buffer_to_matrix(pnt_py, &pnt_view, &pnt_c, -1, -1, 0)) {
+        return NULL;
+    }
+    res_py = output_matrix(out_py, pnt_c.rows, pnt_c.rows, &out_view, &out_c);
+    if (res_py != NULL) {
+        Py_BEGIN_ALLOW_THREADS
+        if (goal == 'n') {
+            res_c = norm_mat_into(&pnt_c, &out_c, NULL);
+        } else {
+            res_c = sym_mat_into(&pnt_c, &out_c);
+            if (goal == 'd') {
+                res_c = diag_mat_into(&out_c, &out_c);
+            }
+        }
+        Py_END_ALLOW_THREADS
+        if (res_c == NULL) {
+            Py_CLEAR(res_py);
+            PyErr_NoMemory();
+        }
+        PyBuffer_Release(&out_view);
+    }
+    PyBuffer_Release(&pnt_view);
+    return res_py;
+}
+
+/**
+ * Constructs the similarity matrix from a float64 buffer of points.
+ * @param self: Pointer to the module
+ * @param args: Arguments passed from Python (points[, out])
+ * @param kwargs: Keyword arguments passed from Python
+ * @return: The output array holding the similarity matrix
+ */
+static PyObject* sym_array_py(PyObject *self, PyObject *args, PyObject *kwargs) {
+    return goal_array(args, kwargs, 's');
+}
+
+/**
+ * Builds the diagonal degree matrix from a float64 buffer of points.
+ * @param self: Pointer to the module
+ * @param args: Arguments passed from Python (points[, out])
+ * @param kwargs: Keyword arguments passed from Python
+ * @return: The output array holding the diagonal degree matrix
+ */
+static PyObject* diag_array_py(PyObject *self, PyObject *args, PyObject *kwargs) {
+    return goal_array(args, kwargs, 'd');
+}
+
+/**
+ * Computes the normalized similarity matrix from a float64 buffer of points.
+ * @param self: Pointer to the module
+ * @param args: Arguments passed from Python (points[, out])
+ * @param kwargs: Keyword arguments passed from Python
+ * @return: The output array holding the normalized similarity matrix
+ */
+static PyObject* norm_array_py(PyObject *self, PyObject *args, PyObject *kwargs) {
+    return goal_array(args, kwargs, 'n');
+}
+
+/**
+ * Computes the average of the entries of a float64 buffer, summed in row-major order.
+ * @param self: Pointer to the module
+ * @param args: Arguments passed from Python (matrix)
+ * @return: Average as a Python float
+ */
+static PyObject* entry_avg_py(PyObject *self, PyObject *args) {
+    PyObject *M_py;
+    Py_buffer M_view;
+    Matrix M_c;
+    double avg;
+    if (!PyArg_ParseTuple(args, "O", &M_py)) {
+        return NULL;
+    }
+    if (!buffer_to_matrix(M_py, &M_view, &M_c, -1, -1, 0)) {
+        return NULL;
+    }
+    Py_BEGIN_ALLOW_THREADS
+    avg = mat_entry_avg(&M_c);
+    Py_END_ALLOW_THREADS
+    PyBuffer_Release(&M_view);
+    return PyFloat_FromDouble(avg);
+}
+
+/**
+ * Optimizes H without materializing W: tiles of W are regenerated from the points on every
+ * product, using at most memory_budget bytes for the tile.
+ * @param self: Pointer to the module
+ * @param args: Arguments passed from Python (H, points, k, memory_budget)
+ * @return: Optimized matrix H as a Python object
+ */
+static PyObject* opt_mat_stream_py(PyObject *self, PyObject *args) {
+    int k;
+    double memory_budget;
+    PyObject *H_py, *pnt_lst_py, *final_H_py = NULL;
+    Matrix *H_c, *pnt_lst;
+    StreamGraph *W_stream = NULL;
+    Graph W_graph;
+    Workspace *ws;
+    Matrix *solved = NULL;
+    if (!PyArg_ParseTuple(args, "OOid", &H_py, &pnt_lst_py, &k, &memory_budget)) {
+        return NULL;
+    }
+    if (memory_budget < 0) {
+        PyErr_SetString(PyExc_ValueError, "memory_budget must be non-negative");
+        return NULL;
+    }
+    pnt_lst = points_from_py(pnt_lst_py);
+    if (pnt_lst == NULL) {
+        return NULL;
+    }
+    H_c = lst_Py_to_lst_c(H_py, pnt_lst->rows, k);
+    if (H_c != NULL) {
+        Py_BEGIN_ALLOW_THREADS
+        W_stream = stream_graph_create(pnt_lst, (size_t)memory_budget, NULL);
+        ws = workspace_create(pnt_lst->rows, k);
+        if (W_stream != NULL && ws != NULL) {
+            solved = opt_mat_with_workspace(H_c, graph_stream(&W_graph, W_stream), ws);
+        }
+        workspace_free(ws);
+        stream_graph_free(W_stream);
+        Py_END_ALLOW_THREADS
+        final_H_py = (solved == NULL) ? PyErr_NoMemory() : lst_c_to_lst_Py(H_c);
+    }
+    matrix_free(H_c);
+    matrix_free(pnt_lst);
+    return final_H_py;
+}
+
+/**
+ * Computes the average entry of the normalized similarity matrix without materializing it.
+ * @param self: Pointer to the module
+ * @param args: Arguments passed from Python (points, memory_budget)
+ * @return: Average as a Python float
+ */
+static PyObject* norm_avg_py(PyObject *self, PyObject *args) {
+    double memory_budget;
+    PyObject *pnt_lst_py;
+    Matrix *pnt_lst;
+    StreamGraph *W_stream;
+    Graph W_graph;
+    double avg = 0.0;
+    if (!PyArg_ParseTuple(args, "Od", &pnt_lst_py, &memory_budget)) {
+        return NULL;
+    }
+    pnt_lst = points_from_py(pnt_lst_py);
+    if (pnt_lst == NULL) {
+        return NULL;
+    }
+    Py_BEGIN_ALLOW_THREADS
+    W_stream = stream_graph_create(pnt_lst, memory_budget > 0 ? (size_t)memory_budget : 0, NULL);
+    if (W_stream != NULL) {
+        avg = graph_entry_avg(graph_stream(&W_graph, W_stream));
+    }
+    stream_graph_free(W_stream);
+    Py_END_ALLOW_THREADS
+    matrix_free(pnt_lst);
+    return (W_stream == NULL) ? PyErr_NoMemory() : PyFloat_FromDouble(avg);
+}
+
+/**
+ * Python object owning a similarity graph W in one of the C storage formats, so that W can be
+ * built once and reused by several fits without crossing the Python boundary.
+ */
+typedef struct GraphObject {
+    PyObject_HEAD
+    Matrix* points;
+    Matrix* dense;
+    PackedMatrix* packed;
+    CsrMatrix* csr;
+    StreamGraph* stream;
+    BinFile* file;      /* binary matrix file W is mapped from (see load_graph) */
+    Graph graph;
+} GraphObject;
+
+static PyObject* GraphType = NULL;
+
+/**
+ * Builds W from the points into a graph object (runs without the GIL).
+ * @param self: Graph object whose storage is filled; takes ownership of points
+ * @param points: Matrix of points
+ * @param kind: 'd' dense, 'p' packed, 'k' sparse kNN / radius, 's' streamed
+ * @param neighbors: Number of neighbours for the sparse graph
+ * @param radius: Radius for the sparse graph (0 for none)
+ * @param memory_budget: Tile budget in bytes for the streamed graph
+ * @param stats: Optional statistics (may be NULL)
+ * @return: 1 on success, 0 if an allocation failed
+ */
+static int graph_build(GraphObject* self, Matrix* points, char kind, int neighbors, double radius, size_t memory_budget, SymnmfStats *stats) {
+    double n = points->rows, pairs = n * (n - 1) / 2 * (3.0 * points->cols + 1);
+    int built;
+    self->points = points;
+    switch (kind) {
+    case 'd':
+        stats_begin(stats, PHASE_SYM);
+        self->dense = sym_mat(points);
+        stats_end(stats, pairs);
+        stats_begin(stats, PHASE_NORM);
+        built = self->dense != NULL && norm_mat_in_place(self->dense, NULL) != NULL;
+        stats_end(stats, 3 * n * n);
+        return built && graph_dense(&self->graph, self->dense) != NULL;
+    case 'k':
+        stats_begin(stats, PHASE_NORM);
+        self->csr = knn_graph(points, neighbors, radius, NULL);
+        stats_end(stats, pairs);
+        return self->csr != NULL && graph_csr(&self->graph, self->csr) != NULL;
+    case 's':
+        stats_begin(stats, PHASE_NORM);
+        self->stream = stream_graph_create(points, memory_budget, NULL);
+        stats_end(stats, pairs);
+        return self->stream != NULL && graph_stream(&self->graph, self->stream) != NULL;
+    default:
+        stats_begin(stats, PHASE_SYM);
+        self->packed = sym_mat_packed(points);
+        stats_end(stats, pairs);
+        stats_begin(stats, PHASE_NORM);
+        built = self->packed != NULL && norm_packed_in_place(self->packed, NULL) != NULL;
+        stats_end(stats, 3 * n * (n + 1) / 2);
+        return built && graph_packed(&self->graph, self->packed) != NULL;
+    }
+}
+
+/**
+ * Creates a graph object from points.
+ * @param type: Graph type
+ * @param pnt_py: Points
+ * @param kind: "dense", "packed", "knn" or "stream"
+ * @param neighbors: Number of neighbours for the sparse graph
+ * @param radius: Radius for the sparse graph (0 for none)
+ * @param memory_budget: Tile budget in bytes for the streamed graph (0 or less for the default)
+ * @param stats: Optional statistics (may be NULL), timed from reading the points to the normalized W
+ * @return: New graph object, NULL with a Python exception set on failure
+ */
+static PyObject* graph_create(PyTypeObject *type, PyObject *pnt_py, const char *kind, int neighbors, double radius, double memory_budget, SymnmfStats *stats) {
+    int built;
+    Matrix *points;
+    GraphObject *self;
+    if (strcmp(kind, "dense") != 0 && strcmp(kind, "packed") != 0 && strcmp(kind, "knn") != 0 && strcmp(kind, "stream") != 0) {
+        PyErr_SetString(PyExc_ValueError, "kind must be 'dense', 'packed', 'knn' or 'stream'");
+        return NULL;
+    }
+    if (kind[0] == 'k' && neighbors <= 0 && radius <= 0) {
+        PyErr_SetString(PyExc_ValueError, "neighbors or radius must be positive");
+        return NULL;
+    }
+    stats_begin(stats, PHASE_LOAD);
+    points = points_from_py(pnt_py);
+    stats_end(stats, 0);
+    if (points == NULL) {
+        return NULL;
+    }
+    self = (GraphObject*)type->tp_alloc(type, 0);
+    if (self == NULL) {
+        matrix_free(points);
+        return NULL;
+    }
+    Py_BEGIN_ALLOW_THREADS
+    built = graph_build(self, points, kind[0], neighbors, radius, memory_budget > 0 ? (size_t)memory_budget : 0, stats);
+    Py_END_ALLOW_THREADS
+    if (!built) {
+        Py_DECREF(self);
+        return PyErr_NoMemory();
+    }
+    return (PyObject*)self;
+}
+
+/**
+ * Creates a graph object: Graph(points, kind="packed", neighbors=10, radius=0.0, memory_budget=0).
+ * @param type: Graph type
+ * @param args: Positional arguments passed from Python
+ * @param kwargs: Keyword arguments passed from Python
+ * @return: New graph object, NULL with a Python exception set on failure
+ */
+static PyObject* graph_new(PyTypeObject *type, PyObject *args, PyObject *kwargs) {
+    static char *kwlist[] = {"points", "kind", "neighbors", "radius", "memory_budget", NULL};
+    PyObject *pnt_py;
+    const char *kind = "packed";
+    int neighbors = 10;
+    double radius = 0.0, memory_budget = 0.0;
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O|sidd", kwlist, &pnt_py, &kind, &neighbors, &radius, &memory_budget)) {
+        return NULL;
+    }
+    return graph_create(type, pnt_py, kind, neighbors, radius, memory_budget, NULL);
+}
+
+/**
+ * Frees the C storage of a graph object.
+ * @param self: Graph object
+ */
+static void graph_dealloc(GraphObject *self) {
+    PyTypeObject *type = Py_TYPE(self);
+    matrix_free(self->dense);
+    packed_free(self->packed);
+    csr_free(self->csr);
+    stream_graph_free(self->stream);
+    bin_close(self->file);
+    matrix_free(self->points);
+    type->tp_free((PyObject*)self);
+    Py_DECREF(type);
+}
+
+/**
+ * Returns the graph operand a single call should use (runs without the GIL). A streamed
+ * graph gets a private tile so that calls sharing the graph object do not race on it.
+ * @param self: Graph object
+ * @param local: Storage for the private stream graph
+ * @param local_graph: Storage for the private graph header
+ * @return: Graph operand, NULL if the private tile could not be allocated
+ */
+static const Graph* graph_acquire(GraphObject *self, StreamGraph *local, Graph *local_graph) {
+    if (self->graph.kind != GRAPH_STREAM) {
+        return &self->graph;
+    }
+    *local = *self->stream;
+    local->tile = matrix_create(local->tile_rows, self->graph.n);
+    return (local->tile == NULL) ? NULL : graph_stream(local_graph, local);
+}
+
+/**
+ * Releases a graph operand obtained with graph_acquire.
+ * @param W: Graph operand (may be NULL)
+ * @param local_graph: Private graph header passed to graph_acquire
+ */
+static void graph_release(const Graph *W, Graph *local_graph) {
+    if (W == local_graph) {
+        matrix_free(local_graph->stream->tile);
+    }
+}
+
+/**
+ * Returns the average entry of W, as used for the initialization of H.
+ * @param self: Graph object
+ * @param args: Unused
+ * @return: Average as a Python float
+ */
+static PyObject* graph_mean_py(GraphObject *self, PyObject *args) {
+    double avg = 0.0;
+    StreamGraph local;
+    Graph local_graph;
+    const Graph *W;
+    Py_BEGIN_ALLOW_THREADS
+    W = graph_acquire(self, &local, &local_graph);
+    if (W != NULL) {
+        avg = graph_entry_avg(W);
+    }
+    graph_release(W, &local_graph);
+    Py_END_ALLOW_THREADS
+    return (W == NULL) ? PyErr_NoMemory() : PyFloat_FromDouble(avg);
+}
+
+/**
+ * Returns the number of points of the graph.
+ * @param self: Graph object
+ * @param closure: Unused
+ * @return: n as a Python int
+ */
+static PyObject* graph_get_n(GraphObject *self, void *closure) {
+    return PyLong_FromLong(self->graph.n);
+}
+
+/**
+ * Returns the storage format of the graph.
+ * @param self: Graph object
+ * @param closure: Unused
+ * @return: "dense", "packed", "knn" or "stream"
+ */
+static PyObject* graph_get_kind(GraphObject *self, void *closure) {
+    static const char *names[] = {"dense", "packed", "knn", "stream"};
+    return PyUnicode_FromString(names[self->graph.kind]);
+}
+
+static PyMethodDef graph_methods[] = {
+    {"mean", (PyCFunction)graph_mean_py, METH_NOARGS, PyDoc_STR("Average entry of W")},
+    {NULL, NULL, 0, NULL}
+};
+
+static PyGetSetDef graph_getset[] = {
+    {"n", (getter)graph_get_n, NULL, "Number of points", NULL},
+    {"kind", (getter)graph_get_kind, NULL, "Storage format of W", NULL},
+    {NULL, NULL, NULL, NULL, NULL}
+};
+
+static PyType_Slot graph_slots[] = {
+    {Py_tp_doc, "Graph(points, kind='packed', neighbors=10, radius=0.0, memory_budget=0)\n\n"
+                "Normalized similarity graph W kept in C. kind selects the storage: 'dense', 'packed'\n"
+                "(upper triangle), 'knn' (sparse, neighbors / radius) or 'stream' (recomputed in tiles\n"
+                "of at most memory_budget bytes). A graph may be shared by concurrent fits."},
+    {Py_tp_new, graph_new},
+    {Py_tp_dealloc, graph_dealloc},
+    {Py_tp_methods, graph_methods},
+    {Py_tp_getset, graph_getset},
+    {0, NULL}
+};
+
+static PyType_Spec graph_spec = {
+    "mysymnmf.Graph",
+    sizeof(GraphObject),
+    0,
+    Py_TPFLAGS_DEFAULT,
+    graph_slots
+};
+
+/**
+ * Returns data itself if it is a Graph, otherwise builds a Graph of the given kind from the points.
+ * @param data_py: Graph object or points
+ * @param kind: Storage format used when building
+ * @param stats: Optional statistics of the build (may be NULL)
+ * @return: New reference to a Graph object, NULL with a Python exception set on failure
+ */
+static PyObject* graph_from_data(PyObject *data_py, const char *kind, SymnmfStats *stats) {
+    if (PyObject_TypeCheck(data_py, (PyTypeObject*)GraphType)) {
+        Py_INCREF(data_py);
+        return data_py;
+    }
+    return graph_create((PyTypeObject*)GraphType, data_py, kind, 10, 0.0, 0.0, stats);
+}
+
+/* A binary matrix file mapped in place, exporting its dense data as a read-only buffer. */
+typedef struct MappingObject {
+    PyObject_HEAD
+    BinFile* file;
+    Py_ssize_t shape[2];
+    Py_ssize_t strides[2];
+} MappingObject;
+
+static PyObject* MappingType = NULL;
+
+/**
+ * Exports the mapped data as a read-only C-contiguous 2D float64 buffer.
+ * @param self: Mapping object
+ * @param view: Buffer to fill
+ * @param flags: Requested buffer features
+ * @return: 0 on success, -1 with a Python exception set on failure
+ */
+static int mapping_getbuffer(MappingObject *self, Py_buffer *view, int flags) {
+    if (flags & PyBUF_WRITABLE) {
+        PyErr_SetString(PyExc_BufferError, "mapped file is read-only");
+        view->obj = NULL;
+        return -1;
+    }
+    view->buf = self->file->dense.data;
+    view->obj = (PyObject*)self;
+    Py_INCREF(self);
+    view->len = self->shape[0] * self->strides[0];
+    view->readonly = 1;
+    view->itemsize = sizeof(double);
+    view->format = (flags & PyBUF_FORMAT) ? (char*)"d" : NULL;
+    view->ndim = 2;
+    view->shape = (flags & PyBUF_ND) ? self->shape : NULL;
+    view->strides = ((flags & PyBUF_STRIDES) == PyBUF_STRIDES) ? self->strides : NULL;
+    view->suboffsets = NULL;
+    view->internal = NULL;
+    return 0;
+}
+
+/**
+ * Unmaps the file of a mapping object.
+ * @param self: Mapping object
+ */
+static void mapping_dealloc(MappingObject *self) {
+    PyTypeObject *type = Py_TYPE(self);
+    bin_close(self->file);
+    type->tp_free((PyObject*)self);
+    Py_DECREF(type);
+}
+
+static PyType_Slot mapping_slots[] = {
+    {Py_tp_doc, "Read-only float64 data of a mapped binary matrix file"},
+    {Py_tp_dealloc, mapping_dealloc},
+    {Py_bf_getbuffer, mapping_getbuffer},
+    {0, NULL}
+};
+
+static PyType_Spec mapping_spec = {
+    "mysymnmf.Mapping",
+    sizeof(MappingObject),
+    0,
+    Py_TPFLAGS_DEFAULT,
+    mapping_slots
+};
+
+/**
+ * Raises ValueError for a file that could not be loaded.
+ * @param filename: Name of the file
+ * @param error: Reason reported by the loader
+ * @return: NULL
+ */
+static PyObject* load_error_to_py(const char *filename, const LoadError *error) {
+    if (error->line > 0) {
+        return PyErr_Format(PyExc_ValueError, "%s:%ld: field %d: %s", filename, error->line, error->column, error->message);
+    }
+    return PyErr_Format(PyExc_ValueError, "%s: %s", filename, error->message);
+}
+
+/**
+ * Opens a binary matrix file without the GIL.
+ * @param filename: Name of the file
+ * @param verify: Nonzero to check the checksum
+ * @return: Open file, NULL with ValueError set on failure
+ */
+static BinFile* open_bin_py(const char *filename, int verify) {
+    BinFile *bin;
+    LoadError error;
+    Py_BEGIN_ALLOW_THREADS
+    bin = bin_open(filename, verify, &error);
+    Py_END_ALLOW_THREADS
+    if (bin == NULL) {
+        load_error_to_py(filename, &error);
+    }
+    return bin;
+}
+
+/**
+ * Loads a matrix: load(filename, verify=True). A binary matrix file is mapped and returned
+ * as a read-only array without copying; a comma separated file is parsed with the C loader.
+ * @param self: Pointer to the module
+ * @param args: Arguments passed from Python (filename[, verify])
+ * @param kwargs: Keyword arguments passed from Python
+ * @return: float64 array, raises ValueError with the line and field of a malformed value
+ */
+static PyObject* load_py(PyObject *self, PyObject *args, PyObject *kwargs) {
+    static char *kwlist[] = {"filename", "verify", NULL};
+    const char *filename;
+    int verify = 1, i, binary;
+    PyObject *out, *numpy;
+    Py_buffer out_view;
+    Matrix out_c;
+    Matrix *points;
+    LoadError error;
+    MappingObject *mapping;
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "s|p", kwlist, &filename, &verify)) {
+        return NULL;
+    }
+    Py_BEGIN_ALLOW_THREADS
+    binary = bin_is_matrix_file(filename);
+    points = binary ? NULL : load_points(filename, &error);
+    Py_END_ALLOW_THREADS
+    if (binary) {
+        mapping = (MappingObject*)((PyTypeObject*)MappingType)->tp_alloc((PyTypeObject*)MappingType, 0);
+        if (mapping == NULL) {
+            return NULL;
+        }
+        mapping->file = open_bin_py(filename, verify);
+        if (mapping->file == NULL || mapping->file->layout != BIN_DENSE) {
+            if (mapping->file != NULL) {
+                PyErr_Format(PyExc_ValueError, "%s: packed matrix, use load_graph", filename);
+            }
+            Py_DECREF(mapping);
+            return NULL;
+        }
+        mapping->shape[0] = mapping->file->dense.rows;
+        mapping->shape[1] = mapping->file->dense.cols;
+        mapping->strides[0] = (Py_ssize_t)mapping->file->dense.cols * (Py_ssize_t)sizeof(double);
+        mapping->strides[1] = sizeof(double);
+        numpy = PyImport_ImportModule("numpy");
+        out = (numpy == NULL) ? NULL : PyObject_CallMethod(numpy, "asarray", "O", (PyObject*)mapping);
+        Py_XDECREF(numpy);
+        Py_DECREF(mapping);
+        return out;
+    }
+    if (points == NULL) {
+        return load_error_to_py(filename, &error);
+    }
+    out = output_matrix(NULL, points->rows, points->cols, &out_view, &out_c);
+    if (out != NULL) {
+        for (i = 0; i < points->rows; i++) {
+            memcpy(MAT_ROW(&out_c, i), MAT_ROW(points, i), (size_t)points->cols * sizeof(double));
+        }
+        PyBuffer_Release(&out_view);
+    }
+    matrix_free(points);
+    return out;
+}
+
+/**
+ * Maps a W saved with save() as a Graph, without rebuilding it: load_graph(filename, verify=True).
+ * @param self: Pointer to the module
+ * @param args: Arguments passed from Python (filename[, verify])
+ * @param kwargs: Keyword arguments passed from Python
+ * @return: New Graph object of kind 'dense' or 'packed'
+ */
+static PyObject* load_graph_py(PyObject *self, PyObject *args, PyObject *kwargs) {
+    static char *kwlist[] = {"filename", "verify", NULL};
+    const char *filename;
+    int verify = 1;
+    BinFile *bin;
+    GraphObject *graph;
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "s|p", kwlist, &filename, &verify)) {
+        return NULL;
+    }
+    bin = open_bin_py(filename, verify);
+    if (bin == NULL) {
+        return NULL;
+    }
+    if (bin->dense.rows != bin->dense.cols) {
+        bin_close(bin);
+        return PyErr_Format(PyExc_ValueError, "%s: W must be square", filename);
+    }
+    graph = (GraphObject*)((PyTypeObject*)GraphType)->tp_alloc((PyTypeObject*)GraphType, 0);
+    if (graph == NULL) {
+        bin_close(bin);
+        return NULL;
+    }
+    graph->file = bin;
+    if (bin->layout == BIN_PACKED) {
+        graph_packed(&graph->graph, &bin->packed);
+    } else {
+        graph_dense(&graph->graph, &bin->dense);
+    }
+    return (PyObject*)graph;
+}
+
+/**
+ * Writes a matrix to a binary matrix file: save(filename, data, packed=False).
+ * data is a 2D float64 buffer (points X, a W or H) or a dense or packed Graph, whose W is
+ * written; packed=True stores only the upper triangle of a symmetric matrix. A packed Graph
+ * is always stored packed.
+ * @param self: Pointer to the module
+ * @param args: Arguments passed from Python (filename, data[, packed])
+ * @param kwargs: Keyword arguments passed from Python
+ * @return: None
+ */
+static PyObject* save_py(PyObject *self, PyObject *args, PyObject *kwargs) {
+    static char *kwlist[] = {"filename", "data", "packed", NULL};
+    const char *filename;
+    PyObject *data_py;
+    int packed = 0, saved;
+    Py_buffer view;
+    Matrix M;
+    const Graph *W = NULL;
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "sO|p", kwlist, &filename, &data_py, &packed)) {
+        return NULL;
+    }
+    if (PyObject_TypeCheck(data_py, (PyTypeObject*)GraphType)) {
+        W = &((GraphObject*)data_py)->graph;
+        if (W->kind != GRAPH_DENSE && W->kind != GRAPH_PACKED) {
+            PyErr_SetString(PyExc_ValueError, "only dense and packed graphs can be saved");
+            return NULL;
+        }
+    } else {
+        if (!buffer_to_matrix(data_py, &view, &M, -1, -1, 0)) {
+            return NULL;
+        }
+        if (packed && M.rows != M.cols) {
+            PyBuffer_Release(&view);
+            PyErr_SetString(PyExc_ValueError, "a packed matrix must be square");
+            return NULL;
+        }
+    }
+    Py_BEGIN_ALLOW_THREADS
+    if (W == NULL) {
+        saved = bin_save_matrix(filename, &M, packed ? BIN_PACKED : BIN_DENSE);
+    } else if (W->kind == GRAPH_PACKED) {
+        saved = bin_save_packed(filename, W->packed);
+    } else {
+        saved = bin_save_matrix(filename, W->dense, packed ? BIN_PACKED : BIN_DENSE);
+    }
+    Py_END_ALLOW_THREADS
+    if (W == NULL) {
+        PyBuffer_Release(&view);
+    }
+    if (!saved) {
+        return PyErr_SetFromErrnoWithFilename(PyExc_OSError, filename);
+    }
+    Py_RETURN_NONE;
+}
+
+/**
+ * Writes a matrix as "%.4f" text with the C writer: write_matrix(data, filename=None).
+ * Without a filename the text goes to the process's standard output, after flushing sys.stdout.
+ * @param self: Pointer to the module
+ * @param args: Arguments passed from Python (data[, filename])
+ * @param kwargs: Keyword arguments passed from Python
+ * @return: None
+ */
+static PyObject* write_matrix_py(PyObject *self, PyObject *args, PyObject *kwargs) {
+    static char *kwlist[] = {"data", "filename", NULL};
+    const char *filename = NULL;
+    PyObject *data_py, *py_stdout, *flushed;
+    Py_buffer view;
+    Matrix M;
+    FILE *file;
+    int written;
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O|z", kwlist, &data_py, &filename)) {
+        return NULL;
+    }
+    if (!buffer_to_matrix(data_py, &view, &M, -1, -1, 0)) {
+        return NULL;
+    }
+    if (filename == NULL) {
+        py_stdout = PySys_GetObject("stdout");
+        flushed = (py_stdout == NULL || py_stdout == Py_None) ? NULL : PyObject_CallMethod(py_stdout, "flush", NULL);
+        if (flushed == NULL) {
+            PyErr_Clear();
+        }
+        Py_XDECREF(flushed);
+    }
+    Py_BEGIN_ALLOW_THREADS
+    file = (filename == NULL) ? stdout : fopen(filename, "w");
+    written = file != NULL && write_matrix(file, &M);
+    if (file == stdout) {
+        written = (fflush(stdout) == 0) && written;
+    } else if (file != NULL) {
+        written = (fclose(file) == 0) && written;
+    }
+    Py_END_ALLOW_THREADS
+    PyBuffer_Release(&view);
+    if (!written) {
+        return (filename == NULL) ? PyErr_SetFromErrno(PyExc_OSError) : PyErr_SetFromErrnoWithFilename(PyExc_OSError, filename);
+    }
+    Py_RETURN_NONE;
+}
+
+/**
+ * Exposes a C-contiguous 2D float32 buffer as a MatrixF view without copying.
+ * On success the caller must release the buffer with PyBuffer_Release.
+ * @param obj: Python object
+ * @param view: Buffer to fill
+ * @param M: Matrix header to point at the buffer data (stride = cols)
+ * @return: 1 on success, 0 if obj is not a 2D float32 buffer (no exception set)
+ */
+static int buffer_to_matrix_f32(PyObject* obj, Py_buffer* view, MatrixF* M) {
+    const char *fmt;
+    if (!PyObject_CheckBuffer(obj) || PyObject_GetBuffer(obj, view, PyBUF_C_CONTIGUOUS | PyBUF_FORMAT) < 0) {
+        PyErr_Clear();
+        return 0;
+    }
+    fmt = (view->format == NULL) ? "B" : view->format;
+    if (fmt[0] == '@' || fmt[0] == '=' || fmt[0] == '<') {
+        fmt++;
+    }
+    if (view->ndim == 2 && view->itemsize == sizeof(float) && strcmp(fmt, "f") == 0
+        && view->shape[0] > 0 && view->shape[0] <= INT_MAX && view->shape[1] <= INT_MAX) {
+        matrix_f_view(M, (float*)view->buf, (int)view->shape[0], (int)view->shape[1], (int)view->shape[1]);
+        return 1;
+    }
+    PyBuffer_Release(view);
+    return 0;
+}
+
+/**
+ * Reads points given as a float32 buffer, a float64 buffer or a list into a float C matrix.
+ * @param pnt_py: Points
+ * @return: Pointer to the C matrix, NULL with a Python exception set on failure
+ */
+static MatrixF* points_f32_from_py(PyObject* pnt_py) {
+    int i, j;
+    Py_buffer view;
+    MatrixF M;
+    MatrixF *points = NULL;
+    Matrix *wide;
+    if (buffer_to_matrix_f32(pnt_py, &view, &M)) {
+        points = matrix_f_create(M.rows, M.cols);
+        for (i = 0; points != NULL && i < M.rows; i++) {
+            memcpy(MAT_ROW(points, i), MAT_ROW(&M, i), (size_t)M.cols * sizeof(float));
+        }
+        PyBuffer_Release(&view);
+        return (points == NULL) ? (MatrixF*)PyErr_NoMemory() : points;
+    }
+    wide = points_from_py(pnt_py);
+    if (wide == NULL) {
+        return NULL;
+    }
+    points = matrix_f_create(wide->rows, wide->cols);
+    for (i = 0; points != NULL && i < wide->rows; i++) {
+        for (j = 0; j < wide->cols; j++) {
+            MAT_AT(points, i, j) = (float)MAT_AT(wide, i, j);
+        }
+    }
+    matrix_free(wide);
+    return (points == NULL) ? (MatrixF*)PyErr_NoMemory() : points;
+}
+
+/**
+ * Reads points given as a float32 buffer, a float64 buffer or a list into a double C matrix.
+ * @param pnt_py: Points
+ * @return: Pointer to the C matrix, NULL with a Python exception set on failure
+ */
+static Matrix* points_mixed_from_py(PyObject* pnt_py) {
+    int i, j;
+    Py_buffer view;
+    MatrixF M;
+    Matrix *points;
+    if (!buffer_to_matrix_f32(pnt_py, &view, &M)) {
+        return points_from_py(pnt_py);
+    }
+    points = matrix_create(M.rows, M.cols);
+    for (i = 0; points != NULL && i < M.rows; i++) {
+        for (j = 0; j < M.cols; j++) {
+            MAT_AT(points, i, j) = MAT_AT(&M, i, j);
+        }
+    }
+    PyBuffer_Release(&view);
+    return (points == NULL) ? (Matrix*)PyErr_NoMemory() : points;
+}
+
+/**
+ * Factorizes the normalized similarity matrix of the points with a float W (see
+ * symnmf_solve_f32 and symnmf_solve_mixed). H is returned as a float32 array in single
+ * precision and as a float64 array in mixed precision.
+ * @param data_py: Points
+ * @param k: Number of clusters
+ * @param seed: Seed of the starting H
+ * @param single: Nonzero for single precision, zero for mixed precision
+ * @param options: Stopping criteria
+ * @param want_info: Nonzero to return (H, info)
+ * @param stats: Optional statistics (may be NULL); W is timed as a whole under PHASE_NORM
+ * @return: H or (H, info), NULL with a Python exception set on failure
+ */
+static PyObject* fit_reduced(PyObject *data_py, int k, unsigned long seed, int single, const SolverOptions *options, int want_info, SymnmfStats *stats) {
+    PyObject *numpy, *res_py;
+    MatrixF *points_f = NULL, *H_f = NULL;
+    Matrix *points_d = NULL, *H_d = NULL;
+    PackedMatrixF *W = NULL;
+    Py_buffer H_view;
+    void *solved = NULL;
+    int i, n;
+    size_t row_bytes;
+    SolverResult result;
+    stats_begin(stats, PHASE_LOAD);
+    if (single) {
+        points_f = points_f32_from_py(data_py);
+    } else {
+        points_d = points_mixed_from_py(data_py);
+    }
+    stats_end(stats, 0);
+    if (points_f == NULL && points_d == NULL) {
+        return NULL;
+    }
+    n = single ? points_f->rows : points_d->rows;
+    if (k <= 0 || k > n) {
+        matrix_f_free(points_f);
+        matrix_free(points_d);
+        PyErr_SetString(PyExc_ValueError, "k must be between 1 and the number of points");
+        return NULL;
+    }
+    Py_BEGIN_ALLOW_THREADS
+    stats_begin(stats, PHASE_NORM);
+    W = single ? norm_mat_packed_f32(points_f) : norm_mat_packed_mixed(points_d);
+    stats_end(stats, (double)n * (n - 1) / 2 * (3.0 * (single ? points_f->cols : points_d->cols) + 1));
+    if (single) {
+        H_f = matrix_f_create(n, k);
+        if (W != NULL && H_f != NULL) {
+            stats_begin(stats, PHASE_INIT);
+            init_H_f32(W, H_f, seed);
+            stats_end(stats, 0);
+            stats_begin(stats, PHASE_SOLVE);
+            solved = symnmf_solve_f32(H_f, W, options, &result);
+            stats_end_solve(stats, solve_iteration_flops(n, (double)n * n, k), &result);
+        }
+    } else {
+        H_d = matrix_create(n, k);
+        if (W != NULL && H_d != NULL) {
+            stats_begin(stats, PHASE_INIT);
+            init_H_mixed(W, H_d, seed);
+            stats_end(stats, 0);
+            stats_begin(stats, PHASE_SOLVE);
+            solved = symnmf_solve_mixed(H_d, W, options, &result);
+            stats_end_solve(stats, solve_iteration_flops(n, (double)n * n, k), &result);
+        }
+    }
+    packed_f_free(W);
+    Py_END_ALLOW_THREADS
+    matrix_f_free(points_f);
+    matrix_free(points_d);
+    res_py = NULL;
+    numpy = (solved == NULL) ? NULL : PyImport_ImportModule("numpy");
+    if (numpy != NULL) {
+        res_py = PyObject_CallMethod(numpy, "empty", "((ii)s)", n, k, single ? "float32" : "float64");
+        Py_DECREF(numpy);
+    }
+    stats_begin(stats, PHASE_OUTPUT);
+    if (res_py != NULL && PyObject_GetBuffer(res_py, &H_view, PyBUF_C_CONTIGUOUS | PyBUF_WRITABLE) == 0) {
+        row_bytes = (size_t)k * (single ? sizeof(float) : sizeof(double));
+        for (i = 0; i < n; i++) {
+            memcpy((char*)H_view.buf + (size_t)i * row_bytes, single ? (void*)MAT_ROW(H_f, i) : (void*)MAT_ROW(H_d, i), row_bytes);
+        }
+        PyBuffer_Release(&H_view);
+    } else {
+        Py_CLEAR(res_py);
+    }
+    stats_end(stats, 0);
+    matrix_f_free(H_f);
+    matrix_free(H_d);
+    if (res_py == NULL) {
+        return PyErr_Occurred() ? NULL : PyErr_NoMemory();
+    }
+    res_py = solve_output(res_py, want_info || stats != NULL, &result, NULL);
+    return (stats == NULL) ? res_py : add_stats(res_py, stats);
+}
+
+/**
+ * Sets the starting H of fit and the state its solve continues from: the checkpoint if its
+ * file exists (the fit resumes), else H0, else the H seeded by init_H. Runs without the GIL.
+ * @param W: Normalized similarity graph
+ * @param H: Receives the starting H (n*k)
+ * @param H0: Starting H given by the caller (n*k), or NULL
+ * @param seed: Seed of init_H
+ * @param options: Solver options, with the checkpoint file
+ * @param state: Receives the state; state->V is a new matrix when a HALS checkpoint is resumed
+ * @param error: Receives the reason on failure
+ * @return: 1 on success, 0 if the checkpoint could not be read or does not match H and the solver
+ */
+static int fit_start(const Graph *W, Matrix *H, const Matrix *H0, unsigned long seed, const SolverOptions *options, SolverState *state, LoadError *error) {
+    int i, ok;
+    FILE *probe = NULL;
+    Matrix *saved = NULL;
+    solver_state_init(state, options->solver);
+    if (options->checkpoint != NULL) {
+        probe = fopen(options->checkpoint, "rb");
+    }
+    if (probe != NULL) {
+        fclose(probe);
+        saved = checkpoint_load(options->checkpoint, state, error);
+        if (saved == NULL) {
+            return 0;
+        }
+        H0 = saved;
+    } else if (H0 == NULL) {
+        init_H(W, H, seed);
+        return 1;
+    }
+    ok = H0->rows == H->rows && H0->cols == H->cols && state->solver == options->solver;
+    for (i = 0; ok && i < H->rows; i++) {
+        memcpy(MAT_ROW(H, i), MAT_ROW(H0, i), (size_t)H->cols * sizeof(double));
+    }
+    if (!ok) {
+        load_error_set(error, 0, 0, "checkpoint does not match the data, k or solver");
+    }
+    matrix_free(saved);
+    return ok;
+}
+
+/**
+ * Builds W (or takes a Graph), seeds H in C from the average entry of W and factorizes,
+ * without W crossing the Python boundary.
+ * solver is "mu" (multiplicative update) or "hals" (symmetric HALS, see symnmf_solve); tol,
+ * max_iter and rel_obj are the stopping criteria of SolverOptions. With info=True the result
+ * is (H, {"iterations": n, "stop": reason}); trace=True implies info and adds the per-iteration
+ * lists "objective" and "seconds". stats=True implies both and adds info["stats"], the time,
+ * allocated bytes and estimated flops of every phase (see stats_to_py); without it nothing is
+ * timed. A Graph passed as data was built beforehand, so only its solve is measured.
+ * precision is "double", "single" (float32 W, H and sums) or "mixed" (float32 W, float64 H
+ * and sums); by default it follows the dtype of data: single for float32 arrays, double
+ * otherwise. Reduced precision builds a packed W and runs the multiplicative update only.
+ * H0 (n*k) warm-starts the solve instead of the seeded H, e.g. from the H of a fit on
+ * slightly different data. checkpoint names a file H and the solver state are written to
+ * every checkpoint_every iterations (see checkpoint_save); if it already exists the fit
+ * resumes from it instead, continuing the exact trajectory of the interrupted fit, so it
+ * must be called with the same data and options. info["start"] is the iteration it resumed at.
+ * @param self: Pointer to the module
+ * @param args: Arguments passed from Python (data, k[, seed, kind, solver, tol, max_iter, rel_obj, info, trace, precision, stats, H0, checkpoint, checkpoint_every])
+ * @param kwargs: Keyword arguments passed from Python
+ * @return: The optimized H as a new array, or (H, info)
+ */
+static PyObject* fit_py(PyObject *self, PyObject *args, PyObject *kwargs) {
+    static char *kwlist[] = {"data", "k", "seed", "kind", "solver", "tol", "max_iter", "rel_obj", "info", "trace", "precision", "stats",
+                             "H0", "checkpoint", "checkpoint_every", NULL};
+    PyObject *data_py, *graph_py, *res_py, *H0_py = Py_None;
+    int k, max_iter = MAXITER, want_info = 0, want_trace = 0, want_stats = 0, checkpoint_every = 100, started = 1;
+    unsigned long seed = 1234;
+    double tol = EPSILON, rel_obj = 0.0;
+    const char *kind = "packed";
+    const char *solver_name = "mu";
+    const char *precision = NULL;
+    const char *checkpoint = NULL;
+    Py_buffer H_view;
+    MatrixF probe;
+    Matrix H_c;
+    Matrix *solved = NULL, *H0 = NULL;
+    Workspace *ws;
+    SolverOptions options;
+    SolverResult result;
+    SolverState state;
+    LoadError load_error;
+    SolverTrace *trace = NULL;
+    SymnmfStats stats_data;
+    SymnmfStats *stats = NULL;
+    StreamGraph local;
+    Graph local_graph;
+    const Graph *W;
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "Oi|kssdidppzpOzi", kwlist, &data_py, &k, &seed, &kind, &solver_name,
+                                     &tol, &max_iter, &rel_obj, &want_info, &want_trace, &precision, &want_stats,
+                                     &H0_py, &checkpoint, &checkpoint_every)) {
+        return NULL;
+    }
+    if (want_stats) {
+        stats = stats_init(&stats_data, NULL);
+    }
+    if (!solver_options_from_py(solver_name, tol, max_iter, rel_obj, &options)) {
+        return NULL;
+    }
+    if (checkpoint_every <= 0) {
+        PyErr_SetString(PyExc_ValueError, "checkpoint_every must be positive");
+        return NULL;
+    }
+    options.checkpoint = checkpoint;
+    options.checkpoint_every = (checkpoint != NULL) ? checkpoint_every : 0;
+    if (precision == NULL) {
+        precision = buffer_to_matrix_f32(data_py, &H_view, &probe) ? "single" : "double";
+        if (precision[0] == 's') {
+            PyBuffer_Release(&H_view);
+        }
+    }
+    if (strcmp(precision, "single") == 0 || strcmp(precision, "mixed") == 0) {
+        if (options.solver != SOLVER_MU || want_trace || PyObject_TypeCheck(data_py, (PyTypeObject*)GraphType)
+            || H0_py != Py_None || checkpoint != NULL) {
+            PyErr_SetString(PyExc_ValueError, "reduced precision takes points and supports solver='mu' without trace, H0 or checkpoint");
+            return NULL;
+        }
+        return fit_reduced(data_py, k, seed, precision[0] == 's', &options, want_info, stats);
+    }
+    if (strcmp(precision, "double") != 0) {
+        PyErr_SetString(PyExc_ValueError, "precision must be 'double', 'single' or 'mixed'");
+        return NULL;
+    }
+    if (H0_py != Py_None) {
+        H0 = points_from_py(H0_py);
+        if (H0 == NULL) {
+            return NULL;
+        }
+    }
+    graph_py = graph_from_data(data_py, kind, stats);
+    if (graph_py == NULL) {
+        matrix_free(H0);
+        return NULL;
+    }
+    W = &((GraphObject*)graph_py)->graph;
+    if (k <= 0 || k > W->n || (H0 != NULL && (H0->rows != W->n || H0->cols != k))) {
+        Py_DECREF(graph_py);
+        matrix_free(H0);
+        PyErr_SetString(PyExc_ValueError, (H0 == NULL) ? "k must be between 1 and the number of points" : "H0 must have n rows and k columns");
+        return NULL;
+    }
+    res_py = output_matrix(NULL, W->n, k, &H_view, &H_c);
+    if (res_py == NULL) {
+        Py_DECREF(graph_py);
+        matrix_free(H0);
+        return NULL;
+    }
+    Py_BEGIN_ALLOW_THREADS
+    W = graph_acquire((GraphObject*)graph_py, &local, &local_graph);
+    ws = workspace_create(H_c.rows, k);
+    want_trace = want_trace || want_stats;
+    trace = want_trace ? trace_create(max_iter) : NULL;
+    if (W != NULL && ws != NULL && (trace != NULL || !want_trace)) {
+        stats_begin(stats, PHASE_INIT);
+        started = fit_start(W, &H_c, H0, seed, &options, &state, &load_error);
+        stats_end(stats, 0);
+        if (started) {
+            stats_begin(stats, PHASE_SOLVE);
+            solved = symnmf_resume(&H_c, W, ws, &options, &state, &result, trace);
+            stats_end_solve(stats, solve_iteration_flops(W->n, (W->kind == GRAPH_CSR) ? (double)W->csr->nnz : (double)W->n * W->n, k), &result);
+        }
+        matrix_free(state.V);
+    }
+    workspace_free(ws);
+    graph_release(W, &local_graph);
+    Py_END_ALLOW_THREADS
+    PyBuffer_Release(&H_view);
+    Py_DECREF(graph_py);
+    matrix_free(H0);
+    if (solved == NULL) {
+        trace_free(trace);
+        Py_DECREF(res_py);
+        if (!started) {
+            return load_error_to_py(checkpoint, &load_error);
+        }
+        return (checkpoint != NULL) ? PyErr_Format(PyExc_OSError, "%s: could not write the checkpoint", checkpoint) : PyErr_NoMemory();
+    }
+    res_py = solve_output(res_py, want_info || want_trace, &result, trace);
+    if (stats != NULL) {
+        stats->trace = trace;
+        res_py = add_stats(res_py, stats);
+    }
+    trace_free(trace);
+    return res_py;
+}
+
+/**
+ * Runs a batch of (k, seed) restarts on one W and keeps the best factorization of every k.
+ * tol, max_iter and rel_obj are the stopping criteria of fit with solver="mu".
+ * @param self: Pointer to the module
+ * @param args: Arguments passed from Python (data, configs[, kind, tol, max_iter, rel_obj]); configs is a sequence of (k, seed)
+ * @param kwargs: Keyword arguments passed from Python
+ * @return: Dict mapping each k to (H, objective, seed) of its lowest-objective restart
+ */
+static PyObject* fit_batch_py(PyObject *self, PyObject *args, PyObject *kwargs) {
+    static char *kwlist[] = {"data", "configs", "kind", "tol", "max_iter", "rel_obj", NULL};
+    PyObject *data_py, *configs_py, *graph_py, *seq = NULL, *result = NULL, *entry, *key;
+    const char *kind = "packed";
+    Py_ssize_t r, i, j, best;
+    int *ks = NULL, ok = 0, max_iter = MAXITER;
+    double tol = EPSILON, rel_obj = 0.0;
+    SolverOptions options;
+    unsigned long *seeds = NULL;
+    double *objectives = NULL;
+    PyObject **arrays = NULL;
+    Py_buffer *views = NULL;
+    Matrix *H_c = NULL;
+    Matrix **H_ptrs = NULL;
+    StreamGraph local;
+    Graph local_graph;
+    const Graph *W;
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "OO|sdid", kwlist, &data_py, &configs_py, &kind, &tol, &max_iter, &rel_obj)) {
+        return NULL;
+    }
+    if (!solver_options_from_py("mu", tol, max_iter, rel_obj, &options)) {
+        return NULL;
+    }
+    graph_py = graph_from_data(data_py, kind, NULL);
+    if (graph_py == NULL) {
+        return NULL;
+    }
+    seq = PySequence_Fast(configs_py, "configs must be a sequence of (k, seed) pairs");
+    if (seq == NULL) {
+        goto done;
+    }
+    r = PySequence_Fast_GET_SIZE(seq);
+    ks = PyMem_Calloc((size_t)r + 1, sizeof(int));
+    seeds = PyMem_Calloc((size_t)r + 1, sizeof(unsigned long));
+    objectives = PyMem_Calloc((size_t)r + 1, sizeof(double));
+    arrays = PyMem_Calloc((size_t)r + 1, sizeof(PyObject*));
+    views = PyMem_Calloc((size_t)r + 1, sizeof(Py_buffer));
+    H_c = PyMem_Calloc((size_t)r + 1, sizeof(Matrix));
+    H_ptrs = PyMem_Calloc((size_t)r + 1, sizeof(Matrix*));
+    if (ks == NULL || seeds == NULL || objectives == NULL || arrays == NULL || views == NULL || H_c == NULL || H_ptrs == NULL) {
+        PyErr_NoMemory();
+        goto done;
+    }
+    for (i = 0; i < r; i++) {
+        if (!PyArg_ParseTuple(PySequence_Fast_GET_ITEM(seq, i), "ik", &ks[i], &seeds[i])) {
+            goto done;
+        }
+        if (ks[i] <= 0 || ks[i] > ((GraphObject*)graph_py)->graph.n) {
+            PyErr_SetString(PyExc_ValueError, "k must be between 1 and the number of points");
+            goto done;
+        }
+    }
+    for (i = 0; i < r; i++) {
+        arrays[i] = output_matrix(NULL, ((GraphObject*)graph_py)->graph.n, ks[i], &views[i], &H_c[i]);
+        if (arrays[i] == NULL) {
+            goto done;
+        }
+        H_ptrs[i] = &H_c[i];
+    }
+    Py_BEGIN_ALLOW_THREADS
+    W = graph_acquire((GraphObject*)graph_py, &local, &local_graph);
+    ok = W != NULL && symnmf_batch(W, ks, seeds, (int)r, &options, H_ptrs, objectives);
+    graph_release(W, &local_graph);
+    Py_END_ALLOW_THREADS
+    if (!ok) {
+        PyErr_NoMemory();
+        goto done;
+    }
+    result = PyDict_New();
+    for (i = 0; i < r && result != NULL; i++) {
+        best = i;
+        for (j = 0; j < r; j++) {
+            if (ks[j] == ks[i] && objectives[j] < objectives[best]) {
+                best = j;
+            }
+        }
+        if (best != i) {
+            continue;
+        }
+        key = PyLong_FromLong(ks[i]);
+        entry = Py_BuildValue("(Odk)", arrays[i], objectives[i], seeds[i]);
+        if (key == NULL || entry == NULL || PyDict_SetItem(result, key, entry) < 0) {
+            Py_CLEAR(result);
+        }
+        Py_XDECREF(key);
+        Py_XDECREF(entry);
+    }
+done:
+    for (i = 0; arrays != NULL && i < r && arrays[i] != NULL; i++) {
+        PyBuffer_Release(&views[i]);
+        Py_DECREF(arrays[i]);
+    }
+    PyMem_Free(ks);
+    PyMem_Free(seeds);
+    PyMem_Free(objectives);
+    PyMem_Free(arrays);
+    PyMem_Free(views);
+    PyMem_Free(H_c);
+    PyMem_Free(H_ptrs);
+    Py_XDECREF(seq);
+    Py_DECREF(graph_py);
+    return result;
+}
+
+/**
+ * Copies an array of ints into a new one-dimensional numpy array of dtype intc.
+ * @param values: Array
+ * @param count: Number of entries
+ * @return: New array, NULL with a Python exception set on failure
+ */
+static PyObject* ints_to_array(const int *values, int count) {
+    PyObject *numpy, *array;
+    Py_buffer view;
+    numpy = PyImport_ImportModule("numpy");
+    if (numpy == NULL) {
+        return NULL;
+    }
+    array = PyObject_CallMethod(numpy, "empty", "(is)", count, "intc");
+    Py_DECREF(numpy);
+    if (array == NULL || PyObject_GetBuffer(array, &view, PyBUF_C_CONTIGUOUS | PyBUF_WRITABLE) < 0) {
+        Py_XDECREF(array);
+        return NULL;
+    }
+    memcpy(view.buf, values, (size_t)count * sizeof(int));
+    PyBuffer_Release(&view);
+    return array;
+}
+
+/**
+ * Clusters points with k-means in C, with the same starting centroids, updates and stopping
+ * rule as kmeans.k_means. method is "lloyd" or "hamerly" (triangle inequality bounds that skip
+ * most distance computations once the centroids settle); both give the same centroids.
+ * With info=True the result is (centroids, {"iterations": n, "labels": array of the centroid
+ * of every point in the last assignment}).
+ * @param self: Pointer to the module
+ * @param args: Arguments passed from Python (data, k[, max_iter, method, info])
+ * @param kwargs: Keyword arguments passed from Python
+ * @return: The k*d centroids as a new array, or (centroids, info)
+ */
+static PyObject* kmeans_py(PyObject *self, PyObject *args, PyObject *kwargs) {
+    static char *kwlist[] = {"data", "k", "max_iter", "method", "info", NULL};
+    PyObject *data_py, *res_py, *labels_py;
+    int k, max_iter = MAXITER, want_info = 0, method, iterations = 0, c;
+    int *labels = NULL;
+    const char *method_name = "lloyd";
+    Matrix *points, *C = NULL;
+    Matrix out;
+    Py_buffer view;
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "Oi|isp", kwlist, &data_py, &k, &max_iter, &method_name, &want_info)) {
+        return NULL;
+    }
+    if (strcmp(method_name, "lloyd") != 0 && strcmp(method_name, "hamerly") != 0) {
+        PyErr_SetString(PyExc_ValueError, "method must be 'lloyd' or 'hamerly'");
+        return NULL;
+    }
+    if (max_iter < 0) {
+        PyErr_SetString(PyExc_ValueError, "max_iter must be non-negative");
+        return NULL;
+    }
+    method = (method_name[0] == 'h') ? KMEANS_HAMERLY : KMEANS_LLOYD;
+    points = points_from_py(data_py);
+    if (points == NULL) {
+        return NULL;
+    }
+    if (k <= 0 || k > points->rows) {
+        matrix_free(points);
+        PyErr_SetString(PyExc_ValueError, "k must be between 1 and the number of points");
+        return NULL;
+    }
+    labels = want_info ? (int*)PyMem_Malloc((size_t)points->rows * sizeof(int)) : NULL;
+    if (!want_info || labels != NULL) {
+        Py_BEGIN_ALLOW_THREADS
+        C = kmeans(points, k, max_iter, method, labels, &iterations);
+        Py_END_ALLOW_THREADS
+    }
+    res_py = (C == NULL) ? PyErr_NoMemory() : output_matrix(NULL, k, points->cols, &view, &out);
+    for (c = 0; res_py != NULL && c < k; c++) {
+        memcpy(MAT_ROW(&out, c), MAT_ROW(C, c), (size_t)points->cols * sizeof(double));
+    }
+    if (res_py != NULL) {
+        PyBuffer_Release(&view);
+    }
+    labels_py = (res_py != NULL && want_info) ? ints_to_array(labels, points->rows) : NULL;
+    matrix_free(C);
+    PyMem_Free(labels);
+    matrix_free(points);
+    if (res_py == NULL || !want_info) {
+        return res_py;
+    }
+    if (labels_py == NULL) {
+        Py_DECREF(res_py);
+        return NULL;
+    }
+    return Py_BuildValue("(N{sisN})", res_py, "iterations", iterations, "labels", labels_py);
+}
+
+/**
+ * Labels every row of H with the column of its largest entry, as numpy.argmax(H, axis=1).
+ * @param self: Pointer to the module
+ * @param args: Arguments passed from Python (H)
+ * @return: Array of n labels
+ */
+static PyObject* argmax_labels_py(PyObject *self, PyObject *args) {
+    PyObject *H_py, *res_py = NULL;
+    Matrix *H;
+    int *labels;
+    if (!PyArg_ParseTuple(args, "O", &H_py)) {
+        return NULL;
+    }
+    H = points_from_py(H_py);
+    if (H == NULL) {
+        return NULL;
+    }
+    labels = (int*)PyMem_Malloc((size_t)H->rows * sizeof(int));
+    if (labels == NULL) {
+        PyErr_NoMemory();
+    } else {
+        Py_BEGIN_ALLOW_THREADS
+        argmax_labels(H, labels);
+        Py_END_ALLOW_THREADS
+        res_py = ints_to_array(labels, H->rows);
+    }
+    PyMem_Free(labels);
+    matrix_free(H);
+    return res_py;
+}
+
+/**
+ * Labels every point with its nearest centroid (the first one on ties).
+ * @param self: Pointer to the module
+ * @param args: Arguments passed from Python (data, centroids)
+ * @return: Array of n labels
+ */
+static PyObject* nearest_labels_py(PyObject *self, PyObject *args) {
+    PyObject *pnt_py, *cent_py, *res_py = NULL;
+    Matrix *points, *C;
+    int *labels = NULL;
+    if (!PyArg_ParseTuple(args, "OO", &pnt_py, &cent_py)) {
+        return NULL;
+    }
+    points = points_from_py(pnt_py);
+    C = (points == NULL) ? NULL : points_from_py(cent_py);
+    if (C != NULL && C->cols != points->cols) {
+        PyErr_SetString(PyExc_ValueError, "points and centroids must have the same dimension");
+    } else if (C != NULL) {
+        labels = (int*)PyMem_Malloc((size_t)points->rows * sizeof(int));
+        if (labels == NULL) {
+            PyErr_NoMemory();
+        } else {
+            Py_BEGIN_ALLOW_THREADS
+            nearest_labels(points, C, labels);
+            Py_END_ALLOW_THREADS
+            res_py = ints_to_array(labels, points->rows);
+        }
+    }
+    PyMem_Free(labels);
+    matrix_free(C);
+    matrix_free(points);
+    return res_py;
+}
+
+/**
+ * Reads a sequence of n non-negative integer labels.
+ * @param labels_py: Sequence of labels (list, numpy array, ...)
+ * @param n: Required length
+ * @param k: Receives the largest label plus one
+ * @return: Array of n labels to free with PyMem_Free, NULL with a Python exception set on failure
+ */
+static int* labels_from_py(PyObject *labels_py, int n, int *k) {
+    PyObject *seq;
+    long value;
+    int i, *labels;
+    seq = PySequence_Fast(labels_py, "labels must be a sequence");
+    if (seq == NULL) {
+        return NULL;
+    }
+    if (PySequence_Fast_GET_SIZE(seq) != n) {
+        Py_DECREF(seq);
+        PyErr_SetString(PyExc_ValueError, "expected one label per point");
+        return NULL;
+    }
+    labels = (int*)PyMem_Malloc((size_t)n * sizeof(int));
+    *k = 0;
+    for (i = 0; labels != NULL && i < n; i++) {
+        value = PyLong_AsLong(PySequence_Fast_GET_ITEM(seq, i));
+        if (value < 0 || value >= INT_MAX) {
+            if (!PyErr_Occurred()) {
+                PyErr_SetString(PyExc_ValueError, "labels must be non-negative integers");
+            }
+            PyMem_Free(labels);
+            labels = NULL;
+            break;
+        }
+        labels[i] = (int)value;
+        *k = (labels[i] >= *k) ? labels[i] + 1 : *k;
+    }
+    Py_DECREF(seq);
+    if (labels == NULL && !PyErr_Occurred()) {
+        PyErr_NoMemory();
+    }
+    return labels;
+}
+
+/**
+ * Computes the mean silhouette coefficient of a clustering, as sklearn.metrics.silhouette_score
+ * with the Euclidean metric. sym, the similarity matrix of the points (see sym_array), lets the
+ * distances be recovered from the affinities instead of the coordinates; a float64 array is
+ * read in place, a list is copied.
+ * @param self: Pointer to the module
+ * @param args: Arguments passed from Python (data, labels[, sym])
+ * @param kwargs: Keyword arguments passed from Python
+ * @return: The score as a float
+ */
+static PyObject* silhouette_py(PyObject *self, PyObject *args, PyObject *kwargs) {
+    static char *kwlist[] = {"data", "labels", "sym", NULL};
+    PyObject *pnt_py, *labels_py, *sym_py = Py_None, *res_py = NULL;
+    Matrix *points, *A = NULL;
+    Matrix sym_c;
+    Py_buffer sym_view;
+    int *labels = NULL, k = 0, ok = 0, borrowed = 0;
+    double score = 0.0;
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "OO|O", kwlist, &pnt_py, &labels_py, &sym_py)) {
+        return NULL;
+    }
+    points = points_from_py(pnt_py);
+    if (points != NULL) {
+        labels = labels_from_py(labels_py, points->rows, &k);
+    }
+    if (labels != NULL && sym_py != Py_None && PyObject_CheckBuffer(sym_py)) {
+        borrowed = buffer_to_matrix(sym_py, &sym_view, &sym_c, points->rows, points->rows, 0);
+        A = borrowed ? &sym_c : NULL;
+    } else if (labels != NULL && sym_py != Py_None) {
+        A = lst_Py_to_lst_c(sym_py, points->rows, points->rows);
+    }
+    if (labels != NULL && (sym_py == Py_None || A != NULL)) {
+        Py_BEGIN_ALLOW_THREADS
+        ok = silhouette_score(points, labels, k, A, &score);
+        Py_END_ALLOW_THREADS
+        if (ok) {
+            res_py = PyFloat_FromDouble(score);
+        } else {
+            PyErr_SetString(PyExc_ValueError, "labels must form between 2 and n - 1 clusters");
+        }
+    }
+    if (borrowed) {
+        PyBuffer_Release(&sym_view);
+    } else {
+        matrix_free(A);
+    }
+    PyMem_Free(labels);
+    matrix_free(points);
+    return res_py;
+}
+
+/**
+ * Reads a sequence of count floats.
+ * @param seq_py: Sequence of numbers (list, numpy array, ...)
+ * @param count: Required length
+ * @param values: Receives the numbers
+ * @return: 1 on success, 0 with a Python exception set on failure
+ */
+static int doubles_from_py(PyObject *seq_py, int count, double *values) {
+    PyObject *seq;
+    int i;
+    seq = PySequence_Fast(seq_py, "expected a sequence of numbers");
+    if (seq == NULL) {
+        return 0;
+    }
+    if (PySequence_Fast_GET_SIZE(seq) != count) {
+        Py_DECREF(seq);
+        PyErr_Format(PyExc_ValueError, "expected %d numbers", count);
+        return 0;
+    }
+    for (i = 0; i < count; i++) {
+        values[i] = PyFloat_AsDouble(PySequence_Fast_GET_ITEM(seq, i));
+        if (values[i] == -1.0 && PyErr_Occurred()) {
+            Py_DECREF(seq);
+            return 0;
+        }
+    }
+    Py_DECREF(seq);
+    return 1;
+}
+
+/* A fitted model assigning new points online, wrapping an OnlineModel. */
+typedef struct OnlineObject {
+    PyObject_HEAD
+    OnlineModel* model;
+    int busy;           /* a call is running without the GIL */
+} OnlineObject;
+
+static PyObject* OnlineType = NULL;
+
+/**
+ * Creates an online model: Online(points, H, degrees=None, refit_every=0, solver="mu",
+ * tol=1e-4, max_iter=300, rel_obj=0.0).
+ * @param type: Online type
+ * @param args: Positional arguments passed from Python
+ * @param kwargs: Keyword arguments passed from Python
+ * @return: New model, NULL with a Python exception set on failure
+ */
+static PyObject* online_new(PyTypeObject *type, PyObject *args, PyObject *kwargs) {
+    static char *kwlist[] = {"points", "H", "degrees", "refit_every", "solver", "tol", "max_iter", "rel_obj", NULL};
+    PyObject *pnt_py, *H_py, *deg_py = Py_None;
+    int refit_every = 0, max_iter = MAXITER;
+    double tol = EPSILON, rel_obj = 0.0;
+    const char *solver_name = "mu";
+    double *degrees = NULL;
+    Matrix *points, *H = NULL;
+    SolverOptions options;
+    OnlineObject *self = NULL;
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "OO|Oisdid", kwlist, &pnt_py, &H_py, &deg_py, &refit_every,
+                                     &solver_name, &tol, &max_iter, &rel_obj)) {
+        return NULL;
+    }
+    if (!solver_options_from_py(solver_name, tol, max_iter, rel_obj, &options)) {
+        return NULL;
+    }
+    if (refit_every < 0) {
+        PyErr_SetString(PyExc_ValueError, "refit_every must be non-negative");
+        return NULL;
+    }
+    points = points_from_py(pnt_py);
+    if (points != NULL) {
+        H = points_from_py(H_py);
+    }
+    if (H != NULL && H->rows != points->rows) {
+        PyErr_SetString(PyExc_ValueError, "H must have one row per point");
+    } else if (H != NULL && deg_py != Py_None) {
+        degrees = (double*)PyMem_Malloc((size_t)points->rows * sizeof(double));
+        if (degrees == NULL) {
+            PyErr_NoMemory();
+        } else if (!doubles_from_py(deg_py, points->rows, degrees)) {
+            PyMem_Free(degrees);
+            degrees = NULL;
+        }
+    }
+    if (H != NULL && !PyErr_Occurred()) {
+        self = (OnlineObject*)type->tp_alloc(type, 0);
+    }
+    if (self != NULL) {
+        Py_BEGIN_ALLOW_THREADS
+        self->model = online_create(points, H, degrees, refit_every, &options);
+        Py_END_ALLOW_THREADS
+        if (self->model == NULL) {
+            Py_CLEAR(self);
+            PyErr_NoMemory();
+        }
+    }
+    PyMem_Free(degrees);
+    matrix_free(H);
+    matrix_free(points);
+    return (PyObject*)self;
+}
+
+/**
+ * Frees the C storage of an online model.
+ * @param self: Online object
+ */
+static void online_dealloc(OnlineObject *self) {
+    PyTypeObject *type = Py_TYPE(self);
+    online_free(self->model);
+    type->tp_free((PyObject*)self);
+    Py_DECREF(type);
+}
+
+/**
+ * Marks the model as used by the running call, which then releases the GIL.
+ * @param self: Online object
+ * @return: 1 on success, 0 with RuntimeError set if another call is using the model
+ */
+static int online_claim(OnlineObject *self) {
+    if (self->busy) {
+        PyErr_SetString(PyExc_RuntimeError, "the model is in use by another thread");
+        return 0;
+    }
+    self->busy = 1;
+    return 1;
+}
+
+/**
+ * Assigns a new point: model.assign(point, keep=True) -> (label, h).
+ * @param self: Online object
+ * @param args: Positional arguments passed from Python
+ * @param kwargs: Keyword arguments passed from Python
+ * @return: (cluster, row of H as a list), NULL with a Python exception set on failure
+ */
+static PyObject* online_assign_py(OnlineObject *self, PyObject *args, PyObject *kwargs) {
+    static char *kwlist[] = {"point", "keep", NULL};
+    PyObject *point_py, *res_py = NULL;
+    int keep = 1, label = -1;
+    double *buffer;
+    OnlineModel *model = self->model;
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O|p", kwlist, &point_py, &keep)) {
+        return NULL;
+    }
+    buffer = (double*)PyMem_Malloc((size_t)(model->points->cols + model->H->cols) * sizeof(double));
+    if (buffer == NULL) {
+        return PyErr_NoMemory();
+    }
+    if (doubles_from_py(point_py, model->points->cols, buffer) && online_claim(self)) {
+        Py_BEGIN_ALLOW_THREADS
+        label = online_assign(model, buffer, keep, buffer + model->points->cols);
+        Py_END_ALLOW_THREADS
+        self->busy = 0;
+        res_py = (label < 0) ? PyErr_NoMemory() : Py_BuildValue("(iN)", label, doubles_to_py(buffer + model->points->cols, model->H->cols));
+    }
+    PyMem_Free(buffer);
+    return res_py;
+}
+
+/**
+ * Refits the model on all its points from the current H: model.refit() -> info.
+ * @param self: Online object
+ * @param args: Unused
+ * @return: {"iterations", "stop", "delta"} of the solve, NULL with a Python exception set on failure
+ */
+static PyObject* online_refit_py(OnlineObject *self, PyObject *args) {
+    int ok;
+    SolverResult result;
+    if (!online_claim(self)) {
+        return NULL;
+    }
+    Py_BEGIN_ALLOW_THREADS
+    ok = online_refit(self->model, &result);
+    Py_END_ALLOW_THREADS
+    self->busy = 0;
+    return ok ? solve_info_to_py(&result, NULL) : PyErr_NoMemory();
+}
+
+/**
+ * Returns the number of points of the model.
+ * @param self: Online object
+ * @param closure: Unused
+ * @return: n as a Python int
+ */
+static PyObject* online_get_n(OnlineObject *self, void *closure) {
+    return PyLong_FromLong(self->model->n);
+}
+
+/**
+ * Returns a copy of the rows of H of all the points of the model.
+ * @param self: Online object
+ * @param closure: Unused
+ * @return: New n*k array
+ */
+static PyObject* online_get_H(OnlineObject *self, void *closure) {
+    PyObject *res_py;
+    Py_buffer view;
+    Matrix out;
+    int i;
+    if (!online_claim(self)) {
+        return NULL;
+    }
+    res_py = output_matrix(NULL, self->model->n, self->model->H->cols, &view, &out);
+    for (i = 0; res_py != NULL && i < self->model->n; i++) {
+        memcpy(MAT_ROW(&out, i), MAT_ROW(self->model->H, i), (size_t)out.cols * sizeof(double));
+    }
+    if (res_py != NULL) {
+        PyBuffer_Release(&view);
+    }
+    self->busy = 0;
+    return res_py;
+}
+
+/**
+ * Returns the degrees of all the points of the model.
+ * @param self: Online object
+ * @param closure: Unused
+ * @return: List of n floats
+ */
+static PyObject* online_get_degrees(OnlineObject *self, void *closure) {
+    PyObject *res_py;
+    if (!online_claim(self)) {
+        return NULL;
+    }
+    res_py = doubles_to_py(MAT_ROW(self->model->vectors, 0), self->model->n);
+    self->busy = 0;
+    return res_py;
+}
+
+static PyMethodDef online_methods[] = {
+    {"assign", (PyCFunction)(void(*)(void))online_assign_py, METH_VARARGS | METH_KEYWORDS, PyDoc_STR("assign(point, keep=True): (cluster, row of H) of a new point; keep adds it to the model unless it has no affinity to any point (then h is 0 and the cluster 0)")},
+    {"refit", (PyCFunction)online_refit_py, METH_NOARGS, PyDoc_STR("Refit on all points warm-started from the current H, return {'start', 'iterations', 'stop', 'delta'}")},
+    {NULL, NULL, 0, NULL}
+};
+
+static PyGetSetDef online_getset[] = {
+    {"n", (getter)online_get_n, NULL, "Number of points", NULL},
+    {"H", (getter)online_get_H, NULL, "Copy of H (n*k)", NULL},
+    {"degrees", (getter)online_get_degrees, NULL, "Degree of every point", NULL},
+    {NULL, NULL, NULL, NULL, NULL}
+};
+
+static PyType_Slot online_slots[] = {
+    {Py_tp_doc, "Online(points, H, degrees=None, refit_every=0, solver='mu', tol=1e-4, max_iter=300, rel_obj=0.0)\n\n"
+                "Fitted SymNMF model assigning new points without refactorizing. A new point is\n"
+                "normalized against the kept degrees and projected onto H; kept points update the\n"
+                "degrees, and every refit_every kept points (or on refit()) the model refits from\n"
+                "the current H. degrees defaults to the degrees of the points' similarity graph."},
+    {Py_tp_new, online_new},
+    {Py_tp_dealloc, online_dealloc},
+    {Py_tp_methods, online_methods},
+    {Py_tp_getset, online_getset},
+    {0, NULL}
+};
+
+static PyType_Spec online_spec = {
+    "mysymnmf.Online",
+    sizeof(OnlineObject),
+    0,
+    Py_TPFLAGS_DEFAULT,
+    online_slots
+};
+
+/**
+ * Sets the number of threads used by the C kernels.
+ * @param self: Pointer to the module
+ * @param args: Arguments passed from Python (number of threads, 0 for the default)
+ * @return: None
+ */
+static PyObject* set_threads_py(PyObject *self, PyObject *args) {
+    int threads;
+    if (!PyArg_ParseTuple(args, "i", &threads)) {
+        return NULL;
+    }
+    set_num_threads(threads);
+    Py_RETURN_NONE;
+}
+
+/**
+ * Returns the number of threads used by the C kernels.
+ * @param self: Pointer to the module
+ * @param args: Unused
+ * @return: Number of threads as a Python int
+ */
+static PyObject* get_threads_py(PyObject *self, PyObject *args) {
+    return PyLong_FromLong(get_num_threads());
+}
+
+/**
+ * Method definitions for the module.
+ */
+static PyMethodDef symnmf_methods[] = {
+    {"symnmf", (PyCFunction)(void(*)(void))opt_mat_py, METH_VARARGS | METH_KEYWORDS, PyDoc_STR("symnmf(H, W, k, n, tol=1e-4, max_iter=300, rel_obj=0, solver='mu', info=False): optimize the matrix H; info=True also returns {'iterations', 'stop'}")},
+    {"sym", (PyCFunction)sym_mat_py, METH_VARARGS, PyDoc_STR("Construct a symmetric matrix")},
+    {"ddg", (PyCFunction)diag_mat_py, METH_VARARGS, PyDoc_STR("Construct a diagonal degree matrix")},
+    {"norm", (PyCFunction)norm_mat_py, METH_VARARGS, PyDoc_STR("Normalize a matrix")},
+    {"fit", (PyCFunction)(void(*)(void))fit_py, METH_VARARGS | METH_KEYWORDS, PyDoc_STR("fit(data, k, seed=1234, kind='packed', solver='mu', tol=1e-4, max_iter=300, rel_obj=0, info=False, trace=False, precision=None, stats=False, H0=None, checkpoint=None, checkpoint_every=100): build W from points (or take a Graph), seed H in C and factorize; info=True also returns {'start', 'iterations', 'stop', 'delta'}, trace=True adds per-iteration objective and seconds, stats=True adds per-phase timings, allocations and flops; precision is 'double', 'single' or 'mixed', by default single for float32 points; H0 warm-starts from a given H; checkpoint saves H and the solver state every checkpoint_every iterations and, if the file exists, resumes from it on the exact same trajectory")},
+    {"kmeans", (PyCFunction)(void(*)(void))kmeans_py, METH_VARARGS | METH_KEYWORDS, PyDoc_STR("kmeans(data, k, max_iter=300, method='lloyd', info=False): k-means from the first k points as kmeans.k_means, return the k*d centroids; method 'hamerly' prunes distances with triangle inequality bounds; info=True also returns {'iterations', 'labels'}")},
+    {"argmax_labels", (PyCFunction)argmax_labels_py, METH_VARARGS, PyDoc_STR("argmax_labels(H): column of the largest entry of every row of H, as numpy.argmax(H, axis=1)")},
+    {"nearest_labels", (PyCFunction)nearest_labels_py, METH_VARARGS, PyDoc_STR("nearest_labels(data, centroids): index of the nearest centroid of every point")},
+    {"silhouette", (PyCFunction)(void(*)(void))silhouette_py, METH_VARARGS | METH_KEYWORDS, PyDoc_STR("silhouette(data, labels, sym=None): mean Euclidean silhouette coefficient as sklearn.metrics.silhouette_score; sym, the similarity matrix of data, reuses its distances")},
+    {"fit_batch", (PyCFunction)(void(*)(void))fit_batch_py, METH_VARARGS | METH_KEYWORDS, PyDoc_STR("fit_batch(data, configs, kind='packed', tol=1e-4, max_iter=300, rel_obj=0): run (k, seed) multiplicative update restarts on one W with the stopping criteria of fit, return {k: (H, objective, seed)} of the best restart per k")},
+    {"symnmf_array", (PyCFunction)(void(*)(void))opt_mat_array_py, METH_VARARGS | METH_KEYWORDS, PyDoc_STR("Optimize H given as a float64 array against a dense float64 W, without list conversion")},
+    {"sym_array", (PyCFunction)(void(*)(void))sym_array_py, METH_VARARGS | METH_KEYWORDS, PyDoc_STR("Similarity matrix of a float64 array of points, optionally into out")},
+    {"ddg_array", (PyCFunction)(void(*)(void))diag_array_py, METH_VARARGS | METH_KEYWORDS, PyDoc_STR("Diagonal degree matrix of a float64 array of points, optionally into out")},
+    {"norm_array", (PyCFunction)(void(*)(void))norm_array_py, METH_VARARGS | METH_KEYWORDS, PyDoc_STR("Normalized similarity matrix of a float64 array of points, optionally into out")},
+    {"load", (PyCFunction)(void(*)(void))load_py, METH_VARARGS | METH_KEYWORDS, PyDoc_STR("load(filename, verify=True): map a binary matrix file as a read-only array, or parse a comma separated file of points")},
+    {"load_graph", (PyCFunction)(void(*)(void))load_graph_py, METH_VARARGS | METH_KEYWORDS, PyDoc_STR("load_graph(filename, verify=True): map a W saved with save() as a Graph")},
+    {"write_matrix", (PyCFunction)(void(*)(void))write_matrix_py, METH_VARARGS | METH_KEYWORDS, PyDoc_STR("write_matrix(data, filename=None): write a float64 matrix as '%.4f' comma separated text to stdout or a file")},
+    {"save", (PyCFunction)(void(*)(void))save_py, METH_VARARGS | METH_KEYWORDS, PyDoc_STR("save(filename, data, packed=False): write a float64 matrix or a dense / packed Graph to a binary matrix file")},
+    {"entry_avg", (PyCFunction)entry_avg_py, METH_VARARGS, PyDoc_STR("Average entry of a float64 matrix buffer")},
+    {"symnmf_stream", (PyCFunction)opt_mat_stream_py, METH_VARARGS, PyDoc_STR("Optimize H from the points, streaming W in tiles within memory_budget bytes")},
+    {"norm_avg", (PyCFunction)norm_avg_py, METH_VARARGS, PyDoc_STR("Average entry of the normalized similarity matrix, streamed within memory_budget bytes")},
+    {"knn", (PyCFunction)knn_graph_py, METH_VARARGS, PyDoc_STR("Build the normalized sparse kNN graph as (row_ptr, col_idx, values)")},
+    {"set_num_threads", (PyCFunction)set_threads_py, METH_VARARGS, PyDoc_STR("Set the number of threads used by the C kernels (0 for the default)")},
+    {"get_num_threads", (PyCFunction)get_threads_py, METH_NOARGS, PyDoc_STR("Get the number of threads used by the C kernels")},
+    {NULL, NULL, 0, NULL}
+};
+
+/**
+ * Module definition structure.
+ */
+static struct PyModuleDef symmmodule = {
+    PyModuleDef_HEAD_INIT,
+    "mysymnmf",
+    PyDoc_STR("SymNMF clustering kernels.\n\n"
+              "Every function releases the GIL while it computes, so calls from several Python\n"
+              "threads run concurrently. Arguments are converted or borrowed (buffer inputs) for\n"
+              "the duration of the call and must not be modified by other threads meanwhile;\n"
+              "concurrent calls must not share an out= buffer. Each call uses its own OpenMP team\n"
+              "of get_num_threads() threads; lower it with set_num_threads() when running many\n"
+              "solves at once."),
+    -1,
+    symnmf_methods
+};
+
+/**
+ * Module initialization function.
+ */
+PyMODINIT_FUNC PyInit_mysymnmf(void) {
+    PyObject *m;
+    m = PyModule_Create(&symmmodule);
+    if (!m) {
+        return NULL;
+    }
+    GraphType = PyType_FromSpec(&graph_spec);
+    MappingType = PyType_FromSpec(&mapping_spec);
+    OnlineType = PyType_FromSpec(&online_spec);
+    if (GraphType == NULL || MappingType == NULL || OnlineType == NULL) {
+        Py_XDECREF(GraphType);
+        Py_XDECREF(MappingType);
+        Py_XDECREF(OnlineType);
+        Py_DECREF(m);
+        return NULL;
+    }
+    Py_INCREF(GraphType);
+    if (PyModule_AddObject(m, "Graph", GraphType) < 0) {
+        Py_DECREF(GraphType);
+        Py_DECREF(m);
+        return NULL;
+    }
+    Py_INCREF(OnlineType);
+    if (PyModule_AddObject(m, "Online", OnlineType) < 0) {
+        Py_DECREF(OnlineType);
+        Py_DECREF(m);
         return NULL;
     }
     return m;
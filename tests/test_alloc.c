@@ -0,0 +1,96 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "symnmf.h"
+
+/* Size of the problem the solves run on. */
+#define TEST_N 120
+#define TEST_K 4
+
+/**
+ * Fills a matrix of points with three well separated groups.
+ * @param points: Matrix of points (n*d)
+ */
+static void fill_points(Matrix* points)
+{
+    int i;
+    int j;
+    for (i = 0; i < points->rows; i++)
+    {
+        for (j = 0; j < points->cols; j++)
+        {
+            MAT_AT(points, i, j) = 3.0 * (i % 3) + 0.01 * ((i * 7 + j * 13) % 17);
+        }
+    }
+}
+
+/**
+ * Runs two solves on the same workspace and checks that the second allocates no matrix:
+ * the iterations must run entirely out of the workspace.
+ * @param name: Name of the graph kind, for the report
+ * @param W: Graph operand for W
+ * @param H: Matrix H (n*k)
+ * @param ws: Workspace created for the size of H
+ * @return: 1 if the check passed
+ */
+static int check_steady_state(const char* name, const Graph* W, Matrix* H, Workspace* ws)
+{
+    unsigned long before;
+    unsigned long allocated;
+    init_H(W, H, 1234);
+    if (opt_mat_with_workspace(H, W, ws) == NULL)
+    {
+        printf("FAIL %s: first solve failed\n", name);
+        return 0;
+    }
+    init_H(W, H, 4321);
+    before = matrix_alloc_count();
+    if (opt_mat_with_workspace(H, W, ws) == NULL)
+    {
+        printf("FAIL %s: second solve failed\n", name);
+        return 0;
+    }
+    allocated = matrix_alloc_count() - before;
+    if (allocated != 0)
+    {
+        printf("FAIL %s: %lu matrices allocated by a solve on a reused workspace\n", name, allocated);
+        return 0;
+    }
+    printf("ok %s\n", name);
+    return 1;
+}
+
+/**
+ * Asserts that the steady-state solver loop does no heap allocation, with dense and packed W.
+ * @return: Exit status, 0 if every check passed
+ */
+int main(void)
+{
+    int ok = 1;
+    Graph W;
+    Matrix* points = matrix_create(TEST_N, 2);
+    Matrix* H = matrix_create(TEST_N, TEST_K);
+    Matrix* W_dense = NULL;
+    PackedMatrix* W_packed = NULL;
+    Workspace* ws = workspace_create(TEST_N, TEST_K);
+    if (points == NULL || H == NULL || ws == NULL)
+    {
+        printf("FAIL: allocation\n");
+        return 1;
+    }
+    fill_points(points);
+    W_dense = sym_mat(points);
+    W_packed = norm_mat_packed(points, NULL);
+    if (W_dense == NULL || norm_mat_in_place(W_dense, NULL) == NULL || W_packed == NULL)
+    {
+        printf("FAIL: W\n");
+        return 1;
+    }
+    ok = check_steady_state("dense", graph_dense(&W, W_dense), H, ws) && ok;
+    ok = check_steady_state("packed", graph_packed(&W, W_packed), H, ws) && ok;
+    matrix_free(W_dense);
+    packed_free(W_packed);
+    matrix_free(points);
+    matrix_free(H);
+    workspace_free(ws);
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,37 @@
+"""fit_batch must reproduce fit restart by restart under the same stopping criteria."""
+import unittest
+
+import numpy as np
+
+import mysymnmf
+
+
+class BatchOptionsTest(unittest.TestCase):
+
+    def setUp(self):
+        rng = np.random.default_rng(2)
+        self.X = np.vstack([rng.normal(c, 1.0, (60, 4)) for c in (0.0, 3.0, 6.0)])
+        self.configs = [(2, 1), (3, 5), (3, 9), (4, 2)]
+
+    def check(self, **options):
+        for k, (H, _, seed) in mysymnmf.fit_batch(self.X, self.configs, **options).items():
+            self.assertTrue(np.array_equal(H, mysymnmf.fit(self.X, k, seed=seed, **options)), (k, options))
+
+    def test_defaults(self):
+        self.check()
+
+    def test_tol_and_max_iter(self):
+        self.check(tol=1e-8, max_iter=500)
+        self.check(max_iter=0)
+
+    def test_rel_obj(self):
+        self.check(rel_obj=1e-6)
+        self.check(tol=0.0, max_iter=37, rel_obj=1e-9)
+
+    def test_negative_options_are_rejected(self):
+        with self.assertRaises(ValueError):
+            mysymnmf.fit_batch(self.X, self.configs, tol=-1.0)
+
+
+if __name__ == "__main__":
+    unittest.main()
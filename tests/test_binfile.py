@@ -0,0 +1,91 @@
+"""Binary matrix files must round-trip exactly and refuse corrupt or truncated data."""
+import os
+import shutil
+import tempfile
+import unittest
+
+import numpy as np
+
+import mysymnmf
+
+HEADER_SIZE = 64
+
+
+class BinFileTest(unittest.TestCase):
+
+    def setUp(self):
+        rng = np.random.default_rng(1)
+        self.X = rng.normal(0.0, 1.0, (40, 3))
+        self.W = np.asarray(mysymnmf.norm_array(self.X))
+        self.dir = tempfile.mkdtemp()
+
+    def tearDown(self):
+        shutil.rmtree(self.dir)
+
+    def path(self, name):
+        return os.path.join(self.dir, name)
+
+    def test_load_round_trip(self):
+        for data in (self.X, self.W):
+            mysymnmf.save(self.path("m.bin"), data)
+            loaded = mysymnmf.load(self.path("m.bin"))
+            self.assertFalse(loaded.flags.writeable)
+            self.assertTrue(np.array_equal(np.asarray(loaded), data))
+
+    def test_load_graph_round_trip(self):
+        mysymnmf.save(self.path("w.bin"), self.W)
+        G = mysymnmf.load_graph(self.path("w.bin"))
+        self.assertEqual(G.n, len(self.X))
+        expected = mysymnmf.fit(mysymnmf.Graph(self.X, kind="dense"), 3)
+        self.assertTrue(np.array_equal(np.asarray(mysymnmf.fit(G, 3)), np.asarray(expected)))
+
+    def test_graph_save(self):
+        mysymnmf.save(self.path("g.bin"), mysymnmf.Graph(self.X, kind="dense"))
+        self.assertTrue(np.array_equal(np.asarray(mysymnmf.load(self.path("g.bin"))), self.W))
+
+    def test_packed_save(self):
+        mysymnmf.save(self.path("p.bin"), self.W, packed=True)
+        mysymnmf.save(self.path("g.bin"), mysymnmf.Graph(self.X, kind="packed"))
+        n = len(self.X)
+        self.assertEqual(os.path.getsize(self.path("p.bin")), HEADER_SIZE + n * (n + 1) // 2 * 8)
+        with open(self.path("p.bin"), "rb") as a, open(self.path("g.bin"), "rb") as b:
+            self.assertEqual(a.read(), b.read())
+        with self.assertRaisesRegex(ValueError, "packed matrix, use load_graph"):
+            mysymnmf.load(self.path("p.bin"))
+        G = mysymnmf.load_graph(self.path("p.bin"))
+        self.assertEqual(G.kind, "packed")
+        expected = mysymnmf.fit(self.X, 3, kind="packed")
+        self.assertTrue(np.array_equal(np.asarray(mysymnmf.fit(G, 3)), np.asarray(expected)))
+
+    def test_checksum_mismatch(self):
+        mysymnmf.save(self.path("w.bin"), self.W)
+        with open(self.path("w.bin"), "rb") as f:
+            data = bytearray(f.read())
+        data[HEADER_SIZE + 100] ^= 1
+        with open(self.path("bad.bin"), "wb") as f:
+            f.write(data)
+        for load in (mysymnmf.load, mysymnmf.load_graph):
+            with self.assertRaisesRegex(ValueError, "checksum mismatch"):
+                load(self.path("bad.bin"))
+        # verify=False skips the checksum and maps the data as it is.
+        self.assertEqual(np.asarray(mysymnmf.load(self.path("bad.bin"), verify=False)).shape, self.W.shape)
+
+    def test_truncated_file(self):
+        mysymnmf.save(self.path("w.bin"), self.W)
+        with open(self.path("w.bin"), "rb") as f:
+            data = f.read()
+        with open(self.path("short.bin"), "wb") as f:
+            f.write(data[:-8])
+        for load in (mysymnmf.load, mysymnmf.load_graph):
+            with self.assertRaisesRegex(ValueError, "file is truncated"):
+                load(self.path("short.bin"))
+        with self.assertRaisesRegex(ValueError, "file is truncated"):
+            mysymnmf.load(self.path("short.bin"), verify=False)
+        with open(self.path("header.bin"), "wb") as f:
+            f.write(data[:HEADER_SIZE // 2])
+        with self.assertRaisesRegex(ValueError, "not a binary matrix file"):
+            mysymnmf.load_graph(self.path("header.bin"))
+
+
+if __name__ == "__main__":
+    unittest.main()
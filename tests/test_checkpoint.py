@@ -0,0 +1,85 @@
+"""A fit resumed from a checkpoint must follow the uninterrupted trajectory bit for bit."""
+import os
+import shutil
+import tempfile
+import unittest
+
+import numpy as np
+
+import mysymnmf
+
+K = 4
+MAX_ITER = 300
+
+
+class CheckpointTest(unittest.TestCase):
+
+    def setUp(self):
+        rng = np.random.default_rng(5)
+        self.X = rng.uniform(0.0, 4.0, (150, 2))
+        self.dir = tempfile.mkdtemp()
+        self.path = os.path.join(self.dir, "fit.ckpt")
+
+    def tearDown(self):
+        shutil.rmtree(self.dir)
+
+    def interrupt(self, at, **options):
+        """Runs the first `at` iterations, leaving a checkpoint of iteration `at`, and returns its H."""
+        if os.path.exists(self.path):
+            os.remove(self.path)
+        H = mysymnmf.fit(self.X, K, tol=0.0, max_iter=at, checkpoint=self.path, checkpoint_every=at, **options)
+        self.assertTrue(os.path.exists(self.path))
+        return np.asarray(H)
+
+    def check(self, at, **options):
+        full, full_info = mysymnmf.fit(self.X, K, tol=0.0, max_iter=MAX_ITER, info=True, **options)
+        self.interrupt(at, **options)
+        H, info = mysymnmf.fit(self.X, K, tol=0.0, max_iter=MAX_ITER, info=True,
+                               checkpoint=self.path, checkpoint_every=at, **options)
+        self.assertEqual(info["start"], at)
+        self.assertEqual(info["iterations"], full_info["iterations"])
+        self.assertEqual(info["stop"], full_info["stop"])
+        self.assertTrue(np.array_equal(np.asarray(H), np.asarray(full)), (at, options))
+
+    def test_mu(self):
+        self.check(50, solver="mu")
+        self.check(120, solver="mu")
+
+    def test_mu_rel_obj(self):
+        # rel_obj=1e-7 stops the uninterrupted run at iteration 231, after every interruption.
+        self.check(40, solver="mu", rel_obj=1e-7)
+        self.check(50, solver="mu", rel_obj=1e-7)
+        self.check(120, solver="mu", rel_obj=1e-7)
+
+    def test_hals(self):
+        self.check(50, solver="hals")
+        self.check(120, solver="hals")
+
+    def test_hals_rel_obj(self):
+        # rel_obj=1e-12 stops the uninterrupted run at iteration 84.
+        self.check(40, solver="hals", rel_obj=1e-12)
+        self.check(50, solver="hals", rel_obj=1e-12)
+
+    def test_hals_checkpoint_holds_h_and_v(self):
+        H = self.interrupt(50, solver="hals")
+        saved = np.asarray(mysymnmf.load(self.path))
+        self.assertEqual(saved.shape, (2 * len(self.X), K))
+        self.assertTrue(np.array_equal(saved[:len(self.X)], H))
+        self.assertTrue(np.all(saved[len(self.X):] >= 0.0))
+        self.assertFalse(np.array_equal(saved[len(self.X):], H))
+
+    def test_mu_checkpoint_holds_h(self):
+        H = self.interrupt(50, solver="mu")
+        self.assertTrue(np.array_equal(np.asarray(mysymnmf.load(self.path)), H))
+
+    def test_mismatch_is_rejected(self):
+        self.interrupt(50, solver="hals")
+        for k, solver in ((K + 1, "hals"), (K, "mu")):
+            with self.assertRaisesRegex(ValueError, "checkpoint does not match the data, k or solver"):
+                mysymnmf.fit(self.X, k, solver=solver, tol=0.0, max_iter=MAX_ITER, checkpoint=self.path)
+        with self.assertRaisesRegex(ValueError, "checkpoint does not match the data, k or solver"):
+            mysymnmf.fit(self.X[:100], K, solver="hals", tol=0.0, max_iter=MAX_ITER, checkpoint=self.path)
+
+
+if __name__ == "__main__":
+    unittest.main()
@@ -0,0 +1,46 @@
+"""mysymnmf.kmeans must reproduce kmeans.k_means bit for bit with either method."""
+import unittest
+
+import numpy as np
+
+import kmeans
+import mysymnmf
+
+METHODS = ("lloyd", "hamerly")
+
+
+class KMeansTest(unittest.TestCase):
+
+    def setUp(self):
+        rng = np.random.default_rng(8)
+        self.X = np.vstack([rng.normal(c, 1.0, (50, 3)) for c in (0.0, 4.0, 8.0)])
+        rng.shuffle(self.X)
+
+    def check(self, X, k, max_iter=300):
+        expected = np.array(kmeans.k_means(k, max_iter, X.tolist()))
+        for method in METHODS:
+            C = np.asarray(mysymnmf.kmeans(X, k, max_iter=max_iter, method=method))
+            self.assertTrue(np.array_equal(C, expected), (k, max_iter, method))
+
+    def test_matches_python(self):
+        for k in (2, 3, 5, 8):
+            self.check(self.X, k)
+
+    def test_iteration_limit(self):
+        for max_iter in (1, 2, 3):
+            self.check(self.X, 5, max_iter)
+
+    def test_empty_cluster(self):
+        # The first two points are equal, so the second centroid never wins a point and
+        # kmeans.k_means moves it to the origin, far from the shifted data.
+        X = self.X + 50.0
+        X[1] = X[0]
+        self.check(X, 3)
+        for method in METHODS:
+            C, info = mysymnmf.kmeans(X, 3, method=method, info=True)
+            self.assertEqual(np.bincount(np.asarray(info["labels"]), minlength=3)[1], 0)
+            self.assertTrue(np.array_equal(np.asarray(C)[1], np.zeros(3)))
+
+
+if __name__ == "__main__":
+    unittest.main()
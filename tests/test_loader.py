@@ -0,0 +1,102 @@
+"""The C text loader must parse CSV points like numpy and name the line and field of a bad value."""
+import os
+import shutil
+import tempfile
+import unittest
+
+import numpy as np
+
+import mysymnmf
+
+CHUNK_BYTES = 4096
+CHUNKS_PER_THREAD = 4
+THREADS = 4
+
+
+class LoaderTest(unittest.TestCase):
+
+    def setUp(self):
+        self.dir = tempfile.mkdtemp()
+        self.path = os.path.join(self.dir, "points.txt")
+        self.threads = mysymnmf.get_num_threads()
+
+    def tearDown(self):
+        mysymnmf.set_num_threads(self.threads)
+        shutil.rmtree(self.dir)
+
+    def load(self, text):
+        with open(self.path, "w", newline="") as f:
+            f.write(text)
+        return np.asarray(mysymnmf.load(self.path))
+
+    def assertLoadError(self, text, line, field, message):
+        with self.assertRaises(ValueError) as caught:
+            self.load(text)
+        self.assertEqual(str(caught.exception), "%s:%d: field %d: %s" % (self.path, line, field, message))
+
+    def test_values(self):
+        self.assertTrue(np.array_equal(self.load("1,2.5\n-3e2,0.125\n"), [[1.0, 2.5], [-300.0, 0.125]]))
+
+    def test_not_a_number(self):
+        self.assertLoadError("1,2\n3,x\n", 2, 2, "not a number")
+        self.assertLoadError("1,2\n,4\n", 2, 1, "not a number")
+        self.assertLoadError("1,2\n3,\n", 2, 2, "not a number")
+
+    def test_too_many_values(self):
+        self.assertLoadError("1,2\n3,4\n5,6,7\n", 3, 3, "too many values on the line")
+
+    def test_too_few_values(self):
+        self.assertLoadError("1,2,3\n4,5\n", 2, 3, "too few values on the line")
+
+    def test_blank_lines(self):
+        self.assertTrue(np.array_equal(self.load("\n1,2\n\n \t\n3,4\n\n"), [[1.0, 2.0], [3.0, 4.0]]))
+        # Blank lines still count towards the reported line number.
+        self.assertLoadError("\n1,2\n\n\n3,y\n", 5, 2, "not a number")
+
+    def test_crlf(self):
+        self.assertTrue(np.array_equal(self.load("1,2\r\n3,4\r\n"), [[1.0, 2.0], [3.0, 4.0]]))
+        self.assertLoadError("1,2\r\n3,4\r\n5\r\n", 3, 2, "too few values on the line")
+
+    def test_last_line_without_newline(self):
+        self.assertTrue(np.array_equal(self.load("1,2\n3,4"), [[1.0, 2.0], [3.0, 4.0]]))
+        self.assertLoadError("1,2\n3,z", 2, 2, "not a number")
+
+    def chunk_starts(self, text):
+        """Line numbers at which the loader's chunks start, cut as parse_text cuts them."""
+        data = text.encode()
+        chunks = min(THREADS * CHUNKS_PER_THREAD, len(data) // CHUNK_BYTES + 1)
+        starts = []
+        for c in range(1, chunks):
+            cut = data.find(b"\n", len(data) // chunks * c) + 1
+            starts.append(data.count(b"\n", 0, cut) + 1)
+        return starts
+
+    def test_chunk_boundaries(self):
+        mysymnmf.set_num_threads(THREADS)
+        rng = np.random.default_rng(4)
+        X = rng.normal(0.0, 10.0, (3000, 3))
+        lines = [",".join(repr(float(v)) for v in row) for row in X]
+        lines[1000:1000] = ["", "  "]
+        text = "\n".join(lines) + "\n"
+        self.assertGreater(len(text), 4 * CHUNK_BYTES)
+        self.assertTrue(np.array_equal(self.load(text), X))
+        starts = self.chunk_starts(text)
+        self.assertGreater(len(starts), 2)
+        for start in starts[:3]:
+            for line in (start - 1, start):
+                bad = list(lines)
+                if bad[line - 1].strip() == "":
+                    continue
+                bad[line - 1] = bad[line - 1].rsplit(",", 1)[0] + ",nope"
+                self.assertLoadError("\n".join(bad) + "\n", line, 3, "not a number")
+
+    def test_first_error_wins_across_chunks(self):
+        mysymnmf.set_num_threads(THREADS)
+        lines = ["%d,%d" % (i, i + 1) for i in range(5000)]
+        lines[4000] = "1,2,3"
+        lines[300] = "1"
+        self.assertLoadError("\n".join(lines) + "\n", 301, 2, "too few values on the line")
+
+
+if __name__ == "__main__":
+    unittest.main()
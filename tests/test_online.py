@@ -0,0 +1,46 @@
+"""Regression tests of mysymnmf.Online."""
+import math
+import unittest
+
+import numpy as np
+
+import mysymnmf
+
+
+def blobs():
+    rng = np.random.default_rng(7)
+    return np.vstack([rng.normal(c, 0.5, (40, 2)) for c in (0.0, 4.0, 8.0)])
+
+
+class IsolatedPointTest(unittest.TestCase):
+    """A point whose affinities all underflow to 0 must not poison the model."""
+
+    def setUp(self):
+        self.X = blobs()
+        self.H = mysymnmf.fit(self.X, 3)
+        self.model = mysymnmf.Online(self.X, self.H)
+
+    def test_isolated_point_is_not_kept(self):
+        label, h = self.model.assign([1000.0, 1000.0], keep=True)
+        self.assertEqual(label, 0)
+        self.assertEqual(h, [0.0, 0.0, 0.0])
+        self.assertEqual(self.model.n, len(self.X))
+
+    def test_later_assignments_are_unaffected(self):
+        expected = [self.model.assign(p, keep=False) for p in self.X[:10]]
+        self.model.assign([1000.0, 1000.0], keep=True)
+        for p, (label, h) in zip(self.X[:10], expected):
+            got_label, got_h = self.model.assign(p, keep=False)
+            self.assertEqual(got_label, label)
+            self.assertEqual(got_h, h)
+            self.assertGreater(max(got_h), 0.0)
+
+    def test_refit_stays_finite(self):
+        self.model.assign([1000.0, 1000.0], keep=True)
+        self.model.assign(self.X[0] + 0.1, keep=True)
+        self.model.refit()
+        self.assertTrue(all(math.isfinite(v) for v in np.asarray(self.model.H).ravel()))
+
+
+if __name__ == "__main__":
+    unittest.main()
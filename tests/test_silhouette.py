@@ -0,0 +1,30 @@
+"""silhouette with sym= must agree with the coordinate distances, even for very close pairs."""
+import unittest
+
+import numpy as np
+
+import mysymnmf
+
+
+class SilhouetteTest(unittest.TestCase):
+
+    def check(self, X, labels):
+        expected = mysymnmf.silhouette(X, labels)
+        got = mysymnmf.silhouette(X, labels, sym=np.asarray(mysymnmf.sym_array(X)))
+        self.assertTrue(np.isfinite(got))
+        self.assertLessEqual(abs(got - expected), 1e-7 * abs(expected), (got, expected))
+
+    def test_blobs(self):
+        rng = np.random.default_rng(2)
+        X = np.vstack([rng.normal(c, 1.0, (30, 4)) for c in (0.0, 3.0, 6.0)])
+        self.check(X, [0] * 30 + [1] * 30 + [2] * 30)
+
+    def test_very_close_pairs(self):
+        # Every affinity rounds to 1.0 or lies within 1e-8 of it; the distances must come
+        # from the coordinates rather than read as 0.
+        X = np.array([[0.0], [1e-9], [3e-9], [4e-9], [1e-4], [1.1e-4]])
+        self.check(X, [0, 0, 1, 1, 2, 2])
+
+
+if __name__ == "__main__":
+    unittest.main()
@@ -0,0 +1,69 @@
+"""Stress test of the thread-safety contract: the solvers release the GIL, so concurrent
+calls from a thread pool must each return exactly what the same call returns serially."""
+import unittest
+from concurrent.futures import ThreadPoolExecutor
+
+import numpy as np
+
+import mysymnmf
+
+THREADS = 8
+ROUNDS = 6
+
+
+def dataset(seed, n=90, d=3):
+    rng = np.random.default_rng(seed)
+    return np.vstack([rng.normal(c, 0.7, (n // 3, d)) for c in (0.0, 3.0, 6.0)])
+
+
+def starting_H(W, k, seed):
+    rng = np.random.default_rng(seed)
+    return rng.uniform(0.0, 2.0 * np.sqrt(W.mean() / k), (W.shape[0], k))
+
+
+def make_jobs():
+    """Builds (name, call) pairs covering every entry point that runs a solve without the GIL."""
+    jobs = []
+    for seed in range(3):
+        X = dataset(seed)
+        W = np.asarray(mysymnmf.norm_array(X))
+        for k in (2, 3):
+            H0 = starting_H(W, k, seed)
+            n = W.shape[0]
+            jobs.append(("symnmf", lambda H0=H0, W=W, k=k, n=n:
+                         np.asarray(mysymnmf.symnmf(H0.tolist(), W.tolist(), k, n))))
+            jobs.append(("symnmf_array", lambda H0=H0, W=W:
+                         np.asarray(mysymnmf.symnmf_array(H0.copy(), W))))
+            jobs.append(("symnmf_stream", lambda H0=H0, X=X, k=k:
+                         np.asarray(mysymnmf.symnmf_stream(H0.tolist(), X.tolist(), k, 64.0 * 1024))))
+            jobs.append(("fit", lambda X=X, k=k, seed=seed:
+                         np.asarray(mysymnmf.fit(X, k, seed=seed))))
+            jobs.append(("fit hals", lambda X=X, k=k, seed=seed:
+                         np.asarray(mysymnmf.fit(X, k, seed=seed, solver="hals"))))
+    return jobs
+
+
+class ConcurrentSolvesTest(unittest.TestCase):
+
+    def test_concurrent_results_match_serial(self):
+        jobs = make_jobs()
+        expected = [call() for _, call in jobs]
+        schedule = [i for _ in range(ROUNDS) for i in range(len(jobs))]
+        np.random.default_rng(0).shuffle(schedule)
+        with ThreadPoolExecutor(max_workers=THREADS) as pool:
+            results = list(pool.map(lambda i: (i, jobs[i][1]()), schedule))
+        for i, result in results:
+            self.assertTrue(np.array_equal(result, expected[i]), jobs[i][0])
+
+    def test_shared_graph(self):
+        X = dataset(5)
+        graph = mysymnmf.Graph(X)
+        expected = [np.asarray(mysymnmf.fit(graph, 3, seed=s)) for s in range(THREADS)]
+        with ThreadPoolExecutor(max_workers=THREADS) as pool:
+            results = list(pool.map(lambda s: np.asarray(mysymnmf.fit(graph, 3, seed=s)), list(range(THREADS)) * ROUNDS))
+        for i, result in enumerate(results):
+            self.assertTrue(np.array_equal(result, expected[i % THREADS]))
+
+
+if __name__ == "__main__":
+    unittest.main()
@@ -0,0 +1,65 @@
+"""write_matrix must print every value exactly as printf("%.4f") does."""
+import math
+import os
+import shutil
+import tempfile
+import unittest
+
+import numpy as np
+
+import mysymnmf
+
+
+def printf4(x):
+    """'%.4f' % x, with the sign C's printf keeps on a negative NaN."""
+    if math.isnan(x):
+        return "-nan" if math.copysign(1.0, x) < 0 else "nan"
+    return "%.4f" % x
+
+
+class WriterTest(unittest.TestCase):
+
+    def setUp(self):
+        self.dir = tempfile.mkdtemp()
+        self.path = os.path.join(self.dir, "out.txt")
+
+    def tearDown(self):
+        shutil.rmtree(self.dir)
+
+    def check(self, values, cols=8):
+        values = np.asarray(values, dtype=np.float64).ravel()
+        values = np.concatenate([values, np.zeros(-len(values) % cols)]).reshape(-1, cols)
+        mysymnmf.write_matrix(values, self.path)
+        with open(self.path) as f:
+            written = f.read().splitlines()
+        self.assertEqual(len(written), len(values))
+        for row, line in zip(values, written):
+            self.assertEqual(line.split(","), [printf4(x) for x in row])
+
+    def test_near_ties(self):
+        # Decimal halfway points of the fourth digit and their neighbouring doubles.
+        ties = (np.arange(-3000, 3000) + 0.5) / 10000.0
+        ties = np.concatenate([ties, (np.arange(0, 2000) * 997 + 0.5) / 10000.0])
+        below = np.nextafter(ties, -np.inf)
+        above = np.nextafter(ties, np.inf)
+        self.check(np.concatenate([ties, below, above]))
+
+    def test_signed_zeros_and_small_values(self):
+        self.check([0.0, -0.0, 5e-5, -5e-5, 4.9999e-5, -4.9999e-5, 1e-300, -1e-300, 5e-324, -5e-324])
+
+    def test_large_values(self):
+        limit = 2147483647.0 / 10000.0
+        near = [limit, -limit, np.nextafter(limit, 0.0), np.nextafter(limit, np.inf)]
+        self.check(near + [1e6 + 0.00005, 123456789.123456, 2.0 ** 53, -2.0 ** 63, 1e300, -1.7976931348623157e308])
+
+    def test_inf_and_nan(self):
+        self.check([math.inf, -math.inf, math.nan, -math.nan, 1.0])
+
+    def test_random_values(self):
+        rng = np.random.default_rng(6)
+        self.check(np.concatenate([rng.normal(0.0, 1.0, 4000), rng.uniform(-1e5, 1e5, 4000),
+                                   np.round(rng.uniform(0, 100, 4000), 5)]))
+
+
+if __name__ == "__main__":
+    unittest.main()
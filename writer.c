@@ -0,0 +1,186 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "symnmf.h"
+
+/* Target size of the text of one block of rows. */
+#define BLOCK_BYTES (1 << 20)
+
+/* Longest "%.4f" text of a double (DBL_MAX has 309 integer digits) plus the separator. */
+#define MAX_FIXED_LEN 320
+
+/* Longest text the fast path writes: sign, 6 integer digits, '.', 4 decimals, separator. */
+#define FAST_FIXED_LEN 13
+
+/* Largest |x| * 10^4 formatted by the fast path; its ulp is 2^-22, well inside TIE_MARGIN. */
+#define FAST_LIMIT 2147483647.0
+
+/* Distance from a rounding tie within which the fast path defers to sprintf. */
+#define TIE_MARGIN 1e-6
+
+/* Text of a block of rows, formatted by one thread. */
+typedef struct TextBlock {
+    char* data;
+    size_t size;
+    size_t capacity;
+} TextBlock;
+
+/**
+ * Formats a double exactly as printf("%.4f") does.
+ * |x| * 10^4 is rounded to the nearest integer in double arithmetic, which gives the
+ * correctly rounded result unless the product is within TIE_MARGIN of a tie; those values,
+ * very large values, infinities and NaNs are handed to sprintf.
+ * @param x: Value to format
+ * @param out: Destination, at least MAX_FIXED_LEN bytes
+ * @return: Number of characters written (no terminating NUL)
+ */
+int format_fixed4(double x, char* out)
+{
+    char digits[16];
+    double y;
+    double f;
+    unsigned long scaled;
+    unsigned long whole;
+    unsigned long frac;
+    int len = 0;
+    int n = 0;
+    int negative = (x < 0.0 || (x == 0.0 && 1.0 / x < 0.0));
+    y = negative ? -x * 10000.0 : x * 10000.0;
+    if (!(y < FAST_LIMIT))
+    {
+        return sprintf(out, "%.4f", x);
+    }
+    scaled = (unsigned long)y;
+    f = y - (double)scaled;
+    if (f > 0.5 - TIE_MARGIN && f < 0.5 + TIE_MARGIN)
+    {
+        return sprintf(out, "%.4f", x);
+    }
+    scaled += (f > 0.5);
+    whole = scaled / 10000;
+    frac = scaled % 10000;
+    if (negative)
+    {
+        out[len++] = '-';
+    }
+    do
+    {
+        digits[n++] = (char)('0' + whole % 10);
+        whole /= 10;
+    } while (whole > 0);
+    while (n > 0)
+    {
+        out[len++] = digits[--n];
+    }
+    out[len++] = '.';
+    out[len++] = (char)('0' + frac / 1000);
+    out[len++] = (char)('0' + frac / 100 % 10);
+    out[len++] = (char)('0' + frac / 10 % 10);
+    out[len++] = (char)('0' + frac % 10);
+    return len;
+}
+
+/**
+ * Appends the text of rows [first, last) of M to a block, growing it as needed.
+ * @param block: Block to append to
+ * @param M: Matrix
+ * @param first: First row
+ * @param last: One past the last row
+ * @return: 1 on success, 0 if an allocation failed
+ */
+static int format_rows(TextBlock* block, const Matrix* M, int first, int last)
+{
+    int i;
+    int j;
+    size_t need;
+    char* grown;
+    const double* row;
+    for (i = first; i < last; i++)
+    {
+        need = block->size + (size_t)M->cols * MAX_FIXED_LEN + 1;
+        if (need > block->capacity)
+        {
+            need = (need > 2 * block->capacity) ? need : 2 * block->capacity;
+            grown = (char*)realloc(block->data, need);
+            if (grown == NULL)
+            {
+                return 0;
+            }
+            block->data = grown;
+            block->capacity = need;
+        }
+        row = MAT_ROW(M, i);
+        for (j = 0; j < M->cols; j++)
+        {
+            block->size += (size_t)format_fixed4(row[j], block->data + block->size);
+            block->data[block->size++] = (j == M->cols - 1) ? '\n' : ',';
+        }
+        if (M->cols == 0)
+        {
+            block->data[block->size++] = '\n';
+        }
+    }
+    return 1;
+}
+
+/**
+ * Writes a matrix as text, one comma separated row per line with every value formatted
+ * as "%.4f", byte for byte what printf produces. Rows are formatted into large blocks,
+ * several blocks in parallel when more than one thread is available, and the blocks are
+ * written to the stream in order.
+ * @param file: Output stream (stdout or a file)
+ * @param M: Matrix to write
+ * @return: 1 on success, 0 if an allocation or a write failed
+ */
+int write_matrix(FILE* file, const Matrix* M)
+{
+    int rows_per_block;
+    int blocks = get_num_threads();
+    int b;
+    int start;
+    int first;
+    int last;
+    int ok = 1;
+    TextBlock* block;
+    rows_per_block = BLOCK_BYTES / ((M->cols + 1) * FAST_FIXED_LEN);
+    rows_per_block = (rows_per_block < 1) ? 1 : rows_per_block;
+    if ((M->rows + rows_per_block - 1) / rows_per_block < blocks)
+    {
+        blocks = (M->rows + rows_per_block - 1) / rows_per_block;
+        blocks = (blocks < 1) ? 1 : blocks;
+    }
+    block = (TextBlock*)calloc((size_t)blocks, sizeof(TextBlock));
+    if (block == NULL)
+    {
+        return 0;
+    }
+    for (start = 0; ok && start < M->rows; start += blocks * rows_per_block)
+    {
+#ifdef _OPENMP
+#pragma omp parallel for private(first, last) schedule(static, 1) num_threads(blocks) if (blocks > 1)
+#endif
+        for (b = 0; b < blocks; b++)
+        {
+            first = start + b * rows_per_block;
+            last = (first + rows_per_block < M->rows) ? first + rows_per_block : M->rows;
+            block[b].size = 0;
+            if (first < last && !format_rows(&block[b], M, first, last))
+            {
+#ifdef _OPENMP
+#pragma omp atomic write
+#endif
+                ok = 0;
+            }
+        }
+        for (b = 0; ok && b < blocks; b++)
+        {
+            ok = fwrite(block[b].data, 1, block[b].size, file) == block[b].size;
+        }
+    }
+    for (b = 0; b < blocks; b++)
+    {
+        free(block[b].data);
+    }
+    free(block);
+    return ok;
+}